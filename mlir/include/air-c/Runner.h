@@ -10,7 +10,9 @@
 #define AIR_C_RUNNER_H
 
 #include "mlir-c/IR.h"
+#include "mlir-c/Support.h"
 
+#include <stdint.h>
 #include <string>
 
 #ifdef __cplusplus
@@ -20,6 +22,61 @@ extern "C" {
 void airRunnerRun(MlirModule module, const char *json_file_name,
                   const char *output_file_name, const char *function, bool verbose);
 
+//===---------------------------------------------------------------------===//
+// Simulation results
+//===---------------------------------------------------------------------===//
+
+#define DEFINE_C_API_STRUCT(name, storage)                                     \
+  struct name {                                                                \
+    storage *ptr;                                                              \
+  };                                                                           \
+  typedef struct name name
+
+DEFINE_C_API_STRUCT(AirRunnerResults, void);
+
+#undef DEFINE_C_API_STRUCT
+
+/// Simulate `function` of `module` on the architecture described by the JSON
+/// text `archJson`, without writing a trace. If `recordOps` is set, the
+/// results hold the start and end time of every op. Returns null results and
+/// passes the error message to `errorCallback` on failure. Independent
+/// simulations may run concurrently.
+MLIR_CAPI_EXPORTED AirRunnerResults airRunnerSimulate(
+    MlirModule module, MlirStringRef archJson, MlirStringRef function,
+    bool recordOps, MlirStringCallback errorCallback, void *userData);
+
+MLIR_CAPI_EXPORTED void airRunnerResultsDestroy(AirRunnerResults results);
+
+static inline bool airRunnerResultsIsNull(AirRunnerResults results) {
+  return !results.ptr;
+}
+
+MLIR_CAPI_EXPORTED uint64_t
+airRunnerResultsGetMakespan(AirRunnerResults results);
+
+MLIR_CAPI_EXPORTED uint64_t
+airRunnerResultsGetDmaBytes(AirRunnerResults results);
+
+/// Peak bytes of the fullest memory of memory space `space`, 0 if there is no
+/// such space.
+MLIR_CAPI_EXPORTED intptr_t
+airRunnerResultsGetNumMemorySpaces(AirRunnerResults results);
+MLIR_CAPI_EXPORTED uint64_t airRunnerResultsGetPeakBytes(
+    AirRunnerResults results, intptr_t space);
+
+/// The ops recorded by the simulation, by start time.
+MLIR_CAPI_EXPORTED intptr_t airRunnerResultsGetNumOps(AirRunnerResults results);
+MLIR_CAPI_EXPORTED MlirStringRef
+airRunnerResultsGetOpName(AirRunnerResults results, intptr_t pos);
+MLIR_CAPI_EXPORTED MlirStringRef
+airRunnerResultsGetOpQueue(AirRunnerResults results, intptr_t pos);
+
+/// Copy the start and end times of the ops to `starts` and `ends`, each of
+/// airRunnerResultsGetNumOps elements. Either may be null.
+MLIR_CAPI_EXPORTED void airRunnerResultsGetOpTimes(AirRunnerResults results,
+                                                   uint64_t *starts,
+                                                   uint64_t *ends);
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,6 +16,7 @@ namespace xilinx {
 namespace air {
 
 std::unique_ptr<mlir::Pass> createAIRExamplePass();
+std::unique_ptr<mlir::Pass> createAIRTestDependencyUpdatePass();
 std::unique_ptr<mlir::Pass> createAIRSpecializeDma();
 std::unique_ptr<mlir::Pass> createAIRSpecializeDmaBroadcast();
 std::unique_ptr<mlir::Pass> createAIRPromoteUniformL1Dma();
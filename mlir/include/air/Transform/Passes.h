@@ -23,6 +23,7 @@
 #include "air/Transform/AIRLowerLinalgTensors.h"
 #include "air/Transform/AIRMiscPasses.h"
 #include "air/Transform/AIRRegularizeLoopPass.h"
+#include "air/Transform/AIRRoofline.h"
 #include "air/Transform/AIRTilingUtils.h"
 #include "air/Transform/AffineLoopOptPass.h"
 #include "air/Transform/ReturnEliminationPass.h"
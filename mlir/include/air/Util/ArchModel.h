@@ -0,0 +1,239 @@
+//===- ArchModel.h ----------------------------------------------*- C++ -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef AIR_UTIL_ARCHMODEL_H
+#define AIR_UTIL_ARCHMODEL_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/JSON.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace xilinx {
+namespace air {
+
+// Typed form of the JSON architecture model used by air-runner. The JSON is
+// parsed and validated once, so that cost lookups during simulation are plain
+// field and array accesses.
+struct ArchModel {
+
+  // Compute parameters of a kernel, with the device level values applied
+  // for any field the kernel does not override.
+  struct Kernel {
+    std::string name;
+    double cores;
+    double ops_per_core_per_cycle;
+    double clock;
+    double efficiency;
+
+    // Throughput on elements of one type. Ops on element types absent
+    // from `datatypes` run at ops_per_core_per_cycle.
+    struct Datatype {
+      double ops_per_core_per_cycle = 0;
+      // multiply-accumulates per core per cycle, 0 to count each as a
+      // multiply and an add
+      double macs_per_core_per_cycle = 0;
+    };
+    // keyed by MLIR type name: "i8", "i16", "i32", "bf16", "f32", ...
+    llvm::StringMap<Datatype> datatypes;
+
+    double getOpsPerCycle() const {
+      return cores * ops_per_core_per_cycle * efficiency;
+    }
+
+    // Return the cycles taken by `ops` ops on elements of type `datatype`,
+    // `macs` pairs of which are a multiply feeding an add.
+    double getComputeCycles(llvm::StringRef datatype, uint64_t ops,
+                            uint64_t macs) const;
+  };
+
+  struct Memory {
+    std::string name;
+    unsigned space;
+    uint64_t bytes;
+    bool duplex;
+  };
+
+  std::string devicename;
+
+  // device clock in cycles per second
+  double clock = 1e9;
+
+  // fixed latency in cycles of every DMA transfer, on top of the time taken
+  // to move its bytes
+  uint64_t dma_latency = 0;
+
+  // the default datatype of the model
+  std::string datatype_name;
+  unsigned datatype_bytes = 0;
+
+  // device level compute parameters
+  Kernel device_kernel;
+
+  // Shape of the simulated machine. The device is divided into `partitions`
+  // side by side partitions of `columns` x `rows` core tiles, each with its
+  // own controllers and shim DMA channels. Tile coordinates in placement
+  // attributes are offset by `column_offset` and `row_offset`.
+  struct Topology {
+    unsigned partitions = 1;
+    unsigned columns = 4;
+    unsigned rows = 4;
+    unsigned column_offset = 0;
+    unsigned row_offset = 0;
+    // controllers dispatching work per partition
+    unsigned controllers = 1;
+    // DMA channels per shim column and per core tile
+    unsigned shim_dma_channels = 1;
+    unsigned tile_dma_channels = 1;
+
+    unsigned getNumColumns() const { return partitions * columns; }
+  };
+
+  // Topology given by the "topology" object of the model. When the object
+  // is absent, it is derived from the legacy queue configuration below as
+  // one 4x4 partition per dispatch queue.
+  Topology topology;
+
+  // Buffer descriptor level timing of the shim DMA transfers to and from
+  // external memory (memory space 0), after do_packet_nd_memcpy in the
+  // controller: an ND transfer is a sequence of 1D buffer descriptors, one
+  // per row. Enabled by the "shim_bd" object of the model.
+  struct ShimBD {
+    bool enabled = false;
+    // controller cycles to write and push one buffer descriptor
+    unsigned setup_cycles = 0;
+    // buffer descriptors queued per shim channel before the controller
+    // has to wait
+    unsigned max_outstanding = 4;
+    // DMA cycles at the start of every row
+    unsigned row_cycles = 0;
+    // cycles before the controller checks a full channel again
+    unsigned poll_cycles = 0;
+  };
+  ShimBD shim_bd;
+
+  // Return the cycles taken by `rows` buffer descriptors of `row_bytes`
+  // bytes each at `bytes_per_cycle`, from the controller pushing the first
+  // one to the DMA finishing the last one, according to `shim_bd`.
+  uint64_t getShimBDCycles(uint64_t rows, double row_bytes,
+                           double bytes_per_cycle) const;
+
+  // legacy queue configuration of the simulated machine
+  unsigned num_dispatch_queues = 1;
+  unsigned num_dispatch_dma_queues = 1;
+  unsigned num_core_dma_queues = 1;
+  unsigned num_herd_slots = 1;
+
+  // kernels keyed by operation name
+  llvm::StringMap<Kernel> kernels;
+
+  // FIFO parameters of an air.channel
+  struct Channel {
+    // items buffered per consumer before air.channel.put blocks
+    unsigned depth = 2;
+    // bandwidth of a put into the channel, 0 to use the interface between
+    // the memory spaces of the put and of the gets of the channel
+    double bytes_per_second = 0;
+  };
+
+  // parameters of channels absent from `channels`
+  Channel default_channel;
+
+  // channels keyed by symbol name, from the "channels" object of the model
+  llvm::StringMap<Channel> channels;
+
+  const Channel &getChannel(llvm::StringRef name) const {
+    auto it = channels.find(name);
+    if (it == channels.end())
+      return default_channel;
+    return it->second;
+  }
+
+  // memories indexed by memory space, `valid` is false for unused spaces
+  std::vector<Memory> memories;
+  std::vector<bool> memory_valid;
+
+  unsigned getNumSpaces() const { return interface_bw.size(); }
+
+  bool hasInterface(unsigned src, unsigned dst) const {
+    return src < getNumSpaces() && dst < getNumSpaces() &&
+           interface_bw[src][dst] > 0;
+  }
+
+  // Return the bandwidth in bytes per second of the interface from memory
+  // space `src` to memory space `dst`, or 0 if the model has no such
+  // interface.
+  double getBandwidth(unsigned src, unsigned dst) const {
+    if (!hasInterface(src, dst))
+      return 0;
+    return interface_bw[src][dst];
+  }
+
+  // Return the number of shim columns the interface from memory space `src`
+  // to memory space `dst` is split across, or 0 if the interface has no
+  // per-column limit.
+  unsigned getNumColumns(unsigned src, unsigned dst) const {
+    if (!hasInterface(src, dst))
+      return 0;
+    return interface_columns[src][dst].num;
+  }
+
+  // Return the bandwidth in bytes per second available to a single shim
+  // column of the interface from memory space `src` to memory space `dst`.
+  double getColumnBandwidth(unsigned src, unsigned dst) const {
+    if (!getNumColumns(src, dst))
+      return 0;
+    return interface_columns[src][dst].bytes_per_second;
+  }
+
+  // Return the number of cycles taken to move `bytes` bytes from memory space
+  // `src` to memory space `dst`.
+  uint64_t getTransferCycles(unsigned src, unsigned dst, double bytes) const;
+
+  // Return the shortest time in cycles any DMA transfer can take: the DMA
+  // latency plus the time to move one element over the fastest interface,
+  // and at least one cycle.
+  uint64_t getMinTransferCycles() const;
+
+  // Return the compute parameters for operations named `opName`.
+  const Kernel &getKernel(llvm::StringRef opName) const {
+    auto it = kernels.find(opName);
+    if (it == kernels.end())
+      return device_kernel;
+    return it->second;
+  }
+
+  const Memory *getMemory(unsigned space) const {
+    if (space >= memories.size() || !memory_valid[space])
+      return nullptr;
+    return &memories[space];
+  }
+
+  // Parse and validate a JSON architecture model. Returns nullptr and sets
+  // `errorMessage` if the model is malformed.
+  static std::unique_ptr<ArchModel> parse(const llvm::json::Value &json,
+                                          std::string *errorMessage);
+
+private:
+  // bandwidth in bytes per second, indexed by [src][dst] memory space
+  std::vector<std::vector<double>> interface_bw;
+
+  struct InterfaceColumns {
+    unsigned num = 0;
+    double bytes_per_second = 0;
+  };
+  // per-column limits, indexed by [src][dst] memory space
+  std::vector<std::vector<InterfaceColumns>> interface_columns;
+};
+
+} // namespace air
+} // namespace xilinx
+
+#endif // AIR_UTIL_ARCHMODEL_H
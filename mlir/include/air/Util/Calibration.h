@@ -0,0 +1,66 @@
+//===- Calibration.h --------------------------------------------*- C++ -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef AIR_UTIL_CALIBRATION_H
+#define AIR_UTIL_CALIBRATION_H
+
+#include "mlir/Dialect/Func/IR/FuncOps.h"
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/JSON.h"
+
+#include <string>
+#include <vector>
+
+namespace xilinx {
+namespace air {
+
+// Outcome of fitting an arch model to measured durations.
+struct CalibrationResult {
+  // A fitted parameter: the `efficiency` of a kernel or the
+  // `bytes_per_second` of an interface.
+  struct Parameter {
+    std::string name;
+    double before;
+    double after;
+    // measurements the parameter contributes to
+    unsigned samples;
+    // false if the fit gave a value which is not positive, the parameter
+    // then keeps its value
+    bool fitted;
+  };
+  std::vector<Parameter> parameters;
+  unsigned numSamples = 0;
+  // root mean square error in cycles of the predicted durations
+  double rmsBefore = 0;
+  double rmsAfter = 0;
+};
+
+// Fit the efficiency of the kernels and the bandwidth of the interfaces of
+// the arch model `archJson` to the measured durations `measurements` of ops
+// of function `func`, by linear least squares, and return the updated arch
+// model. Returns None and sets `errorMessage` on malformed input.
+//
+// `measurements` is an array of objects naming an op and its duration in
+// "cycles" or "seconds":
+//   {"herd": "herd_0", "cycles": 9000}
+//   {"op": "linalg.matmul", "index": 1, "cycles": 4096}
+//   {"op": "air.dma_memcpy_nd", "id": 4, "seconds": 1.5e-6}
+// where "index" counts the ops of that name in `func` from 0 and "id"
+// matches their id attribute. The duration of an op is modeled as the
+// compute cycles of its linalg ops plus the transfer cycles of its DMAs, in
+// sequence, over its loop iterations and for a single tile of a herd.
+llvm::Optional<llvm::json::Value>
+calibrateArchModel(mlir::func::FuncOp func, const llvm::json::Value &archJson,
+                   const llvm::json::Value &measurements,
+                   CalibrationResult &result, std::string *errorMessage);
+
+} // namespace air
+} // namespace xilinx
+
+#endif // AIR_UTIL_CALIBRATION_H
@@ -13,13 +13,79 @@
 #include "mlir/Dialect/SCF/IR/SCF.h"
 #include "llvm/Support/JSON.h"
 
+#include <array>
+#include <map>
+#include <vector>
+
 namespace xilinx {
 namespace air {
 
+// Operation counts of linalg ops. The model only reads the IR: loop ranges
+// come from the operand types and indexing maps. Counts are memoized by the
+// structure of the op, so a model is not thread safe.
 class CostModel {
 public:
   CostModel() {}
 
+  // Kinds of the scalar ops in the payload of a linalg op.
+  enum class OpKind : uint8_t {
+    AddF,
+    SubF,
+    MulF,
+    DivF,
+    MaxF,
+    CmpF,
+    TruncF,
+    Rsqrt,
+    AddI,
+    SubI,
+    MulI,
+    DivI,
+    MaxI,
+    CmpI,
+    TruncI,
+    Select,
+    // any other op, counted by name
+    Other,
+  };
+  static constexpr unsigned NumOpKinds = (unsigned)OpKind::Other + 1;
+
+  static OpKind getOpKind(mlir::OperationName name);
+
+  // Return true if `op` is a multiply whose only use is an add of the same
+  // kind, which a vector unit executes as one multiply-accumulate.
+  static bool isMultiplyAccumulate(mlir::Operation *op);
+
+  // Counts of a linalg op over its whole iteration space.
+  struct LinalgOpCounts {
+    // false if a loop range is not static, the counts are then zero
+    bool isStatic = false;
+    int64_t iterations = 0;
+    // payload ops by kind
+    std::array<uint64_t, NumOpKinds> ops = {};
+    // multiplies whose only use is an add of the same kind, each counted
+    // in `ops` as a multiply and an add
+    uint64_t macs = 0;
+    // element type of the first input, or of the first output without
+    // inputs: the type the payload computes on
+    mlir::Type elementType;
+    // payload ops by name, including the known kinds, without linalg.yield
+    llvm::SmallVector<std::pair<mlir::OperationName, uint64_t>, 4> opsByName;
+    // operand elements read and written by the payload
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    // bytes of the operands
+    uint64_t footprint = 0;
+
+    uint64_t getCount(OpKind kind) const { return ops[(unsigned)kind]; }
+    // number of payload ops of the known kinds
+    uint64_t getComputeOps() const;
+  };
+
+  // Return the counts of `op`, computing them on first use of an op with the
+  // same name, operand types, indexing maps and payload.
+  const LinalgOpCounts &getLinalgOpCounts(mlir::linalg::LinalgOp op);
+
   class OpCountMap {
   public:
     size_t count(std::string& s) {
@@ -34,6 +100,7 @@ public:
     std::vector<OpCountMap> ops;
   };
 
+  // String keyed counts for JSON output, see getLinalgOpCounts.
   OpCountMap getOpCounts(mlir::Operation* op);
   std::string opCountsToJSON(mlir::ModuleOp module);
   void opCountToJSON(OpCountMap &opCounts, llvm::json::Object &top);
@@ -41,10 +108,15 @@ public:
 private:
   void getScfForOpCounts(OpCountMap &map, mlir::scf::ForOp op);
   void getLinalgOpCounts(OpCountMap &map, mlir::linalg::LinalgOp op);
+  LinalgOpCounts computeLinalgOpCounts(mlir::linalg::LinalgOp op);
+
+  // counts keyed by the opaque pointers of the op name, operand types,
+  // indexing maps and payload op names, and the payload operand uses
+  std::map<std::vector<const void *>, LinalgOpCounts> linalgCache;
 
   int LayerID;
 };
 
 } // namespace air
 } // namespace xilinx
-#endif // AIR_UTIL_COSTMODEL_H
\ No newline at end of file
+#endif // AIR_UTIL_COSTMODEL_H
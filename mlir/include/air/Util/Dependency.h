@@ -23,6 +23,11 @@
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
 
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+
+#include <memory>
 #include <numeric>
 #include <string>
 
@@ -32,7 +37,6 @@
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/graphviz.hpp>
 #include <boost/graph/subgraph.hpp>
-#include <boost/graph/transitive_reduction.hpp>
 
 using namespace mlir;
 
@@ -57,7 +61,63 @@ Value getLoopCarriedTokenFromScfOp(scf::ForOp op,
                                    std::string operand_or_argument = "operand");
 void addAsyncDependencyIfNew(air::AsyncOpInterface op, Value token);
 std::string getMemorySpaceAsString(Value memref);
-air::ChannelGetOp getTheOtherChannelOpThroughSymbol(air::ChannelPutOp put);
+
+//===----------------------------------------------------------------------===//
+// Channel symbol index
+//===----------------------------------------------------------------------===//
+
+// Index of the channels of a module: channel symbol to declaration, puts and
+// gets. Built with a single walk of the module on first lookup, instead of
+// walking the module for every channel op. A pass builds one index per run.
+// When it inserts or erases channel ops or declarations, it keeps the index
+// up to date through notifyOperationInserted and notifyOperationRemoved, or
+// by attaching a listener to its builder.
+class channelIndex {
+public:
+  struct channelEntry {
+    air::ChannelOp declaration;
+    SmallVector<air::ChannelPutOp, 1> puts;
+    SmallVector<air::ChannelGetOp, 1> gets;
+    // Channel bundle sizes, and the sizes after broadcasting if the channel
+    // is annotated with a broadcast_shape, else empty
+    SmallVector<int64_t, 2> size;
+    SmallVector<int64_t, 2> broadcast_shape;
+  };
+
+  // Builder listener adding the channel ops inserted to the index
+  struct listener : public OpBuilder::Listener {
+    listener(channelIndex &index) : index(index) {}
+    void notifyOperationInserted(Operation *op) override {
+      index.notifyOperationInserted(op);
+    }
+    channelIndex &index;
+  };
+
+  channelIndex(ModuleOp module) : module(module) {}
+
+  // Returns nullptr if the symbol is not a channel of the module.
+  const channelEntry *lookup(StringRef chan_name);
+  // The single op at the other end of a channel, or a null op if there is
+  // none. Asserts on multiple occurrences.
+  air::ChannelGetOp getTheOtherChannelOp(air::ChannelPutOp put);
+  air::ChannelPutOp getTheOtherChannelOp(air::ChannelGetOp get);
+
+  // Add or remove the channel ops nested in `op`. An op removed stays out of
+  // the index until it is inserted again, as dialect conversion only erases
+  // ops at the end of the conversion.
+  void notifyOperationInserted(Operation *op);
+  void notifyOperationRemoved(Operation *op);
+  void invalidate();
+
+private:
+  void build();
+  void add(Operation *op);
+
+  ModuleOp module;
+  bool valid = false;
+  llvm::StringMap<channelEntry> entries;
+  llvm::SmallPtrSet<Operation *, 8> removed;
+};
 
 //===----------------------------------------------------------------------===//
 // Dependency graph parsed as a Boost graph object
@@ -125,6 +185,67 @@ struct dependencyGraph {
   }
 };
 
+// Compact form of a dependency graph for canonicalization: vertices are the
+// integer vertex ids of the boost graph, whose vertex bundles serve as the
+// side table of display attributes, and out-edges are stored in compressed
+// sparse rows in their order in the boost graph.
+struct dependencyCSRGraph {
+  std::vector<unsigned> offsets;
+  std::vector<unsigned> targets;
+
+  dependencyCSRGraph(unsigned numVertices = 0)
+      : offsets(numVertices + 1, 0) {}
+  // From a boost graph with vertices in a vector
+  template <typename GraphT>
+  dependencyCSRGraph(const GraphT &g) : offsets(num_vertices(g) + 1, 0) {
+    targets.reserve(num_edges(g));
+    auto vp = boost::vertices(g);
+    for (auto vit = vp.first; vit != vp.second; ++vit) {
+      auto ap = boost::adjacent_vertices(*vit, g);
+      for (auto ait = ap.first; ait != ap.second; ++ait)
+        targets.push_back(*ait);
+      offsets[*vit + 1] = targets.size();
+    }
+  }
+
+  unsigned getNumVertices() const { return offsets.size() - 1; }
+  unsigned getNumEdges() const { return targets.size(); }
+  ArrayRef<unsigned> getSuccessors(unsigned v) const {
+    return ArrayRef<unsigned>(targets).slice(offsets[v],
+                                             offsets[v + 1] - offsets[v]);
+  }
+
+  // Vertices in the finishing order of a depth first search, which is a
+  // reverse topological order. Asserts if the graph has a cycle.
+  std::vector<unsigned> getReverseTopologicalOrder() const;
+
+  // Transitive reduction, with the reachability of each vertex held in a
+  // bitset. The vertices of the reduced graph are numbered in topological
+  // order; `tr_to_g` is set to the vertex of this graph of each of them. The
+  // successors of each vertex are kept in topological order.
+  dependencyCSRGraph
+  getTransitiveReduction(std::vector<unsigned> &tr_to_g) const;
+
+  // The graph with its edges reversed. The predecessors of each vertex are
+  // listed latest first.
+  dependencyCSRGraph getTranspose() const;
+};
+
+// Transitive reduction of a dependencyGraph and its subgraphs. The reduced
+// edges are kept in CSR form; ops and display attributes are read from the
+// vertex bundles of the original graph through `tr_to_g`.
+struct dependencyGraphTR {
+  const dependencyGraph *graph;
+  mlir::Operation *hierarchyOp;
+  dependencyCSRGraph csr;
+  // vertex of the original graph of each reduced vertex
+  std::vector<unsigned> tr_to_g;
+  std::vector<dependencyGraphTR> subgraphs;
+
+  dependencyGraphTR(const dependencyGraph *graph = nullptr)
+      : graph(graph), hierarchyOp(graph ? graph->hierarchyOp : nullptr) {}
+};
+
 struct vertex_to_vertex_map_tree {
   vertex_to_vertex_map a_to_b;
   vertex_to_vertex_map b_to_a;
@@ -175,17 +296,19 @@ class dependencyCanonicalizer {
 
 public:
   void parseCommandGraphs(func::FuncOp &toplevel, dependencyGraph &global_graph,
-                          dependencyContext &dep_ctx, bool dump_dot = false,
-                          std::string dump_dir = "");
-  void canonicalizeGraphs(dependencyGraph &global_graph,
-                          dependencyGraph &tr_graph,
+                          dependencyContext &dep_ctx, channelIndex &channels,
+                          bool dump_dot = false, std::string dump_dir = "");
+  void canonicalizeGraphs(const dependencyGraph &global_graph,
+                          dependencyGraphTR &tr_graph,
                           vertex_to_vertex_map_tree &g_to_tr,
                           bool dump_graph = false, std::string dump_dir = "");
-  void updateDepList(func::FuncOp func, dependencyGraph &global_graph);
+  void updateDepList(func::FuncOp func, const dependencyGraphTR &tr_graph);
   void removeDepListRepitition(func::FuncOp func);
   void removeUnusedExecuteOp(func::FuncOp func);
   void removeRedundantWaitAllOps(func::FuncOp func);
-  void dumpDotGraphFiles(dependencyGraph global_graph,
+  void dumpDotGraphFiles(const dependencyGraph &global_graph,
+                         std::string dump_dir = "");
+  void dumpDotGraphFiles(const dependencyGraphTR &tr_graph,
                          std::string dump_dir = "");
   void copyDependencyGraphToFlatGraphAndVisualize(func::FuncOp &toplevel,
                                                   dependencyGraph &global_graph,
@@ -196,6 +319,10 @@ public:
   void canonicalizeAIRHierarchyDependency(func::FuncOp func);
 
 private:
+  // channels of the module being parsed, owned by the caller of
+  // parseCommandGraphs
+  channelIndex *channel_index = nullptr;
+
   void addVerticesInHerd(std::vector<dependencyGraph> &herd_subgraphs,
                          air::HerdOp herd, dependencyContext &dep_ctx);
   void addVerticesInPartition(std::vector<dependencyGraph> &part_subgraphs,
@@ -234,19 +361,20 @@ private:
   std::pair<std::string, unsigned> getTypeIdPairFromOp(Operation *op);
   std::string getOpTypeFromOpImpls(Operation *op);
   std::pair<Graph::vertex_descriptor, Graph *>
-  getVertexFromOp(Operation *op, dependencyContext dep_ctx,
+  getVertexFromOp(Operation *op, const dependencyContext &dep_ctx,
                   std::string front_or_back = "front");
-  void parseDependencyEdgesInGraph(Graph &g, dependencyContext dep_ctx);
-  void copyFromDependencyGraphToFlatGraph(Graph g_src, FlatGraph &g_dst,
+  void parseDependencyEdgesInGraph(Graph &g, const dependencyContext &dep_ctx);
+  void copyFromDependencyGraphToFlatGraph(const Graph &g_src, FlatGraph &g_dst,
                                           vertex_to_flat_vertex_map &map,
                                           bool copyEdges = false);
-  void updateSubgraphFromDependencyGraph(Graph subg_src, FlatGraph &subg_dst,
-                                         vertex_to_flat_vertex_map map,
+  void updateSubgraphFromDependencyGraph(const Graph &subg_src,
+                                         FlatGraph &subg_dst,
+                                         vertex_to_flat_vertex_map &map,
                                          bool copyEdges = false);
   void connectOpToItsDepListImpls(Operation *op, Graph &g,
-                                  dependencyContext dep_ctx);
-  void connectOpToItsDepList(Operation *op, SmallVector<Value, 1> dep_list,
-                             Graph &g, dependencyContext dep_ctx);
+                                  const dependencyContext &dep_ctx);
+  void connectOpToItsDepList(Operation *op, SmallVector<Value, 1> &dep_list,
+                             Graph &g, const dependencyContext &dep_ctx);
   std::vector<Operation *> traceOpFromToken(Operation *op, Value dep_token);
   void connectTerminatorInGraph(Graph &g);
   void connectStartNodeInCommandGraph(dependencyGraph &G);
@@ -254,14 +382,15 @@ private:
   void updatePointerFromHierarchyTerminatorToGraph(dependencyGraph &G,
                                                    dependencyGraph &subG);
   void updatePointerFromHierarchyOpToGraph(dependencyGraph &G);
-  void dump_graph(std::string filename, Graph G);
-  void boostTransitiveReductionImpl(Graph &asyncExecuteGraph,
-                                    Graph &asyncExecuteGraphTR,
-                                    vertex_to_vertex_map &g_to_tr,
-                                    vertex_to_vertex_map &tr_to_g);
-  void purgeAIRDepList(dependencyGraph &graph);
-  void fillAIRDepListUsingGraphTR(dependencyGraph &graph);
-  void collectAIRChannelPutAndGetInGraph(Graph g, vertex_to_flat_vertex_map map,
+  void dump_graph(std::string filename, const Graph &G);
+  void dump_graph(std::string filename, const dependencyGraphTR &G);
+  void transitiveReductionImpl(dependencyGraphTR &graph,
+                               vertex_to_vertex_map &g_to_tr,
+                               vertex_to_vertex_map &tr_to_g);
+  void purgeAIRDepList(const dependencyGraphTR &graph);
+  void fillAIRDepListUsingGraphTR(const dependencyGraphTR &graph);
+  void collectAIRChannelPutAndGetInGraph(const Graph &g,
+                                         vertex_to_flat_vertex_map &map,
                                          ChannelMap &channel_map);
 };
 
@@ -273,8 +402,30 @@ struct partialMemref {
   Value memrefValue;
   unsigned numDims;
   SmallVector<Value, 2> memrefIndices;
+  // Sizes and strides of the accessed tile, one per dim, if known. Offsets
+  // are the indices and strides are in elements of the memref. Without
+  // strides, the tile has the dims and strides of the memref layout.
+  SmallVector<OpFoldResult, 2> memrefSizes;
+  SmallVector<OpFoldResult, 2> memrefStrides;
 };
 
+// Record the access pattern of an air.dma_memcpy_nd or air.channel op in a
+// tile. Its dims become those of the offsets, which may outnumber the dims
+// of the memref.
+void setPartialMemrefExtents(partialMemref &tile, ValueRange offsets,
+                             ValueRange sizes, ValueRange strides);
+// Record the sizes and strides of a tile whose indices are its offsets.
+void setPartialMemrefExtents(partialMemref &tile,
+                             ArrayRef<OpFoldResult> sizes,
+                             ArrayRef<OpFoldResult> strides);
+// Check if two tiles of a memref may access the same element. Indices are
+// decomposed into affine forms of their loop ivs and other operands, and
+// tile extents are intersected with FlatAffineValueConstraints. Tiles are
+// only found disjoint if the extents of both are known; a null index spans
+// its whole dim.
+bool areOverlappingPartialMemrefs(partialMemref *tile_0,
+                                  partialMemref *tile_1);
+
 class dependencyTracer {
 
 public:
@@ -322,13 +473,39 @@ public:
                         SmallVector<Value, 1> out_scalars,
                         air::AsyncOpInterface sink_air_op);
 
+  // Incremental dependency update. Passes which create, move or erase async
+  // ops report them here instead of re-running air-dependency. Created and
+  // moved ops are re-traced by updateDependencies, erased ops are detached
+  // immediately and must be reported before they are erased.
+  void notifyOpCreated(Operation *op);
+  void notifyOpMoved(Operation *op);
+  void notifyOpErased(Operation *op);
+
+  // Re-trace the reported ops: drop their tokens where they no longer
+  // dominate, then trace their memref, tile index and loop-carried deps and
+  // the deps of the later ops in their scope which access the same memrefs.
+  // The other ops are left untouched.
+  void updateDependencies();
+
 private:
+  // ops reported as created or moved since the last update
+  llvm::SetVector<Operation *> dirty_ops;
+
+  // Trace the memref, tile index and loop-carried deps of `op`.
+  void retraceOp(air::AsyncOpInterface op);
+
+  // Collect the ops after `op` in its block which access a memref of `op`.
+  void getLaterMemrefUsers(air::AsyncOpInterface op,
+                           llvm::SetVector<Operation *> &users);
+
   // Trace the defining op of sink op, RAW
   template <typename T> void traceDefiningOpAsDep(Value operand, T op) {
     // Check memref deps
     if (auto defop = operand.getDefiningOp<air::ExecuteOp>()) {
       // addNewAsyncDepToGraph<T>(defop.getResult(0), op);
-      op.addAsyncDependency(defop.getAsyncToken());
+      addAsyncDependencyIfNew(
+          dyn_cast<air::AsyncOpInterface>(op.getOperation()),
+          defop.getAsyncToken());
     }
   }
 
@@ -341,10 +518,6 @@ private:
   partialMemref createPartialMemref(mlir::Value memrefValue, unsigned numDims,
                                     SmallVector<Value, 2> memrefIndices);
 
-  // Check if two partial memref tiles have identical indices
-  bool areEqualIndexPartialMemrefs(partialMemref *tile_0,
-                                   partialMemref *tile_1);
-
   char checkOperandReadOrWrite(mlir::Value operand);
 
   // Add dependency edge
@@ -0,0 +1,61 @@
+//===- Npy.h ----------------------------------------------------*- C++ -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef AIR_UTIL_NPY_H
+#define AIR_UTIL_NPY_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xilinx {
+namespace air {
+
+// An array in the numpy .npy format: little-endian elements of a numeric
+// dtype in C order.
+struct NpyArray {
+  // kind of the dtype: 'i' signed integer, 'u' unsigned integer, 'f' float
+  // or 'b' bool
+  char kind = 'f';
+  unsigned itemBytes = 4;
+  std::vector<int64_t> shape;
+  std::vector<char> data;
+
+  NpyArray() = default;
+  // A zero filled array.
+  NpyArray(char kind, unsigned itemBytes, llvm::ArrayRef<int64_t> shape);
+
+  uint64_t getNumElements() const;
+
+  // The dtype in numpy notation, e.g. "<f4".
+  std::string getDescr() const;
+
+  // Element `i` in C order, converted.
+  double getFloat(uint64_t i) const;
+  int64_t getInt(uint64_t i) const;
+  void setFloat(uint64_t i, double v);
+  void setInt(uint64_t i, int64_t v);
+
+  // Parse the contents of a .npy file, version 1 to 3. Returns None and sets
+  // `errorMessage` for unsupported dtypes and Fortran order.
+  static llvm::Optional<NpyArray> parse(llvm::StringRef buffer,
+                                        std::string *errorMessage);
+
+  // Write the array as a version 1 .npy file.
+  void write(llvm::raw_ostream &os) const;
+};
+
+} // namespace air
+} // namespace xilinx
+
+#endif // AIR_UTIL_NPY_H
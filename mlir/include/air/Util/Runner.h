@@ -9,6 +9,9 @@
 #ifndef AIR_UTIL_RUNNER_H
 #define AIR_UTIL_RUNNER_H
 
+#include "air/Util/ArchModel.h"
+#include "air/Util/Npy.h"
+#include "air/Util/TraceSink.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 
 #include "llvm/Support/JSON.h"
@@ -16,16 +19,164 @@
 namespace xilinx {
 namespace air {
 
+struct AIRRunnerOptions {
+  bool verbose = false;
+  // Simulate the partitions of the topology on parallel threads, in windows
+  // of the minimum DMA transfer time of the architecture, the lookahead.
+  // Interactions between partitions take effect when they happen, unless
+  // the partition they affect has simulated past that time in the window;
+  // those are delayed to the next window, see
+  // AIRRunnerResults::delayedInteractions.
+  bool parallel = false;
+  TraceFormat traceFormat = TraceFormat::JSON;
+  // Fail the simulation when buffers do not fit the capacity of a memory in
+  // the arch model, instead of warning.
+  bool failOnMemoryOverflow = false;
+  // Record the start and end of every entry in the results.
+  bool recordOps = false;
+  // Simulate the iterations of scf.for loops carrying async tokens until the
+  // periods of the last two windows of steadyStateWindow iterations agree,
+  // and extrapolate the other iterations from the period of the last window.
+  // Loops which are not steady after maxSteadyStateWindows windows are
+  // extrapolated from there and reported unsteady.
+  bool extrapolateLoops = false;
+  unsigned steadyStateWindow = 4;
+  unsigned maxSteadyStateWindows = 8;
+  // Schedule the iterations of an scf.for as earlier ones complete, with at
+  // most maxLiveIterations of them scheduled and not complete at a time.
+  unsigned maxLiveIterations = 8;
+  // Compute the contents of the buffers along with the timing: DMAs and
+  // channels move data and linalg ops run on native kernels. The memref
+  // arguments of the function are the inputs and outputs, see
+  // AIRRunner::setArgument. Implies sequential simulation of every loop
+  // iteration, so parallel and extrapolateLoops are ignored.
+  bool functional = false;
+  // seed of the random contents of the memref arguments without an input
+  uint64_t randomSeed = 0;
+};
+
+// Summary of the last simulation of an AIRRunner.
+struct AIRRunnerResults {
+  // Usage of a memory: the L1 of a core tile, the L2 of a partition or a
+  // whole memory space for the other spaces.
+  struct Memory {
+    std::string name;
+    unsigned space;
+    // capacity from the arch model, 0 if unknown
+    uint64_t capacity;
+    // highest number of bytes allocated at once
+    uint64_t peakBytes;
+    // highest end of a buffer, with buffers placed first fit
+    uint64_t highWater;
+
+    // fraction of the high-water mark lost to holes between buffers
+    double getFragmentation() const {
+      return highWater ? 1.0 - (double)peakBytes / highWater : 0;
+    }
+  };
+
+  // Activity of a command queue. The queue is idle for the rest of the
+  // makespan.
+  struct Queue {
+    std::string name;
+    uint64_t busyCycles;
+    // cycles the entry at the front of the queue waited for async tokens or
+    // channel buffers
+    uint64_t stallCycles;
+  };
+
+  // An entry of a queue as it ran.
+  struct Step {
+    std::string op;
+    std::string queue;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  // Stall cycles of the entries of `op` waiting on `cause`: the op whose
+  // async token completed last, or a channel.
+  struct Stall {
+    std::string op;
+    std::string cause;
+    uint64_t cycles;
+    uint64_t count;
+  };
+
+  // The extrapolated instances of an scf.for.
+  struct Loop {
+    // location of the scf.for
+    std::string loc;
+    uint64_t instances = 0;
+    uint64_t simulatedIterations = 0;
+    uint64_t extrapolatedIterations = 0;
+    // largest period of an instance, in cycles per iteration
+    uint64_t period = 0;
+    // largest error bound of an instance, in cycles
+    uint64_t maxErrorBound = 0;
+    // instances whose iterations had not reached a steady state
+    uint64_t unsteady = 0;
+  };
+
+  // time in cycles at which the last queue finished
+  uint64_t makespan = 0;
+  // highest peak of a single memory of each memory space
+  std::vector<uint64_t> peakBytes;
+  // bytes moved by DMA transfers and channel puts
+  uint64_t dmaBytes = 0;
+  std::vector<Memory> memories;
+  // true if the buffers of a memory did not fit its capacity
+  bool memoryOverflow = false;
+  // queues which ran or stalled
+  std::vector<Queue> queues;
+  // chain of entries which determined the makespan, in time order
+  std::vector<Step> criticalPath;
+  // every entry which ran, by start time, if the runner records ops
+  std::vector<Step> ops;
+  // by decreasing cycles
+  std::vector<Stall> stalls;
+  std::vector<Loop> loops;
+  // bound on the error of the makespan: the sum of the error bounds of the
+  // extrapolated loops on the critical path
+  uint64_t extrapolationErrorBound = 0;
+  // Lookahead windows of a parallel simulation, the windows in which several
+  // logical processes ran, and the interactions between processes which took
+  // effect later than they happened, by less than the lookahead.
+  uint64_t parallelWindows = 0;
+  uint64_t concurrentWindows = 0;
+  uint64_t delayedInteractions = 0;
+
+  uint64_t getPeakBytes(unsigned memorySpace) const {
+    return memorySpace < peakBytes.size() ? peakBytes[memorySpace] : 0;
+  }
+};
+
 struct AIRRunner {
 
   AIRRunner(llvm::raw_ostream &trace_stream, llvm::json::Value &json_model,
             bool verbose = false);
+  AIRRunner(llvm::raw_ostream &trace_stream, const ArchModel &arch,
+            bool verbose = false);
+  AIRRunner(llvm::raw_ostream &trace_stream, const ArchModel &arch,
+            const AIRRunnerOptions &options);
   ~AIRRunner();
 
   void emitTraceStart(llvm::raw_ostream &s);
   void emitTraceEnd(llvm::raw_ostream &s);
 
-  void scheduleFunction(mlir::func::FuncOp &toplevel);
+  // Simulate `toplevel`. Fails if a memory overflows and the runner was
+  // created with failOnMemoryOverflow.
+  mlir::LogicalResult scheduleFunction(mlir::func::FuncOp &toplevel);
+
+  const AIRRunnerResults &getResults() const;
+
+  // In functional mode, set the initial contents of memref argument `index`
+  // of the function, in C order. Arguments without contents are filled with
+  // random values.
+  void setArgument(unsigned index, const NpyArray &array);
+
+  // In functional mode, the contents of memref argument `index` at the end of
+  // the last simulation, or nullptr if it is not a memref argument.
+  const NpyArray *getArgument(unsigned index) const;
 
 private:
   class AIRRunner_impl;
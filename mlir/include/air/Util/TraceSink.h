@@ -0,0 +1,65 @@
+//===- TraceSink.h ----------------------------------------------*- C++ -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef AIR_UTIL_TRACESINK_H
+#define AIR_UTIL_TRACESINK_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace xilinx {
+namespace air {
+
+enum class TraceFormat {
+  // Chrome trace event JSON, one object per event
+  JSON,
+  // Perfetto TracePacket protobuf stream, with interned event names
+  Perfetto,
+  // compact binary records with interned names, see BinaryTraceSink
+  Binary,
+  // no events, a per-event-name histogram of durations at the end
+  Aggregate,
+};
+
+// Parse a trace format name: "json", "perfetto", "binary" or "aggregate".
+llvm::Optional<TraceFormat> parseTraceFormat(llvm::StringRef name);
+
+// Destination of the trace events of air-runner. Events are begin ('B') or
+// end ('E') events of a slice named `name` on the track `tid` of process
+// `pid`, at time `ts` in cycles, and samples of counters. Sinks are not
+// thread safe.
+class TraceSink {
+public:
+  virtual ~TraceSink();
+
+  // Write the header of the trace to `os`.
+  virtual void start(llvm::raw_ostream &os) {}
+
+  virtual void event(llvm::StringRef name, llvm::StringRef cat, char ph,
+                     uint64_t ts, uint64_t tid, int64_t pid) = 0;
+
+  // Record that counter `name` of process `pid` is `value` from time `ts`.
+  virtual void counter(llvm::StringRef name, uint64_t ts, int64_t pid,
+                       int64_t value) {}
+
+  // Write the rest of the trace to `os`, and the footer.
+  virtual void finish(llvm::raw_ostream &os) {}
+
+  // Create a sink of `format` which streams events to `os`.
+  static std::unique_ptr<TraceSink> create(TraceFormat format,
+                                           llvm::raw_ostream &os);
+};
+
+} // namespace air
+} // namespace xilinx
+
+#endif // AIR_UTIL_TRACESINK_H
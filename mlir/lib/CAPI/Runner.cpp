@@ -12,6 +12,8 @@
 
 #include "mlir/CAPI/IR.h"
 #include "mlir/CAPI/Support.h"
+#include "mlir/CAPI/Utils.h"
+#include "mlir/CAPI/Wrap.h"
 #include "mlir/IR/BuiltinTypes.h"
 #include "mlir/Support/FileUtilities.h"
 
@@ -34,15 +36,20 @@ void airRunnerRun(MlirModule module, const char *jsonFileName, const char *outpu
     return;
   }
 
-  std::string json_str = json_file->getBuffer().str();
-  llvm::StringRef sr(json_str);
-  auto jsonModel = llvm::json::parse(sr);
+  auto jsonModel = llvm::json::parse(json_file->getBuffer());
   if (!jsonModel) {
-    llvm::errs() << "failed to parse model json\n";
+    llvm::errs() << "failed to parse model json: "
+                 << llvm::toString(jsonModel.takeError()) << "\n";
     return;
   }
 
-  xilinx::air::AIRRunner runner(output->os(), *jsonModel, verbose);
+  auto archModel = xilinx::air::ArchModel::parse(*jsonModel, &errorMessage);
+  if (!archModel) {
+    llvm::errs() << errorMessage << "\n";
+    return;
+  }
+
+  xilinx::air::AIRRunner runner(output->os(), *archModel, verbose);
 
   auto toplevel = moduleOp.lookupSymbol<mlir::func::FuncOp>(topLevelFunction);
   if (!toplevel) {
@@ -51,9 +58,97 @@ void airRunnerRun(MlirModule module, const char *jsonFileName, const char *outpu
   }
 
   runner.emitTraceStart(output->os());
-  runner.scheduleFunction(toplevel);
+  (void)runner.scheduleFunction(toplevel);
   runner.emitTraceEnd(output->os());
 
   output->keep();
   return;
 }
+
+DEFINE_C_API_PTR_METHODS(AirRunnerResults, xilinx::air::AIRRunnerResults)
+
+AirRunnerResults airRunnerSimulate(MlirModule module, MlirStringRef archJson,
+                                   MlirStringRef function, bool recordOps,
+                                   MlirStringCallback errorCallback,
+                                   void *userData) {
+  mlir::detail::CallbackOstream errors(errorCallback, userData);
+  auto moduleOp = unwrap(module);
+
+  auto jsonModel = llvm::json::parse(unwrap(archJson));
+  if (!jsonModel) {
+    errors << "failed to parse model json: "
+           << llvm::toString(jsonModel.takeError());
+    return wrap((xilinx::air::AIRRunnerResults *)nullptr);
+  }
+
+  std::string errorMessage;
+  auto archModel = xilinx::air::ArchModel::parse(*jsonModel, &errorMessage);
+  if (!archModel) {
+    errors << errorMessage;
+    return wrap((xilinx::air::AIRRunnerResults *)nullptr);
+  }
+
+  auto toplevel = moduleOp.lookupSymbol<mlir::func::FuncOp>(unwrap(function));
+  if (!toplevel) {
+    errors << "function '" << unwrap(function) << "' not found";
+    return wrap((xilinx::air::AIRRunnerResults *)nullptr);
+  }
+
+  // only the results are wanted, the aggregate sink produces no events
+  xilinx::air::AIRRunnerOptions options;
+  options.traceFormat = xilinx::air::TraceFormat::Aggregate;
+  options.recordOps = recordOps;
+  xilinx::air::AIRRunner runner(llvm::nulls(), *archModel, options);
+  if (mlir::failed(runner.scheduleFunction(toplevel))) {
+    errors << "simulation of '" << unwrap(function) << "' failed";
+    return wrap((xilinx::air::AIRRunnerResults *)nullptr);
+  }
+  return wrap(new xilinx::air::AIRRunnerResults(runner.getResults()));
+}
+
+void airRunnerResultsDestroy(AirRunnerResults results) {
+  delete unwrap(results);
+}
+
+uint64_t airRunnerResultsGetMakespan(AirRunnerResults results) {
+  return unwrap(results)->makespan;
+}
+
+uint64_t airRunnerResultsGetDmaBytes(AirRunnerResults results) {
+  return unwrap(results)->dmaBytes;
+}
+
+intptr_t airRunnerResultsGetNumMemorySpaces(AirRunnerResults results) {
+  return unwrap(results)->peakBytes.size();
+}
+
+uint64_t airRunnerResultsGetPeakBytes(AirRunnerResults results,
+                                      intptr_t space) {
+  if (space < 0)
+    return 0;
+  return unwrap(results)->getPeakBytes(space);
+}
+
+intptr_t airRunnerResultsGetNumOps(AirRunnerResults results) {
+  return unwrap(results)->ops.size();
+}
+
+MlirStringRef airRunnerResultsGetOpName(AirRunnerResults results,
+                                        intptr_t pos) {
+  return wrap(llvm::StringRef(unwrap(results)->ops[pos].op));
+}
+
+MlirStringRef airRunnerResultsGetOpQueue(AirRunnerResults results,
+                                         intptr_t pos) {
+  return wrap(llvm::StringRef(unwrap(results)->ops[pos].queue));
+}
+
+void airRunnerResultsGetOpTimes(AirRunnerResults results, uint64_t *starts,
+                                uint64_t *ends) {
+  for (auto &op : unwrap(results)->ops) {
+    if (starts)
+      *starts++ = op.start;
+    if (ends)
+      *ends++ = op.end;
+  }
+}
@@ -567,12 +567,13 @@ unsigned getScfParDimIdFromBCastDma(air::DmaMemcpyInterface memcpyOp) {
   return 0;
 }
 
-// Create channel name as string
-std::string createChannelName(ModuleOp module) {
+// Create channel name as string. Names of channels are looked up in the
+// index, the module is only searched for other symbols of the name.
+std::string createChannelName(ModuleOp module, channelIndex &channels) {
   std::string new_cname = "channel_0";
   std::string cname = "channel";
   int which_try = 0;
-  while (module.lookupSymbol(new_cname))
+  while (channels.lookup(new_cname) || module.lookupSymbol(new_cname))
     new_cname = cname + "_" + std::to_string(++which_try);
   cname = new_cname;
   return cname;
@@ -609,7 +610,8 @@ void annotateChannelOpWithBCastShape(OpBuilder builder,
 void replaceAIRDmaWithAIRChannelPairs(
     OpBuilder &builder, unsigned innerMemorySpace, air::DmaMemcpyNdOp op,
     SmallVector<air::ChannelInterface, 1> &internalGetPutVector,
-    SmallVector<air::ChannelInterface, 1> &externalGetPutVector) {
+    SmallVector<air::ChannelInterface, 1> &externalGetPutVector,
+    channelIndex &channels) {
   auto loc = op->getLoc();
   auto src = op.getSrcMemref();
   auto dst = op.getDstMemref();
@@ -639,7 +641,8 @@ void replaceAIRDmaWithAIRChannelPairs(
 
   // Create channel symbol
   auto module = op->getParentOfType<ModuleOp>();
-  auto cname = createChannelName(module);
+  auto cname = createChannelName(module, channels);
+  air::ChannelOp channel_op;
 
   // Infer broadcast shape from integer set, if broadcast_set attribute is set
   if (op->hasAttr("broadcast_set")) {
@@ -651,7 +654,7 @@ void replaceAIRDmaWithAIRChannelPairs(
     getBCastSizesFromIntegerSet(ctx, int_set, lbs_int, ubs_int);
     SmallVector<int64_t, 2> bcast_sizes = {ubs_int[0] - lbs_int[0] + 1,
                                            ubs_int[1] - lbs_int[1] + 1};
-    auto channel_op =
+    channel_op =
         createChannelOpWithBCast(builder, module, cname, loc, channel_sizes);
     channel_op->setAttr("broadcast_shape",
                         builder.getI64ArrayAttr(bcast_sizes));
@@ -666,13 +669,14 @@ void replaceAIRDmaWithAIRChannelPairs(
     SmallVector<int64_t, 2> channel_sizes = {1, 1};
     channel_sizes[getScfParDimIdFromBCastDma(dyn_cast<air::DmaMemcpyInterface>(
         op.getOperation()))] = ubs_int[0] - lbs_int[0] + 1;
-    auto channel_op =
+    channel_op =
         createChannelOpWithBCast(builder, module, cname, loc, channel_sizes);
     annotateChannelOpWithBCastShape(builder, channel_op,
                                     op->getParentOfType<air::HerdOp>());
   } else {
     SmallVector<int64_t, 2> channel_sizes = {1, 1};
-    createChannelOpWithBCast(builder, module, cname, loc, channel_sizes);
+    channel_op =
+        createChannelOpWithBCast(builder, module, cname, loc, channel_sizes);
   }
 
   SmallVector<Value, 1> channel_idx_internal{};
@@ -739,9 +743,14 @@ void replaceAIRDmaWithAIRChannelPairs(
 
   externalGetPutVector.push_back(externalGetPut);
   internalGetPutVector.push_back(internalGetPut);
+
+  // the broadcast shape is only known once the declaration is annotated
+  channels.notifyOperationInserted(channel_op);
+  channels.notifyOperationInserted(internalGetPut);
+  channels.notifyOperationInserted(externalGetPut);
 }
 
-void HoistingAffineIf(mlir::AffineIfOp op) {
+void HoistingAffineIf(mlir::AffineIfOp op, channelIndex &channels) {
   auto ctx = op->getContext();
 
   air::HierarchyInterface hier_op = nullptr;
@@ -765,13 +774,15 @@ void HoistingAffineIf(mlir::AffineIfOp op) {
   // Recursively search for and replace air.dma ops
   auto module = op->getParentOfType<ModuleOp>();
   OpBuilder module_builder(module);
+  channelIndex::listener listener(channels);
+  module_builder.setListener(&listener);
   // The first then block
   auto then_block_dma = getAIRDmaInBlock(op.getThenBlock());
   dmas.push_back(then_block_dma);
   module_builder.setInsertionPoint(then_block_dma);
   replaceAIRDmaWithAIRChannelPairs(module_builder, innerMemorySpace,
                                    then_block_dma, internalGetPut,
-                                   externalGetPut);
+                                   externalGetPut, channels);
   // Recursion
   mlir::AffineIfOp current_if = op;
   while (getAffineIfInBlock(current_if.getElseBlock())) {
@@ -782,7 +793,7 @@ void HoistingAffineIf(mlir::AffineIfOp op) {
     module_builder.setInsertionPoint(child_then_block_dma);
     replaceAIRDmaWithAIRChannelPairs(module_builder, innerMemorySpace,
                                      child_then_block_dma, internalGetPut,
-                                     externalGetPut);
+                                     externalGetPut, channels);
 
     current_if = child_if_op;
   }
@@ -792,7 +803,7 @@ void HoistingAffineIf(mlir::AffineIfOp op) {
   module_builder.setInsertionPoint(else_block_dma);
   replaceAIRDmaWithAIRChannelPairs(module_builder, innerMemorySpace,
                                    else_block_dma, internalGetPut,
-                                   externalGetPut);
+                                   externalGetPut, channels);
 
   // Get dependent ops to hoist together with external get/put
   SetVector<Operation *> backwardSlice;
@@ -890,6 +901,7 @@ void HoistingAffineIf(mlir::AffineIfOp op) {
     if (o->hasAttr("loop-carried-dep") &&
         o->getAttrOfType<StringAttr>("loop-carried-dep").getValue().str() ==
             "externalGetPut") {
+      channels.notifyOperationRemoved(o);
       o->erase();
     }
   });
@@ -898,9 +910,17 @@ void HoistingAffineIf(mlir::AffineIfOp op) {
   }
 }
 
+// The conversion rewriter is its own builder listener, so the pattern keeps
+// the channel index up to date itself.
 class AIRDmaToAIRChannelConversion
     : public OpRewritePattern<air::DmaMemcpyNdOp> {
-  using OpRewritePattern<air::DmaMemcpyNdOp>::OpRewritePattern;
+public:
+  AIRDmaToAIRChannelConversion(MLIRContext *ctx, channelIndex &channels)
+      : OpRewritePattern(ctx), channels(channels) {}
+
+private:
+  channelIndex &channels;
+
   LogicalResult matchAndRewrite(air::DmaMemcpyNdOp op,
                                 PatternRewriter &rewriter) const override {
 
@@ -963,7 +983,7 @@ class AIRDmaToAIRChannelConversion
     SmallVector<air::ChannelInterface, 1> internalGetPut;
 
     replaceAIRDmaWithAIRChannelPairs(rewriter, innerMemorySpace, op,
-                                     internalGetPut, externalGetPut);
+                                     internalGetPut, externalGetPut, channels);
 
     {
       OpBuilder::InsertionGuard guard(rewriter);
@@ -993,11 +1013,9 @@ class AIRDmaToAIRChannelConversion
         // broadcasting
         SmallVector<int, 2> lbs;
         SmallVector<int, 2> ubs;
-        auto module = op->getParentOfType<ModuleOp>();
-        auto channel_op = dyn_cast<air::ChannelOp>(
-            module.lookupSymbol(externalGetPut[0].getChanName()));
-        auto size = extractFromI64ArrayAttr(channel_op.getSize());
-        for (auto s : size) {
+        auto entry = channels.lookup(externalGetPut[0].getChanName());
+        assert(entry && "found channel op without declaration");
+        for (auto s : entry->size) {
           lbs.push_back(0);
           ubs.push_back(s);
         }
@@ -1055,6 +1073,7 @@ class AIRDmaToAIRChannelConversion
             }
           }
         }
+        channels.notifyOperationInserted(scf_par);
       } else if (partition) {
         // Get mapping for remapped ssa values entering the hoisted scf.for
         BlockAndValueMapping remap;
@@ -1073,7 +1092,8 @@ class AIRDmaToAIRChannelConversion
             continue;
           if (o.hasAttr("hoist-channel")) {
             if (auto child_for_op = dyn_cast<scf::ForOp>(o)) {
-              cloneForUsingRemap(rewriter, remap, child_for_op);
+              channels.notifyOperationInserted(
+                  cloneForUsingRemap(rewriter, remap, child_for_op));
             } else if (auto channel_op = dyn_cast<air::ChannelInterface>(o)) {
               if (o.hasAttr("loop-carried-dep") &&
                   o.getAttrOfType<StringAttr>("loop-carried-dep")
@@ -1083,10 +1103,10 @@ class AIRDmaToAIRChannelConversion
                 // shouldn't be hoisted
                 replaceAsyncOpWithWaitAllAndClone(rewriter, remap, &o, false);
               } else {
-                rewriter.clone(o, remap);
+                channels.notifyOperationInserted(rewriter.clone(o, remap));
               }
             } else {
-              rewriter.clone(o, remap);
+              channels.notifyOperationInserted(rewriter.clone(o, remap));
             }
           }
         }
@@ -1112,6 +1132,7 @@ class AIRDmaToAIRChannelConversion
     }
     erased.insert(op);
     for (auto e : erased) {
+      channels.notifyOperationRemoved(e);
       rewriter.eraseOp(e);
     }
 
@@ -1670,12 +1691,15 @@ struct DmaToChannelPass : public DmaToChannelBase<DmaToChannelPass> {
     SmallVector<func::FuncOp, 4> funcOps;
     module.walk([&](func::FuncOp op) { funcOps.push_back(op); });
 
+    // One index of the channels of the module for the whole pass
+    channelIndex channels(module);
+
     // Hoist broadcast pattern
     for (auto f : funcOps) {
       f.walk([&](mlir::AffineIfOp op) {
         if (!op->getParentOfType<mlir::AffineIfOp>()) {
           // Only hoist top-level affine if op with a nest of if ops
-          HoistingAffineIf(op);
+          HoistingAffineIf(op, channels);
         }
       });
     }
@@ -1689,7 +1713,7 @@ struct DmaToChannelPass : public DmaToChannelBase<DmaToChannelPass> {
     target.addIllegalOp<air::DmaMemcpyNdOp>();
 
     RewritePatternSet air_dma_patterns(context);
-    air_dma_patterns.add<AIRDmaToAIRChannelConversion>(context);
+    air_dma_patterns.add<AIRDmaToAIRChannelConversion>(context, channels);
     if (failed(applyPartialConversion(module, target,
                                       std::move(air_dma_patterns)))) {
       emitError(UnknownLoc::get(context), "error\n");
@@ -19,11 +19,13 @@
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
 #include "mlir/Dialect/SCF/Transforms/Transforms.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
 #include "mlir/IR/Builders.h"
 #include "mlir/IR/BuiltinTypes.h"
 #include "mlir/IR/Dominance.h"
 #include "mlir/IR/OperationSupport.h"
 #include "mlir/IR/PatternMatch.h"
+#include "mlir/IR/Threading.h"
 #include "mlir/Pass/Pass.h"
 #include "mlir/Transforms/DialectConversion.h"
 #include "mlir/Transforms/GreedyPatternRewriteDriver.h"
@@ -47,10 +49,10 @@ void boost::throw_exception(std::exception const &e) {
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/graphviz.hpp>
-#include <boost/graph/transitive_reduction.hpp>
 
 #include <algorithm>
 #include <map>
+#include <memory>
 #include <numeric>
 #include <string>
 #include <vector>
@@ -82,606 +84,609 @@ typedef boost::graph_traits<Graph>::in_edge_iterator in_edge_iterator;
 typedef boost::graph_traits<Graph>::out_edge_iterator out_edge_iterator;
 typedef boost::graph_traits<Graph>::vertex_iterator vertex_iterator;
 
-typedef std::map<Graph::vertex_descriptor, Graph::vertex_descriptor> vertex_map;
 typedef std::map<unsigned, Graph::vertex_descriptor> operation_id_to_vertex_map;
 
-static uint64_t ExecuteOpID;
-static uint64_t HierarchyOpID;
-static uint64_t WaitAllOpID;
-static uint64_t ChannelOpID;
-
-class AIRDependency : public AIRDependencyBase<AIRDependency> {
+// Dependency tracing of one function. The dependency graph, its transitive
+// reduction and the async op histories only relate ops in the same function,
+// so that the functions of a module can be traced independently.
+class functionDependencyTracer {
 
 public:
-  AIRDependency() = default;
-  AIRDependency(const AIRDependency &pass) {}
-
-  void getDependentDialects(::mlir::DialectRegistry &registry) const override {
-    registry.insert<scf::SCFDialect, air::airDialect>();
-  }
-
-  void runOnOperation() override {
-    auto module = getOperation();
-
-    // Preprocessing: renumber the air dma op ids
-    for (auto f : module.getOps<func::FuncOp>()) {
-      xilinx::air::renumberDmaOps(f, "global");
-    }
+  functionDependencyTracer(func::FuncOp f) : f(f) {}
+
+  // 1st traversal: create async ops with empty dep list.
+  void createAsyncOps(OpBuilder &builder) {
+    f.walk([&](Operation *op) {
+      // Create async interface for air.dmamemcpy ops
+      if (mlir::dyn_cast<xilinx::air::DmaMemcpyInterface>(op))
+        createAsyncDMA(builder, op);
+
+      // Create async interface for air.channel ops
+      else if (mlir::dyn_cast<xilinx::air::ChannelInterface>(op))
+        createAsyncChannel(builder, op, ChannelOpID);
+
+      // Create async execute region for linalg.matmul
+      else if (dyn_cast<linalg::MatmulOp>(op))
+        createAsyncExecute(builder, op, "linalg::matmul", ExecuteOpID);
+
+      // Create async execute region for linalg.fill
+      else if (dyn_cast<linalg::FillOp>(op))
+        createAsyncExecute(builder, op, "linalg::fill", ExecuteOpID);
+
+      // Create async execute region for linalg.copy
+      else if (dyn_cast<linalg::CopyOp>(op))
+        createAsyncExecute(builder, op, "linalg::copy", ExecuteOpID);
+
+      // Create async execute region for linalg op
+      else if (mlir::dyn_cast<linalg::LinalgOp>(op))
+        createAsyncExecute(builder, op, "linalg::unknown", ExecuteOpID);
+
+      // Create async execute region for memref.alloc
+      else if (auto memalloc_op = dyn_cast<memref::AllocOp>(op))
+        createAsyncExecute(builder, op, "memref::alloc", ExecuteOpID,
+                           memalloc_op.getMemref().getType());
+
+      // Create async execute region for memref.alloc
+      else if (auto memcast_op = dyn_cast<memref::CastOp>(op))
+        createAsyncExecute(builder, op, "memref::cast", ExecuteOpID,
+                           memcast_op.getDest().getType());
+
+      // Create async execute region for memref.dealloc
+      else if (dyn_cast<memref::DeallocOp>(op))
+        createAsyncExecute(builder, op, "memref::dealloc", ExecuteOpID);
+
+      // Create async execute region for memref.copy
+      else if (dyn_cast<memref::CopyOp>(op))
+        createAsyncExecute(builder, op, "memref::copy", ExecuteOpID);
+
+      // Create async execute region for arith.muli
+      else if (auto arith_op = dyn_cast<arith::MulIOp>(op)) {
+        if (arith_op.getResult().getType().isa<IndexType>()) {
+          createAsyncExecute(builder, op, "arith::muli", ExecuteOpID,
+                             arith_op.getResult().getType());
+        }
+      }
 
-    // 1st traversal: create async ops with empty dep list.
+      // Create async execute region for arith.addi
+      else if (auto arith_op = dyn_cast<arith::AddIOp>(op)) {
+        if (arith_op.getResult().getType().isa<IndexType>()) {
+          createAsyncExecute(builder, op, "arith::addi", ExecuteOpID,
+                             arith_op.getResult().getType());
+        }
+      }
 
-    OpBuilder module_builder(module);
+      // Create async execute region for affine.apply
+      else if (auto apply_op = dyn_cast<mlir::AffineApplyOp>(op))
+        createAsyncExecute(builder, op, "affine::apply", ExecuteOpID,
+                           apply_op.getResult().getType());
 
-    ExecuteOpID = 0;
-    HierarchyOpID = 0;
-    WaitAllOpID = 0;
-    ChannelOpID = 0;
+      // Create async execute region for air hierarchy ops (air.launch and
+      // air.partition, TODO: air.herd).
+      else if (auto hierarchy_op = dyn_cast<air::HierarchyInterface>(op)) {
+        createAsyncHierarchyImpls(builder, hierarchy_op, HierarchyOpID);
+      }
 
-    for (auto f : module.getOps<func::FuncOp>()) {
-      f.walk([&](Operation *op) {
-        // Create async interface for air.dmamemcpy ops
-        if (mlir::dyn_cast<xilinx::air::DmaMemcpyInterface>(op))
-          createAsyncDMA(module_builder, op);
-
-        // Create async interface for air.channel ops
-        else if (mlir::dyn_cast<xilinx::air::ChannelInterface>(op))
-          createAsyncChannel(module_builder, op, ChannelOpID);
-
-        // Create async execute region for linalg.matmul
-        else if (dyn_cast<linalg::MatmulOp>(op))
-          createAsyncExecute(module_builder, op, "linalg::matmul", ExecuteOpID);
-
-        // Create async execute region for linalg.fill
-        else if (dyn_cast<linalg::FillOp>(op))
-          createAsyncExecute(module_builder, op, "linalg::fill", ExecuteOpID);
-
-        // Create async execute region for linalg.copy
-        else if (dyn_cast<linalg::CopyOp>(op))
-          createAsyncExecute(module_builder, op, "linalg::copy", ExecuteOpID);
-
-        // Create async execute region for linalg op
-        else if (mlir::dyn_cast<linalg::LinalgOp>(op))
-          createAsyncExecute(module_builder, op, "linalg::unknown",
-                             ExecuteOpID);
-
-        // Create async execute region for memref.alloc
-        else if (auto memalloc_op = dyn_cast<memref::AllocOp>(op))
-          createAsyncExecute(module_builder, op, "memref::alloc", ExecuteOpID,
-                             memalloc_op.getMemref().getType());
-
-        // Create async execute region for memref.alloc
-        else if (auto memcast_op = dyn_cast<memref::CastOp>(op))
-          createAsyncExecute(module_builder, op, "memref::cast", ExecuteOpID,
-                             memcast_op.getDest().getType());
-
-        // Create async execute region for memref.dealloc
-        else if (dyn_cast<memref::DeallocOp>(op))
-          createAsyncExecute(module_builder, op, "memref::dealloc",
-                             ExecuteOpID);
-
-        // Create async execute region for memref.copy
-        else if (dyn_cast<memref::CopyOp>(op))
-          createAsyncExecute(module_builder, op, "memref::copy", ExecuteOpID);
-
-        // Create async execute region for arith.muli
-        else if (auto arith_op = dyn_cast<arith::MulIOp>(op)) {
-          if (arith_op.getResult().getType().isa<IndexType>()) {
-            createAsyncExecute(module_builder, op, "arith::muli", ExecuteOpID,
-                               arith_op.getResult().getType());
+      // Create async execute region for an unknown op which has memref or
+      // index-type operands
+      else {
+        bool isCandidateExecute = false;
+        for (auto operand : op->getOperands()) {
+          if (operand.getType().isa<MemRefType>() ||
+              operand.getType().isa<IndexType>()) {
+            isCandidateExecute = true;
           }
         }
-
-        // Create async execute region for arith.addi
-        else if (auto arith_op = dyn_cast<arith::AddIOp>(op)) {
-          if (arith_op.getResult().getType().isa<IndexType>()) {
-            createAsyncExecute(module_builder, op, "arith::addi", ExecuteOpID,
-                               arith_op.getResult().getType());
-          }
+        // No air execute for loop ops
+        if (mlir::dyn_cast<mlir::LoopLikeOpInterface>(op))
+          isCandidateExecute = false;
+        // No air execute for subview ops
+        if (mlir::dyn_cast<mlir::OffsetSizeAndStrideOpInterface>(op))
+          isCandidateExecute = false;
+        // No air execute for terminators
+        if (op->mightHaveTrait<OpTrait::IsTerminator>()) {
+          isCandidateExecute = false;
         }
-
-        // Create async execute region for affine.apply
-        else if (auto apply_op = dyn_cast<mlir::AffineApplyOp>(op))
-          createAsyncExecute(module_builder, op, "affine::apply", ExecuteOpID,
-                             apply_op.getResult().getType());
-
-        // Create async execute region for air hierarchy ops (air.launch and
-        // air.partition, TODO: air.herd).
-        else if (auto hierarchy_op = dyn_cast<air::HierarchyInterface>(op)) {
-          createAsyncHierarchyImpls(module_builder, hierarchy_op,
-                                    HierarchyOpID);
+        // No air execute in linalg.generic
+        if (op->getParentOfType<mlir::linalg::GenericOp>()) {
+          isCandidateExecute = false;
+        }
+        if (isCandidateExecute) {
+          if (op->getNumResults())
+            createAsyncExecute(builder, op, "unknown", ExecuteOpID,
+                               op->getResults().front().getType());
+          else
+            createAsyncExecute(builder, op, "unknown", ExecuteOpID);
         }
+      }
+    });
+  }
 
-        // Create async execute region for an unknown op which has memref or
-        // index-type operands
-        else {
-          bool isCandidateExecute = false;
-          for (auto operand : op->getOperands()) {
-            if (operand.getType().isa<MemRefType>() ||
-                operand.getType().isa<IndexType>()) {
-              isCandidateExecute = true;
-            }
-          }
-          // No air execute for loop ops
-          if (mlir::dyn_cast<mlir::LoopLikeOpInterface>(op))
-            isCandidateExecute = false;
-          // No air execute for subview ops
-          if (mlir::dyn_cast<mlir::OffsetSizeAndStrideOpInterface>(op))
-            isCandidateExecute = false;
-          // No air execute for terminators
-          if (op->mightHaveTrait<OpTrait::IsTerminator>()) {
-            isCandidateExecute = false;
-          }
-          // No air execute in linalg.generic
-          if (op->getParentOfType<mlir::linalg::GenericOp>()) {
-            isCandidateExecute = false;
-          }
-          if (isCandidateExecute) {
-            if (op->getNumResults())
-              createAsyncExecute(module_builder, op, "unknown", ExecuteOpID,
-                                 op->getResults().front().getType());
-            else
-              createAsyncExecute(module_builder, op, "unknown", ExecuteOpID);
+  // 2nd traversal: trace deps among async execute regions; build a boost dep
+  // graph.
+  void traceDependencies() {
+    f.walk([&](Operation *op) {
+      Operation *sink_op = nullptr;
+      if (auto async_execute_op = dyn_cast<air::ExecuteOp>(op)) {
+        for (auto &bb : async_execute_op.getBody()) {
+          for (auto &child_op : bb.getOperations()) {
+            if (!dyn_cast<air::ExecuteTerminatorOp>(child_op))
+              sink_op = &child_op;
           }
         }
-      });
-    }
-
-    // 2nd traversal: trace deps among async execute regions; build a boost dep
-    // graph.
-
-    for (auto f : module.getOps<func::FuncOp>()) {
-      f.walk([&](Operation *op) {
-        Operation *sink_op = nullptr;
-        if (auto async_execute_op = dyn_cast<air::ExecuteOp>(op)) {
-          for (auto &bb : async_execute_op.getBody()) {
-            for (auto &child_op : bb.getOperations()) {
-              if (!dyn_cast<air::ExecuteTerminatorOp>(child_op))
-                sink_op = &child_op;
-            }
+      } else if (mlir::dyn_cast<xilinx::air::DmaMemcpyInterface>(op)) {
+        sink_op = op;
+      } else if (mlir::dyn_cast<xilinx::air::ChannelInterface>(op)) {
+        sink_op = op;
+      } else if (dyn_cast<air::HierarchyInterface>(op)) {
+        sink_op = op;
+      } else
+        return;
+
+      SmallVector<partialMemref, 1> sink_op_memref_reads;
+      SmallVector<partialMemref, 1> sink_op_memref_writes;
+      SmallVector<Value, 1> sink_op_scalar_ins;
+      SmallVector<Value, 1> sink_op_scalar_outs;
+
+      // If the sink op is linalg op
+      if (auto sink_op_linalgop = dyn_cast<linalg::LinalgOp>(sink_op)) {
+        for (auto linalg_ins : sink_op_linalgop.getDpsInputOperands()) {
+          auto ins_value = linalg_ins->get();
+          if (ins_value.getType().isa<MemRefType>()) {
+            unsigned memRefRank =
+                ins_value.getType().cast<MemRefType>().getRank();
+            partialMemref tile = createPartialMemref(ins_value, memRefRank);
+            sink_op_memref_reads.push_back(tile);
+          } else if (ins_value.getType().isa<IndexType>()) {
+            sink_op_scalar_ins.push_back(ins_value);
           }
-        } else if (mlir::dyn_cast<xilinx::air::DmaMemcpyInterface>(op)) {
-          sink_op = op;
-        } else if (mlir::dyn_cast<xilinx::air::ChannelInterface>(op)) {
-          sink_op = op;
-        } else if (dyn_cast<air::HierarchyInterface>(op)) {
-          sink_op = op;
-        } else
-          return;
-
-        SmallVector<partialMemref, 1> sink_op_memref_reads;
-        SmallVector<partialMemref, 1> sink_op_memref_writes;
-        SmallVector<Value, 1> sink_op_scalar_ins;
-        SmallVector<Value, 1> sink_op_scalar_outs;
-
-        // If the sink op is linalg op
-        if (auto sink_op_linalgop = dyn_cast<linalg::LinalgOp>(sink_op)) {
-          for (auto linalg_ins : sink_op_linalgop.getDpsInputOperands()) {
-            auto ins_value = linalg_ins->get();
-            if (ins_value.getType().isa<MemRefType>()) {
-              unsigned memRefRank =
-                  ins_value.getType().cast<MemRefType>().getRank();
-              partialMemref tile = createPartialMemref(ins_value, memRefRank);
-              sink_op_memref_reads.push_back(tile);
-            } else if (ins_value.getType().isa<IndexType>()) {
-              sink_op_scalar_ins.push_back(ins_value);
-            }
+        }
+        for (auto linalg_outs : sink_op_linalgop.getDpsInitOperands()) {
+          auto outs_value = linalg_outs->get();
+          if (outs_value.getType().isa<MemRefType>()) {
+            unsigned memRefRank =
+                outs_value.getType().cast<MemRefType>().getRank();
+            partialMemref tile = createPartialMemref(outs_value, memRefRank);
+            sink_op_memref_reads.push_back(
+                tile); // linalg op both reads and writes the output memref
+            sink_op_memref_writes.push_back(tile);
+          } else if (outs_value.getType().isa<IndexType>()) {
+            sink_op_scalar_ins.push_back(
+                outs_value); // linalg op both reads and writes the output
+                             // memref
+            sink_op_scalar_outs.push_back(outs_value);
           }
-          for (auto linalg_outs : sink_op_linalgop.getDpsInitOperands()) {
-            auto outs_value = linalg_outs->get();
-            if (outs_value.getType().isa<MemRefType>()) {
+        }
+        if (sink_op_linalgop->getNumResults()) {
+          for (auto linalg_results : sink_op_linalgop->getResults()) {
+            if (linalg_results.getType().isa<MemRefType>()) {
               unsigned memRefRank =
-                  outs_value.getType().cast<MemRefType>().getRank();
-              partialMemref tile = createPartialMemref(outs_value, memRefRank);
-              sink_op_memref_reads.push_back(
-                  tile); // linalg op both reads and writes the output memref
+                  linalg_results.getType().cast<MemRefType>().getRank();
+              partialMemref tile =
+                  createPartialMemref(linalg_results, memRefRank);
               sink_op_memref_writes.push_back(tile);
-            } else if (outs_value.getType().isa<IndexType>()) {
-              sink_op_scalar_ins.push_back(
-                  outs_value); // linalg op both reads and writes the output
-                               // memref
-              sink_op_scalar_outs.push_back(outs_value);
-            }
-          }
-          if (sink_op_linalgop->getNumResults()) {
-            for (auto linalg_results : sink_op_linalgop->getResults()) {
-              if (linalg_results.getType().isa<MemRefType>()) {
-                unsigned memRefRank =
-                    linalg_results.getType().cast<MemRefType>().getRank();
-                partialMemref tile =
-                    createPartialMemref(linalg_results, memRefRank);
-                sink_op_memref_writes.push_back(tile);
-              } else if (linalg_results.getType().isa<IndexType>()) {
-                sink_op_scalar_outs.push_back(linalg_results);
-              }
+            } else if (linalg_results.getType().isa<IndexType>()) {
+              sink_op_scalar_outs.push_back(linalg_results);
             }
           }
         }
+      }
 
-        // If the sink op is memref::dealloc
-        else if (auto sink_op_memdealloc =
-                     dyn_cast<memref::DeallocOp>(sink_op)) {
-          unsigned memRefRank = sink_op_memdealloc.getMemref()
-                                    .getType()
-                                    .cast<MemRefType>()
-                                    .getRank();
-          partialMemref tile =
-              createPartialMemref(sink_op_memdealloc.getMemref(), memRefRank);
-          sink_op_memref_reads.push_back(tile);
-          sink_op_memref_writes.push_back(
-              tile); // dealloc erases (i.e. writes to) output memref
-        }
+      // If the sink op is memref::dealloc
+      else if (auto sink_op_memdealloc =
+                   dyn_cast<memref::DeallocOp>(sink_op)) {
+        unsigned memRefRank = sink_op_memdealloc.getMemref()
+                                  .getType()
+                                  .cast<MemRefType>()
+                                  .getRank();
+        partialMemref tile =
+            createPartialMemref(sink_op_memdealloc.getMemref(), memRefRank);
+        sink_op_memref_reads.push_back(tile);
+        sink_op_memref_writes.push_back(
+            tile); // dealloc erases (i.e. writes to) output memref
+      }
 
-        // If the sink op is memref::copy
-        else if (auto sink_op_memref_copy = dyn_cast<memref::CopyOp>(sink_op)) {
-          unsigned memRefRankSrc = sink_op_memref_copy.getSource()
-                                       .getType()
-                                       .cast<MemRefType>()
-                                       .getRank();
-          partialMemref tileSrc = createPartialMemref(
-              sink_op_memref_copy.getSource(), memRefRankSrc);
-          sink_op_memref_reads.push_back(tileSrc);
-          unsigned memRefRankDst = sink_op_memref_copy.getTarget()
-                                       .getType()
-                                       .cast<MemRefType>()
-                                       .getRank();
-          partialMemref tileDst = createPartialMemref(
-              sink_op_memref_copy.getTarget(), memRefRankDst);
-          sink_op_memref_reads.push_back(tileDst);
-          sink_op_memref_writes.push_back(tileDst);
-        }
+      // If the sink op is memref::copy
+      else if (auto sink_op_memref_copy = dyn_cast<memref::CopyOp>(sink_op)) {
+        unsigned memRefRankSrc = sink_op_memref_copy.getSource()
+                                     .getType()
+                                     .cast<MemRefType>()
+                                     .getRank();
+        partialMemref tileSrc = createPartialMemref(
+            sink_op_memref_copy.getSource(), memRefRankSrc);
+        sink_op_memref_reads.push_back(tileSrc);
+        unsigned memRefRankDst = sink_op_memref_copy.getTarget()
+                                     .getType()
+                                     .cast<MemRefType>()
+                                     .getRank();
+        partialMemref tileDst = createPartialMemref(
+            sink_op_memref_copy.getTarget(), memRefRankDst);
+        sink_op_memref_reads.push_back(tileDst);
+        sink_op_memref_writes.push_back(tileDst);
+      }
 
-        // If the sink op is an air::DmaMemcpy op
-        else if (auto sink_op_dma =
-                     mlir::dyn_cast<xilinx::air::DmaMemcpyInterface>(sink_op)) {
-          SmallVector<Value, 2> src_indices;
-          SmallVector<Value, 2> dst_indices;
-          unsigned numDimsSrc = sink_op_dma.getNumDims();
-          unsigned numDimsDst = sink_op_dma.getNumDims();
-          // air.dmamemcpynd op has unknown # of dims (thus numdims defaults to
-          // 0)
-          if (numDimsSrc == 0) {
-            numDimsSrc = sink_op_dma.getSrcMemref()
-                             .getType()
-                             .cast<MemRefType>()
-                             .getRank();
-            numDimsDst = sink_op_dma.getDstMemref()
-                             .getType()
-                             .cast<MemRefType>()
-                             .getRank();
-          }
-          // Special case with ND DMA op
-          if (auto sink_op_nddma = dyn_cast<air::DmaMemcpyNdOp>(sink_op)) {
-            // air.dmamemcpynd op has extra scalar operands
-            for (unsigned i = 0; i < sink_op_nddma.getDstOffsets().size(); i++)
-              sink_op_scalar_outs.push_back(sink_op_nddma.getDstOffsets()[i]);
-            for (unsigned i = 0; i < sink_op_nddma.getDstSizes().size(); i++)
-              sink_op_scalar_outs.push_back(sink_op_nddma.getDstSizes()[i]);
-            for (unsigned i = 0; i < sink_op_nddma.getDstStrides().size(); i++)
-              sink_op_scalar_outs.push_back(sink_op_nddma.getDstStrides()[i]);
-            for (unsigned i = 0; i < sink_op_nddma.getSrcOffsets().size(); i++)
-              sink_op_scalar_ins.push_back(sink_op_nddma.getSrcOffsets()[i]);
-            for (unsigned i = 0; i < sink_op_nddma.getSrcSizes().size(); i++)
-              sink_op_scalar_ins.push_back(sink_op_nddma.getSrcSizes()[i]);
-            for (unsigned i = 0; i < sink_op_nddma.getSrcStrides().size(); i++)
-              sink_op_scalar_ins.push_back(sink_op_nddma.getSrcStrides()[i]);
-            if (sink_op_nddma.getSrcOffsets().size()) {
-              for (unsigned i = 0; i < numDimsSrc; i++) {
-                src_indices.push_back(sink_op_nddma.getSrcOffsets()[i]);
-              }
-            } else {
-              for (unsigned i = 0; i < numDimsSrc; i++) {
-                src_indices.push_back(nullptr);
-              }
-            }
-            if (sink_op_nddma.getDstOffsets().size()) {
-              for (unsigned i = 0; i < numDimsDst; i++) {
-                dst_indices.push_back(sink_op_nddma.getDstOffsets()[i]);
-              }
-            } else {
-              for (unsigned i = 0; i < numDimsDst; i++) {
-                dst_indices.push_back(nullptr);
-              }
-            }
-          } else {
-            for (unsigned i = 0; i < numDimsSrc; i++) {
-              sink_op_scalar_ins.push_back(sink_op_dma.getSrcMemrefDim(i));
-              src_indices.push_back(sink_op_dma.getSrcMemrefDim(i));
-            }
-            for (unsigned i = 0; i < numDimsDst; i++) {
-              sink_op_scalar_outs.push_back(sink_op_dma.getDstMemrefDim(i));
-              dst_indices.push_back(sink_op_dma.getDstMemrefDim(i));
-            }
-          }
-          partialMemref tile_in = createPartialMemref(
-              sink_op_dma.getSrcMemref(), numDimsSrc, src_indices);
-          sink_op_memref_reads.push_back(tile_in);
-          partialMemref tile_out = createPartialMemref(
-              sink_op_dma.getDstMemref(), numDimsDst, dst_indices);
-          sink_op_memref_writes.push_back(tile_out);
+      // If the sink op is an air::DmaMemcpy op
+      else if (auto sink_op_dma =
+                   mlir::dyn_cast<xilinx::air::DmaMemcpyInterface>(sink_op)) {
+        SmallVector<Value, 2> src_indices;
+        SmallVector<Value, 2> dst_indices;
+        unsigned numDimsSrc = sink_op_dma.getNumDims();
+        unsigned numDimsDst = sink_op_dma.getNumDims();
+        // air.dmamemcpynd op has unknown # of dims (thus numdims defaults to
+        // 0)
+        if (numDimsSrc == 0) {
+          numDimsSrc = sink_op_dma.getSrcMemref()
+                           .getType()
+                           .cast<MemRefType>()
+                           .getRank();
+          numDimsDst = sink_op_dma.getDstMemref()
+                           .getType()
+                           .cast<MemRefType>()
+                           .getRank();
         }
-
-        // If the sink op is channel put
-        else if (auto sink_op_channel_put =
-                     dyn_cast<air::ChannelPutOp>(sink_op)) {
-          unsigned numDimsSrc = sink_op_channel_put.getSrcMemref()
-                                    .getType()
-                                    .cast<MemRefType>()
-                                    .getRank();
-          for (unsigned i = 0; i < sink_op_channel_put.getSrcOffsets().size();
-               i++)
-            sink_op_scalar_ins.push_back(
-                sink_op_channel_put.getSrcOffsets()[i]);
-          for (unsigned i = 0; i < sink_op_channel_put.getSrcSizes().size();
-               i++)
-            sink_op_scalar_ins.push_back(sink_op_channel_put.getSrcSizes()[i]);
-          for (unsigned i = 0; i < sink_op_channel_put.getSrcStrides().size();
-               i++)
-            sink_op_scalar_ins.push_back(
-                sink_op_channel_put.getSrcStrides()[i]);
-          SmallVector<Value, 2> src_indices;
-          if (sink_op_channel_put.getSrcOffsets().size()) {
+        // Special case with ND DMA op
+        if (auto sink_op_nddma = dyn_cast<air::DmaMemcpyNdOp>(sink_op)) {
+          // air.dmamemcpynd op has extra scalar operands
+          for (unsigned i = 0; i < sink_op_nddma.getDstOffsets().size(); i++)
+            sink_op_scalar_outs.push_back(sink_op_nddma.getDstOffsets()[i]);
+          for (unsigned i = 0; i < sink_op_nddma.getDstSizes().size(); i++)
+            sink_op_scalar_outs.push_back(sink_op_nddma.getDstSizes()[i]);
+          for (unsigned i = 0; i < sink_op_nddma.getDstStrides().size(); i++)
+            sink_op_scalar_outs.push_back(sink_op_nddma.getDstStrides()[i]);
+          for (unsigned i = 0; i < sink_op_nddma.getSrcOffsets().size(); i++)
+            sink_op_scalar_ins.push_back(sink_op_nddma.getSrcOffsets()[i]);
+          for (unsigned i = 0; i < sink_op_nddma.getSrcSizes().size(); i++)
+            sink_op_scalar_ins.push_back(sink_op_nddma.getSrcSizes()[i]);
+          for (unsigned i = 0; i < sink_op_nddma.getSrcStrides().size(); i++)
+            sink_op_scalar_ins.push_back(sink_op_nddma.getSrcStrides()[i]);
+          if (sink_op_nddma.getSrcOffsets().size()) {
             for (unsigned i = 0; i < numDimsSrc; i++) {
-              src_indices.push_back(sink_op_channel_put.getSrcOffsets()[i]);
+              src_indices.push_back(sink_op_nddma.getSrcOffsets()[i]);
             }
           } else {
             for (unsigned i = 0; i < numDimsSrc; i++) {
               src_indices.push_back(nullptr);
             }
           }
-          partialMemref tile_in = createPartialMemref(
-              sink_op_channel_put.getSrcMemref(), numDimsSrc, src_indices);
-          sink_op_memref_reads.push_back(tile_in);
-        }
-
-        // If the sink op is channel get
-        else if (auto sink_op_channel_get =
-                     dyn_cast<air::ChannelGetOp>(sink_op)) {
-          unsigned numDimsDst = sink_op_channel_get.getDstMemref()
-                                    .getType()
-                                    .cast<MemRefType>()
-                                    .getRank();
-          for (unsigned i = 0; i < sink_op_channel_get.getDstOffsets().size();
-               i++)
-            sink_op_scalar_outs.push_back(
-                sink_op_channel_get.getDstOffsets()[i]);
-          for (unsigned i = 0; i < sink_op_channel_get.getDstSizes().size();
-               i++)
-            sink_op_scalar_outs.push_back(sink_op_channel_get.getDstSizes()[i]);
-          for (unsigned i = 0; i < sink_op_channel_get.getDstStrides().size();
-               i++)
-            sink_op_scalar_outs.push_back(
-                sink_op_channel_get.getDstStrides()[i]);
-          SmallVector<Value, 2> dst_indices;
-          if (sink_op_channel_get.getDstOffsets().size()) {
+          if (sink_op_nddma.getDstOffsets().size()) {
             for (unsigned i = 0; i < numDimsDst; i++) {
-              dst_indices.push_back(sink_op_channel_get.getDstOffsets()[i]);
+              dst_indices.push_back(sink_op_nddma.getDstOffsets()[i]);
             }
           } else {
             for (unsigned i = 0; i < numDimsDst; i++) {
               dst_indices.push_back(nullptr);
             }
           }
-          partialMemref tile_out = createPartialMemref(
-              sink_op_channel_get.getDstMemref(), numDimsDst, dst_indices);
-          sink_op_memref_writes.push_back(tile_out);
+        } else {
+          for (unsigned i = 0; i < numDimsSrc; i++) {
+            sink_op_scalar_ins.push_back(sink_op_dma.getSrcMemrefDim(i));
+            src_indices.push_back(sink_op_dma.getSrcMemrefDim(i));
+          }
+          for (unsigned i = 0; i < numDimsDst; i++) {
+            sink_op_scalar_outs.push_back(sink_op_dma.getDstMemrefDim(i));
+            dst_indices.push_back(sink_op_dma.getDstMemrefDim(i));
+          }
         }
+        partialMemref tile_in = createPartialMemref(
+            sink_op_dma.getSrcMemref(), numDimsSrc, src_indices);
+        if (auto sink_op_nddma = dyn_cast<air::DmaMemcpyNdOp>(sink_op))
+          setPartialMemrefExtents(tile_in, sink_op_nddma.getSrcOffsets(),
+                                  sink_op_nddma.getSrcSizes(),
+                                  sink_op_nddma.getSrcStrides());
+        sink_op_memref_reads.push_back(tile_in);
+        partialMemref tile_out = createPartialMemref(
+            sink_op_dma.getDstMemref(), numDimsDst, dst_indices);
+        if (auto sink_op_nddma = dyn_cast<air::DmaMemcpyNdOp>(sink_op))
+          setPartialMemrefExtents(tile_out, sink_op_nddma.getDstOffsets(),
+                                  sink_op_nddma.getDstSizes(),
+                                  sink_op_nddma.getDstStrides());
+        sink_op_memref_writes.push_back(tile_out);
+      }
 
-        // If the sink op is arith::MulIOp
-        else if (auto sink_op_arith = dyn_cast<arith::MulIOp>(sink_op)) {
-          sink_op_scalar_ins.push_back(sink_op_arith.getLhs());
-          sink_op_scalar_ins.push_back(sink_op_arith.getRhs());
-          sink_op_scalar_outs.push_back(sink_op_arith.getResult());
+      // If the sink op is channel put
+      else if (auto sink_op_channel_put =
+                   dyn_cast<air::ChannelPutOp>(sink_op)) {
+        unsigned numDimsSrc = sink_op_channel_put.getSrcMemref()
+                                  .getType()
+                                  .cast<MemRefType>()
+                                  .getRank();
+        for (unsigned i = 0; i < sink_op_channel_put.getSrcOffsets().size();
+             i++)
+          sink_op_scalar_ins.push_back(
+              sink_op_channel_put.getSrcOffsets()[i]);
+        for (unsigned i = 0; i < sink_op_channel_put.getSrcSizes().size();
+             i++)
+          sink_op_scalar_ins.push_back(sink_op_channel_put.getSrcSizes()[i]);
+        for (unsigned i = 0; i < sink_op_channel_put.getSrcStrides().size();
+             i++)
+          sink_op_scalar_ins.push_back(
+              sink_op_channel_put.getSrcStrides()[i]);
+        SmallVector<Value, 2> src_indices;
+        if (sink_op_channel_put.getSrcOffsets().size()) {
+          for (unsigned i = 0; i < numDimsSrc; i++) {
+            src_indices.push_back(sink_op_channel_put.getSrcOffsets()[i]);
+          }
+        } else {
+          for (unsigned i = 0; i < numDimsSrc; i++) {
+            src_indices.push_back(nullptr);
+          }
         }
+        partialMemref tile_in = createPartialMemref(
+            sink_op_channel_put.getSrcMemref(), numDimsSrc, src_indices);
+        setPartialMemrefExtents(tile_in, sink_op_channel_put.getSrcOffsets(),
+                                sink_op_channel_put.getSrcSizes(),
+                                sink_op_channel_put.getSrcStrides());
+        sink_op_memref_reads.push_back(tile_in);
+      }
 
-        // If the sink op is arith::AddIOp
-        else if (auto sink_op_arith = dyn_cast<arith::AddIOp>(sink_op)) {
-          sink_op_scalar_ins.push_back(sink_op_arith.getLhs());
-          sink_op_scalar_ins.push_back(sink_op_arith.getRhs());
-          sink_op_scalar_outs.push_back(sink_op_arith.getResult());
+      // If the sink op is channel get
+      else if (auto sink_op_channel_get =
+                   dyn_cast<air::ChannelGetOp>(sink_op)) {
+        unsigned numDimsDst = sink_op_channel_get.getDstMemref()
+                                  .getType()
+                                  .cast<MemRefType>()
+                                  .getRank();
+        for (unsigned i = 0; i < sink_op_channel_get.getDstOffsets().size();
+             i++)
+          sink_op_scalar_outs.push_back(
+              sink_op_channel_get.getDstOffsets()[i]);
+        for (unsigned i = 0; i < sink_op_channel_get.getDstSizes().size();
+             i++)
+          sink_op_scalar_outs.push_back(sink_op_channel_get.getDstSizes()[i]);
+        for (unsigned i = 0; i < sink_op_channel_get.getDstStrides().size();
+             i++)
+          sink_op_scalar_outs.push_back(
+              sink_op_channel_get.getDstStrides()[i]);
+        SmallVector<Value, 2> dst_indices;
+        if (sink_op_channel_get.getDstOffsets().size()) {
+          for (unsigned i = 0; i < numDimsDst; i++) {
+            dst_indices.push_back(sink_op_channel_get.getDstOffsets()[i]);
+          }
+        } else {
+          for (unsigned i = 0; i < numDimsDst; i++) {
+            dst_indices.push_back(nullptr);
+          }
         }
+        partialMemref tile_out = createPartialMemref(
+            sink_op_channel_get.getDstMemref(), numDimsDst, dst_indices);
+        setPartialMemrefExtents(tile_out, sink_op_channel_get.getDstOffsets(),
+                                sink_op_channel_get.getDstSizes(),
+                                sink_op_channel_get.getDstStrides());
+        sink_op_memref_writes.push_back(tile_out);
+      }
 
-        // If the sink op is mlir::AffineApplyOp
-        else if (auto sink_op_apply = dyn_cast<mlir::AffineApplyOp>(sink_op)) {
-          for (auto applyop_operand : sink_op_apply.getMapOperands()) {
-            sink_op_scalar_ins.push_back(applyop_operand);
-          }
-          sink_op_scalar_outs.push_back(sink_op_apply.getResult());
+      // If the sink op is arith::MulIOp
+      else if (auto sink_op_arith = dyn_cast<arith::MulIOp>(sink_op)) {
+        sink_op_scalar_ins.push_back(sink_op_arith.getLhs());
+        sink_op_scalar_ins.push_back(sink_op_arith.getRhs());
+        sink_op_scalar_outs.push_back(sink_op_arith.getResult());
+      }
+
+      // If the sink op is arith::AddIOp
+      else if (auto sink_op_arith = dyn_cast<arith::AddIOp>(sink_op)) {
+        sink_op_scalar_ins.push_back(sink_op_arith.getLhs());
+        sink_op_scalar_ins.push_back(sink_op_arith.getRhs());
+        sink_op_scalar_outs.push_back(sink_op_arith.getResult());
+      }
+
+      // If the sink op is mlir::AffineApplyOp
+      else if (auto sink_op_apply = dyn_cast<mlir::AffineApplyOp>(sink_op)) {
+        for (auto applyop_operand : sink_op_apply.getMapOperands()) {
+          sink_op_scalar_ins.push_back(applyop_operand);
         }
+        sink_op_scalar_outs.push_back(sink_op_apply.getResult());
+      }
 
-        // If the sink op is an unknown op
-        else {
-          for (auto sink_op_op : sink_op->getOperands()) {
-            if (sink_op_op.getType().isa<MemRefType>()) {
+      // If the sink op is an unknown op
+      else {
+        for (auto sink_op_op : sink_op->getOperands()) {
+          if (sink_op_op.getType().isa<MemRefType>()) {
+            unsigned memRefRank =
+                sink_op_op.getType().cast<MemRefType>().getRank();
+            partialMemref tile = createPartialMemref(sink_op_op, memRefRank);
+            sink_op_memref_reads.push_back(
+                tile); // Assuming all operands are both read and written to
+            sink_op_memref_writes.push_back(tile);
+          } else if (sink_op_op.getType().isa<IndexType>()) {
+            sink_op_scalar_ins.push_back(
+                sink_op_op); // Assuming all operands are both read and
+                             // written to
+            sink_op_scalar_outs.push_back(sink_op_op);
+          }
+        }
+        if (sink_op->getNumResults()) {
+          for (auto sink_op_results : sink_op->getResults()) {
+            if (sink_op_results.getType().isa<MemRefType>()) {
               unsigned memRefRank =
-                  sink_op_op.getType().cast<MemRefType>().getRank();
-              partialMemref tile = createPartialMemref(sink_op_op, memRefRank);
-              sink_op_memref_reads.push_back(
-                  tile); // Assuming all operands are both read and written to
+                  sink_op_results.getType().cast<MemRefType>().getRank();
+              partialMemref tile =
+                  createPartialMemref(sink_op_results, memRefRank);
               sink_op_memref_writes.push_back(tile);
-            } else if (sink_op_op.getType().isa<IndexType>()) {
-              sink_op_scalar_ins.push_back(
-                  sink_op_op); // Assuming all operands are both read and
-                               // written to
-              sink_op_scalar_outs.push_back(sink_op_op);
-            }
-          }
-          if (sink_op->getNumResults()) {
-            for (auto sink_op_results : sink_op->getResults()) {
-              if (sink_op_results.getType().isa<MemRefType>()) {
-                unsigned memRefRank =
-                    sink_op_results.getType().cast<MemRefType>().getRank();
-                partialMemref tile =
-                    createPartialMemref(sink_op_results, memRefRank);
-                sink_op_memref_writes.push_back(tile);
-              } else if (sink_op_results.getType().isa<IndexType>()) {
-                sink_op_scalar_outs.push_back(sink_op_results);
-              }
+            } else if (sink_op_results.getType().isa<IndexType>()) {
+              sink_op_scalar_outs.push_back(sink_op_results);
             }
           }
         }
+      }
 
-        // Detect dependencies
-        if (auto async_execute_op = dyn_cast<air::ExecuteOp>(op)) {
-          // Detect RAW deps
-          traceDeps<air::ExecuteOp>(sink_op_memref_reads, async_execute_op,
-                                    "RAW");
-          // Detect WAW and WAR deps
-          traceDeps<air::ExecuteOp>(sink_op_memref_writes, async_execute_op,
-                                    "WAW/WAR");
-          // Detect tile index deps
-          traceTileIndices(sink_op_memref_reads, sink_op_memref_writes,
-                           sink_op_scalar_ins, sink_op_scalar_outs,
-                           async_execute_op);
-          // Keep track of processed async execute region ops. Deps should point
-          // to the past, not future.
-          async_execute_op_history.push_back(async_execute_op);
-        } else if (auto dma_op =
-                       mlir::dyn_cast<xilinx::air::DmaMemcpyInterface>(op)) {
-          traceDeps<air::DmaMemcpyInterface>(sink_op_memref_reads, dma_op,
-                                             "RAW");
-          traceDeps<air::DmaMemcpyInterface>(sink_op_memref_writes, dma_op,
-                                             "WAW/WAR");
-          traceTileIndices(sink_op_memref_reads, sink_op_memref_writes,
-                           sink_op_scalar_ins, sink_op_scalar_outs, dma_op);
-          dma_op_history.push_back(dma_op);
-        } else if (auto channel_op =
-                       mlir::dyn_cast<xilinx::air::ChannelInterface>(op)) {
-          traceDeps<air::ChannelInterface>(sink_op_memref_reads, channel_op,
+      // Detect dependencies
+      if (auto async_execute_op = dyn_cast<air::ExecuteOp>(op)) {
+        // Detect RAW deps
+        traceDeps<air::ExecuteOp>(sink_op_memref_reads, async_execute_op,
+                                  "RAW");
+        // Detect WAW and WAR deps
+        traceDeps<air::ExecuteOp>(sink_op_memref_writes, async_execute_op,
+                                  "WAW/WAR");
+        // Detect tile index deps
+        traceTileIndices(sink_op_memref_reads, sink_op_memref_writes,
+                         sink_op_scalar_ins, sink_op_scalar_outs,
+                         async_execute_op);
+        // Keep track of processed async execute region ops. Deps should point
+        // to the past, not future.
+        async_execute_op_history.push_back(async_execute_op);
+      } else if (auto dma_op =
+                     mlir::dyn_cast<xilinx::air::DmaMemcpyInterface>(op)) {
+        traceDeps<air::DmaMemcpyInterface>(sink_op_memref_reads, dma_op,
                                            "RAW");
-          traceDeps<air::ChannelInterface>(sink_op_memref_writes, channel_op,
+        traceDeps<air::DmaMemcpyInterface>(sink_op_memref_writes, dma_op,
                                            "WAW/WAR");
-          traceTileIndices(sink_op_memref_reads, sink_op_memref_writes,
-                           sink_op_scalar_ins, sink_op_scalar_outs, channel_op);
-          channel_op_history.push_back(channel_op);
-        } else if (auto hier_op = dyn_cast<air::HierarchyInterface>(op)) {
-          hier_op_history.push_back(hier_op);
-        }
-      });
-    }
+        traceTileIndices(sink_op_memref_reads, sink_op_memref_writes,
+                         sink_op_scalar_ins, sink_op_scalar_outs, dma_op);
+        dma_op_history.push_back(dma_op);
+      } else if (auto channel_op =
+                     mlir::dyn_cast<xilinx::air::ChannelInterface>(op)) {
+        traceDeps<air::ChannelInterface>(sink_op_memref_reads, channel_op,
+                                         "RAW");
+        traceDeps<air::ChannelInterface>(sink_op_memref_writes, channel_op,
+                                         "WAW/WAR");
+        traceTileIndices(sink_op_memref_reads, sink_op_memref_writes,
+                         sink_op_scalar_ins, sink_op_scalar_outs, channel_op);
+        channel_op_history.push_back(channel_op);
+      } else if (auto hier_op = dyn_cast<air::HierarchyInterface>(op)) {
+        hier_op_history.push_back(hier_op);
+      }
+    });
+  }
 
-    // 3rd traversal: perform transitive reduction on dependency graph.
-
-    std::vector<size_t> id_map(num_vertices(asyncExecuteGraph));
-    std::iota(id_map.begin(), id_map.end(), 0u);
-
-    transitive_reduction(asyncExecuteGraph, asyncExecuteGraphTR,
-                         make_assoc_property_map(g_to_tr), id_map.data());
-
-    for (vertex_map::iterator i = g_to_tr.begin(); i != g_to_tr.end(); ++i) {
-      // Copy over graph properties
-      asyncExecuteGraphTR[i->second].asyncEventName =
-          asyncExecuteGraph[i->first].asyncEventName;
-      asyncExecuteGraphTR[i->second].asyncEventType =
-          asyncExecuteGraph[i->first].asyncEventType;
-      asyncExecuteGraphTR[i->second].color = asyncExecuteGraph[i->first].color;
-      asyncExecuteGraphTR[i->second].shape = asyncExecuteGraph[i->first].shape;
-      asyncExecuteGraphTR[i->second].operationId =
-          asyncExecuteGraph[i->first].operationId;
-      // Build reverse map tr_to_g, for convenient vertex mapping
-      tr_to_g[i->second] = i->first;
-    }
+  // 3rd traversal: perform transitive reduction on dependency graph; fill the
+  // dep lists of the async ops.
+  void fillDependencyLists() {
+    auto csr_tr =
+        dependencyCSRGraph(asyncExecuteGraph).getTransitiveReduction(tr_to_g);
+    asyncExecuteGraphTRDeps = csr_tr.getTranspose();
+    g_to_tr.resize(tr_to_g.size());
+    for (unsigned v = 0; v < tr_to_g.size(); v++)
+      g_to_tr[tr_to_g[v]] = v;
+
+    f.walk([&](Operation *op) {
+      // Fill dep list of air execute ops
+      if (auto async_execute_op = dyn_cast<air::ExecuteOp>(op)) {
+        fillAIRDepListUsingGraphTR<air::ExecuteOp>(async_execute_op);
+      }
+      // Fill dep list of air dmamemcpy2d ops
+      else if (auto dma_op = dyn_cast<air::DmaMemcpyInterface>(op)) {
+        fillAIRDepListUsingGraphTR<air::DmaMemcpyInterface>(dma_op);
+      }
+      // Fill dep list of air channel ops
+      else if (auto channel_op = dyn_cast<air::ChannelInterface>(op)) {
+        fillAIRDepListUsingGraphTR<air::ChannelInterface>(channel_op);
+      }
+      // Fill dep list of air hierarchy ops
+      else if (auto hier_op = dyn_cast<air::HierarchyInterface>(op)) {
+        fillAIRDepListUsingGraphTR<air::HierarchyInterface>(hier_op);
+      }
+    });
+  }
 
-    for (auto f : module.getOps<func::FuncOp>()) {
-      f.walk([&](Operation *op) {
-        // Fill dep list of air execute ops
-        if (auto async_execute_op = dyn_cast<air::ExecuteOp>(op)) {
-          fillAIRDepListUsingGraphTR<air::ExecuteOp>(async_execute_op);
-        }
-        // Fill dep list of air dmamemcpy2d ops
-        else if (auto dma_op = dyn_cast<air::DmaMemcpyInterface>(op)) {
-          fillAIRDepListUsingGraphTR<air::DmaMemcpyInterface>(dma_op);
-        }
-        // Fill dep list of air channel ops
-        else if (auto channel_op = dyn_cast<air::ChannelInterface>(op)) {
-          fillAIRDepListUsingGraphTR<air::ChannelInterface>(channel_op);
-        }
-        // Fill dep list of air hierarchy ops
-        else if (auto hier_op = dyn_cast<air::HierarchyInterface>(op)) {
-          fillAIRDepListUsingGraphTR<air::HierarchyInterface>(hier_op);
+  // 4th traversal: loop-carried deps.
+  // Add wait_all events to collect sinks in loop bodies. Add iter_args to scp
+  // for loops representing loop-carried deps.
+  void traceLoopCarriedDeps(OpBuilder &builder) {
+    f.walk([&](Operation *op) {
+      if (scf::ForOp for_op = dyn_cast<scf::ForOp>(op)) {
+
+        bool hasAsyncTokensInBody = false;
+        SmallVector<Value, 1> yielded_tokens_in_for_op;
+
+        // Conservative loop-carried dependency: no pipelining
+        // TODO: loop pipelining support
+        for (auto async_op : for_op.getOps<air::AsyncOpInterface>()) {
+          hasAsyncTokensInBody = true;
+          auto token = async_op.getOperation()->getResult(0);
+          if (!isNotLoopCarriedOp(async_op) &&
+              isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody())) {
+            yielded_tokens_in_for_op.push_back(token);
+          }
         }
-      });
-    }
-
-    // 4th traversal: loop-carried deps.
-    // Add wait_all events to collect sinks in loop bodies. Add iter_args to scp
-    // for loops representing loop-carried deps.
-
-    for (auto f : module.getOps<func::FuncOp>()) {
-      f.walk([&](Operation *op) {
-        if (scf::ForOp for_op = dyn_cast<scf::ForOp>(op)) {
-
-          bool hasAsyncTokensInBody = false;
-          SmallVector<Value, 1> yielded_tokens_in_for_op;
-
-          // Conservative loop-carried dependency: no pipelining
-          // TODO: loop pipelining support
-          for (auto async_op : for_op.getOps<air::AsyncOpInterface>()) {
-            hasAsyncTokensInBody = true;
-            auto token = async_op.getOperation()->getResult(0);
-            if (!isNotLoopCarriedOp(async_op) &&
-                isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody())) {
+        for (auto child_for_op : for_op.getOps<scf::ForOp>()) {
+          hasAsyncTokensInBody = true;
+          if (auto token = child_for_op.getResult(0)) {
+            if (isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody()))
               yielded_tokens_in_for_op.push_back(token);
-            }
-          }
-          for (auto child_for_op : for_op.getOps<scf::ForOp>()) {
-            hasAsyncTokensInBody = true;
-            if (auto token = child_for_op.getResult(0)) {
-              if (isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody()))
-                yielded_tokens_in_for_op.push_back(token);
-            }
           }
-          for (auto child_parallel_op : for_op.getOps<scf::ParallelOp>()) {
-            hasAsyncTokensInBody = true;
-            if (auto token = child_parallel_op.getResult(0)) {
-              if (isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody()))
-                yielded_tokens_in_for_op.push_back(token);
-            }
+        }
+        for (auto child_parallel_op : for_op.getOps<scf::ParallelOp>()) {
+          hasAsyncTokensInBody = true;
+          if (auto token = child_parallel_op.getResult(0)) {
+            if (isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody()))
+              yielded_tokens_in_for_op.push_back(token);
           }
+        }
 
-          if (hasAsyncTokensInBody) {
-            insertLoopCarriedDeps(module_builder, for_op,
-                                  yielded_tokens_in_for_op);
-          }
+        if (hasAsyncTokensInBody) {
+          insertLoopCarriedDeps(builder, for_op, yielded_tokens_in_for_op);
         }
+      }
 
-        else if (scf::ParallelOp for_op = dyn_cast<scf::ParallelOp>(op)) {
+      else if (scf::ParallelOp for_op = dyn_cast<scf::ParallelOp>(op)) {
 
-          bool hasAsyncTokensInBody = false;
-          SmallVector<Value, 1> yielded_tokens_in_parallel_op;
+        bool hasAsyncTokensInBody = false;
+        SmallVector<Value, 1> yielded_tokens_in_parallel_op;
 
-          for (auto async_op : for_op.getOps<air::AsyncOpInterface>()) {
-            hasAsyncTokensInBody = true;
-            auto token = async_op.getOperation()->getResult(0);
-            if (!isNotLoopCarriedOp(async_op) &&
-                isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody())) {
-              yielded_tokens_in_parallel_op.push_back(token);
-            }
+        for (auto async_op : for_op.getOps<air::AsyncOpInterface>()) {
+          hasAsyncTokensInBody = true;
+          auto token = async_op.getOperation()->getResult(0);
+          if (!isNotLoopCarriedOp(async_op) &&
+              isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody())) {
+            yielded_tokens_in_parallel_op.push_back(token);
           }
-          for (auto child_for_op : for_op.getOps<scf::ForOp>()) {
-            hasAsyncTokensInBody = true;
-            if (auto token = child_for_op.getResult(0)) {
-              if (isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody()))
-                yielded_tokens_in_parallel_op.push_back(token);
-            }
+        }
+        for (auto child_for_op : for_op.getOps<scf::ForOp>()) {
+          hasAsyncTokensInBody = true;
+          if (auto token = child_for_op.getResult(0)) {
+            if (isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody()))
+              yielded_tokens_in_parallel_op.push_back(token);
           }
-          for (auto child_parallel_op : for_op.getOps<scf::ParallelOp>()) {
-            hasAsyncTokensInBody = true;
-            if (auto token = child_parallel_op.getResult(0)) {
-              if (isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody()))
-                yielded_tokens_in_parallel_op.push_back(token);
-            }
+        }
+        for (auto child_parallel_op : for_op.getOps<scf::ParallelOp>()) {
+          hasAsyncTokensInBody = true;
+          if (auto token = child_parallel_op.getResult(0)) {
+            if (isOnlyUsedByNoLoopCarryOpsInBlock(token, for_op.getBody()))
+              yielded_tokens_in_parallel_op.push_back(token);
           }
+        }
 
-          if (hasAsyncTokensInBody) {
-            insertLoopCarriedDeps(module_builder, for_op,
-                                  yielded_tokens_in_parallel_op);
-          }
+        if (hasAsyncTokensInBody) {
+          insertLoopCarriedDeps(builder, for_op, yielded_tokens_in_parallel_op);
         }
-      });
-    }
+      }
+    });
+  }
+
+  // Shift the ids of the async ops created in this function past those of the
+  // preceding functions, whose counts are accumulated in the arguments.
+  void offsetIds(uint64_t &executeOps, uint64_t &hierarchyOps,
+                 uint64_t &waitAllOps, uint64_t &channelOps) {
+    for (auto op : async_execute_op_history)
+      offsetId(op, executeOps);
+    for (auto op : hier_op_history)
+      offsetId(op, hierarchyOps);
+    for (auto op : wait_all_op_history)
+      offsetId(op, waitAllOps);
+    for (auto op : channel_op_history)
+      offsetId(op, channelOps);
+    executeOps += ExecuteOpID;
+    hierarchyOps += HierarchyOpID;
+    waitAllOps += WaitAllOpID;
+    channelOps += ChannelOpID;
   }
 
 private:
+  func::FuncOp f;
+
+  // Async op ids, numbered from 1 in each function so that functions can be
+  // traced in parallel; offsetIds makes them unique across the module.
+  uint64_t ExecuteOpID = 0;
+  uint64_t HierarchyOpID = 0;
+  uint64_t WaitAllOpID = 0;
+  uint64_t ChannelOpID = 0;
+
+  void offsetId(Operation *op, uint64_t offset) {
+    auto id = op->getAttrOfType<IntegerAttr>("id");
+    if (!offset || !id)
+      return;
+    op->setAttr("id", IntegerAttr::get(id.getType(), id.getInt() + offset));
+  }
+
   //===----------------------------------------------------------------------===//
   // Creating async events
   //===----------------------------------------------------------------------===//
@@ -691,6 +696,7 @@ private:
   std::vector<air::DmaMemcpyInterface> dma_op_history;
   std::vector<air::ChannelInterface> channel_op_history;
   std::vector<air::HierarchyInterface> hier_op_history;
+  std::vector<air::WaitAllOp> wait_all_op_history;
 
   // Create air execute op with async interface (no ssa result returned); update
   // graph
@@ -973,12 +979,6 @@ private:
   // Data dependency tracing
   //===----------------------------------------------------------------------===//
 
-  struct partialMemref {
-    Value memrefValue;
-    unsigned numDims;
-    SmallVector<Value, 2> memrefIndices;
-  };
-
   partialMemref createPartialMemref(mlir::Value memrefValue, unsigned numDims) {
     partialMemref tile;
     tile.memrefValue = memrefValue;
@@ -1145,13 +1145,20 @@ private:
               createPartialMemref(dma.getSrcMemref(), numDimsSrc, src_indices);
           partialMemref dma_dst =
               createPartialMemref(dma.getDstMemref(), numDimsDst, dst_indices);
+          if (auto nddma =
+                  dyn_cast<xilinx::air::DmaMemcpyNdOp>(dma.getOperation())) {
+            setPartialMemrefExtents(dma_src, nddma.getSrcOffsets(),
+                                    nddma.getSrcSizes(), nddma.getSrcStrides());
+            setPartialMemrefExtents(dma_dst, nddma.getDstOffsets(),
+                                    nddma.getDstSizes(), nddma.getDstStrides());
+          }
 
           if (rw == 'r') {
             if (u.is(dma.getSrcMemref())) {
               if (tile == nullptr) {
                 addAsyncDepToGraphIfNew<T>(dma.getOperation()->getResult(0),
                                            op);
-              } else if (areEqualIndexPartialMemrefs(tile, &dma_src))
+              } else if (areOverlappingPartialMemrefs(tile, &dma_src))
                 addAsyncDepToGraphIfNew<T>(dma.getOperation()->getResult(0),
                                            op);
             }
@@ -1160,7 +1167,7 @@ private:
               if (tile == nullptr) {
                 addAsyncDepToGraphIfNew<T>(dma.getOperation()->getResult(0),
                                            op);
-              } else if (areEqualIndexPartialMemrefs(tile, &dma_dst))
+              } else if (areOverlappingPartialMemrefs(tile, &dma_dst))
                 addAsyncDepToGraphIfNew<T>(dma.getOperation()->getResult(0),
                                            op);
             }
@@ -1168,11 +1175,11 @@ private:
             if (tile == nullptr) {
               addAsyncDepToGraphIfNew<T>(dma.getOperation()->getResult(0), op);
             } else if (u.is(dma.getDstMemref())) {
-              if (areEqualIndexPartialMemrefs(tile, &dma_dst))
+              if (areOverlappingPartialMemrefs(tile, &dma_dst))
                 addAsyncDepToGraphIfNew<T>(dma.getOperation()->getResult(0),
                                            op);
             } else if (u.is(dma.getSrcMemref())) {
-              if (areEqualIndexPartialMemrefs(tile, &dma_src))
+              if (areOverlappingPartialMemrefs(tile, &dma_src))
                 addAsyncDepToGraphIfNew<T>(dma.getOperation()->getResult(0),
                                            op);
             }
@@ -1203,13 +1210,17 @@ private:
             }
             partialMemref channel_put_src = createPartialMemref(
                 channel_put.getSrcMemref(), numDimsSrc, src_indices);
+            setPartialMemrefExtents(channel_put_src,
+                                    channel_put.getSrcOffsets(),
+                                    channel_put.getSrcSizes(),
+                                    channel_put.getSrcStrides());
 
             if (rw == 'r') {
               if (u.is(channel_put.getSrcMemref())) {
                 if (tile == nullptr) {
                   addAsyncDepToGraphIfNew<T>(
                       channel_put.getOperation()->getResult(0), op);
-                } else if (areEqualIndexPartialMemrefs(tile, &channel_put_src))
+                } else if (areOverlappingPartialMemrefs(tile, &channel_put_src))
                   addAsyncDepToGraphIfNew<T>(
                       channel_put.getOperation()->getResult(0), op);
               }
@@ -1219,7 +1230,7 @@ private:
                 addAsyncDepToGraphIfNew<T>(
                     channel_put.getOperation()->getResult(0), op);
               } else if (u.is(channel_put.getSrcMemref())) {
-                if (areEqualIndexPartialMemrefs(tile, &channel_put_src))
+                if (areOverlappingPartialMemrefs(tile, &channel_put_src))
                   addAsyncDepToGraphIfNew<T>(
                       channel_put.getOperation()->getResult(0), op);
               }
@@ -1242,6 +1253,10 @@ private:
             }
             partialMemref channel_get_dst = createPartialMemref(
                 channel_get.getDstMemref(), numDimsDst, dst_indices);
+            setPartialMemrefExtents(channel_get_dst,
+                                    channel_get.getDstOffsets(),
+                                    channel_get.getDstSizes(),
+                                    channel_get.getDstStrides());
 
             if (rw == 'r') {
             } else if (rw == 'w') {
@@ -1249,7 +1264,7 @@ private:
                 if (tile == nullptr) {
                   addAsyncDepToGraphIfNew<T>(
                       channel_get.getOperation()->getResult(0), op);
-                } else if (areEqualIndexPartialMemrefs(tile, &channel_get_dst))
+                } else if (areOverlappingPartialMemrefs(tile, &channel_get_dst))
                   addAsyncDepToGraphIfNew<T>(
                       channel_get.getOperation()->getResult(0), op);
               }
@@ -1258,7 +1273,7 @@ private:
                 addAsyncDepToGraphIfNew<T>(
                     channel_get.getOperation()->getResult(0), op);
               } else if (u.is(channel_get.getDstMemref())) {
-                if (areEqualIndexPartialMemrefs(tile, &channel_get_dst))
+                if (areOverlappingPartialMemrefs(tile, &channel_get_dst))
                   addAsyncDepToGraphIfNew<T>(
                       channel_get.getOperation()->getResult(0), op);
               }
@@ -1365,8 +1380,18 @@ private:
       // Check if operand is returned from memref.subview
       if (auto subview =
               operand.memrefValue.getDefiningOp<memref::SubViewOp>()) {
+        // Static offsets span their whole dim
+        SmallVector<Value, 2> subview_offsets;
+        for (auto offset : subview.getMixedOffsets())
+          subview_offsets.push_back(offset.dyn_cast<Value>());
         partialMemref subview_tile = createPartialMemref(
-            subview.getSource(), subview.sizes().size(), subview.offsets());
+            subview.getSource(), subview_offsets.size(), subview_offsets);
+        // Subview strides scale those of the source layout, so that only
+        // unit strides match the tile's element ranges
+        if (llvm::all_of(subview.getMixedStrides(), [](OpFoldResult stride) {
+              return isConstantIntValue(stride, 1);
+            }))
+          setPartialMemrefExtents(subview_tile, subview.getMixedSizes(), {});
         SmallVector<partialMemref, 1> subview_operands = {subview_tile};
         traceDeps<T>(subview_operands, sink_air_op, dep_type);
       }
@@ -1400,53 +1425,6 @@ private:
   // SCF for loop-carried dependency
   //===----------------------------------------------------------------------===//
 
-  void insertVertexBetweenTwoOps(Operation *a, Operation *b,
-                                 Graph::vertex_descriptor v) {
-    unsigned v_a = 0;
-    unsigned v_b = 0;
-    if (auto op = dyn_cast<air::ExecuteOp>(a)) {
-      v_a = g_to_tr[getGraphGVertexFromAIROp(op)];
-    } else if (auto op = mlir::dyn_cast<air::DmaMemcpyInterface>(a)) {
-      v_a = g_to_tr[getGraphGVertexFromAIROp(op)];
-    } else if (auto op = mlir::dyn_cast<air::ChannelInterface>(a)) {
-      v_a = g_to_tr[getGraphGVertexFromAIROp(op)];
-    } else if (auto op = dyn_cast<air::HierarchyInterface>(a)) {
-      v_a = g_to_tr[getGraphGVertexFromAIROp(op)];
-    } else if (auto op = dyn_cast<scf::ForOp>(a)) {
-      v_a = getGraphGVertexFromAIROp(
-          op); // g_to_tr not needed since wait_all is created after TR
-    } else if (auto op = dyn_cast<scf::ParallelOp>(a)) {
-      v_a = getGraphGVertexFromAIROp(
-          op); // g_to_tr not needed since wait_all is created after TR
-    } else if (auto op = dyn_cast<air::WaitAllOp>(a)) {
-      v_a = getGraphGVertexFromAIROp(op);
-    }
-    if (auto op = dyn_cast<air::ExecuteOp>(b)) {
-      v_b = g_to_tr[getGraphGVertexFromAIROp(op)];
-    } else if (auto op = mlir::dyn_cast<air::DmaMemcpyInterface>(b)) {
-      v_b = g_to_tr[getGraphGVertexFromAIROp(op)];
-    } else if (auto op = mlir::dyn_cast<air::ChannelInterface>(b)) {
-      v_b = g_to_tr[getGraphGVertexFromAIROp(op)];
-    } else if (auto op = dyn_cast<air::HierarchyInterface>(b)) {
-      v_b = g_to_tr[getGraphGVertexFromAIROp(op)];
-    } else if (auto op = dyn_cast<scf::ForOp>(b)) {
-      v_b = getGraphGVertexFromAIROp(
-          op); // g_to_tr not needed since wait_all is created after TR
-    } else if (auto op = dyn_cast<scf::ParallelOp>(b)) {
-      v_b = getGraphGVertexFromAIROp(
-          op); // g_to_tr not needed since wait_all is created after TR
-    } else if (auto op = dyn_cast<air::WaitAllOp>(b)) {
-      v_b = getGraphGVertexFromAIROp(op);
-    }
-    if (edge(v_a, v_b, asyncExecuteGraphTR).second) { // if an edge exists
-      remove_edge(v_a, v_b, asyncExecuteGraphTR);
-      if (!edge(v_a, v, asyncExecuteGraphTR).second)
-        add_edge(v_a, v, asyncExecuteGraphTR);
-      if (!edge(v, v_b, asyncExecuteGraphTR).second)
-        add_edge(v, v_b, asyncExecuteGraphTR);
-    }
-  }
-
   template <typename T>
   air::WaitAllOp insertWaitAllOpBeforeLoopYield(
       OpBuilder &builder, T loop_op,
@@ -1463,55 +1441,14 @@ private:
         "id",
         mlir::IntegerAttr::get(
             mlir::IntegerType::get(loop_op->getContext(), 32), ++WaitAllOpID));
+    wait_all_op_history.push_back(wait_all_op_yielded);
     return wait_all_op_yielded;
   }
 
-  Graph::vertex_descriptor addVertexWaitAllOpBeforeLoopYield(
-      SmallVector<Value, 1> yielded_tokens_in_loop_op, std::string loop_type) {
-    // Create vertex
-    Graph::vertex_descriptor wait_all_op_yielded_v =
-        add_vertex(asyncExecuteGraphTR);
-    asyncExecuteGraphTR[wait_all_op_yielded_v].asyncEventName = "scf::";
-    asyncExecuteGraphTR[wait_all_op_yielded_v].asyncEventName += loop_type;
-    asyncExecuteGraphTR[wait_all_op_yielded_v].asyncEventName += "_loop_end";
-    asyncExecuteGraphTR[wait_all_op_yielded_v].asyncEventType = "wait_all";
-    asyncExecuteGraphTR[wait_all_op_yielded_v].color = "crimson";
-    asyncExecuteGraphTR[wait_all_op_yielded_v].shape = "oval";
-    asyncExecuteGraphTR[wait_all_op_yielded_v].operationId = 0;
-    // Update graph connectivity
-    for (auto token : yielded_tokens_in_loop_op) {
-      unsigned src_id = 0;
-      if (auto async_execute_op =
-              dyn_cast<air::ExecuteOp>(token.getDefiningOp())) {
-        src_id = g_to_tr[getGraphGVertexFromAIROp(async_execute_op)];
-      } else if (auto dma_op =
-                     dyn_cast<air::DmaMemcpyInterface>(token.getDefiningOp())) {
-        src_id = g_to_tr[getGraphGVertexFromAIROp(dma_op)];
-      } else if (auto channel_op =
-                     dyn_cast<air::ChannelInterface>(token.getDefiningOp())) {
-        src_id = g_to_tr[getGraphGVertexFromAIROp(channel_op)];
-      } else if (auto hier_op =
-                     dyn_cast<air::HierarchyInterface>(token.getDefiningOp())) {
-        src_id = g_to_tr[getGraphGVertexFromAIROp(hier_op)];
-      } else if (auto scf_for_op =
-                     dyn_cast<scf::ForOp>(token.getDefiningOp())) {
-        src_id = getGraphGVertexFromAIROp(
-            scf_for_op); // g_to_tr not needed since wait_all created after TR
-      } else if (auto scf_parallel_op =
-                     dyn_cast<scf::ParallelOp>(token.getDefiningOp())) {
-        src_id = getGraphGVertexFromAIROp(
-            scf_parallel_op); // g_to_tr not needed since wait_all created after
-                              // TR
-      }
-      add_edge(src_id, wait_all_op_yielded_v, asyncExecuteGraphTR);
-    }
-    return wait_all_op_yielded_v;
-  }
-
   template <typename T>
   air::WaitAllOp insertWaitAllOpAtLoopBegin(
-      OpBuilder &builder, T loop_op, std::string loop_type,
-      SmallVector<Value, 4> incoming_tokens, SmallVector<Value, 4> constants) {
+      OpBuilder &builder, T loop_op, SmallVector<Value, 4> incoming_tokens,
+      SmallVector<Value, 4> constants) {
     // Create a new wait_all event before the for op which collects the incoming
     // deps. Output token of wait_all shall be the iter_arg of for op.
     builder.setInsertionPoint(loop_op);
@@ -1523,28 +1460,7 @@ private:
         "id",
         mlir::IntegerAttr::get(
             mlir::IntegerType::get(loop_op->getContext(), 32), ++WaitAllOpID));
-
-    // Create vertex
-    Graph::vertex_descriptor wait_all_op_before_loop_v =
-        add_vertex(asyncExecuteGraphTR);
-    asyncExecuteGraphTR[wait_all_op_before_loop_v].asyncEventName = "scf::";
-    asyncExecuteGraphTR[wait_all_op_before_loop_v].asyncEventName += loop_type;
-    asyncExecuteGraphTR[wait_all_op_before_loop_v].asyncEventName +=
-        "_loop_begin";
-    asyncExecuteGraphTR[wait_all_op_before_loop_v].asyncEventType = "wait_all";
-    asyncExecuteGraphTR[wait_all_op_before_loop_v].color = "crimson";
-    asyncExecuteGraphTR[wait_all_op_before_loop_v].shape = "oval";
-    asyncExecuteGraphTR[wait_all_op_before_loop_v].operationId = 0;
-    // Update op-to-graph map
-    wa_to_g[wait_all_op_before_loop.getId()] = wait_all_op_before_loop_v;
-
-    // Update graph connectivity
-    for (Value v : incoming_tokens) {
-      for (auto user : v.getUsers()) {
-        insertVertexBetweenTwoOps(v.getDefiningOp(), user,
-                                  wait_all_op_before_loop_v);
-      }
-    }
+    wait_all_op_history.push_back(wait_all_op_before_loop);
 
     return wait_all_op_before_loop;
   }
@@ -1674,18 +1590,14 @@ private:
   // legal domination T: loop type (scf::ForOp or scf::ParallelOp) U: source op
   // type
   template <typename T, typename U>
-  void elevateAsyncTokens(T new_loop_op, Graph::vertex_descriptor wait_all_op) {
+  void elevateAsyncTokens(T new_loop_op) {
     for (auto source : new_loop_op.template getOps<U>()) {
       SmallPtrSet<Operation *, 1> keep;
       if (source->getResult(0)) {
         for (auto sink : source->getResult(0).getUsers()) {
           // Keep token if source already dominates sink
-          if (source->getParentOp()->isAncestor(sink)) {
+          if (source->getParentOp()->isAncestor(sink))
             keep.insert(sink);
-          } else {
-            // Update graph connectivity
-            insertVertexBetweenTwoOps(source.getOperation(), sink, wait_all_op);
-          }
         }
       }
       source->getResult(0).replaceAllUsesExcept(new_loop_op.getResult(0), keep);
@@ -1699,12 +1611,6 @@ private:
         insertWaitAllOpBeforeLoopYield<scf::ForOp>(builder, loop_op,
                                                    yielded_tokens_in_loop_op);
 
-    // Update boost graph
-    Graph::vertex_descriptor wait_all_op_yielded_v =
-        addVertexWaitAllOpBeforeLoopYield(yielded_tokens_in_loop_op, "for");
-    // Update op-to-graph map for wait_all ops
-    wa_to_g[wait_all_op_yielded.getId()] = wait_all_op_yielded_v;
-
     // (2) Create a new wait_all event before the for op which collects the
     // incoming deps.
     SmallVector<Value, 4> incoming_tokens;
@@ -1729,7 +1635,7 @@ private:
       }
     }
     air::WaitAllOp wait_all_op_before_loop =
-        insertWaitAllOpAtLoopBegin<scf::ForOp>(builder, loop_op, "for",
+        insertWaitAllOpAtLoopBegin<scf::ForOp>(builder, loop_op,
                                                incoming_tokens, constants);
 
     // (3) Create new for op with iter_args.
@@ -1744,12 +1650,9 @@ private:
 
     // Elevating tokens from inside forOp body to the yielded token, to maintain
     // dominance
-    elevateAsyncTokens<scf::ForOp, air::AsyncOpInterface>(
-        new_loop_op, wait_all_op_yielded_v);
-    elevateAsyncTokens<scf::ForOp, scf::ForOp>(new_loop_op,
-                                               wait_all_op_yielded_v);
-    elevateAsyncTokens<scf::ForOp, scf::ParallelOp>(new_loop_op,
-                                                    wait_all_op_yielded_v);
+    elevateAsyncTokens<scf::ForOp, air::AsyncOpInterface>(new_loop_op);
+    elevateAsyncTokens<scf::ForOp, scf::ForOp>(new_loop_op);
+    elevateAsyncTokens<scf::ForOp, scf::ParallelOp>(new_loop_op);
 
     loop_op.erase();
 
@@ -1763,13 +1666,6 @@ private:
         insertWaitAllOpBeforeLoopYield<scf::ParallelOp>(
             builder, loop_op, yielded_tokens_in_loop_op);
 
-    // Update boost graph
-    Graph::vertex_descriptor wait_all_op_yielded_v =
-        addVertexWaitAllOpBeforeLoopYield(yielded_tokens_in_loop_op,
-                                          "parallel");
-    // Update op-to-graph map for wait_all ops
-    wa_to_g[wait_all_op_yielded.getId()] = wait_all_op_yielded_v;
-
     // (2) Create a new wait_all event before the parallel op which collects the
     // incoming deps.
     SmallVector<Value, 4> incoming_tokens;
@@ -1794,8 +1690,8 @@ private:
       }
     }
     air::WaitAllOp wait_all_op_before_loop =
-        insertWaitAllOpAtLoopBegin<scf::ParallelOp>(
-            builder, loop_op, "parallel", incoming_tokens, constants);
+        insertWaitAllOpAtLoopBegin<scf::ParallelOp>(builder, loop_op,
+                                                    incoming_tokens, constants);
 
     // (3) Create new parallel op with init_val.
     scf::ParallelOp new_loop_op = replaceLoopOpWithNewTerminator(
@@ -1824,12 +1720,9 @@ private:
 
     // Elevating tokens from inside forOp body to the yielded token, to maintain
     // dominance
-    elevateAsyncTokens<scf::ParallelOp, air::AsyncOpInterface>(
-        new_loop_op, wait_all_op_yielded_v);
-    elevateAsyncTokens<scf::ParallelOp, scf::ForOp>(new_loop_op,
-                                                    wait_all_op_yielded_v);
-    elevateAsyncTokens<scf::ParallelOp, scf::ParallelOp>(new_loop_op,
-                                                         wait_all_op_yielded_v);
+    elevateAsyncTokens<scf::ParallelOp, air::AsyncOpInterface>(new_loop_op);
+    elevateAsyncTokens<scf::ParallelOp, scf::ForOp>(new_loop_op);
+    elevateAsyncTokens<scf::ParallelOp, scf::ParallelOp>(new_loop_op);
 
     loop_op.erase();
 
@@ -1869,8 +1762,11 @@ private:
 
   // Dependency graph constructed as Boost graph
   Graph asyncExecuteGraph;
-  Graph asyncExecuteGraphTR;
-  vertex_map g_to_tr,
+  // Transitive reduction of asyncExecuteGraph with its edges reversed: the
+  // successors of a vertex are its deps. Vertices are numbered in
+  // topological order, ops are read from asyncExecuteGraph.
+  dependencyCSRGraph asyncExecuteGraphTRDeps;
+  std::vector<unsigned> g_to_tr,
       tr_to_g; // Map between graph g and graph tr (post-tr graph)
   operation_id_to_vertex_map
       region_to_g; // Map between air executes and vertices in graph
@@ -1880,31 +1776,34 @@ private:
       channel_to_g; // Map between air channel put/get and vertices in graph
   operation_id_to_vertex_map
       hier_to_g; // Map between air hierarchy and vertices in graph
-  operation_id_to_vertex_map
-      wa_to_g; // Map between air wait_all and vertices in graph
 
-  // g vertex to air op mapping
-  air::ExecuteOp getExecuteOpFromVertex(Graph::vertex_descriptor v, Graph g) {
+  // g vertex to air op mapping. Ids are numbered across the module in walk
+  // order, so the ops of this function have consecutive ids starting at the
+  // id of the first op in its history.
+  air::ExecuteOp getExecuteOpFromVertex(Graph::vertex_descriptor v,
+                                        const Graph &g) {
     assert(g[v].asyncEventType == "execute" &&
            "This vertex is not a ExecuteOp");
-    return async_execute_op_history[g[v].operationId - 1];
+    return async_execute_op_history[g[v].operationId -
+                                    async_execute_op_history.front().getId()];
   }
   air::DmaMemcpyInterface getDmaOpFromVertex(Graph::vertex_descriptor v,
-                                             Graph g) {
+                                             const Graph &g) {
     assert(g[v].asyncEventType == "dma" && "This vertex is not a DmaMemcpy op");
-    return dma_op_history[g[v].operationId - 1];
+    return dma_op_history[g[v].operationId - dma_op_history.front().getId()];
   }
   air::ChannelInterface getChannelOpFromVertex(Graph::vertex_descriptor v,
-                                               Graph g) {
+                                               const Graph &g) {
     assert(g[v].asyncEventType == "channel" &&
            "This vertex is not a Channel op");
-    return channel_op_history[g[v].operationId - 1];
+    return channel_op_history[g[v].operationId -
+                              channel_op_history.front().getId()];
   }
   air::HierarchyInterface getHierOpFromVertex(Graph::vertex_descriptor v,
-                                              Graph g) {
+                                              const Graph &g) {
     assert(g[v].asyncEventType == "hierarchy" &&
            "This vertex is not a Hierarchy op");
-    return hier_op_history[g[v].operationId - 1];
+    return hier_op_history[g[v].operationId - hier_op_history.front().getId()];
   }
 
   // air execute op to g vertex mapping
@@ -1926,58 +1825,30 @@ private:
     return hier_to_g[op.getId()];
   }
 
-  Graph::vertex_descriptor getGraphGVertexFromAIROp(air::WaitAllOp op) {
-    return wa_to_g[op.getId()];
-  }
-
-  Graph::vertex_descriptor getGraphGVertexFromAIROp(scf::ForOp op) {
-    // Note: using forOp's last wait_all's id as the forOp's id
-    air::WaitAllOp last_wa_op;
-    // MLIR iterators cannot get the last element directly?
-    for (air::WaitAllOp wa_op : op.getOps<air::WaitAllOp>()) {
-      last_wa_op = wa_op;
-    }
-    return wa_to_g[last_wa_op.getId()];
-  }
-
-  Graph::vertex_descriptor getGraphGVertexFromAIROp(scf::ParallelOp op) {
-    // Note: using parallelOp's last wait_all's id as the parallelOp's id
-    air::WaitAllOp last_wa_op;
-    // MLIR iterators cannot get the last element directly?
-    for (air::WaitAllOp wa_op : op.getOps<air::WaitAllOp>()) {
-      last_wa_op = wa_op;
-    }
-    return wa_to_g[last_wa_op.getId()];
-  }
-
   // Fill in dep list of air async ops using graph tr's connectivity
   template <typename T> void fillAIRDepListUsingGraphTR(T op) {
     if (auto async_op =
             mlir::dyn_cast<xilinx::air::AsyncOpInterface>(op.getOperation())) {
-      uint64_t dstTRVertex = g_to_tr[getGraphGVertexFromAIROp(op)];
-      auto incoming_deps = in_edges(dstTRVertex, asyncExecuteGraphTR);
-      for (in_edge_iterator it = incoming_deps.first;
-           it != incoming_deps.second; it++) {
-        auto TRVertex = source(*it, asyncExecuteGraphTR);
-        if (asyncExecuteGraphTR[TRVertex].asyncEventType == "execute")
-          async_op.addAsyncDependency(
-              getExecuteOpFromVertex(TRVertex, asyncExecuteGraphTR)
-                  .getResult(0));
-        else if (asyncExecuteGraphTR[TRVertex].asyncEventType == "dma")
+      unsigned dstTRVertex = g_to_tr[getGraphGVertexFromAIROp(op)];
+      for (auto TRVertex : asyncExecuteGraphTRDeps.getSuccessors(dstTRVertex)) {
+        auto v = tr_to_g[TRVertex];
+        auto &type = asyncExecuteGraph[v].asyncEventType;
+        if (type == "execute")
           async_op.addAsyncDependency(
-              getDmaOpFromVertex(TRVertex, asyncExecuteGraphTR)
-                  .getOperation()
-                  ->getResult(0));
-        else if (asyncExecuteGraphTR[TRVertex].asyncEventType == "channel")
+              getExecuteOpFromVertex(v, asyncExecuteGraph).getResult(0));
+        else if (type == "dma")
+          async_op.addAsyncDependency(getDmaOpFromVertex(v, asyncExecuteGraph)
+                                          .getOperation()
+                                          ->getResult(0));
+        else if (type == "channel")
           async_op.addAsyncDependency(
-              getChannelOpFromVertex(TRVertex, asyncExecuteGraphTR)
-                  .getOperation()
-                  ->getResult(0));
-        else if (asyncExecuteGraphTR[TRVertex].asyncEventType == "hierarchy")
-          async_op.addAsyncDependency(
-              getHierOpFromVertex(TRVertex, asyncExecuteGraphTR)
+              getChannelOpFromVertex(v, asyncExecuteGraph)
                   .getOperation()
                   ->getResult(0));
+        else if (type == "hierarchy")
+          async_op.addAsyncDependency(getHierOpFromVertex(v, asyncExecuteGraph)
+                                          .getOperation()
+                                          ->getResult(0));
         else
           assert(false && "Unknown async event type");
       }
@@ -2014,22 +1885,6 @@ private:
       assert(false && "Operation has no async interface");
   }
 
-  // Dump graphviz
-  void dump_graph(std::string filename) {
-    std::ofstream ofs(filename, std::ofstream::out);
-    boost::dynamic_properties dp;
-    dp.property("label",
-                boost::get(&executeNode::asyncEventName, asyncExecuteGraphTR));
-    dp.property("color", boost::get(&executeNode::color, asyncExecuteGraphTR));
-    dp.property("shape", boost::get(&executeNode::shape, asyncExecuteGraphTR));
-    dp.property("node_id",
-                boost::get(boost::vertex_index, asyncExecuteGraphTR));
-    dp.property(
-        "style",
-        boost::make_constant_property<Graph::vertex_descriptor>(+"filled"));
-    write_graphviz_dp(ofs, asyncExecuteGraphTR, dp);
-  }
-
   //===----------------------------------------------------------------------===//
   // Other utilities
   //===----------------------------------------------------------------------===//
@@ -2066,22 +1921,6 @@ private:
     return false;
   }
 
-  // Check if two partial memref tiles have identical indices
-  bool areEqualIndexPartialMemrefs(partialMemref *tile_0,
-                                   partialMemref *tile_1) {
-    if (tile_0->numDims != tile_1->numDims) {
-      // Unequal # dimensions
-      return false;
-    } else {
-      for (unsigned i = 0; i < tile_0->numDims; i++) {
-        if (!areEqualIndices(tile_0->memrefIndices[i],
-                             tile_1->memrefIndices[i]))
-          return false;
-      }
-    }
-    return true;
-  }
-
   // Check if a value is only used outside of a given block
   bool isOnlyUsedOutsideOfBlock(Value v, Block *block) {
     for (auto u : v.getUsers())
@@ -2140,6 +1979,44 @@ private:
   }
 };
 
+class AIRDependency : public AIRDependencyBase<AIRDependency> {
+
+public:
+  AIRDependency() = default;
+  AIRDependency(const AIRDependency &pass) {}
+
+  void getDependentDialects(::mlir::DialectRegistry &registry) const override {
+    registry.insert<scf::SCFDialect, air::airDialect>();
+  }
+
+  void runOnOperation() override {
+    auto module = getOperation();
+
+    // Preprocessing: renumber the air dma op ids
+    for (auto f : module.getOps<func::FuncOp>()) {
+      xilinx::air::renumberDmaOps(f, "global");
+    }
+
+    // Each function is traced independently, with its async op ids numbered
+    // from 1; run them all in parallel.
+    std::vector<std::unique_ptr<functionDependencyTracer>> tracers;
+    for (auto f : module.getOps<func::FuncOp>())
+      tracers.push_back(std::make_unique<functionDependencyTracer>(f));
+    parallelForEach(&getContext(), tracers, [&](auto &tracer) {
+      OpBuilder builder(&getContext());
+      tracer->createAsyncOps(builder);
+      tracer->traceDependencies();
+      tracer->fillDependencyLists();
+      tracer->traceLoopCarriedDeps(builder);
+    });
+
+    // Number the async ops across the module, in function order.
+    uint64_t executeOps = 0, hierarchyOps = 0, waitAllOps = 0, channelOps = 0;
+    for (auto &tracer : tracers)
+      tracer->offsetIds(executeOps, hierarchyOps, waitAllOps, channelOps);
+  }
+};
+
 } // namespace
 
 namespace xilinx {
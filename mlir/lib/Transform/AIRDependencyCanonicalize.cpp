@@ -36,14 +36,15 @@ public:
 
   void runOnOperation() override {
     auto module = getOperation();
+    channelIndex channels(module);
 
     for (auto func : module.getOps<func::FuncOp>()) {
       // Parse dependency graphs
       hostGraph = dependencyGraph(func, true);
-      canonicalizer.parseCommandGraphs(func, hostGraph, dep_ctx);
+      canonicalizer.parseCommandGraphs(func, hostGraph, dep_ctx, channels);
 
       // Transitive reduction
-      xilinx::air::dependencyGraph trHostGraph;
+      xilinx::air::dependencyGraphTR trHostGraph;
       canonicalizer.canonicalizeGraphs(hostGraph, trHostGraph, g_to_tr);
 
       // Update dependency list
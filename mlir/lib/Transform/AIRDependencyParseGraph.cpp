@@ -35,11 +35,12 @@ public:
 
   void runOnOperation() override {
     auto module = getOperation();
+    channelIndex channels(module);
 
     for (auto func : module.getOps<func::FuncOp>()) {
       // Parse dependency graphs
       hostGraph = dependencyGraph(func, true);
-      canonicalizer.parseCommandGraphs(func, hostGraph, dep_ctx);
+      canonicalizer.parseCommandGraphs(func, hostGraph, dep_ctx, channels);
       // Purge id attribute
       func.walk([&](Operation *op) { op->removeAttr("id"); });
 
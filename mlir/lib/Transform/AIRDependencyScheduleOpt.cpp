@@ -507,57 +507,52 @@ public:
     } else {
       return;
     }
-    auto dep_list = async_op.getAsyncDependencies();
-    for (int i = dep_list.size() - 1; i >= 0; i--) {
-      auto upstream_op = dep_list[i].getDefiningOp();
-      if (upstream_op && dyn_cast<air::DmaMemcpyInterface>(upstream_op)) {
-        auto upstream_dma = dyn_cast<air::DmaMemcpyInterface>(upstream_op);
-        if (v == upstream_dma.getDstMemref()) {
-          // Disconnect dependency between async op and upstream dma
-          async_op.eraseAsyncDependency(i);
-          // Reconnect upstream dma's dep list to async op
-          auto upstream_dma_async =
-              dyn_cast<air::AsyncOpInterface>(upstream_dma.getOperation());
-          for (auto token : upstream_dma_async.getAsyncDependencies()) {
-            async_op.addAsyncDependency(token);
-          }
-          Value srcMemref = upstream_dma.getSrcMemref();
-          // Recursively trace upstream dma
-          for (unsigned j = 0; j < upstream_op->getNumOperands(); j++) {
-            if (srcMemref == upstream_op->getOperand(j)) {
-              findAndPruneRedundantDma(&upstream_op->getOpOperand(j));
-            }
-          }
-          // Elevate from argument to operand of herd launch
-          if (auto hl_op = getHerdArgOwner(srcMemref)) {
-            for (unsigned i = 0; i < hl_op.getNumKernelOperands(); i++) {
-              if (hl_op.getKernelArgument(i) == srcMemref) {
-                auto &hl_opoperand = hl_op->getOpOperand(
-                    i + hl_op.getAsyncDependencies().size() + 2);
-                findAndPruneRedundantDma(&hl_opoperand);
-              }
-            }
+    // Collect the upstream dmas first, as erasing them edits the dep list
+    llvm::SetVector<Operation *> upstream_ops;
+    for (auto dep : async_op.getAsyncDependencies()) {
+      auto upstream_dma = dep.getDefiningOp<air::DmaMemcpyInterface>();
+      if (upstream_dma && v == upstream_dma.getDstMemref())
+        upstream_ops.insert(upstream_dma.getOperation());
+    }
+    for (auto upstream_op : upstream_ops) {
+      auto upstream_dma = dyn_cast<air::DmaMemcpyInterface>(upstream_op);
+      Value srcMemref = upstream_dma.getSrcMemref();
+      // Recursively trace upstream dma
+      for (unsigned j = 0; j < upstream_op->getNumOperands(); j++) {
+        if (srcMemref == upstream_op->getOperand(j)) {
+          findAndPruneRedundantDma(&upstream_op->getOpOperand(j));
+        }
+      }
+      // Elevate from argument to operand of herd launch
+      if (auto hl_op = getHerdArgOwner(srcMemref)) {
+        for (unsigned i = 0; i < hl_op.getNumKernelOperands(); i++) {
+          if (hl_op.getKernelArgument(i) == srcMemref) {
+            auto &hl_opoperand = hl_op->getOpOperand(
+                i + hl_op.getAsyncDependencies().size() + 2);
+            findAndPruneRedundantDma(&hl_opoperand);
           }
-          // Elevate from argument to operand of hierarchy op
-          if (auto hier_op = getHierarchyArgOwner(srcMemref)) {
-            auto dep_list =
-                dyn_cast<air::AsyncOpInterface>(hier_op.getOperation())
-                    .getAsyncDependencies();
-            for (unsigned i = 0; i < hier_op.getNumKernelOperands(); i++) {
-              if (hier_op.getKernelArgument(i) == srcMemref) {
-                auto &hier_opoperand = hier_op->getOpOperand(
-                    i + dep_list.size() + hier_op.getNumDims());
-                findAndPruneRedundantDma(&hier_opoperand);
-              }
-            }
+        }
+      }
+      // Elevate from argument to operand of hierarchy op
+      if (auto hier_op = getHierarchyArgOwner(srcMemref)) {
+        auto dep_list = dyn_cast<air::AsyncOpInterface>(hier_op.getOperation())
+                            .getAsyncDependencies();
+        for (unsigned i = 0; i < hier_op.getNumKernelOperands(); i++) {
+          if (hier_op.getKernelArgument(i) == srcMemref) {
+            auto &hier_opoperand = hier_op->getOpOperand(
+                i + dep_list.size() + hier_op.getNumDims());
+            findAndPruneRedundantDma(&hier_opoperand);
           }
-          upstream_dma->erase();
         }
       }
+      // Users of the upstream dma, including async op, inherit its dep list
+      tracer.notifyOpErased(upstream_op);
+      upstream_op->erase();
     }
   }
 
 private:
+  air::dependencyTracer tracer;
 };
 
 class AIRHoistDmaInAccumPattern
@@ -982,16 +982,16 @@ public:
   }
 
   // use the algorithm from affine loop tiling pass
-  static void getTileSizes(linalg::LinalgOp op, size_t cacheSizeBytes,
-                           SmallVectorImpl<int64_t> &tripCounts,
-                           SmallVectorImpl<int64_t> *tileSizes) {
+  void getTileSizes(linalg::LinalgOp op, size_t cacheSizeBytes,
+                    SmallVectorImpl<int64_t> &tripCounts,
+                    SmallVectorImpl<int64_t> *tileSizes) {
     if (!cacheSizeBytes)
       return;
 
     auto nLoops = op.getNumLoops();
     tileSizes->resize(nLoops);
 
-    uint64_t fp = CostModel().getOpCounts(op)["footprint"];
+    uint64_t fp = costModel.getLinalgOpCounts(op).footprint;
     LLVM_DEBUG(llvm::outs() << "Footprint: " << fp << "\n");
     LLVM_DEBUG(llvm::outs() << "Cache size: " << cacheSizeBytes << "\n");
     uint64_t excessFactor = llvm::divideCeil(fp, cacheSizeBytes);
@@ -1468,6 +1468,8 @@ public:
   }
 
 private:
+  // footprints of the ops being tiled, memoized across the functions
+  CostModel costModel;
 };
 
 } // namespace
@@ -55,6 +55,56 @@ private:
 
 void AIRExamplePass::runOnOperation() {}
 
+class AIRTestDependencyUpdate
+    : public air::AIRTestDependencyUpdateBase<AIRTestDependencyUpdate> {
+
+public:
+  AIRTestDependencyUpdate() = default;
+  AIRTestDependencyUpdate(const AIRTestDependencyUpdate &pass){};
+
+  void runOnOperation() override;
+
+private:
+};
+
+void AIRTestDependencyUpdate::runOnOperation() {
+  auto module = getOperation();
+
+  SmallVector<air::ExecuteOp, 4> moved_ops;
+  SmallVector<air::ExecuteOp, 4> cloned_ops;
+  SmallVector<air::ExecuteOp, 4> erased_ops;
+  module.walk([&](air::ExecuteOp exec) {
+    auto &child_op = exec.getRegion().front().front();
+    if (child_op.removeAttr("test_move_before"))
+      moved_ops.push_back(exec);
+    if (child_op.removeAttr("test_clone"))
+      cloned_ops.push_back(exec);
+    if (child_op.removeAttr("test_erase"))
+      erased_ops.push_back(exec);
+  });
+
+  air::dependencyTracer tracer;
+  for (auto exec : moved_ops) {
+    auto prev_op = exec->getPrevNode();
+    while (prev_op && !isa<air::AsyncOpInterface>(prev_op))
+      prev_op = prev_op->getPrevNode();
+    if (!prev_op)
+      continue;
+    exec->moveBefore(prev_op);
+    tracer.notifyOpMoved(exec);
+  }
+  for (auto exec : cloned_ops) {
+    OpBuilder builder(exec);
+    builder.setInsertionPointAfter(exec);
+    tracer.notifyOpCreated(builder.clone(*exec.getOperation()));
+  }
+  for (auto exec : erased_ops) {
+    tracer.notifyOpErased(exec);
+    exec->erase();
+  }
+  tracer.updateDependencies();
+}
+
 class AIRLinalgNamePass : public air::AIRLinalgNamePassBase<AIRLinalgNamePass> {
 
 public:
@@ -841,6 +891,10 @@ std::unique_ptr<Pass> createAIRExamplePass() {
   return std::make_unique<AIRExamplePass>();
 }
 
+std::unique_ptr<Pass> createAIRTestDependencyUpdatePass() {
+  return std::make_unique<AIRTestDependencyUpdate>();
+}
+
 std::unique_ptr<Pass> createAIRSpecializeDma() {
   return std::make_unique<AIRSpecializeDma>();
 }
@@ -0,0 +1,501 @@
+//===- AIRRoofline.cpp ------------------------------------------*- C++ -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+#include "air/Transform/AIRRoofline.h"
+#include "PassDetail.h"
+#include "air/Dialect/AIR/AIRDialect.h"
+#include "air/Util/ArchModel.h"
+#include "air/Util/CostModel.h"
+#include "air/Util/Util.h"
+
+#include "mlir/Dialect/Affine/IR/AffineOps.h"
+#include "mlir/Dialect/Affine/Analysis/LoopAnalysis.h"
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/Linalg/IR/Linalg.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+#include "mlir/Pass/Pass.h"
+#include "mlir/Support/FileUtilities.h"
+
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <deque>
+#include <map>
+
+#define DEBUG_TYPE "air-roofline"
+
+using namespace mlir;
+using namespace xilinx;
+using namespace xilinx::air;
+
+namespace {
+
+// One entry of the report: a function, launch, herd or linalg op. The counts
+// are per run of the entry, over all the tiles of a herd and all the
+// iterations of a launch.
+struct RooflineEntry {
+  std::string kind;
+  std::string name;
+  std::string parent;
+  // operation name and element type of a linalg op, to look up its kernel
+  // throughput
+  std::string opName;
+  std::string datatype;
+  uint64_t macs = 0;
+  // runs of the entry per run of its function
+  uint64_t count = 1;
+  // false if a loop trip count or a size is not constant, the counts then
+  // assume a single iteration
+  bool isStatic = true;
+  // payload ops of the linalg ops, see CostModel::LinalgOpCounts
+  uint64_t ops = 0;
+  // bytes of the operands of a linalg op
+  uint64_t operandBytes = 0;
+  // bytes moved, keyed by source and destination memory space
+  std::map<std::pair<unsigned, unsigned>, uint64_t> bytes;
+  // herd tiles, the sum over the herds for a launch or function
+  uint64_t tiles = 0;
+  // cycles of the linalg ops at the throughput of their kernel and element
+  // type, summed over the tiles
+  double computeCycles = 0;
+};
+
+class AIRRoofline : public AIRRooflineBase<AIRRoofline> {
+public:
+  AIRRoofline() = default;
+  AIRRoofline(const AIRRoofline &pass) {}
+
+  void runOnOperation() override;
+
+private:
+  // An enclosing entry, with the multiplicity of the walk at its start.
+  struct Scope {
+    RooflineEntry *entry;
+    uint64_t multiplicity;
+  };
+
+  RooflineEntry &addEntry(StringRef kind, std::string name,
+                          uint64_t multiplicity);
+  void visit(Block &block, uint64_t multiplicity);
+  void visitLinalgOp(linalg::LinalgOp op, uint64_t multiplicity);
+  void addBytes(unsigned src, unsigned dst, uint64_t bytes,
+                uint64_t multiplicity);
+  uint64_t getSizesProduct(OperandRange sizes);
+  void markDynamic();
+
+  llvm::json::Value entryToJSON(const RooflineEntry &e);
+  void entryToCSV(const RooflineEntry &e, llvm::raw_ostream &os);
+
+  CostModel costModel;
+  std::unique_ptr<ArchModel> arch;
+
+  std::deque<RooflineEntry> entries;
+  SmallVector<Scope, 4> scopes;
+  // memory space of the gets of each channel
+  llvm::StringMap<unsigned> channelDstSpace;
+  unsigned numLaunches = 0;
+  unsigned numHerds = 0;
+  unsigned numLinalgOps = 0;
+};
+
+std::string getSpaceName(unsigned space) {
+  if (space <= (unsigned)MemorySpace::L1)
+    return stringifyMemorySpace((MemorySpace)space).str();
+  return std::to_string(space);
+}
+
+uint64_t getElementBytes(MemRefType ty) {
+  auto elTy = ty.getElementType();
+  if (elTy.isIntOrFloat())
+    return llvm::divideCeil(elTy.getIntOrFloatBitWidth(), 8);
+  return 8;
+}
+
+// Return the name of `op` from its symbol attribute, or `kind` followed by
+// `index`.
+std::string getEntryName(Operation *op, StringRef kind, unsigned index) {
+  if (auto attr =
+          op->getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName()))
+    return attr.getValue().str();
+  return (kind + "_" + Twine(index)).str();
+}
+
+RooflineEntry &AIRRoofline::addEntry(StringRef kind, std::string name,
+                                     uint64_t multiplicity) {
+  entries.emplace_back();
+  auto &e = entries.back();
+  e.kind = kind.str();
+  e.name = std::move(name);
+  if (!scopes.empty()) {
+    e.parent = scopes.back().entry->name;
+    e.count = multiplicity / scopes.front().multiplicity;
+    e.isStatic = scopes.back().entry->isStatic;
+  }
+  return e;
+}
+
+// Mark the enclosing entries as not static.
+void AIRRoofline::markDynamic() {
+  for (auto &s : scopes)
+    s.entry->isStatic = false;
+}
+
+// Return the product of the constant `sizes`, dynamic sizes count as 1.
+uint64_t AIRRoofline::getSizesProduct(OperandRange sizes) {
+  uint64_t product = 1;
+  for (auto v : sizes) {
+    if (auto c = v.getDefiningOp<arith::ConstantIndexOp>())
+      product *= c.value();
+    else
+      markDynamic();
+  }
+  return product;
+}
+
+void AIRRoofline::addBytes(unsigned src, unsigned dst, uint64_t bytes,
+                           uint64_t multiplicity) {
+  for (auto &s : scopes)
+    s.entry->bytes[{src, dst}] += bytes * (multiplicity / s.multiplicity);
+}
+
+void AIRRoofline::visitLinalgOp(linalg::LinalgOp op, uint64_t multiplicity) {
+  auto &counts = costModel.getLinalgOpCounts(op);
+  if (!counts.isStatic)
+    markDynamic();
+  uint64_t ops = counts.getComputeOps();
+  for (auto &s : scopes)
+    s.entry->ops += ops * (multiplicity / s.multiplicity);
+
+  auto &e = addEntry("linalg",
+                     getEntryName(op, op->getName().getStringRef(),
+                                  numLinalgOps++),
+                     multiplicity);
+  e.isStatic &= counts.isStatic;
+  e.opName = op->getName().getStringRef().str();
+  if (counts.elementType) {
+    llvm::raw_string_ostream os(e.datatype);
+    counts.elementType.print(os);
+  }
+  e.macs = counts.macs;
+  e.ops = ops;
+  for (auto v : op->getOperands())
+    if (auto ty = v.getType().dyn_cast<MemRefType>())
+      e.operandBytes += getTensorVolume(ty) * getElementBytes(ty);
+  e.tiles = 1;
+  if (arch) {
+    e.computeCycles =
+        arch->getKernel(e.opName).getComputeCycles(e.datatype, ops, e.macs);
+    for (auto &s : scopes)
+      s.entry->computeCycles +=
+          e.computeCycles * (multiplicity / s.multiplicity);
+  }
+}
+
+// Return the elements moved by `op`, from its constant sizes if any, or the
+// smaller of its memrefs.
+uint64_t getDmaVolume(DmaMemcpyInterface op) {
+  auto getVolume = [](OperandRange sizes) -> uint64_t {
+    if (sizes.empty())
+      return 0;
+    uint64_t volume = 1;
+    for (auto v : sizes) {
+      auto c = v.getDefiningOp<arith::ConstantIndexOp>();
+      if (!c)
+        return 0;
+      volume *= c.value();
+    }
+    return volume;
+  };
+  if (auto nd = dyn_cast<DmaMemcpyNdOp>(op.getOperation())) {
+    if (auto volume = getVolume(nd.getSrcSizes()))
+      return volume;
+    if (auto volume = getVolume(nd.getDstSizes()))
+      return volume;
+  }
+  return std::min(getTensorVolume(op.getSrcMemref().getType()),
+                  getTensorVolume(op.getDstMemref().getType()));
+}
+
+void AIRRoofline::visit(Block &block, uint64_t multiplicity) {
+  for (auto &o : block) {
+    Operation *op = &o;
+    if (auto linalgOp = dyn_cast<linalg::LinalgOp>(op)) {
+      visitLinalgOp(linalgOp, multiplicity);
+    } else if (auto dma = dyn_cast<DmaMemcpyInterface>(op)) {
+      auto srcTy = dma.getSrcMemref().getType().cast<MemRefType>();
+      auto dstTy = dma.getDstMemref().getType().cast<MemRefType>();
+      addBytes(srcTy.getMemorySpaceAsInt(), dstTy.getMemorySpaceAsInt(),
+               getDmaVolume(dma) * getElementBytes(srcTy), multiplicity);
+    } else if (auto put = dyn_cast<ChannelPutOp>(op)) {
+      // the bytes are counted once, at the put
+      auto it = channelDstSpace.find(put.getChanName());
+      if (it == channelDstSpace.end())
+        continue;
+      auto srcTy = put.getSrc().getType().cast<MemRefType>();
+      uint64_t volume = getTensorVolume(srcTy);
+      if (!put.getSrcSizes().empty())
+        volume = getSizesProduct(put.getSrcSizes());
+      addBytes(srcTy.getMemorySpaceAsInt(), it->second,
+               volume * getElementBytes(srcTy), multiplicity);
+    } else if (auto forOp = dyn_cast<scf::ForOp>(op)) {
+      auto lb = forOp.getLowerBound().getDefiningOp<arith::ConstantIndexOp>();
+      auto ub = forOp.getUpperBound().getDefiningOp<arith::ConstantIndexOp>();
+      auto step = forOp.getStep().getDefiningOp<arith::ConstantIndexOp>();
+      uint64_t trip_count = 1;
+      if (lb && ub && step && step.value() > 0)
+        trip_count = ub.value() > lb.value()
+                         ? llvm::divideCeil(ub.value() - lb.value(),
+                                            step.value())
+                         : 0;
+      else
+        markDynamic();
+      visit(*forOp.getBody(), multiplicity * trip_count);
+    } else if (auto parOp = dyn_cast<scf::ParallelOp>(op)) {
+      uint64_t trip_count = 1;
+      for (auto t : llvm::zip(parOp.getLowerBound(), parOp.getUpperBound(),
+                              parOp.getStep())) {
+        auto lb = std::get<0>(t).getDefiningOp<arith::ConstantIndexOp>();
+        auto ub = std::get<1>(t).getDefiningOp<arith::ConstantIndexOp>();
+        auto step = std::get<2>(t).getDefiningOp<arith::ConstantIndexOp>();
+        if (lb && ub && step && step.value() > 0)
+          trip_count *= ub.value() > lb.value()
+                            ? llvm::divideCeil(ub.value() - lb.value(),
+                                               step.value())
+                            : 0;
+        else
+          markDynamic();
+      }
+      visit(*parOp.getBody(), multiplicity * trip_count);
+    } else if (auto afo = dyn_cast<AffineForOp>(op)) {
+      uint64_t trip_count = 1;
+      if (auto c = getConstantTripCount(afo))
+        trip_count = *c;
+      else
+        markDynamic();
+      visit(*afo.getBody(), multiplicity * trip_count);
+    } else if (auto launch = dyn_cast<LaunchOp>(op)) {
+      auto &e = addEntry("launch", getEntryName(op, "launch", numLaunches++),
+                         multiplicity);
+      scopes.push_back({&e, multiplicity});
+      uint64_t size = getSizesProduct(launch.getSizeOperands());
+      visit(launch.getBody().front(), multiplicity * size);
+      scopes.pop_back();
+    } else if (auto herd = dyn_cast<HerdOp>(op)) {
+      auto &e =
+          addEntry("herd", getEntryName(op, "herd", numHerds++), multiplicity);
+      scopes.push_back({&e, multiplicity});
+      uint64_t tiles = getSizesProduct(herd.getSizeOperands());
+      for (auto &s : scopes)
+        s.entry->tiles += tiles;
+      visit(herd.getBody().front(), multiplicity * tiles);
+      scopes.pop_back();
+    } else {
+      for (auto &region : op->getRegions())
+        for (auto &b : region)
+          visit(b, multiplicity);
+    }
+  }
+}
+
+llvm::json::Value AIRRoofline::entryToJSON(const RooflineEntry &e) {
+  llvm::json::Object obj;
+  obj["kind"] = e.kind;
+  obj["name"] = e.name;
+  if (!e.parent.empty())
+    obj["parent"] = e.parent;
+  obj["count"] = (int64_t)e.count;
+  obj["static"] = e.isStatic;
+  obj["ops"] = (int64_t)e.ops;
+  if (e.kind == "linalg") {
+    obj["operand_bytes"] = (int64_t)e.operandBytes;
+    if (e.operandBytes)
+      obj["intensity"] = (double)e.ops / e.operandBytes;
+  }
+
+  double peak = 0;
+  std::string bound = "compute";
+  double cycles = 0;
+  if (arch) {
+    // the tiles compute in parallel
+    double tile_cycles = e.computeCycles / std::max<uint64_t>(e.tiles, 1);
+    if (tile_cycles > 0)
+      peak = e.ops / tile_cycles;
+    else if (e.kind == "linalg")
+      peak = arch->getKernel(e.opName).getOpsPerCycle();
+    else
+      peak = std::max<uint64_t>(e.tiles, 1) *
+             arch->device_kernel.getOpsPerCycle();
+    obj["peak_ops_per_cycle"] = peak;
+    if (peak > 0) {
+      cycles = e.ops / peak;
+      obj["compute_cycles"] = cycles;
+    }
+  }
+
+  llvm::json::Array boundaries;
+  for (auto &b : e.bytes) {
+    unsigned src = b.first.first, dst = b.first.second;
+    llvm::json::Object boundary;
+    boundary["src"] = getSpaceName(src);
+    boundary["dst"] = getSpaceName(dst);
+    boundary["bytes"] = (int64_t)b.second;
+    if (b.second)
+      boundary["intensity"] = (double)e.ops / b.second;
+    double bytes_per_cycle = arch ? arch->getBandwidth(src, dst) / arch->clock
+                                  : 0;
+    if (bytes_per_cycle > 0) {
+      boundary["bytes_per_cycle"] = bytes_per_cycle;
+      boundary["ridge"] = peak / bytes_per_cycle;
+      double transfer_cycles = b.second / bytes_per_cycle;
+      boundary["cycles"] = transfer_cycles;
+      if (transfer_cycles > cycles) {
+        cycles = transfer_cycles;
+        bound = getSpaceName(src) + "->" + getSpaceName(dst);
+      }
+    }
+    boundaries.push_back(std::move(boundary));
+  }
+  obj["boundaries"] = std::move(boundaries);
+
+  if (arch) {
+    obj["bound"] = bound;
+    obj["cycles"] = cycles;
+    if (cycles > 0)
+      obj["attainable_ops_per_cycle"] = e.ops / cycles;
+  }
+  return llvm::json::Value(std::move(obj));
+}
+
+// Write the rows of `e` from its JSON form, one per boundary.
+void AIRRoofline::entryToCSV(const RooflineEntry &e, llvm::raw_ostream &os) {
+  auto value = entryToJSON(e);
+  auto *obj = value.getAsObject();
+  auto field = [](const llvm::json::Object *o, StringRef key) -> std::string {
+    auto *v = o->get(key);
+    if (!v)
+      return "";
+    if (auto s = v->getAsString())
+      return s->str();
+    if (auto b = v->getAsBoolean())
+      return *b ? "1" : "0";
+    if (auto i = v->getAsInteger())
+      return std::to_string(*i);
+    if (auto d = v->getAsNumber())
+      return llvm::formatv("{0:f3}", *d).str();
+    return "";
+  };
+  auto printRow = [&](const llvm::json::Object *boundary) {
+    for (auto key : {"kind", "name", "parent", "count", "static", "ops",
+                     "operand_bytes", "peak_ops_per_cycle", "compute_cycles"})
+      os << field(obj, key) << ",";
+    for (auto key : {"src", "dst", "bytes", "intensity", "bytes_per_cycle",
+                     "ridge", "cycles"})
+      os << field(boundary, key) << ",";
+    os << field(obj, "bound") << "," << field(obj, "cycles") << "\n";
+  };
+  // a linalg op has no boundary, its intensity is over its operands
+  auto *boundaries = obj->getArray("boundaries");
+  if (boundaries->empty()) {
+    llvm::json::Object operands;
+    if (auto *intensity = obj->get("intensity"))
+      operands["intensity"] = *intensity;
+    printRow(&operands);
+  }
+  for (auto &b : *boundaries)
+    printRow(b.getAsObject());
+}
+
+void AIRRoofline::runOnOperation() {
+  auto module = getOperation();
+
+  if (!clArchFile.empty()) {
+    std::string errorMessage;
+    auto file = openInputFile(clArchFile, &errorMessage);
+    if (!file) {
+      module.emitError(errorMessage);
+      return signalPassFailure();
+    }
+    auto json = llvm::json::parse(file->getBuffer());
+    if (!json) {
+      module.emitError("failed to parse arch model: ")
+          << llvm::toString(json.takeError());
+      return signalPassFailure();
+    }
+    arch = ArchModel::parse(*json, &errorMessage);
+    if (!arch) {
+      module.emitError(errorMessage);
+      return signalPassFailure();
+    }
+  }
+  if (clFormat != "json" && clFormat != "csv") {
+    module.emitError("unknown roofline report format '") << clFormat << "'";
+    return signalPassFailure();
+  }
+
+  entries.clear();
+  channelDstSpace.clear();
+  numLaunches = numHerds = numLinalgOps = 0;
+
+  module.walk([&](ChannelGetOp get) {
+    channelDstSpace.try_emplace(
+        get.getChanName(),
+        get.getDst().getType().cast<MemRefType>().getMemorySpaceAsInt());
+  });
+
+  for (auto f : module.getOps<func::FuncOp>()) {
+    if (f.isDeclaration())
+      continue;
+    auto &e = addEntry("func", f.getSymName().str(), 1);
+    scopes.push_back({&e, 1});
+    visit(f.getBody().front(), 1);
+    scopes.pop_back();
+  }
+
+  std::string errorMessage;
+  auto output = openOutputFile(clOutputFile, &errorMessage);
+  if (!output) {
+    module.emitError(errorMessage);
+    return signalPassFailure();
+  }
+  auto &os = output->os();
+  if (clFormat == "csv") {
+    os << "kind,name,parent,count,static,ops,operand_bytes,"
+          "peak_ops_per_cycle,compute_cycles,src,dst,bytes,intensity,"
+          "bytes_per_cycle,ridge,transfer_cycles,bound,cycles\n";
+    for (auto &e : entries)
+      entryToCSV(e, os);
+  } else {
+    llvm::json::Object top;
+    if (arch)
+      top["arch"] = arch->devicename;
+    llvm::json::Array array;
+    for (auto &e : entries)
+      array.push_back(entryToJSON(e));
+    top["entries"] = std::move(array);
+    os << llvm::formatv("{0:2}", llvm::json::Value(std::move(top))) << "\n";
+  }
+  output->keep();
+  markAllAnalysesPreserved();
+}
+
+} // namespace
+
+namespace xilinx {
+namespace air {
+
+std::unique_ptr<Pass> createAIRRooflinePass() {
+  return std::make_unique<AIRRoofline>();
+}
+
+} // namespace air
+} // namespace xilinx
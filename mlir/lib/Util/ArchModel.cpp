@@ -0,0 +1,512 @@
+//===- ArchModel.cpp --------------------------------------------*- C++ -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+#include "air/Util/ArchModel.h"
+
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <vector>
+
+using namespace llvm;
+
+namespace xilinx {
+namespace air {
+
+namespace {
+
+// Read the optional number `key` of `obj` into `result`. Fails if the field is
+// present but is not a number.
+bool getOptionalNumber(const json::Object &obj, StringRef key, double &result,
+                       const Twine &context, std::string *errorMessage) {
+  auto *v = obj.get(key);
+  if (!v)
+    return true;
+  auto d = v->getAsNumber();
+  if (!d) {
+    *errorMessage =
+        (context + ": field '" + key + "' must be a number").str();
+    return false;
+  }
+  result = *d;
+  return true;
+}
+
+bool getOptionalNumber(const json::Object &obj, StringRef key,
+                       unsigned &result, const Twine &context,
+                       std::string *errorMessage) {
+  double d = result;
+  if (!getOptionalNumber(obj, key, d, context, errorMessage))
+    return false;
+  if (d < 0) {
+    *errorMessage =
+        (context + ": field '" + key + "' must not be negative").str();
+    return false;
+  }
+  result = d;
+  return true;
+}
+
+bool parseKernel(const json::Object &obj, ArchModel::Kernel &kernel,
+                 const Twine &context, std::string *errorMessage) {
+  if (!getOptionalNumber(obj, "cores", kernel.cores, context, errorMessage) ||
+      !getOptionalNumber(obj, "ops_per_core_per_cycle",
+                         kernel.ops_per_core_per_cycle, context,
+                         errorMessage) ||
+      !getOptionalNumber(obj, "clock", kernel.clock, context, errorMessage) ||
+      !getOptionalNumber(obj, "efficiency", kernel.efficiency, context,
+                         errorMessage))
+    return false;
+  if (kernel.getOpsPerCycle() <= 0) {
+    *errorMessage =
+        (context + ": ops per cycle must be greater than zero").str();
+    return false;
+  }
+
+  // per element type throughput, adding to or overriding the datatypes
+  // inherited from the device
+  if (auto *datatypes = obj.get("datatypes")) {
+    auto *dobj = datatypes->getAsObject();
+    if (!dobj) {
+      *errorMessage = (context + ": 'datatypes' must be an object").str();
+      return false;
+    }
+    for (auto &d : *dobj) {
+      std::string dcontext =
+          (context + ": datatype '" + StringRef(d.first) + "'").str();
+      auto *tobj = d.second.getAsObject();
+      if (!tobj) {
+        *errorMessage = dcontext + " must be an object";
+        return false;
+      }
+      auto &dt = kernel.datatypes[d.first];
+      if (!dt.ops_per_core_per_cycle)
+        dt.ops_per_core_per_cycle = kernel.ops_per_core_per_cycle;
+      if (!getOptionalNumber(*tobj, "ops_per_core_per_cycle",
+                             dt.ops_per_core_per_cycle, dcontext,
+                             errorMessage) ||
+          !getOptionalNumber(*tobj, "macs_per_core_per_cycle",
+                             dt.macs_per_core_per_cycle, dcontext,
+                             errorMessage))
+        return false;
+      if (dt.ops_per_core_per_cycle <= 0 || dt.macs_per_core_per_cycle < 0) {
+        *errorMessage = dcontext + ": ops per cycle must be greater than "
+                                   "zero and macs per cycle not negative";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+double ArchModel::Kernel::getComputeCycles(StringRef datatype, uint64_t ops,
+                                           uint64_t macs) const {
+  auto it = datatypes.find(datatype);
+  if (it == datatypes.end())
+    return ops / getOpsPerCycle();
+  auto &dt = it->second;
+  double cycles = 0;
+  if (dt.macs_per_core_per_cycle > 0) {
+    macs = std::min(macs, ops / 2);
+    cycles = macs / (cores * dt.macs_per_core_per_cycle * efficiency);
+    ops -= 2 * macs;
+  }
+  return cycles + ops / (cores * dt.ops_per_core_per_cycle * efficiency);
+}
+
+uint64_t ArchModel::getTransferCycles(unsigned src, unsigned dst,
+                                      double bytes) const {
+  double bps = getBandwidth(src, dst);
+  if (bps <= 0 || bps == DBL_MAX)
+    return 0;
+  double seconds = bytes / bps;
+  return (uint64_t)ceil(seconds * clock);
+}
+
+uint64_t ArchModel::getMinTransferCycles() const {
+  uint64_t cycles = UINT64_MAX;
+  for (unsigned src = 0; src < getNumSpaces(); src++)
+    for (unsigned dst = 0; dst < getNumSpaces(); dst++)
+      if (hasInterface(src, dst) && interface_bw[src][dst] != DBL_MAX)
+        cycles = std::min(cycles, getTransferCycles(src, dst, datatype_bytes));
+  if (cycles == UINT64_MAX)
+    cycles = 0;
+  return std::max<uint64_t>(1, cycles + dma_latency);
+}
+
+uint64_t ArchModel::getShimBDCycles(uint64_t rows, double row_bytes,
+                                    double bytes_per_cycle) const {
+  if (!rows)
+    return 0;
+  // DMA cycles of one buffer descriptor
+  uint64_t row = shim_bd.row_cycles;
+  if (bytes_per_cycle > 0)
+    row += (uint64_t)ceil(row_bytes / bytes_per_cycle);
+
+  // The controller pushes a descriptor every setup_cycles while fewer than
+  // max_outstanding are queued, otherwise it gives up the channel and checks
+  // again every poll_cycles. The DMA runs the descriptors in order. Only the
+  // differences of the times matter, so once the issue time and the end
+  // times of the queued descriptors, relative to the last end time, repeat
+  // those after an earlier descriptor, the end times repeat with that period
+  // and the rest is extrapolated. The period depends on how the polls line
+  // up with the DMA, and is looked for in the first descriptors only.
+  unsigned k = shim_bd.max_outstanding;
+  // end times of the last k descriptors
+  std::vector<uint64_t> done(k, 0);
+  // end times of the descriptors searched for a period, and the descriptor
+  // after which each relative state was seen
+  std::vector<uint64_t> ends;
+  std::map<std::vector<uint64_t>, uint64_t> seen;
+  uint64_t search = 64 * (uint64_t)k + 64;
+  uint64_t issue = 0, last = 0;
+  for (uint64_t i = 0; i < rows; i++) {
+    uint64_t &oldest = done[i % k];
+    if (i >= k && oldest > issue) {
+      if (shim_bd.poll_cycles)
+        issue += divideCeil(oldest - issue, shim_bd.poll_cycles) *
+                 shim_bd.poll_cycles;
+      else
+        issue = oldest;
+    }
+    issue += shim_bd.setup_cycles;
+    last = std::max(issue, last) + row;
+    oldest = last;
+    if (i + 1 < k || i >= search)
+      continue;
+    ends.push_back(last);
+    std::vector<uint64_t> state{last - issue};
+    for (unsigned j = 1; j <= k; j++)
+      state.push_back(last - done[(i + j) % k]);
+    auto it = seen.try_emplace(std::move(state), i);
+    if (it.second)
+      continue;
+    // ends[d - k + 1] is the end time of descriptor d
+    uint64_t first = it.first->second, period = i - first;
+    uint64_t left = rows - 1 - i;
+    uint64_t start = ends[first - k + 1];
+    return last + left / period * (last - start) +
+           (ends[first - k + 1 + left % period] - start);
+  }
+  return last;
+}
+
+std::unique_ptr<ArchModel> ArchModel::parse(const json::Value &json,
+                                            std::string *errorMessage) {
+  auto *model = json.getAsObject();
+  if (!model) {
+    *errorMessage = "arch model: expected a JSON object";
+    return nullptr;
+  }
+
+  auto arch = std::make_unique<ArchModel>();
+
+  if (auto name = model->getString("devicename"))
+    arch->devicename = name->str();
+
+  if (!getOptionalNumber(*model, "clock", arch->clock, "arch model",
+                         errorMessage))
+    return nullptr;
+  if (arch->clock <= 0) {
+    *errorMessage = "arch model: 'clock' must be greater than zero";
+    return nullptr;
+  }
+
+  unsigned dma_latency = 0;
+  if (!getOptionalNumber(*model, "dma_latency", dma_latency, "arch model",
+                         errorMessage))
+    return nullptr;
+  arch->dma_latency = dma_latency;
+
+  if (auto *datatype = model->get("datatype")) {
+    auto *dt = datatype->getAsObject();
+    if (!dt) {
+      *errorMessage = "arch model: 'datatype' must be an object";
+      return nullptr;
+    }
+    if (auto name = dt->getString("name"))
+      arch->datatype_name = name->str();
+    if (!getOptionalNumber(*dt, "bytes", arch->datatype_bytes,
+                           "arch model: datatype", errorMessage))
+      return nullptr;
+  }
+
+  // queue configuration
+  if (!getOptionalNumber(*model, "num_dispatch_queues",
+                         arch->num_dispatch_queues, "arch model",
+                         errorMessage) ||
+      !getOptionalNumber(*model, "num_dispatch_dma_queues",
+                         arch->num_dispatch_dma_queues, "arch model",
+                         errorMessage) ||
+      !getOptionalNumber(*model, "num_core_dma_queues",
+                         arch->num_core_dma_queues, "arch model",
+                         errorMessage) ||
+      !getOptionalNumber(*model, "num_herd_slots", arch->num_herd_slots,
+                         "arch model", errorMessage))
+    return nullptr;
+
+  auto &topo = arch->topology;
+  topo.partitions = arch->num_dispatch_queues;
+  topo.shim_dma_channels = arch->num_dispatch_dma_queues;
+  topo.tile_dma_channels = arch->num_core_dma_queues;
+  if (auto *topology = model->get("topology")) {
+    auto *obj = topology->getAsObject();
+    if (!obj) {
+      *errorMessage = "arch model: 'topology' must be an object";
+      return nullptr;
+    }
+    topo = Topology();
+    StringRef context = "arch model: topology";
+    if (!getOptionalNumber(*obj, "partitions", topo.partitions, context,
+                           errorMessage) ||
+        !getOptionalNumber(*obj, "columns", topo.columns, context,
+                           errorMessage) ||
+        !getOptionalNumber(*obj, "rows", topo.rows, context, errorMessage) ||
+        !getOptionalNumber(*obj, "column_offset", topo.column_offset,
+                           context, errorMessage) ||
+        !getOptionalNumber(*obj, "row_offset", topo.row_offset, context,
+                           errorMessage) ||
+        !getOptionalNumber(*obj, "controllers", topo.controllers, context,
+                           errorMessage) ||
+        !getOptionalNumber(*obj, "shim_dma_channels", topo.shim_dma_channels,
+                           context, errorMessage) ||
+        !getOptionalNumber(*obj, "tile_dma_channels", topo.tile_dma_channels,
+                           context, errorMessage))
+      return nullptr;
+  }
+  if (!topo.partitions || !topo.columns || !topo.rows || !topo.controllers ||
+      !topo.shim_dma_channels || !topo.tile_dma_channels) {
+    *errorMessage = "arch model: the topology must have at least one "
+                    "partition, column, row, controller and DMA channel";
+    return nullptr;
+  }
+
+  if (auto *shimBD = model->get("shim_bd")) {
+    auto *obj = shimBD->getAsObject();
+    if (!obj) {
+      *errorMessage = "arch model: 'shim_bd' must be an object";
+      return nullptr;
+    }
+    auto &bd = arch->shim_bd;
+    bd.enabled = true;
+    StringRef context = "arch model: shim_bd";
+    if (!getOptionalNumber(*obj, "setup_cycles", bd.setup_cycles, context,
+                           errorMessage) ||
+        !getOptionalNumber(*obj, "max_outstanding", bd.max_outstanding,
+                           context, errorMessage) ||
+        !getOptionalNumber(*obj, "row_cycles", bd.row_cycles, context,
+                           errorMessage) ||
+        !getOptionalNumber(*obj, "poll_cycles", bd.poll_cycles, context,
+                           errorMessage))
+      return nullptr;
+    if (!bd.max_outstanding) {
+      *errorMessage = "arch model: shim_bd: 'max_outstanding' must be at "
+                      "least 1";
+      return nullptr;
+    }
+  }
+
+  // device level compute parameters
+  auto &dk = arch->device_kernel;
+  dk.cores = 1;
+  dk.ops_per_core_per_cycle = 8;
+  dk.clock = arch->clock;
+  dk.efficiency = 1.0;
+  if (!parseKernel(*model, dk, "arch model", errorMessage))
+    return nullptr;
+
+  // kernel level overrides of the device parameters
+  if (auto *kernels = model->get("kernels")) {
+    auto *obj = kernels->getAsObject();
+    if (!obj) {
+      *errorMessage = "arch model: 'kernels' must be an object";
+      return nullptr;
+    }
+    for (auto &k : *obj) {
+      auto *kobj = k.second.getAsObject();
+      std::string context = ("arch model: kernel '" + k.first + "'").str();
+      if (!kobj) {
+        *errorMessage = context + " must be an object";
+        return nullptr;
+      }
+      Kernel kernel = dk;
+      kernel.name = k.first.str();
+      if (!parseKernel(*kobj, kernel, context, errorMessage))
+        return nullptr;
+      arch->kernels[k.first] = kernel;
+    }
+  }
+
+  // channels, with "default" applying to every channel not listed
+  if (auto *channels = model->get("channels")) {
+    auto *obj = channels->getAsObject();
+    if (!obj) {
+      *errorMessage = "arch model: 'channels' must be an object";
+      return nullptr;
+    }
+    auto parseChannel = [&](StringRef name, const json::Value &v,
+                            Channel &channel) {
+      std::string context = ("arch model: channel '" + name + "'").str();
+      auto *cobj = v.getAsObject();
+      if (!cobj) {
+        *errorMessage = context + " must be an object";
+        return false;
+      }
+      if (!getOptionalNumber(*cobj, "depth", channel.depth, context,
+                             errorMessage) ||
+          !getOptionalNumber(*cobj, "bytes_per_second",
+                             channel.bytes_per_second, context, errorMessage))
+        return false;
+      if (!channel.depth) {
+        *errorMessage = context + ": 'depth' must be at least 1";
+        return false;
+      }
+      return true;
+    };
+    if (auto *d = obj->get("default"))
+      if (!parseChannel("default", *d, arch->default_channel))
+        return nullptr;
+    for (auto &c : *obj) {
+      if (c.first == "default")
+        continue;
+      Channel channel = arch->default_channel;
+      if (!parseChannel(c.first, c.second, channel))
+        return nullptr;
+      arch->channels[c.first] = channel;
+    }
+  }
+
+  // memories, keyed by memory space
+  unsigned numSpaces = 3;
+  if (auto *memories = model->get("memories")) {
+    auto *obj = memories->getAsObject();
+    if (!obj) {
+      *errorMessage = "arch model: 'memories' must be an object";
+      return nullptr;
+    }
+    for (auto &m : *obj) {
+      std::string context = ("arch model: memory '" + m.first + "'").str();
+      auto *mobj = m.second.getAsObject();
+      if (!mobj) {
+        *errorMessage = context + " must be an object";
+        return nullptr;
+      }
+      Memory mem;
+      unsigned space;
+      if (StringRef(m.first).getAsInteger(10, space)) {
+        *errorMessage = context + ": key must be a memory space number";
+        return nullptr;
+      }
+      mem.space = space;
+      if (!getOptionalNumber(*mobj, "space", mem.space, context,
+                             errorMessage))
+        return nullptr;
+      if (auto name = mobj->getString("name"))
+        mem.name = name->str();
+      double bytes = 0;
+      if (!getOptionalNumber(*mobj, "bytes", bytes, context, errorMessage))
+        return nullptr;
+      mem.bytes = bytes;
+      auto type = mobj->getString("type");
+      if (!type || (*type != "duplex" && *type != "simplex")) {
+        *errorMessage = context + ": 'type' must be 'duplex' or 'simplex'";
+        return nullptr;
+      }
+      mem.duplex = *type == "duplex";
+      if (mem.space >= arch->memories.size()) {
+        arch->memories.resize(mem.space + 1);
+        arch->memory_valid.resize(mem.space + 1, false);
+      }
+      arch->memories[mem.space] = mem;
+      arch->memory_valid[mem.space] = true;
+      numSpaces = std::max(numSpaces, mem.space + 1);
+    }
+  }
+
+  // interfaces between memory spaces
+  struct Interface {
+    unsigned src, dst;
+    double bps;
+    InterfaceColumns columns;
+  };
+  std::vector<Interface> interfaces;
+  if (auto *ifaces = model->get("interfaces")) {
+    auto *arr = ifaces->getAsArray();
+    if (!arr) {
+      *errorMessage = "arch model: 'interfaces' must be an array";
+      return nullptr;
+    }
+    unsigned idx = 0;
+    for (auto &i : *arr) {
+      std::string context =
+          ("arch model: interface " + Twine(idx++)).str();
+      auto *iobj = i.getAsObject();
+      if (!iobj) {
+        *errorMessage = context + " must be an object";
+        return nullptr;
+      }
+      auto src = iobj->getNumber("src");
+      auto dst = iobj->getNumber("dst");
+      auto bps = iobj->getNumber("bytes_per_second");
+      if (!src || !dst || !bps) {
+        *errorMessage =
+            context + ": 'src', 'dst' and 'bytes_per_second' are required";
+        return nullptr;
+      }
+      if (*src < 0 || *dst < 0 || *bps <= 0) {
+        *errorMessage = context + ": invalid 'src', 'dst' or "
+                                  "'bytes_per_second'";
+        return nullptr;
+      }
+      // optional per shim column limit of a shared interface
+      InterfaceColumns columns;
+      if (!getOptionalNumber(*iobj, "columns", columns.num, context,
+                             errorMessage) ||
+          !getOptionalNumber(*iobj, "column_bytes_per_second",
+                             columns.bytes_per_second, context, errorMessage))
+        return nullptr;
+      if (columns.num && columns.bytes_per_second <= 0) {
+        *errorMessage = context + ": 'columns' requires a positive "
+                                  "'column_bytes_per_second'";
+        return nullptr;
+      }
+      interfaces.push_back({(unsigned)*src, (unsigned)*dst, *bps, columns});
+      numSpaces = std::max(numSpaces, (unsigned)*src + 1);
+      numSpaces = std::max(numSpaces, (unsigned)*dst + 1);
+    }
+    if (!arch->datatype_bytes) {
+      *errorMessage = "arch model: 'datatype' with a non-zero 'bytes' field "
+                      "is required to model interfaces";
+      return nullptr;
+    }
+  }
+
+  // defaults, then overrides from the model
+  arch->interface_bw.assign(numSpaces, std::vector<double>(numSpaces, 0));
+  arch->interface_bw[0][1] = 100;
+  arch->interface_bw[1][0] = 100;
+  arch->interface_bw[1][2] = DBL_MAX;
+  arch->interface_bw[2][1] = DBL_MAX;
+  arch->interface_columns.assign(
+      numSpaces, std::vector<InterfaceColumns>(numSpaces));
+  for (auto &i : interfaces) {
+    arch->interface_bw[i.src][i.dst] = i.bps;
+    arch->interface_columns[i.src][i.dst] = i.columns;
+  }
+
+  return arch;
+}
+
+} // namespace air
+} // namespace xilinx
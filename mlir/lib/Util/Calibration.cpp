@@ -0,0 +1,443 @@
+//===- Calibration.cpp ------------------------------------------*- C++ -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+#include "air/Util/Calibration.h"
+#include "air/Dialect/AIR/AIRDialect.h"
+#include "air/Util/ArchModel.h"
+#include "air/Util/CostModel.h"
+#include "air/Util/Util.h"
+
+#include "mlir/Dialect/Affine/Analysis/LoopAnalysis.h"
+#include "mlir/Dialect/Affine/IR/AffineOps.h"
+#include "mlir/Dialect/Arith/IR/Arith.h"
+#include "mlir/Dialect/Linalg/IR/Linalg.h"
+#include "mlir/Dialect/SCF/IR/SCF.h"
+
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cfloat>
+#include <cmath>
+#include <map>
+
+using namespace mlir;
+
+namespace xilinx {
+namespace air {
+
+namespace {
+
+// An unknown of the fit: the inverse of the efficiency of a kernel, or the
+// cycles per byte of an interface.
+struct Unknown {
+  std::string name;
+  bool isKernel;
+  std::string kernel;
+  unsigned src = 0, dst = 0;
+  // value in the arch model
+  double value;
+  unsigned samples = 0;
+};
+
+// A measurement: `target` cycles, of which `constant` do not depend on the
+// unknowns, and `features` multiplying the unknowns, keyed by their index.
+struct Sample {
+  std::map<unsigned, double> features;
+  double constant = 0;
+  double target;
+};
+
+class Calibrator {
+public:
+  Calibrator(const ArchModel &arch, ModuleOp module) : arch(arch) {
+    module.walk([&](ChannelGetOp get) {
+      channelDstSpace.try_emplace(
+          get.getChanName(),
+          get.getDst().getType().cast<MemRefType>().getMemorySpaceAsInt());
+    });
+  }
+
+  // Add the modeled cycles of `op`, run `multiplicity` times, to `sample`.
+  void addFeatures(Operation *op, double multiplicity, Sample &sample);
+
+  std::vector<Unknown> unknowns;
+
+private:
+  unsigned getKernelUnknown(StringRef name);
+  // Return the unknown of the interface from `src` to `dst`, or -1 if the
+  // model has no such interface.
+  int getInterfaceUnknown(unsigned src, unsigned dst);
+  void addTransfer(unsigned src, unsigned dst, double bytes,
+                   double multiplicity, Sample &sample);
+
+  const ArchModel &arch;
+  CostModel costModel;
+  llvm::StringMap<unsigned> channelDstSpace;
+  std::map<std::string, unsigned> kernelUnknowns;
+  std::map<std::pair<unsigned, unsigned>, unsigned> interfaceUnknowns;
+};
+
+std::string getTypeName(Type type) {
+  std::string s;
+  if (!type)
+    return s;
+  llvm::raw_string_ostream os(s);
+  type.print(os);
+  return os.str();
+}
+
+uint64_t getElementBytes(MemRefType ty) {
+  auto elTy = ty.getElementType();
+  if (elTy.isIntOrFloat())
+    return llvm::divideCeil(elTy.getIntOrFloatBitWidth(), 8);
+  return 8;
+}
+
+// Return the product of the constant `sizes`, or 0 if one is not constant.
+uint64_t getConstantVolume(OperandRange sizes) {
+  if (sizes.empty())
+    return 0;
+  uint64_t volume = 1;
+  for (auto v : sizes) {
+    auto c = v.getDefiningOp<arith::ConstantIndexOp>();
+    if (!c)
+      return 0;
+    volume *= c.value();
+  }
+  return volume;
+}
+
+// Return the constant trip count of `op` if it is a loop, 1 otherwise.
+uint64_t getTripCount(Operation *op) {
+  auto getCount = [](Value lbv, Value ubv, Value stepv) -> uint64_t {
+    auto lb = lbv.getDefiningOp<arith::ConstantIndexOp>();
+    auto ub = ubv.getDefiningOp<arith::ConstantIndexOp>();
+    auto step = stepv.getDefiningOp<arith::ConstantIndexOp>();
+    if (!lb || !ub || !step || step.value() <= 0)
+      return 1;
+    if (ub.value() <= lb.value())
+      return 0;
+    return llvm::divideCeil(ub.value() - lb.value(), step.value());
+  };
+  if (auto forOp = dyn_cast<scf::ForOp>(op))
+    return getCount(forOp.getLowerBound(), forOp.getUpperBound(),
+                    forOp.getStep());
+  if (auto parOp = dyn_cast<scf::ParallelOp>(op)) {
+    uint64_t count = 1;
+    for (auto t : llvm::zip(parOp.getLowerBound(), parOp.getUpperBound(),
+                            parOp.getStep()))
+      count *= getCount(std::get<0>(t), std::get<1>(t), std::get<2>(t));
+    return count;
+  }
+  if (auto afo = dyn_cast<AffineForOp>(op))
+    if (auto c = getConstantTripCount(afo))
+      return *c;
+  return 1;
+}
+
+unsigned Calibrator::getKernelUnknown(StringRef name) {
+  auto it = kernelUnknowns.find(name.str());
+  if (it != kernelUnknowns.end())
+    return it->second;
+  Unknown u;
+  u.name = ("kernel " + name).str();
+  u.isKernel = true;
+  u.kernel = name.str();
+  u.value = 1.0 / arch.getKernel(name).efficiency;
+  unknowns.push_back(u);
+  return kernelUnknowns[name.str()] = unknowns.size() - 1;
+}
+
+int Calibrator::getInterfaceUnknown(unsigned src, unsigned dst) {
+  auto it = interfaceUnknowns.find({src, dst});
+  if (it != interfaceUnknowns.end())
+    return it->second;
+  // Transfers take no time on missing or infinite bandwidth interfaces, or
+  // when the model has no datatype size to count their bytes
+  double bps = arch.getBandwidth(src, dst);
+  if (bps <= 0 || bps == DBL_MAX || !arch.datatype_bytes)
+    return -1;
+  Unknown u;
+  u.name = "interface " + std::to_string(src) + "->" + std::to_string(dst);
+  u.isKernel = false;
+  u.src = src;
+  u.dst = dst;
+  u.value = arch.clock / bps;
+  unknowns.push_back(u);
+  return interfaceUnknowns[{src, dst}] = unknowns.size() - 1;
+}
+
+void Calibrator::addTransfer(unsigned src, unsigned dst, double bytes,
+                             double multiplicity, Sample &sample) {
+  sample.constant += arch.dma_latency * multiplicity;
+  int u = getInterfaceUnknown(src, dst);
+  if (u >= 0)
+    sample.features[u] += bytes * multiplicity;
+}
+
+void Calibrator::addFeatures(Operation *op, double multiplicity,
+                             Sample &sample) {
+  if (auto linalgOp = dyn_cast<linalg::LinalgOp>(op)) {
+    auto &counts = costModel.getLinalgOpCounts(linalgOp);
+    auto &kernel = arch.getKernel(op->getName().getStringRef());
+    // compute cycles at an efficiency of 1
+    double cycles =
+        kernel.getComputeCycles(getTypeName(counts.elementType),
+                                counts.getComputeOps(), counts.macs) *
+        kernel.efficiency;
+    sample.features[getKernelUnknown(op->getName().getStringRef())] +=
+        cycles * multiplicity;
+  } else if (auto dma = dyn_cast<DmaMemcpyInterface>(op)) {
+    auto srcTy = dma.getSrcMemref().getType().cast<MemRefType>();
+    auto dstTy = dma.getDstMemref().getType().cast<MemRefType>();
+    uint64_t volume = 0;
+    if (auto nd = dyn_cast<DmaMemcpyNdOp>(op)) {
+      volume = getConstantVolume(nd.getSrcSizes());
+      if (!volume)
+        volume = getConstantVolume(nd.getDstSizes());
+    }
+    if (!volume)
+      volume = std::min(getTensorVolume(srcTy), getTensorVolume(dstTy));
+    addTransfer(srcTy.getMemorySpaceAsInt(), dstTy.getMemorySpaceAsInt(),
+                volume * getElementBytes(srcTy), multiplicity, sample);
+  } else if (auto put = dyn_cast<ChannelPutOp>(op)) {
+    auto it = channelDstSpace.find(put.getChanName());
+    if (it == channelDstSpace.end())
+      return;
+    auto srcTy = put.getSrc().getType().cast<MemRefType>();
+    uint64_t volume = getConstantVolume(put.getSrcSizes());
+    if (!volume)
+      volume = getTensorVolume(srcTy);
+    addTransfer(srcTy.getMemorySpaceAsInt(), it->second,
+                volume * getElementBytes(srcTy), multiplicity, sample);
+  } else {
+    // the tiles of a herd run in parallel, only loops multiply the work
+    double count = getTripCount(op);
+    for (auto &region : op->getRegions())
+      for (auto &block : region)
+        for (auto &o : block)
+          addFeatures(&o, multiplicity * count, sample);
+  }
+}
+
+// Return the op of `func` named by measurement `m`.
+Operation *findMeasuredOp(func::FuncOp func, const llvm::json::Object &m,
+                          std::string &context, std::string *errorMessage) {
+  Operation *found = nullptr;
+  if (auto herd = m.getString("herd")) {
+    context += " herd '" + herd->str() + "'";
+    func.walk([&](HerdOp op) {
+      auto attr =
+          op->getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName());
+      if (!found && attr && attr.getValue() == *herd)
+        found = op;
+    });
+  } else if (auto name = m.getString("op")) {
+    context += " op '" + name->str() + "'";
+    auto id = m.getInteger("id");
+    auto index = m.getInteger("index").value_or(0);
+    func.walk([&](Operation *op) {
+      if (found || op->getName().getStringRef() != *name)
+        return;
+      if (id) {
+        auto attr = op->getAttrOfType<IntegerAttr>("id");
+        if (attr && attr.getInt() == *id)
+          found = op;
+      } else if (index-- == 0) {
+        found = op;
+      }
+    });
+  } else {
+    *errorMessage = context + ": expected a 'herd' or an 'op'";
+    return nullptr;
+  }
+  if (!found)
+    *errorMessage = context + " not found in the function";
+  return found;
+}
+
+// Solve the linear system `a` x = `b` of size n in place, by Gaussian
+// elimination with partial pivoting. Returns false if it is singular.
+bool solve(std::vector<std::vector<double>> &a, std::vector<double> &b,
+           std::vector<double> &x) {
+  unsigned n = b.size();
+  for (unsigned c = 0; c < n; c++) {
+    unsigned pivot = c;
+    for (unsigned r = c + 1; r < n; r++)
+      if (std::abs(a[r][c]) > std::abs(a[pivot][c]))
+        pivot = r;
+    if (a[pivot][c] == 0)
+      return false;
+    std::swap(a[c], a[pivot]);
+    std::swap(b[c], b[pivot]);
+    for (unsigned r = c + 1; r < n; r++) {
+      double f = a[r][c] / a[c][c];
+      for (unsigned k = c; k < n; k++)
+        a[r][k] -= f * a[c][k];
+      b[r] -= f * b[c];
+    }
+  }
+  x.assign(n, 0);
+  for (int r = n - 1; r >= 0; r--) {
+    double sum = b[r];
+    for (unsigned k = r + 1; k < n; k++)
+      sum -= a[r][k] * x[k];
+    x[r] = sum / a[r][r];
+  }
+  return true;
+}
+
+double getRMS(const std::vector<Sample> &samples,
+              const std::vector<double> &values) {
+  if (samples.empty())
+    return 0;
+  double sum = 0;
+  for (auto &s : samples) {
+    double predicted = s.constant;
+    for (auto &f : s.features)
+      predicted += f.second * values[f.first];
+    sum += (predicted - s.target) * (predicted - s.target);
+  }
+  return std::sqrt(sum / samples.size());
+}
+
+// Return the object `key` of `obj`, creating it if absent.
+llvm::json::Object &getOrCreateObject(llvm::json::Object &obj,
+                                      StringRef key) {
+  if (!obj.getObject(key))
+    obj[key] = llvm::json::Object();
+  return *obj.getObject(key);
+}
+
+llvm::json::Array &getOrCreateArray(llvm::json::Object &obj, StringRef key) {
+  if (!obj.getArray(key))
+    obj[key] = llvm::json::Array();
+  return *obj.getArray(key);
+}
+
+} // namespace
+
+llvm::Optional<llvm::json::Value>
+calibrateArchModel(func::FuncOp func, const llvm::json::Value &archJson,
+                   const llvm::json::Value &measurements,
+                   CalibrationResult &result, std::string *errorMessage) {
+  auto arch = ArchModel::parse(archJson, errorMessage);
+  if (!arch)
+    return llvm::None;
+  auto *list = measurements.getAsArray();
+  if (!list) {
+    *errorMessage = "measurements: expected a JSON array";
+    return llvm::None;
+  }
+
+  Calibrator calibrator(*arch, func->getParentOfType<ModuleOp>());
+  std::vector<Sample> samples;
+  unsigned idx = 0;
+  for (auto &v : *list) {
+    std::string context = "measurement " + std::to_string(idx++);
+    auto *m = v.getAsObject();
+    if (!m) {
+      *errorMessage = context + ": expected an object";
+      return llvm::None;
+    }
+    auto *op = findMeasuredOp(func, *m, context, errorMessage);
+    if (!op)
+      return llvm::None;
+    Sample sample;
+    if (auto cycles = m->getNumber("cycles")) {
+      sample.target = *cycles;
+    } else if (auto seconds = m->getNumber("seconds")) {
+      sample.target = *seconds * arch->clock;
+    } else {
+      *errorMessage = context + ": expected 'cycles' or 'seconds'";
+      return llvm::None;
+    }
+    calibrator.addFeatures(op, 1, sample);
+    if (sample.features.empty())
+      continue;
+    for (auto &f : sample.features)
+      calibrator.unknowns[f.first].samples++;
+    samples.push_back(std::move(sample));
+  }
+
+  auto &unknowns = calibrator.unknowns;
+  unsigned n = unknowns.size();
+  std::vector<double> before(n), after(n);
+  for (unsigned i = 0; i < n; i++)
+    before[i] = unknowns[i].value;
+
+  // Normal equations of the least squares fit. A small ridge term pulls the
+  // unknowns the measurements cannot tell apart towards their current values.
+  std::vector<std::vector<double>> a(n, std::vector<double>(n, 0));
+  std::vector<double> b(n, 0);
+  for (auto &s : samples) {
+    double target = s.target - s.constant;
+    for (auto &fi : s.features) {
+      b[fi.first] += fi.second * target;
+      for (auto &fj : s.features)
+        a[fi.first][fj.first] += fi.second * fj.second;
+    }
+  }
+  double trace = 0;
+  for (unsigned i = 0; i < n; i++)
+    trace += a[i][i];
+  double lambda = n ? 1e-6 * trace / n : 0;
+  for (unsigned i = 0; i < n; i++) {
+    a[i][i] += lambda;
+    b[i] += lambda * before[i];
+  }
+  if (n && !solve(a, b, after)) {
+    *errorMessage = "calibration: the least squares system is singular";
+    return llvm::None;
+  }
+
+  llvm::json::Value updated = archJson;
+  auto &top = *updated.getAsObject();
+  for (unsigned i = 0; i < n; i++) {
+    auto &u = unknowns[i];
+    CalibrationResult::Parameter p;
+    p.name = u.name;
+    p.samples = u.samples;
+    p.fitted = after[i] > 0;
+    if (!p.fitted)
+      after[i] = before[i];
+    if (u.isKernel) {
+      p.before = 1.0 / before[i];
+      p.after = 1.0 / after[i];
+      auto &kernel = getOrCreateObject(getOrCreateObject(top, "kernels"),
+                                       u.kernel);
+      kernel["efficiency"] = p.after;
+    } else {
+      p.before = arch->clock / before[i];
+      p.after = arch->clock / after[i];
+      // Interfaces with a default bandwidth get an entry of their own
+      auto &interfaces = getOrCreateArray(top, "interfaces");
+      bool found = false;
+      for (auto &iv : interfaces) {
+        auto *iface = iv.getAsObject();
+        if (iface && iface->getNumber("src") == (double)u.src &&
+            iface->getNumber("dst") == (double)u.dst) {
+          (*iface)["bytes_per_second"] = p.after;
+          found = true;
+        }
+      }
+      if (!found)
+        interfaces.push_back(llvm::json::Object{{"src", u.src},
+                                                {"dst", u.dst},
+                                                {"bytes_per_second", p.after}});
+    }
+    result.parameters.push_back(p);
+  }
+  result.numSamples = samples.size();
+  result.rmsBefore = getRMS(samples, before);
+  result.rmsAfter = getRMS(samples, after);
+  return updated;
+}
+
+} // namespace air
+} // namespace xilinx
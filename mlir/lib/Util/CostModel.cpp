@@ -14,6 +14,8 @@
 #include "mlir/Dialect/Linalg/IR/Linalg.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
 
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/TypeSwitch.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
@@ -52,70 +54,123 @@ static uint64_t getTensorVolume(const Type ty) {
 }
 
 
-void
-CostModel::getLinalgOpCounts(OpCountMap &map, linalg::LinalgOp op) {
-  OpBuilder b(op);
-  auto loc = op.getLoc();
+CostModel::OpKind CostModel::getOpKind(OperationName name) {
+  static const llvm::StringMap<OpKind> kinds = {
+      {"arith.addf", OpKind::AddF},     {"arith.subf", OpKind::SubF},
+      {"arith.mulf", OpKind::MulF},     {"arith.divf", OpKind::DivF},
+      {"arith.maxf", OpKind::MaxF},     {"arith.cmpf", OpKind::CmpF},
+      {"arith.truncf", OpKind::TruncF}, {"math.rsqrt", OpKind::Rsqrt},
+      {"arith.addi", OpKind::AddI},     {"arith.subi", OpKind::SubI},
+      {"arith.muli", OpKind::MulI},     {"arith.divsi", OpKind::DivI},
+      {"arith.divui", OpKind::DivI},    {"arith.maxsi", OpKind::MaxI},
+      {"arith.maxui", OpKind::MaxI},    {"arith.cmpi", OpKind::CmpI},
+      {"arith.trunci", OpKind::TruncI}, {"arith.select", OpKind::Select}};
+  auto it = kinds.find(name.getStringRef());
+  if (it == kinds.end())
+    return OpKind::Other;
+  return it->second;
+}
 
-  auto allShapeSizes = op.createFlatListOfOperandDims(b, loc);
-  AffineMap shapeSizesToLoopsMap = op.getShapesToLoopsMap();
-  if (!shapeSizesToLoopsMap)
-    return;
+bool CostModel::isMultiplyAccumulate(Operation *op) {
+  auto kind = getOpKind(op->getName());
+  if ((kind != OpKind::MulF && kind != OpKind::MulI) || !op->hasOneUse())
+    return false;
+  auto userKind = getOpKind((*op->user_begin())->getName());
+  return kind == OpKind::MulF ? userKind == OpKind::AddF
+                              : userKind == OpKind::AddI;
+}
+
+uint64_t CostModel::LinalgOpCounts::getComputeOps() const {
+  uint64_t count = 0;
+  for (unsigned i = 0; i < (unsigned)OpKind::Other; i++)
+    count += ops[i];
+  return count;
+}
+
+const CostModel::LinalgOpCounts &
+CostModel::getLinalgOpCounts(linalg::LinalgOp op) {
+  std::vector<const void *> key;
+  key.push_back(op->getName().getAsOpaquePointer());
+  for (auto ty : op->getOperandTypes())
+    key.push_back(ty.getAsOpaquePointer());
+  for (auto map : op.getIndexingMapsArray())
+    key.push_back(map.getAsOpaquePointer());
+  op->getRegion(0).walk([&](Operation *o) {
+    key.push_back(o->getName().getAsOpaquePointer());
+    key.push_back(
+        reinterpret_cast<const void *>((uintptr_t)isMultiplyAccumulate(o)));
+  });
+  for (auto &oper : op->getOpOperands())
+    key.push_back(reinterpret_cast<const void *>(
+        (uintptr_t)op.payloadUsesValueFromOperand(&oper)));
+
+  auto it = linalgCache.find(key);
+  if (it != linalgCache.end())
+    return it->second;
+  return linalgCache.emplace(key, computeLinalgOpCounts(op)).first->second;
+}
+
+CostModel::LinalgOpCounts
+CostModel::computeLinalgOpCounts(linalg::LinalgOp op) {
+  LinalgOpCounts counts;
+  if (!op.getShapesToLoopsMap())
+    return counts;
 
-  SmallVector<OpFoldResult> shapeSizes =
-      makeComposedFoldedMultiResultAffineApply(b, loc, shapeSizesToLoopsMap,
-                                               allShapeSizes);
   int64_t iters = 1;
-  int64_t reads = 0;
-  int64_t writes = 0;
-  uint64_t footprint = 0;
-  for (auto size : shapeSizes) {
-    if (auto v = size.dyn_cast<Value>()) {
-      auto c = dyn_cast<arith::ConstantIndexOp>(v.getDefiningOp());
-      if (!c) {
-        LLVM_DEBUG(llvm::outs() << "Found non-constant dim!\n");
-        return;
-      }
-      iters *= c.value();
-    } else {
-      auto a = size.dyn_cast<Attribute>();
-      auto c = a.dyn_cast<IntegerAttr>();
-      if (!c) {
-        LLVM_DEBUG(llvm::outs() << "unhandled addr!\n");
-        return;
-      }
-      iters *= c.getInt();
+  for (auto range : op.getStaticLoopRanges()) {
+    if (ShapedType::isDynamic(range)) {
+      LLVM_DEBUG(llvm::outs() << "Found non-constant dim!\n");
+      return counts;
     }
+    iters *= range;
   }
-  Region &region = op.getOperation()->getRegion(0);
-  region.walk([&](Operation *op) {
-    OperationName name = op->getName();
-    std::string s = name.getStringRef().str();
-    if (map.count(s) == 0)
-      map.map.insert({s, 0});
-    map[s] = map[s] + 1;
+  counts.isStatic = true;
+  counts.iterations = iters;
+
+  op->getRegion(0).walk([&](Operation *o) {
+    if (isa<linalg::YieldOp>(o))
+      return;
+    counts.ops[(unsigned)getOpKind(o->getName())] += iters;
+    if (isMultiplyAccumulate(o))
+      counts.macs += iters;
+    auto it = llvm::find_if(counts.opsByName,
+                            [&](auto &p) { return p.first == o->getName(); });
+    if (it == counts.opsByName.end())
+      counts.opsByName.push_back({o->getName(), iters});
+    else
+      it->second += iters;
   });
+  // the inputs come first in the operands
+  for (auto &oper : op->getOpOperands()) {
+    if (auto ty = oper.get().getType().dyn_cast<ShapedType>()) {
+      counts.elementType = ty.getElementType();
+      break;
+    }
+  }
   for (auto &oper : op.getDpsInputOperands()) {
     if (op.payloadUsesValueFromOperand(oper))
-      reads++;
-    footprint += getTensorVolume(oper->get().getType());
+      counts.reads += iters;
+    counts.footprint += getTensorVolume(oper->get().getType());
   }
   for (auto &oper : op.getDpsInitOperands()) {
     if (op.payloadUsesValueFromOperand(oper))
-      reads++;
-    writes++;
-    footprint += getTensorVolume(oper->get().getType());
+      counts.reads += iters;
+    counts.writes += iters;
+    counts.footprint += getTensorVolume(oper->get().getType());
   }
-  map.map.insert({"reads", reads});
-  map.map.insert({"writes", writes});
-  map.map.erase("linalg.yield");
-
-  for (auto &m : map.map)
-    m.second = m.second * iters;
-
-  map.map.insert({"footprint", footprint});
+  return counts;
+}
 
-  return;
+void
+CostModel::getLinalgOpCounts(OpCountMap &map, linalg::LinalgOp op) {
+  auto &counts = getLinalgOpCounts(op);
+  if (!counts.isStatic)
+    return;
+  for (auto &p : counts.opsByName)
+    map.map.insert({p.first.getStringRef().str(), p.second});
+  map.map.insert({"reads", counts.reads});
+  map.map.insert({"writes", counts.writes});
+  map.map.insert({"footprint", counts.footprint});
 }
 
 void
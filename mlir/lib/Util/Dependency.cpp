@@ -7,6 +7,13 @@
 //===----------------------------------------------------------------------===//
 
 #include "air/Util/Dependency.h"
+
+#include "mlir/Dialect/Affine/Analysis/AffineStructures.h"
+#include "mlir/Dialect/Utils/StaticValueUtils.h"
+#include "mlir/IR/Dominance.h"
+
+#include "llvm/ADT/BitVector.h"
+
 #include <sys/stat.h>
 
 #define DEBUG_TYPE "air-dependency-util"
@@ -42,6 +49,234 @@ bool areEqualIndices(mlir::Value index_0, mlir::Value index_1) {
   }
 }
 
+//===----------------------------------------------------------------------===//
+// Memref tile overlap analysis
+//===----------------------------------------------------------------------===//
+
+namespace {
+
+// An index as an affine form: sum of coefficient * value, plus a constant
+struct indexAffineForm {
+  DenseMap<Value, int64_t> coeffs;
+  int64_t constant = 0;
+
+  void add(const indexAffineForm &other, int64_t scale) {
+    for (auto &c : other.coeffs)
+      coeffs[c.first] += scale * c.second;
+    constant += scale * other.constant;
+  }
+};
+
+indexAffineForm getIndexAffineForm(Value v);
+
+// Affine form of expr applied to operands, or None if it is not linear
+Optional<indexAffineForm> getAffineExprForm(AffineExpr expr,
+                                            ValueRange operands,
+                                            unsigned numDims) {
+  indexAffineForm form;
+  if (auto cst = expr.dyn_cast<AffineConstantExpr>()) {
+    form.constant = cst.getValue();
+  } else if (auto dim = expr.dyn_cast<AffineDimExpr>()) {
+    form = getIndexAffineForm(operands[dim.getPosition()]);
+  } else if (auto sym = expr.dyn_cast<AffineSymbolExpr>()) {
+    form = getIndexAffineForm(operands[numDims + sym.getPosition()]);
+  } else if (auto bin = expr.dyn_cast<AffineBinaryOpExpr>()) {
+    auto lhs = getAffineExprForm(bin.getLHS(), operands, numDims);
+    auto rhs = getAffineExprForm(bin.getRHS(), operands, numDims);
+    if (!lhs || !rhs)
+      return None;
+    if (expr.getKind() == AffineExprKind::Add) {
+      form = *lhs;
+      form.add(*rhs, 1);
+    } else if (expr.getKind() == AffineExprKind::Mul && rhs->coeffs.empty()) {
+      form.add(*lhs, rhs->constant);
+    } else if (expr.getKind() == AffineExprKind::Mul && lhs->coeffs.empty()) {
+      form.add(*rhs, lhs->constant);
+    } else {
+      return None;
+    }
+  }
+  return form;
+}
+
+// Decompose an index through constants, affine.apply, arith add, sub and
+// mul by a constant, air.execute results and hierarchy sizes. Any other value
+// is a variable of the form.
+indexAffineForm getIndexAffineForm(Value v) {
+  indexAffineForm form;
+  if (auto cst = getConstantIntValue(v)) {
+    form.constant = *cst;
+    return form;
+  }
+  if (auto arg = v.dyn_cast<BlockArgument>()) {
+    if (auto hier = dyn_cast_or_null<air::HierarchyInterface>(
+            arg.getOwner()->getParentOp())) {
+      auto size = hier.getSize();
+      for (unsigned i = 0; i < size.size(); i++)
+        if (size[i] == arg)
+          return getIndexAffineForm(hier.getSizeOperands()[i]);
+    }
+  } else if (auto exec = v.getDefiningOp<air::ExecuteOp>()) {
+    // Result 0 is the async token
+    auto idx = v.cast<OpResult>().getResultNumber();
+    if (idx > 0)
+      return getIndexAffineForm(
+          exec.getRegion().front().getTerminator()->getOperand(idx - 1));
+  } else if (auto apply = v.getDefiningOp<mlir::AffineApplyOp>()) {
+    auto map = apply.getAffineMap();
+    if (map.getNumResults() == 1)
+      if (auto result = getAffineExprForm(
+              map.getResult(0), apply.getMapOperands(), map.getNumDims()))
+        return *result;
+  } else if (auto add = v.getDefiningOp<arith::AddIOp>()) {
+    form.add(getIndexAffineForm(add.getLhs()), 1);
+    form.add(getIndexAffineForm(add.getRhs()), 1);
+    return form;
+  } else if (auto sub = v.getDefiningOp<arith::SubIOp>()) {
+    form.add(getIndexAffineForm(sub.getLhs()), 1);
+    form.add(getIndexAffineForm(sub.getRhs()), -1);
+    return form;
+  } else if (auto mul = v.getDefiningOp<arith::MulIOp>()) {
+    if (auto cst = getConstantIntValue(mul.getRhs())) {
+      form.add(getIndexAffineForm(mul.getLhs()), *cst);
+      return form;
+    } else if (auto cst = getConstantIntValue(mul.getLhs())) {
+      form.add(getIndexAffineForm(mul.getRhs()), *cst);
+      return form;
+    }
+  }
+  form.coeffs[v] = 1;
+  return form;
+}
+
+// Value of an index if it folds to a constant
+Optional<int64_t> getConstantIndex(Value v) {
+  auto form = getIndexAffineForm(v);
+  for (auto &c : form.coeffs)
+    if (c.second)
+      return None;
+  return form.constant;
+}
+
+Optional<int64_t> getConstantIndex(OpFoldResult ofr) {
+  if (auto v = ofr.dyn_cast<Value>())
+    return getConstantIndex(v);
+  return getConstantIntValue(ofr);
+}
+
+// Constant sizes and strides of a tile, with the strides of the memref
+// layout if the tile has none. Returns false if they are not all known.
+bool getConstantTileExtents(partialMemref *tile, SmallVector<int64_t> &sizes,
+                            SmallVector<int64_t> &strides) {
+  if (!tile->numDims || tile->memrefSizes.size() != tile->numDims)
+    return false;
+  SmallVector<int64_t> layout_strides;
+  if (tile->memrefStrides.empty()) {
+    auto type = tile->memrefValue.getType().dyn_cast<MemRefType>();
+    int64_t offset;
+    if (!type || (unsigned)type.getRank() != tile->numDims ||
+        failed(getStridesAndOffset(type, layout_strides, offset)) ||
+        llvm::any_of(layout_strides,
+                     [](int64_t s) { return ShapedType::isDynamic(s); }))
+      return false;
+  }
+  for (unsigned i = 0; i < tile->numDims; i++) {
+    if (!tile->memrefIndices[i])
+      return false;
+    auto size = getConstantIndex(tile->memrefSizes[i]);
+    if (!size)
+      return false;
+    sizes.push_back(*size);
+    if (layout_strides.size()) {
+      strides.push_back(layout_strides[i]);
+    } else if (auto stride = getConstantIndex(tile->memrefStrides[i])) {
+      strides.push_back(*stride);
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+void setPartialMemrefExtents(partialMemref &tile, ValueRange offsets,
+                             ValueRange sizes, ValueRange strides) {
+  if (offsets.empty() || sizes.size() != offsets.size() ||
+      (strides.size() && strides.size() != offsets.size()))
+    return;
+  tile.numDims = offsets.size();
+  tile.memrefIndices.assign(offsets.begin(), offsets.end());
+  setPartialMemrefExtents(tile, getAsOpFoldResult(sizes),
+                          getAsOpFoldResult(strides));
+}
+
+void setPartialMemrefExtents(partialMemref &tile,
+                             ArrayRef<OpFoldResult> sizes,
+                             ArrayRef<OpFoldResult> strides) {
+  if (sizes.size() != tile.numDims ||
+      (strides.size() && strides.size() != tile.numDims))
+    return;
+  tile.memrefSizes.assign(sizes.begin(), sizes.end());
+  tile.memrefStrides.assign(strides.begin(), strides.end());
+}
+
+bool areOverlappingPartialMemrefs(partialMemref *tile_0,
+                                  partialMemref *tile_1) {
+  // Without constant extents, a tile may span any element of the memref
+  SmallVector<int64_t> sizes_0, strides_0, sizes_1, strides_1;
+  if (!getConstantTileExtents(tile_0, sizes_0, strides_0) ||
+      !getConstantTileExtents(tile_1, sizes_1, strides_1))
+    return true;
+
+  // The tiles access element sum_i (index_i + pos_i) * stride_i, with
+  // 0 <= pos_i < size_i, over the dims of each tile. Equal elements mean
+  // overlap.
+  indexAffineForm diff;
+  for (unsigned i = 0; i < tile_0->numDims; i++) {
+    if (!sizes_0[i])
+      return false;
+    diff.add(getIndexAffineForm(tile_0->memrefIndices[i]), strides_0[i]);
+  }
+  for (unsigned i = 0; i < tile_1->numDims; i++) {
+    if (!sizes_1[i])
+      return false;
+    diff.add(getIndexAffineForm(tile_1->memrefIndices[i]), -strides_1[i]);
+  }
+
+  // Columns are the variables of the index forms, followed by the positions
+  // within both tiles
+  DenseMap<Value, unsigned> columns;
+  for (auto &c : diff.coeffs)
+    if (c.second)
+      columns.insert({c.first, columns.size()});
+  SmallVector<int64_t> pos_coeffs, pos_sizes;
+  for (unsigned i = 0; i < tile_0->numDims; i++) {
+    pos_coeffs.push_back(strides_0[i]);
+    pos_sizes.push_back(sizes_0[i]);
+  }
+  for (unsigned i = 0; i < tile_1->numDims; i++) {
+    pos_coeffs.push_back(-strides_1[i]);
+    pos_sizes.push_back(sizes_1[i]);
+  }
+  unsigned numCols = columns.size() + pos_coeffs.size();
+  FlatAffineValueConstraints cst(numCols, 0, 0);
+  SmallVector<int64_t> row(numCols + 1, 0);
+  for (auto &c : diff.coeffs)
+    if (c.second)
+      row[columns[c.first]] = c.second;
+  for (unsigned i = 0; i < pos_coeffs.size(); i++)
+    row[columns.size() + i] = pos_coeffs[i];
+  row[numCols] = diff.constant;
+  cst.addEquality(row);
+  for (unsigned i = 0; i < pos_sizes.size(); i++) {
+    cst.addBound(FlatAffineValueConstraints::LB, columns.size() + i, 0);
+    cst.addBound(FlatAffineValueConstraints::UB, columns.size() + i,
+                 pos_sizes[i] - 1);
+  }
+  return !cst.isEmpty();
+}
+
 // Recursively check for dependency to loop induction vars arising from dma src
 void traceDependentInductionVar(air::DmaMemcpyInterface async_op,
                                 SmallVector<Value, 1> &loop_dep_history,
@@ -298,68 +533,204 @@ air::ChannelOp getChannelDeclarationThroughSymbol(air::ChannelInterface op) {
   return dyn_cast<air::ChannelOp>(module.lookupSymbol(op.getChanName()));
 }
 
-// Get the other channel op through channel symbol
-air::ChannelGetOp getTheOtherChannelOpThroughSymbol(air::ChannelPutOp put) {
-  auto module = put->getParentOfType<ModuleOp>();
-  // auto channel_op =
-  //     dyn_cast<air::ChannelOp>(module.lookupSymbol(put.getChanName()));
-  auto channel_op = getChannelDeclarationThroughSymbol(
-      dyn_cast<air::ChannelInterface>(put.getOperation()));
-  auto attr =
-      channel_op->getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName());
+//===----------------------------------------------------------------------===//
+// Channel symbol index
+//===----------------------------------------------------------------------===//
 
-  air::ChannelGetOp output = nullptr;
+void channelIndex::build() {
+  entries.clear();
   module.walk([&](Operation *op) {
-    if (auto get = dyn_cast<air::ChannelGetOp>(op)) {
-      if (get.getChanName() == attr) {
-        if (output)
-          assert(false && "found multiple occurrences of channel get");
-        else
-          output = get;
-      }
-    }
+    if (!removed.count(op))
+      add(op);
   });
-
-  if (output)
-    return output;
-  else
+  valid = true;
+}
+
+void channelIndex::add(Operation *op) {
+  if (auto channel_op = dyn_cast<air::ChannelOp>(op)) {
+    auto &entry = entries[channel_op.getSymName()];
+    entry.declaration = channel_op;
+    entry.size = extractFromI64ArrayAttr(channel_op.getSize());
+    entry.broadcast_shape.clear();
+    if (auto bshape =
+            channel_op->getAttrOfType<mlir::ArrayAttr>("broadcast_shape"))
+      entry.broadcast_shape = extractFromI64ArrayAttr(bshape);
+  } else if (auto put = dyn_cast<air::ChannelPutOp>(op)) {
+    auto &puts = entries[put.getChanName()].puts;
+    if (!llvm::is_contained(puts, put))
+      puts.push_back(put);
+  } else if (auto get = dyn_cast<air::ChannelGetOp>(op)) {
+    auto &gets = entries[get.getChanName()].gets;
+    if (!llvm::is_contained(gets, get))
+      gets.push_back(get);
+  }
+}
+
+const channelIndex::channelEntry *channelIndex::lookup(StringRef chan_name) {
+  if (!valid)
+    build();
+  auto it = entries.find(chan_name);
+  if (it == entries.end() || !it->second.declaration)
+    return nullptr;
+  return &it->second;
+}
+
+air::ChannelGetOp channelIndex::getTheOtherChannelOp(air::ChannelPutOp put) {
+  auto entry = lookup(put.getChanName());
+  if (!entry || entry->gets.empty())
     return air::ChannelGetOp();
+  assert(entry->gets.size() == 1 &&
+         "found multiple occurrences of channel get");
+  return entry->gets.front();
 }
-air::ChannelPutOp getTheOtherChannelOpThroughSymbol(air::ChannelGetOp get) {
-  auto module = get->getParentOfType<ModuleOp>();
-  auto channel_op = getChannelDeclarationThroughSymbol(
-      dyn_cast<air::ChannelInterface>(get.getOperation()));
-  auto attr =
-      channel_op->getAttrOfType<StringAttr>(SymbolTable::getSymbolAttrName());
 
-  air::ChannelPutOp output = nullptr;
-  module.walk([&](Operation *op) {
-    if (auto put = dyn_cast<air::ChannelPutOp>(op)) {
-      if (put.getChanName() == attr) {
-        if (output)
-          assert(false && "found multiple occurrences of channel put");
-        else
-          output = put;
-      }
+air::ChannelPutOp channelIndex::getTheOtherChannelOp(air::ChannelGetOp get) {
+  auto entry = lookup(get.getChanName());
+  if (!entry || entry->puts.empty())
+    return air::ChannelPutOp();
+  assert(entry->puts.size() == 1 &&
+         "found multiple occurrences of channel put");
+  return entry->puts.front();
+}
+
+void channelIndex::notifyOperationInserted(Operation *op) {
+  // Cloning a region only notifies the listener of the clone of its parent
+  op->walk([&](Operation *o) {
+    if (!isa<air::ChannelOp, air::ChannelInterface>(o))
+      return;
+    removed.erase(o);
+    if (valid)
+      add(o);
+  });
+}
+
+void channelIndex::notifyOperationRemoved(Operation *op) {
+  // Erasing a region erases the channel ops nested in it
+  op->walk([&](Operation *o) {
+    if (!isa<air::ChannelOp, air::ChannelInterface>(o))
+      return;
+    removed.insert(o);
+    if (!valid)
+      return;
+    if (auto channel_op = dyn_cast<air::ChannelOp>(o)) {
+      auto it = entries.find(channel_op.getSymName());
+      if (it != entries.end() && it->second.declaration == channel_op)
+        it->second.declaration = nullptr;
+    } else if (auto put = dyn_cast<air::ChannelPutOp>(o)) {
+      llvm::erase_value(entries[put.getChanName()].puts, put);
+    } else if (auto get = dyn_cast<air::ChannelGetOp>(o)) {
+      llvm::erase_value(entries[get.getChanName()].gets, get);
     }
   });
+}
 
-  if (output)
-    return output;
-  else
-    return air::ChannelPutOp();
+void channelIndex::invalidate() {
+  valid = false;
+  entries.clear();
 }
 
 //===----------------------------------------------------------------------===//
 // Dependency graph as a Boost graph object
 //===----------------------------------------------------------------------===//
 
+std::vector<unsigned> dependencyCSRGraph::getReverseTopologicalOrder() const {
+  enum { white, gray, black };
+  unsigned n = getNumVertices();
+  std::vector<unsigned> order;
+  order.reserve(n);
+  std::vector<char> color(n, white);
+  // Iterative depth first search, visiting the successors in edge order
+  SmallVector<std::pair<unsigned, unsigned>, 16> stack;
+  for (unsigned root = 0; root < n; root++) {
+    if (color[root] != white)
+      continue;
+    color[root] = gray;
+    stack.push_back({root, offsets[root]});
+    while (!stack.empty()) {
+      auto &top = stack.back();
+      unsigned v = top.first;
+      if (top.second == offsets[v + 1]) {
+        color[v] = black;
+        order.push_back(v);
+        stack.pop_back();
+        continue;
+      }
+      unsigned w = targets[top.second++];
+      assert(color[w] != gray && "dependency graph is not a DAG");
+      if (color[w] == white) {
+        color[w] = gray;
+        stack.push_back({w, offsets[w]});
+      }
+    }
+  }
+  return order;
+}
+
+dependencyCSRGraph dependencyCSRGraph::getTransitiveReduction(
+    std::vector<unsigned> &tr_to_g) const {
+  unsigned n = getNumVertices();
+  auto order = getReverseTopologicalOrder();
+  // Topological number of each vertex
+  std::vector<unsigned> topo(n);
+  tr_to_g.assign(order.rbegin(), order.rend());
+  for (unsigned i = 0; i < n; i++)
+    topo[tr_to_g[i]] = i;
+
+  // Vertices reachable from each vertex, indexed by topological number.
+  // Visiting the vertices in reverse topological order and their successors
+  // in topological order, an edge is redundant if its target is already
+  // reachable through an earlier successor.
+  std::vector<llvm::BitVector> reach(n);
+  std::vector<SmallVector<unsigned, 4>> kept(n); // by topological number
+  SmallVector<unsigned, 8> succs;
+  for (auto v : order) {
+    auto &reach_v = reach[topo[v]];
+    reach_v.resize(n);
+    reach_v.set(topo[v]);
+    auto s = getSuccessors(v);
+    succs.assign(s.begin(), s.end());
+    llvm::sort(succs,
+               [&](unsigned a, unsigned b) { return topo[a] < topo[b]; });
+    for (auto w : succs) {
+      if (reach_v.test(topo[w]))
+        continue;
+      reach_v |= reach[topo[w]];
+      kept[topo[v]].push_back(topo[w]);
+    }
+  }
+
+  dependencyCSRGraph tr(n);
+  for (unsigned v = 0; v < n; v++) {
+    tr.targets.insert(tr.targets.end(), kept[v].begin(), kept[v].end());
+    tr.offsets[v + 1] = tr.targets.size();
+  }
+  return tr;
+}
+
+dependencyCSRGraph dependencyCSRGraph::getTranspose() const {
+  unsigned n = getNumVertices();
+  dependencyCSRGraph t(n);
+  t.targets.resize(getNumEdges());
+  for (auto w : targets)
+    t.offsets[w + 1]++;
+  for (unsigned v = 0; v < n; v++)
+    t.offsets[v + 1] += t.offsets[v];
+  std::vector<unsigned> next(t.offsets.begin(), t.offsets.end() - 1);
+  for (unsigned v = n; v-- > 0;)
+    for (auto w : getSuccessors(v))
+      t.targets[next[w]++] = v;
+  return t;
+}
+
 void dependencyCanonicalizer::parseCommandGraphs(func::FuncOp &toplevel,
                                                  dependencyGraph &global_graph,
                                                  dependencyContext &dep_ctx,
+                                                 channelIndex &channels,
                                                  bool dump_dot,
                                                  std::string dump_dir) {
 
+  channel_index = &channels;
+
   // Create vertices for graphs
   // Build up host graph
   toplevel.walk([&](Operation *op) {
@@ -496,7 +867,7 @@ void dependencyCanonicalizer::copyDependencyGraphToFlatGraphAndVisualize(
   auto vp = boost::vertices(global_graph.g);
   for (auto vit = vp.first; vit != vp.second; ++vit) {
     if (global_graph.g[*vit].asyncEventName == "LaunchOp") {
-      auto G_l = *global_graph.g[*vit].nextDependencyGraph;
+      auto &G_l = *global_graph.g[*vit].nextDependencyGraph;
       FlatGraph &flat_subg_l = flat_g.create_subgraph();
       updateSubgraphFromDependencyGraph(G_l.g, flat_subg_l, maps[index], true);
       boost::get_property(flat_subg_l, boost::graph_name) =
@@ -510,7 +881,7 @@ void dependencyCanonicalizer::copyDependencyGraphToFlatGraphAndVisualize(
       auto vp_l = boost::vertices(G_l.g);
       for (auto vit_l = vp_l.first; vit_l != vp_l.second; ++vit_l) {
         if (G_l.g[*vit_l].asyncEventName == "PartitionOp") {
-          auto G_p = *G_l.g[*vit_l].nextDependencyGraph;
+          auto &G_p = *G_l.g[*vit_l].nextDependencyGraph;
           FlatGraph &flat_subg_p = flat_subg_l.create_subgraph();
           updateSubgraphFromDependencyGraph(G_p.g, flat_subg_p, maps[index],
                                             true);
@@ -528,7 +899,7 @@ void dependencyCanonicalizer::copyDependencyGraphToFlatGraphAndVisualize(
           auto vp_p = boost::vertices(G_p.g);
           for (auto vit_p = vp_p.first; vit_p != vp_p.second; ++vit_p) {
             if (G_p.g[*vit_p].asyncEventName == "HerdOp") {
-              auto G_h = *G_p.g[*vit_p].nextDependencyGraph;
+              auto &G_h = *G_p.g[*vit_p].nextDependencyGraph;
               FlatGraph &flat_subg_h = flat_subg_p.create_subgraph();
               updateSubgraphFromDependencyGraph(G_h.g, flat_subg_h, maps[index],
                                                 true);
@@ -675,20 +1046,22 @@ Graph::vertex_descriptor dependencyCanonicalizer::addVertexFromDmaOp(
 
 Graph::vertex_descriptor dependencyCanonicalizer::addVertexFromChannelOp(
     xilinx::air::ChannelInterface op, Graph &G, dependencyContext &dep_ctx) {
+  auto &channels = *channel_index;
   if (auto channel_put =
           dyn_cast<xilinx::air::ChannelPutOp>(op.getOperation())) {
     std::string memorySpaceSrcStr =
         getMemorySpaceAsString(channel_put.getSrcMemref());
-    auto channel_get = getTheOtherChannelOpThroughSymbol(channel_put);
+    auto channel_get = channels.getTheOtherChannelOp(channel_put);
     assert(channel_get && "found channel op not in pairs");
     std::string memorySpaceDstStr =
         getMemorySpaceAsString(channel_get.getDstMemref());
     std::string event_name = "ChannelPutOp@" + channel_put.getChanName().str() +
                              "(" + memorySpaceSrcStr + "-->" +
                              memorySpaceDstStr + ")";
-    auto channel_op = getChannelDeclarationThroughSymbol(op);
-    if (channel_op->hasAttr("broadcast_shape")) {
-      auto size = extractFromI64ArrayAttr(channel_op.getSize());
+    auto entry = channels.lookup(op.getChanName());
+    assert(entry && "found channel op without declaration");
+    if (!entry->broadcast_shape.empty()) {
+      auto &size = entry->size;
       event_name += "\n(broadcast[";
       for (auto &s : size) {
         event_name += std::to_string(s);
@@ -696,8 +1069,7 @@ Graph::vertex_descriptor dependencyCanonicalizer::addVertexFromChannelOp(
           event_name += ",";
       }
       event_name += "]-->[";
-      auto bsize = extractFromI64ArrayAttr(
-          channel_op->getAttrOfType<mlir::ArrayAttr>("broadcast_shape"));
+      auto &bsize = entry->broadcast_shape;
       for (auto &s : bsize) {
         event_name += std::to_string(s);
         if (&s != &bsize.back())
@@ -711,16 +1083,17 @@ Graph::vertex_descriptor dependencyCanonicalizer::addVertexFromChannelOp(
                  dyn_cast<xilinx::air::ChannelGetOp>(op.getOperation())) {
     std::string memorySpaceDstStr =
         getMemorySpaceAsString(channel_get.getDstMemref());
-    auto channel_put = getTheOtherChannelOpThroughSymbol(channel_get);
+    auto channel_put = channels.getTheOtherChannelOp(channel_get);
     assert(channel_put && "found channel op not in pairs");
     std::string memorySpaceSrcStr =
         getMemorySpaceAsString(channel_put.getSrcMemref());
     std::string event_name = "ChannelGetOp@" + channel_get.getChanName().str() +
                              "(" + memorySpaceDstStr + "<--" +
                              memorySpaceSrcStr + ")";
-    auto channel_op = getChannelDeclarationThroughSymbol(op);
-    if (channel_op->hasAttr("broadcast_shape")) {
-      auto size = extractFromI64ArrayAttr(channel_op.getSize());
+    auto entry = channels.lookup(op.getChanName());
+    assert(entry && "found channel op without declaration");
+    if (!entry->broadcast_shape.empty()) {
+      auto &size = entry->size;
       event_name += "\n(broadcast[";
       for (auto &s : size) {
         event_name += std::to_string(s);
@@ -728,8 +1101,7 @@ Graph::vertex_descriptor dependencyCanonicalizer::addVertexFromChannelOp(
           event_name += ",";
       }
       event_name += "]-->[";
-      auto bsize = extractFromI64ArrayAttr(
-          channel_op->getAttrOfType<mlir::ArrayAttr>("broadcast_shape"));
+      auto &bsize = entry->broadcast_shape;
       for (auto &s : bsize) {
         event_name += std::to_string(s);
         if (&s != &bsize.back())
@@ -900,12 +1272,27 @@ std::string dependencyCanonicalizer::getOpTypeFromOpImpls(Operation *op) {
   }
 }
 
+// Look up the vertex and graph of an op entry, or a null graph if the op has
+// no vertex
+static std::pair<Graph::vertex_descriptor, Graph *>
+lookupVertex(const dependencyContext &dep_ctx,
+             const std::pair<std::string, unsigned> &entry_pair) {
+  std::pair<Graph::vertex_descriptor, Graph *> output(0, nullptr);
+  auto v = dep_ctx.op_to_v.find(entry_pair);
+  if (v != dep_ctx.op_to_v.end())
+    output.first = v->second;
+  auto g = dep_ctx.op_to_g.find(entry_pair);
+  if (g != dep_ctx.op_to_g.end())
+    output.second = g->second;
+  return output;
+}
+
 // Get vertex descriptor from op
 // "front_or_back": if op is an air.execute, then "front" returns the first op
 // in region, while "back" returns the terminator in region.
 std::pair<Graph::vertex_descriptor, Graph *>
 dependencyCanonicalizer::getVertexFromOp(Operation *op,
-                                         dependencyContext dep_ctx,
+                                         const dependencyContext &dep_ctx,
                                          std::string front_or_back) {
   std::pair<Graph::vertex_descriptor, Graph *> output;
   if (auto execute_op = dyn_cast<xilinx::air::ExecuteOp>(op)) {
@@ -913,30 +1300,27 @@ dependencyCanonicalizer::getVertexFromOp(Operation *op,
       auto execute_front_op = &(*op->getRegions().front().op_begin());
       std::pair<std::string, unsigned> entry_pair =
           getTypeIdPairFromOp(execute_front_op);
-      output.first = dep_ctx.op_to_v[entry_pair];
-      output.second = dep_ctx.op_to_g[entry_pair];
+      output = lookupVertex(dep_ctx, entry_pair);
     } else if (front_or_back == "back") {
       auto execute_end_op =
           op->getRegions().front().getBlocks().front().getTerminator();
       std::pair<std::string, unsigned> entry_pair =
           getTypeIdPairFromOp(execute_end_op);
-      output.first = dep_ctx.op_to_v[entry_pair];
-      output.second = dep_ctx.op_to_g[entry_pair];
+      output = lookupVertex(dep_ctx, entry_pair);
     } else {
       assert(false &&
              "Unknown string operand (only accepts 'front' or 'back')");
     }
   } else {
     std::pair<std::string, unsigned> entry_pair = getTypeIdPairFromOp(op);
-    output.first = dep_ctx.op_to_v[entry_pair];
-    output.second = dep_ctx.op_to_g[entry_pair];
+    output = lookupVertex(dep_ctx, entry_pair);
   }
   return output;
 }
 
 // Copy vertices and edges from dependencyGraph to FlatGraph
 void dependencyCanonicalizer::copyFromDependencyGraphToFlatGraph(
-    Graph g_src, FlatGraph &g_dst, vertex_to_flat_vertex_map &map,
+    const Graph &g_src, FlatGraph &g_dst, vertex_to_flat_vertex_map &map,
     bool copyEdges) {
   // Copy vertices
   auto vp = boost::vertices(g_src);
@@ -964,7 +1348,7 @@ void dependencyCanonicalizer::copyFromDependencyGraphToFlatGraph(
 
 // Update subgraph in FlatGraph from dependencyGraph
 void dependencyCanonicalizer::updateSubgraphFromDependencyGraph(
-    Graph subg_src, FlatGraph &subg_dst, vertex_to_flat_vertex_map map,
+    const Graph &subg_src, FlatGraph &subg_dst, vertex_to_flat_vertex_map &map,
     bool copyEdges) {
   // Update vertices
   vertex_to_flat_vertex_map subg_map;
@@ -987,7 +1371,7 @@ void dependencyCanonicalizer::updateSubgraphFromDependencyGraph(
 
 // Collect air.channel put and get pairs
 void dependencyCanonicalizer::collectAIRChannelPutAndGetInGraph(
-    Graph g, vertex_to_flat_vertex_map map, ChannelMap &channel_map) {
+    const Graph &g, vertex_to_flat_vertex_map &map, ChannelMap &channel_map) {
   // Search for air.channep put/get
   auto vp = boost::vertices(g);
   for (auto vit = vp.first; vit != vp.second; ++vit) {
@@ -1012,7 +1396,7 @@ void dependencyCanonicalizer::collectAIRChannelPutAndGetInGraph(
 
 // Trace dependency of every op in a boost graph
 void dependencyCanonicalizer::parseDependencyEdgesInGraph(
-    Graph &g, dependencyContext dep_ctx) {
+    Graph &g, const dependencyContext &dep_ctx) {
   auto vp = boost::vertices(g);
   for (auto vit = vp.first; vit != vp.second; ++vit) {
     auto op = g[*vit].op;
@@ -1023,7 +1407,7 @@ void dependencyCanonicalizer::parseDependencyEdgesInGraph(
 }
 
 void dependencyCanonicalizer::connectOpToItsDepListImpls(
-    Operation *op, Graph &g, dependencyContext dep_ctx) {
+    Operation *op, Graph &g, const dependencyContext &dep_ctx) {
   SmallVector<Value, 1> dep_list;
   // air.asyncopinterface
   if (auto async_op = mlir::dyn_cast<xilinx::air::AsyncOpInterface>(op)) {
@@ -1062,8 +1446,8 @@ void dependencyCanonicalizer::connectOpToItsDepListImpls(
 
 // Connect an async op to ops in its dependency list
 void dependencyCanonicalizer::connectOpToItsDepList(
-    Operation *op, SmallVector<Value, 1> dep_list, Graph &g,
-    dependencyContext dep_ctx) {
+    Operation *op, SmallVector<Value, 1> &dep_list, Graph &g,
+    const dependencyContext &dep_ctx) {
   auto dst_v = getVertexFromOp(op, dep_ctx, "front").first;
   if (dep_list.size()) {
     for (auto dep_token : dep_list) {
@@ -1226,7 +1610,8 @@ void dependencyCanonicalizer::updatePointerFromHierarchyOpToGraph(
 }
 
 // Dump graphviz
-void dependencyCanonicalizer::dump_graph(std::string filename, Graph G) {
+void dependencyCanonicalizer::dump_graph(std::string filename,
+                                         const Graph &G) {
   std::ofstream ofs(filename, std::ofstream::out);
   boost::dynamic_properties dp;
   dp.property("label", boost::get(&dependencyNodeEntry::asyncEventName, G));
@@ -1238,29 +1623,49 @@ void dependencyCanonicalizer::dump_graph(std::string filename, Graph G) {
   write_graphviz_dp(ofs, G, dp);
 }
 
+// Dump graphviz of a transitive reduction, with the attributes of the
+// original graph
+void dependencyCanonicalizer::dump_graph(std::string filename,
+                                         const dependencyGraphTR &G) {
+  std::ofstream ofs(filename, std::ofstream::out);
+  const Graph &g = G.graph->g;
+  ofs << "digraph G {\n";
+  for (unsigned v = 0; v < G.csr.getNumVertices(); v++) {
+    auto &entry = g[G.tr_to_g[v]];
+    ofs << v << "[color=\"" << entry.color << "\", label=\""
+        << entry.asyncEventName << "\", shape=\"" << entry.shape
+        << "\", style=\"filled\"];\n";
+  }
+  for (unsigned v = 0; v < G.csr.getNumVertices(); v++)
+    for (auto w : G.csr.getSuccessors(v))
+      ofs << v << "->" << w << " ;\n";
+  ofs << "}\n";
+}
+
 // Perform transitive reduction to canonicalize the dependency graph
 void dependencyCanonicalizer::canonicalizeGraphs(
-    dependencyGraph &global_graph, dependencyGraph &tr_graph,
+    const dependencyGraph &global_graph, dependencyGraphTR &tr_graph,
     vertex_to_vertex_map_tree &g_to_tr, bool dump_dot, std::string dump_dir) {
 
-  // Construct empty post-canonicalization dependency graph, tr_graph
+  // Construct the tree of reduced graphs, tr_graph, and of the maps
+  tr_graph = dependencyGraphTR(&global_graph);
   for (auto &launchGraph : global_graph.subgraphs) {
-    tr_graph.subgraphs.push_back(dependencyGraph(launchGraph.hierarchyOp));
-    dependencyGraph *current_launch_graph = &(tr_graph.subgraphs.back());
+    tr_graph.subgraphs.push_back(dependencyGraphTR(&launchGraph));
+    dependencyGraphTR *current_launch_graph = &(tr_graph.subgraphs.back());
     g_to_tr.submaps.push_back(vertex_to_vertex_map_tree());
     vertex_to_vertex_map_tree *current_launch_g_to_tr =
         &(g_to_tr.submaps.back());
     for (auto &partitionGraph : launchGraph.subgraphs) {
       current_launch_graph->subgraphs.push_back(
-          dependencyGraph(partitionGraph.hierarchyOp));
-      dependencyGraph *current_partition_graph =
+          dependencyGraphTR(&partitionGraph));
+      dependencyGraphTR *current_partition_graph =
           &(current_launch_graph->subgraphs.back());
       current_launch_g_to_tr->submaps.push_back(vertex_to_vertex_map_tree());
       vertex_to_vertex_map_tree *current_partition_g_to_tr =
           &(current_launch_g_to_tr->submaps.back());
       for (auto &herdGraph : partitionGraph.subgraphs) {
         current_partition_graph->subgraphs.push_back(
-            dependencyGraph(herdGraph.hierarchyOp));
+            dependencyGraphTR(&herdGraph));
         current_partition_g_to_tr->submaps.push_back(
             vertex_to_vertex_map_tree());
       }
@@ -1273,36 +1678,27 @@ void dependencyCanonicalizer::canonicalizeGraphs(
          "graph tree size mismatch");
   assert(global_size == g_to_tr.submaps.size() &&
          "graph tree size and map size mismatch");
-  boostTransitiveReductionImpl(global_graph.g, tr_graph.g, g_to_tr.a_to_b,
-                               g_to_tr.b_to_a);
+  transitiveReductionImpl(tr_graph, g_to_tr.a_to_b, g_to_tr.b_to_a);
   for (unsigned i = 0; i < global_size; i++) {
-    auto &launchGraph = global_graph.subgraphs[i];
     auto &trLaunchGraph = tr_graph.subgraphs[i];
-    auto launch_size = launchGraph.subgraphs.size();
-    auto launchMap = g_to_tr.submaps[i];
-    assert(launch_size == trLaunchGraph.subgraphs.size() &&
-           "graph tree size mismatch");
+    auto launch_size = trLaunchGraph.subgraphs.size();
+    auto &launchMap = g_to_tr.submaps[i];
     assert(launch_size == launchMap.submaps.size() &&
            "graph tree size and map size mismatch");
-    boostTransitiveReductionImpl(launchGraph.g, trLaunchGraph.g,
-                                 launchMap.a_to_b, launchMap.b_to_a);
+    transitiveReductionImpl(trLaunchGraph, launchMap.a_to_b,
+                            launchMap.b_to_a);
     for (unsigned j = 0; j < launch_size; j++) {
-      auto &partitionGraph = launchGraph.subgraphs[j];
       auto &trPartitionGraph = trLaunchGraph.subgraphs[j];
-      auto partition_size = partitionGraph.subgraphs.size();
-      auto partitionMap = launchMap.submaps[j];
-      assert(partition_size == trPartitionGraph.subgraphs.size() &&
-             "graph tree size mismatch");
+      auto partition_size = trPartitionGraph.subgraphs.size();
+      auto &partitionMap = launchMap.submaps[j];
       assert(partition_size == partitionMap.submaps.size() &&
              "graph tree size and map size mismatch");
-      boostTransitiveReductionImpl(partitionGraph.g, trPartitionGraph.g,
-                                   partitionMap.a_to_b, partitionMap.b_to_a);
+      transitiveReductionImpl(trPartitionGraph, partitionMap.a_to_b,
+                              partitionMap.b_to_a);
       for (unsigned k = 0; k < partition_size; k++) {
-        auto &herdGraph = partitionGraph.subgraphs[k];
         auto &trHerdGraph = trPartitionGraph.subgraphs[k];
-        auto herdMap = partitionMap.submaps[k];
-        boostTransitiveReductionImpl(herdGraph.g, trHerdGraph.g, herdMap.a_to_b,
-                                     herdMap.b_to_a);
+        auto &herdMap = partitionMap.submaps[k];
+        transitiveReductionImpl(trHerdGraph, herdMap.a_to_b, herdMap.b_to_a);
       }
     }
   }
@@ -1313,71 +1709,71 @@ void dependencyCanonicalizer::canonicalizeGraphs(
   }
 }
 
-void dependencyCanonicalizer::dumpDotGraphFiles(dependencyGraph global_graph,
-                                                std::string dump_dir) {
-  // Dump dot graphs
+// Dump a dot file per graph of the hierarchy of `global_graph` with `dump`
+template <typename GraphT, typename DumpFn>
+static void dumpDotGraphTree(const GraphT &global_graph, std::string dump_dir,
+                             DumpFn dump) {
   if (dump_dir != "") {
     int status = mkdir(dump_dir.c_str(), 0777);
     if ((status < 0) && (errno != EEXIST))
       dump_dir = ""; // Failed to create dir
   }
-  dump_graph(dump_dir + "host.dot", global_graph.g);
+  dump(dump_dir + "host.dot", global_graph);
   int i = 0;
-  for (auto G_l : global_graph.subgraphs) {
+  for (auto &G_l : global_graph.subgraphs) {
     std::string name = xilinx::air::to_string(G_l.hierarchyOp) + "_" +
                        std::to_string(++i) + ".dot";
-    dump_graph(dump_dir + name, G_l.g);
+    dump(dump_dir + name, G_l);
     int j = 0;
-    for (auto G_p : G_l.subgraphs) {
+    for (auto &G_p : G_l.subgraphs) {
       std::string name = xilinx::air::to_string(G_p.hierarchyOp) + "_" +
                          std::to_string(i) + "_" + std::to_string(++j) + ".dot";
-      dump_graph(dump_dir + name, G_p.g);
+      dump(dump_dir + name, G_p);
       int k = 0;
-      for (auto G_h : G_p.subgraphs) {
+      for (auto &G_h : G_p.subgraphs) {
         std::string name = xilinx::air::to_string(G_h.hierarchyOp) + "_" +
                            std::to_string(i) + "_" + std::to_string(j) + "_" +
                            std::to_string(++k) + ".dot";
-        dump_graph(dump_dir + name, G_h.g);
+        dump(dump_dir + name, G_h);
       }
     }
   }
 }
 
-void dependencyCanonicalizer::boostTransitiveReductionImpl(
-    Graph &asyncExecuteGraph, Graph &asyncExecuteGraphTR,
-    vertex_to_vertex_map &g_to_tr, vertex_to_vertex_map &tr_to_g) {
-
-  std::vector<size_t> id_map(num_vertices(asyncExecuteGraph));
-  std::iota(id_map.begin(), id_map.end(), 0u);
+void dependencyCanonicalizer::dumpDotGraphFiles(
+    const dependencyGraph &global_graph, std::string dump_dir) {
+  dumpDotGraphTree(global_graph, dump_dir,
+                   [&](std::string filename, const dependencyGraph &G) {
+                     dump_graph(filename, G.g);
+                   });
+}
 
-  boost::transitive_reduction(asyncExecuteGraph, asyncExecuteGraphTR,
-                              boost::make_assoc_property_map(g_to_tr),
-                              id_map.data());
+void dependencyCanonicalizer::dumpDotGraphFiles(
+    const dependencyGraphTR &tr_graph, std::string dump_dir) {
+  dumpDotGraphTree(tr_graph, dump_dir,
+                   [&](std::string filename, const dependencyGraphTR &G) {
+                     dump_graph(filename, G);
+                   });
+}
 
-  for (vertex_to_vertex_map::iterator i = g_to_tr.begin(); i != g_to_tr.end();
-       ++i) {
-    // Copy over graph properties
-    asyncExecuteGraphTR[i->second].asyncEventName =
-        asyncExecuteGraph[i->first].asyncEventName;
-    asyncExecuteGraphTR[i->second].asyncEventType =
-        asyncExecuteGraph[i->first].asyncEventType;
-    asyncExecuteGraphTR[i->second].color = asyncExecuteGraph[i->first].color;
-    asyncExecuteGraphTR[i->second].shape = asyncExecuteGraph[i->first].shape;
-    asyncExecuteGraphTR[i->second].operationId =
-        asyncExecuteGraph[i->first].operationId;
-    asyncExecuteGraphTR[i->second].op = asyncExecuteGraph[i->first].op;
-    // Build reverse map tr_to_g, for convenient vertex mapping
-    tr_to_g[i->second] = i->first;
+void dependencyCanonicalizer::transitiveReductionImpl(
+    dependencyGraphTR &graph, vertex_to_vertex_map &g_to_tr,
+    vertex_to_vertex_map &tr_to_g) {
+  graph.csr =
+      dependencyCSRGraph(graph.graph->g).getTransitiveReduction(graph.tr_to_g);
+  for (unsigned v = 0; v < graph.tr_to_g.size(); v++) {
+    g_to_tr[graph.tr_to_g[v]] = v;
+    tr_to_g[v] = graph.tr_to_g[v];
   }
 }
 
-// Update dependency list based on transformed boost graph
-void dependencyCanonicalizer::updateDepList(func::FuncOp func,
-                                            dependencyGraph &global_graph) {
+// Update dependency list based on the transitive reduction
+void dependencyCanonicalizer::updateDepList(
+    func::FuncOp func, const dependencyGraphTR &tr_graph) {
 
   // Purge dependency list
-  purgeAIRDepList(global_graph);
-  for (auto &launchGraph : global_graph.subgraphs) {
+  purgeAIRDepList(tr_graph);
+  for (auto &launchGraph : tr_graph.subgraphs) {
     purgeAIRDepList(launchGraph);
     for (auto &partitionGraph : launchGraph.subgraphs) {
       purgeAIRDepList(partitionGraph);
@@ -1388,8 +1784,8 @@ void dependencyCanonicalizer::updateDepList(func::FuncOp func,
   }
 
   // Rewrite dependency list
-  fillAIRDepListUsingGraphTR(global_graph);
-  for (auto &launchGraph : global_graph.subgraphs) {
+  fillAIRDepListUsingGraphTR(tr_graph);
+  for (auto &launchGraph : tr_graph.subgraphs) {
     fillAIRDepListUsingGraphTR(launchGraph);
     for (auto &partitionGraph : launchGraph.subgraphs) {
       fillAIRDepListUsingGraphTR(partitionGraph);
@@ -1410,10 +1806,11 @@ void dependencyCanonicalizer::updateDepList(func::FuncOp func,
   });
 }
 
-void dependencyCanonicalizer::purgeAIRDepList(dependencyGraph &graph) {
-  auto vp = boost::vertices(graph.g);
-  for (auto dstTRVertex = vp.first; dstTRVertex != vp.second; ++dstTRVertex) {
-    auto op = graph.g[*dstTRVertex].op;
+void dependencyCanonicalizer::purgeAIRDepList(
+    const dependencyGraphTR &graph) {
+  const Graph &g = graph.graph->g;
+  for (auto v : graph.tr_to_g) {
+    auto op = g[v].op;
     if (!op)
       continue;
     auto async_op = mlir::dyn_cast<xilinx::air::AsyncOpInterface>(op);
@@ -1427,28 +1824,28 @@ void dependencyCanonicalizer::purgeAIRDepList(dependencyGraph &graph) {
 }
 
 void dependencyCanonicalizer::fillAIRDepListUsingGraphTR(
-    dependencyGraph &graph) {
-  auto vp = boost::vertices(graph.g);
-  for (auto dstTRVertex = vp.first; dstTRVertex != vp.second; ++dstTRVertex) {
-    auto op = graph.g[*dstTRVertex].op;
+    const dependencyGraphTR &graph) {
+  const Graph &g = graph.graph->g;
+  auto predecessors = graph.csr.getTranspose();
+  for (unsigned dstTRVertex = 0; dstTRVertex < graph.tr_to_g.size();
+       dstTRVertex++) {
+    auto op = g[graph.tr_to_g[dstTRVertex]].op;
     if (!op)
       continue;
     auto async_op = mlir::dyn_cast<xilinx::air::AsyncOpInterface>(op);
     if (!async_op)
       continue;
-    auto incoming_deps = in_edges(*dstTRVertex, graph.g);
-    for (in_edge_iterator it = incoming_deps.first; it != incoming_deps.second;
-         it++) {
-      auto TRVertex = source(*it, graph.g);
-      auto src_op = graph.g[TRVertex].op;
+    for (auto TRVertex : predecessors.getSuccessors(dstTRVertex)) {
+      auto &src = g[graph.tr_to_g[TRVertex]];
+      auto src_op = src.op;
       if (src_op && op != src_op) { // Avoid dep to itself
-        if (graph.g[TRVertex].asyncEventType == "for_loop") {
+        if (src.asyncEventType == "for_loop") {
           auto value = dyn_cast<scf::ForOp>(src_op).getRegionIterArgs()[0];
           async_op.addAsyncDependency(value);
-        } else if (graph.g[TRVertex].asyncEventType == "parallel_loop") {
+        } else if (src.asyncEventType == "parallel_loop") {
           auto value = dyn_cast<scf::ParallelOp>(src_op).getInitVals()[0];
           async_op.addAsyncDependency(value);
-        } else if (graph.g[TRVertex].asyncEventType == "terminator") {
+        } else if (src.asyncEventType == "terminator") {
           auto parent_op = src_op->getParentOp();
           auto value = parent_op->getResult(0);
           async_op.addAsyncDependency(value);
@@ -1645,12 +2042,19 @@ void dependencyTracer::pushDepsAtCurrentScope(mlir::Value operand,
           createPartialMemref(dma.getSrcMemref(), numDimsSrc, src_indices);
       partialMemref dma_dst =
           createPartialMemref(dma.getDstMemref(), numDimsDst, dst_indices);
+      if (auto nddma =
+              dyn_cast<xilinx::air::DmaMemcpyNdOp>(dma.getOperation())) {
+        setPartialMemrefExtents(dma_src, nddma.getSrcOffsets(),
+                                nddma.getSrcSizes(), nddma.getSrcStrides());
+        setPartialMemrefExtents(dma_dst, nddma.getDstOffsets(),
+                                nddma.getDstSizes(), nddma.getDstStrides());
+      }
 
       if (rw == 'r') {
         if (u.is(dma.getSrcMemref())) {
           if (tile == nullptr) {
             addDependencyBetweenOps(dma.getOperation(), op.getOperation());
-          } else if (areEqualIndexPartialMemrefs(tile, &dma_src)) {
+          } else if (areOverlappingPartialMemrefs(tile, &dma_src)) {
             addDependencyBetweenOps(dma.getOperation(), op.getOperation());
           }
         }
@@ -1658,7 +2062,7 @@ void dependencyTracer::pushDepsAtCurrentScope(mlir::Value operand,
         if (u.is(dma.getDstMemref())) {
           if (tile == nullptr) {
             addDependencyBetweenOps(dma.getOperation(), op.getOperation());
-          } else if (areEqualIndexPartialMemrefs(tile, &dma_dst)) {
+          } else if (areOverlappingPartialMemrefs(tile, &dma_dst)) {
             addDependencyBetweenOps(dma.getOperation(), op.getOperation());
           }
         }
@@ -1666,11 +2070,11 @@ void dependencyTracer::pushDepsAtCurrentScope(mlir::Value operand,
         if (tile == nullptr) {
           addDependencyBetweenOps(dma.getOperation(), op.getOperation());
         } else if (u.is(dma.getDstMemref())) {
-          if (areEqualIndexPartialMemrefs(tile, &dma_dst)) {
+          if (areOverlappingPartialMemrefs(tile, &dma_dst)) {
             addDependencyBetweenOps(dma.getOperation(), op.getOperation());
           }
         } else if (u.is(dma.getSrcMemref())) {
-          if (areEqualIndexPartialMemrefs(tile, &dma_src)) {
+          if (areOverlappingPartialMemrefs(tile, &dma_src)) {
             addDependencyBetweenOps(dma.getOperation(), op.getOperation());
           }
         }
@@ -1696,13 +2100,16 @@ void dependencyTracer::pushDepsAtCurrentScope(mlir::Value operand,
         }
         partialMemref channel_put_src = createPartialMemref(
             channel_put.getSrcMemref(), numDimsSrc, src_indices);
+        setPartialMemrefExtents(channel_put_src, channel_put.getSrcOffsets(),
+                                channel_put.getSrcSizes(),
+                                channel_put.getSrcStrides());
 
         if (rw == 'r') {
           if (u.is(channel_put.getSrcMemref())) {
             if (tile == nullptr) {
               addDependencyBetweenOps(channel_put.getOperation(),
                                       op.getOperation());
-            } else if (areEqualIndexPartialMemrefs(tile, &channel_put_src)) {
+            } else if (areOverlappingPartialMemrefs(tile, &channel_put_src)) {
               addDependencyBetweenOps(channel_put.getOperation(),
                                       op.getOperation());
             }
@@ -1713,7 +2120,7 @@ void dependencyTracer::pushDepsAtCurrentScope(mlir::Value operand,
             addDependencyBetweenOps(channel_put.getOperation(),
                                     op.getOperation());
           } else if (u.is(channel_put.getSrcMemref())) {
-            if (areEqualIndexPartialMemrefs(tile, &channel_put_src)) {
+            if (areOverlappingPartialMemrefs(tile, &channel_put_src)) {
               addDependencyBetweenOps(channel_put.getOperation(),
                                       op.getOperation());
             }
@@ -1735,6 +2142,9 @@ void dependencyTracer::pushDepsAtCurrentScope(mlir::Value operand,
         }
         partialMemref channel_get_dst = createPartialMemref(
             channel_get.getDstMemref(), numDimsDst, dst_indices);
+        setPartialMemrefExtents(channel_get_dst, channel_get.getDstOffsets(),
+                                channel_get.getDstSizes(),
+                                channel_get.getDstStrides());
 
         if (rw == 'r') {
         } else if (rw == 'w') {
@@ -1742,7 +2152,7 @@ void dependencyTracer::pushDepsAtCurrentScope(mlir::Value operand,
             if (tile == nullptr) {
               addDependencyBetweenOps(channel_get.getOperation(),
                                       op.getOperation());
-            } else if (areEqualIndexPartialMemrefs(tile, &channel_get_dst)) {
+            } else if (areOverlappingPartialMemrefs(tile, &channel_get_dst)) {
               addDependencyBetweenOps(channel_get.getOperation(),
                                       op.getOperation());
             }
@@ -1752,7 +2162,7 @@ void dependencyTracer::pushDepsAtCurrentScope(mlir::Value operand,
             addDependencyBetweenOps(channel_get.getOperation(),
                                     op.getOperation());
           } else if (u.is(channel_get.getDstMemref())) {
-            if (areEqualIndexPartialMemrefs(tile, &channel_get_dst)) {
+            if (areOverlappingPartialMemrefs(tile, &channel_get_dst)) {
               addDependencyBetweenOps(channel_get.getOperation(),
                                       op.getOperation());
             }
@@ -1966,9 +2376,17 @@ void dependencyTracer::getPartialMemrefFromOp(
     }
     partialMemref tile_in = createPartialMemref(sink_op_dma.getSrcMemref(),
                                                 numDimsSrc, src_indices);
+    if (auto sink_op_nddma = dyn_cast<air::DmaMemcpyNdOp>(sink_op))
+      setPartialMemrefExtents(tile_in, sink_op_nddma.getSrcOffsets(),
+                              sink_op_nddma.getSrcSizes(),
+                              sink_op_nddma.getSrcStrides());
     sink_op_memref_reads.push_back(tile_in);
     partialMemref tile_out = createPartialMemref(sink_op_dma.getDstMemref(),
                                                  numDimsDst, dst_indices);
+    if (auto sink_op_nddma = dyn_cast<air::DmaMemcpyNdOp>(sink_op))
+      setPartialMemrefExtents(tile_out, sink_op_nddma.getDstOffsets(),
+                              sink_op_nddma.getDstSizes(),
+                              sink_op_nddma.getDstStrides());
     sink_op_memref_writes.push_back(tile_out);
   }
 
@@ -1996,6 +2414,9 @@ void dependencyTracer::getPartialMemrefFromOp(
     }
     partialMemref tile_in = createPartialMemref(
         sink_op_channel_put.getSrcMemref(), numDimsSrc, src_indices);
+    setPartialMemrefExtents(tile_in, sink_op_channel_put.getSrcOffsets(),
+                            sink_op_channel_put.getSrcSizes(),
+                            sink_op_channel_put.getSrcStrides());
     sink_op_memref_reads.push_back(tile_in);
   }
 
@@ -2023,6 +2444,9 @@ void dependencyTracer::getPartialMemrefFromOp(
     }
     partialMemref tile_out = createPartialMemref(
         sink_op_channel_get.getDstMemref(), numDimsDst, dst_indices);
+    setPartialMemrefExtents(tile_out, sink_op_channel_get.getDstOffsets(),
+                            sink_op_channel_get.getDstSizes(),
+                            sink_op_channel_get.getDstStrides());
     sink_op_memref_writes.push_back(tile_out);
   }
 
@@ -2101,21 +2525,6 @@ void dependencyTracer::addDependencyBetweenOps(Operation *source,
   }
 }
 
-// Check if two partial memref tiles have identical indices
-bool dependencyTracer::areEqualIndexPartialMemrefs(partialMemref *tile_0,
-                                                   partialMemref *tile_1) {
-  if (tile_0->numDims != tile_1->numDims) {
-    // Unequal # dimensions
-    return false;
-  } else {
-    for (unsigned i = 0; i < tile_0->numDims; i++) {
-      if (!areEqualIndices(tile_0->memrefIndices[i], tile_1->memrefIndices[i]))
-        return false;
-    }
-  }
-  return true;
-}
-
 char dependencyTracer::checkOperandReadOrWrite(mlir::Value operand) {
   assert(operand.getType().isa<MemRefType>() &&
          "operand being traced is not a memref");
@@ -2285,5 +2694,158 @@ void dependencyTracer::pushTileIndexAsDep(mlir::Value tile_index,
   }
 }
 
+// Check if every scf loop around op, up to the first op which is not a loop,
+// carries an async token yielded by a wait_all, as built by air-dependency
+static bool hasAsyncLoopCarriedTokens(Operation *op) {
+  for (auto parent = op->getParentOp(); parent;
+       parent = parent->getParentOp()) {
+    if (auto scf_for = dyn_cast<scf::ForOp>(parent)) {
+      if (!scf_for.getNumIterOperands() ||
+          !scf_for.getRegionIterArgs()[0].getType().isa<air::AsyncTokenType>())
+        return false;
+      auto yield = dyn_cast<scf::YieldOp>(scf_for.getBody()->getTerminator());
+      if (!yield.getNumOperands() ||
+          !yield.getOperand(0).getDefiningOp<air::WaitAllOp>())
+        return false;
+    } else if (auto scf_par = dyn_cast<scf::ParallelOp>(parent)) {
+      if (!scf_par.getInitVals().size() ||
+          !scf_par.getInitVals()[0].getType().isa<air::AsyncTokenType>())
+        return false;
+      SmallVector<scf::ReduceOp, 1> reduce_ops(
+          scf_par.getOps<scf::ReduceOp>());
+      if (reduce_ops.size() != 1 ||
+          !reduce_ops[0].getOperand().getDefiningOp<air::WaitAllOp>())
+        return false;
+    } else
+      return true;
+  }
+  return true;
+}
+
+// Get the op whose memref accesses are traced for an async op: the op
+// wrapped by an air.execute, or the op itself
+static Operation *getTracedOp(air::AsyncOpInterface op) {
+  if (auto exec = dyn_cast<air::ExecuteOp>(op.getOperation())) {
+    auto &child_op = exec.getRegion().front().getOperations().front();
+    if (child_op.hasTrait<OpTrait::IsTerminator>())
+      return nullptr;
+    return &child_op;
+  }
+  return op.getOperation();
+}
+
+void dependencyTracer::notifyOpCreated(Operation *op) { dirty_ops.insert(op); }
+
+void dependencyTracer::notifyOpMoved(Operation *op) { dirty_ops.insert(op); }
+
+// Detach op from the dependency graph before it is erased: its users inherit
+// its dependency list
+void dependencyTracer::notifyOpErased(Operation *op) {
+  dirty_ops.remove(op);
+  auto async_op = dyn_cast<air::AsyncOpInterface>(op);
+  if (!async_op || !async_op.getAsyncToken())
+    return;
+  auto token = async_op.getAsyncToken();
+  SmallVector<Value, 4> deps(async_op.getAsyncDependencies());
+  llvm::SetVector<Operation *> users;
+  for (auto user : token.getUsers())
+    users.insert(user);
+  for (auto user : users) {
+    auto async_user = dyn_cast<air::AsyncOpInterface>(user);
+    if (!async_user ||
+        !llvm::is_contained(async_user.getAsyncDependencies(), token))
+      continue;
+    eraseAsyncDependencyFromAsyncOp(async_user, token);
+    for (auto dep : deps)
+      addAsyncDependencyIfNew(async_user, dep);
+  }
+  // Other uses, e.g. by scf.yield, get a wait_all on the dependency list
+  if (!token.use_empty()) {
+    OpBuilder builder(op);
+    auto wait_all = builder.create<xilinx::air::WaitAllOp>(
+        op->getLoc(), air::AsyncTokenType::get(op->getContext()), deps);
+    token.replaceAllUsesWith(wait_all.getAsyncToken());
+  }
+}
+
+// Collect the ops after op in its block which access a memref of op
+void dependencyTracer::getLaterMemrefUsers(
+    air::AsyncOpInterface op, llvm::SetVector<Operation *> &users) {
+  SmallVector<Value, 4> memrefs;
+  if (auto traced_op = getTracedOp(op))
+    for (auto operand : traced_op->getOperands())
+      if (operand.getType().isa<MemRefType>())
+        memrefs.push_back(operand);
+  for (auto result : op->getResults())
+    if (result.getType().isa<MemRefType>())
+      memrefs.push_back(result);
+  auto block = op->getBlock();
+  for (auto memref : memrefs) {
+    for (auto user : memref.getUsers()) {
+      auto ancestor = block->findAncestorOpInBlock(*user);
+      if (ancestor && ancestor != op.getOperation() &&
+          op->isBeforeInBlock(ancestor) &&
+          isa<air::AsyncOpInterface>(ancestor))
+        users.insert(ancestor);
+    }
+  }
+}
+
+// Trace the memref, tile index and loop-carried deps of op
+void dependencyTracer::retraceOp(air::AsyncOpInterface op) {
+  if (auto traced_op = getTracedOp(op)) {
+    SmallVector<partialMemref, 1> sink_op_memref_reads;
+    SmallVector<partialMemref, 1> sink_op_memref_writes;
+    SmallVector<Value, 1> sink_op_scalar_ins;
+    SmallVector<Value, 1> sink_op_scalar_outs;
+    getPartialMemrefFromOp(traced_op, sink_op_memref_reads,
+                           sink_op_memref_writes, sink_op_scalar_ins,
+                           sink_op_scalar_outs);
+    traceDependencyFromOp<air::AsyncOpInterface>(sink_op_memref_reads, op,
+                                                 "RAW");
+    traceDependencyFromOp<air::AsyncOpInterface>(sink_op_memref_writes, op,
+                                                 "WAW/WAR");
+    traceTileIndices(sink_op_memref_reads, sink_op_memref_writes,
+                     sink_op_scalar_ins, sink_op_scalar_outs, op);
+  }
+  if (isa<scf::ForOp, scf::ParallelOp>(op->getParentOp()) &&
+      op.getAsyncToken() && hasAsyncLoopCarriedTokens(op))
+    reconnectLoopCarriedDependencyFromOp(op);
+}
+
+void dependencyTracer::updateDependencies() {
+  DominanceInfo dom;
+  llvm::SetVector<Operation *> retrace_ops;
+  for (auto op : dirty_ops) {
+    auto async_op = dyn_cast<air::AsyncOpInterface>(op);
+    if (!async_op)
+      continue;
+    // Drop the deps which no longer dominate the op
+    auto dependency_list = async_op.getAsyncDependencies();
+    for (int i = dependency_list.size() - 1; i >= 0; i--)
+      if (!dom.properlyDominates(dependency_list[i], op))
+        async_op.eraseAsyncDependency(i);
+    // Drop the op's token from the ops it no longer dominates, which then
+    // get re-traced
+    if (auto token = async_op.getAsyncToken()) {
+      llvm::SetVector<Operation *> users;
+      for (auto user : token.getUsers())
+        users.insert(user);
+      for (auto user : users) {
+        auto async_user = dyn_cast<air::AsyncOpInterface>(user);
+        if (!async_user || dom.properlyDominates(op, user))
+          continue;
+        eraseAsyncDependencyFromAsyncOp(async_user, token);
+        retrace_ops.insert(user);
+      }
+    }
+    retrace_ops.insert(op);
+    getLaterMemrefUsers(async_op, retrace_ops);
+  }
+  dirty_ops.clear();
+  for (auto op : retrace_ops)
+    retraceOp(dyn_cast<air::AsyncOpInterface>(op));
+}
+
 } // namespace air
 } // namespace xilinx
\ No newline at end of file
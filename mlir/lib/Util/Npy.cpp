@@ -0,0 +1,251 @@
+//===- Npy.cpp --------------------------------------------------*- C++ -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+#include "air/Util/Npy.h"
+
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/Endian.h"
+
+#include <cstring>
+
+using namespace llvm;
+
+namespace xilinx {
+namespace air {
+
+namespace {
+
+const char magic[] = "\x93NUMPY";
+const size_t magicLength = 6;
+
+// Return the value of `key` in the header dictionary `header`, up to the
+// comma which ends it, or an empty string if it is missing. The value of
+// 'shape' is a tuple and ends at the closing parenthesis.
+StringRef getHeaderValue(StringRef header, StringRef key) {
+  size_t pos = header.find((Twine("'") + key + "'").str());
+  if (pos == StringRef::npos)
+    return "";
+  StringRef rest = header.drop_front(pos + key.size() + 2).ltrim();
+  if (!rest.consume_front(":"))
+    return "";
+  rest = rest.ltrim();
+  if (rest.startswith("("))
+    return rest.take_until([](char c) { return c == ')'; }).drop_front(1);
+  return rest.take_until([](char c) { return c == ',' || c == '}'; }).trim();
+}
+
+} // namespace
+
+NpyArray::NpyArray(char kind, unsigned itemBytes, ArrayRef<int64_t> shape)
+    : kind(kind), itemBytes(itemBytes), shape(shape.begin(), shape.end()) {
+  data.resize(getNumElements() * itemBytes);
+}
+
+uint64_t NpyArray::getNumElements() const {
+  uint64_t n = 1;
+  for (auto d : shape)
+    n *= d;
+  return n;
+}
+
+std::string NpyArray::getDescr() const {
+  return std::string(itemBytes == 1 ? "|" : "<") + kind +
+         std::to_string(itemBytes);
+}
+
+double NpyArray::getFloat(uint64_t i) const {
+  const char *p = data.data() + i * itemBytes;
+  if (kind != 'f')
+    return getInt(i);
+  switch (itemBytes) {
+  case 2: {
+    uint16_t h = support::endian::read16le(p);
+    return APFloat(APFloat::IEEEhalf(), APInt(16, h)).convertToFloat();
+  }
+  case 4: {
+    uint32_t w = support::endian::read32le(p);
+    float v;
+    memcpy(&v, &w, sizeof(v));
+    return v;
+  }
+  default: {
+    uint64_t w = support::endian::read64le(p);
+    double v;
+    memcpy(&v, &w, sizeof(v));
+    return v;
+  }
+  }
+}
+
+int64_t NpyArray::getInt(uint64_t i) const {
+  const char *p = data.data() + i * itemBytes;
+  if (kind == 'f')
+    return getFloat(i);
+  uint64_t v = 0;
+  switch (itemBytes) {
+  case 1:
+    v = (uint8_t)*p;
+    break;
+  case 2:
+    v = support::endian::read16le(p);
+    break;
+  case 4:
+    v = support::endian::read32le(p);
+    break;
+  default:
+    v = support::endian::read64le(p);
+    break;
+  }
+  if (kind == 'i')
+    return SignExtend64(v, itemBytes * 8);
+  return v;
+}
+
+void NpyArray::setFloat(uint64_t i, double v) {
+  char *p = data.data() + i * itemBytes;
+  if (kind != 'f')
+    return setInt(i, v);
+  switch (itemBytes) {
+  case 2: {
+    bool losesInfo;
+    APFloat f(v);
+    f.convert(APFloat::IEEEhalf(), APFloat::rmNearestTiesToEven, &losesInfo);
+    support::endian::write16le(p, f.bitcastToAPInt().getZExtValue());
+    return;
+  }
+  case 4: {
+    float f = v;
+    uint32_t w;
+    memcpy(&w, &f, sizeof(w));
+    support::endian::write32le(p, w);
+    return;
+  }
+  default: {
+    uint64_t w;
+    memcpy(&w, &v, sizeof(w));
+    support::endian::write64le(p, w);
+    return;
+  }
+  }
+}
+
+void NpyArray::setInt(uint64_t i, int64_t v) {
+  char *p = data.data() + i * itemBytes;
+  if (kind == 'f')
+    return setFloat(i, v);
+  if (kind == 'b')
+    v = v != 0;
+  switch (itemBytes) {
+  case 1:
+    *p = (char)v;
+    return;
+  case 2:
+    support::endian::write16le(p, v);
+    return;
+  case 4:
+    support::endian::write32le(p, v);
+    return;
+  default:
+    support::endian::write64le(p, v);
+    return;
+  }
+}
+
+Optional<NpyArray> NpyArray::parse(StringRef buffer,
+                                   std::string *errorMessage) {
+  auto fail = [&](const Twine &msg) {
+    if (errorMessage)
+      *errorMessage = ("npy: " + msg).str();
+    return None;
+  };
+
+  if (buffer.size() < magicLength + 4 ||
+      !buffer.startswith(StringRef(magic, magicLength)))
+    return fail("not a .npy file");
+  unsigned major = (uint8_t)buffer[magicLength];
+  size_t headerLength, dataOffset;
+  if (major == 1) {
+    headerLength = support::endian::read16le(buffer.data() + magicLength + 2);
+    dataOffset = magicLength + 4 + headerLength;
+  } else if (major == 2 || major == 3) {
+    if (buffer.size() < magicLength + 6)
+      return fail("truncated header");
+    headerLength = support::endian::read32le(buffer.data() + magicLength + 2);
+    dataOffset = magicLength + 6 + headerLength;
+  } else {
+    return fail("unsupported version " + Twine(major));
+  }
+  if (buffer.size() < dataOffset)
+    return fail("truncated header");
+  StringRef header =
+      buffer.slice(dataOffset - headerLength, dataOffset).trim();
+
+  NpyArray array;
+  StringRef descr = getHeaderValue(header, "descr").trim("'\"");
+  if (descr.size() < 3)
+    return fail("missing dtype");
+  if (descr[0] == '>')
+    return fail("big-endian dtype '" + descr + "' is not supported");
+  array.kind = descr[1];
+  if (descr.drop_front(2).getAsInteger(10, array.itemBytes) ||
+      !StringRef("iufb").contains(array.kind) ||
+      (array.itemBytes != 1 && array.itemBytes != 2 && array.itemBytes != 4 &&
+       array.itemBytes != 8) ||
+      (array.kind == 'f' && array.itemBytes == 1) ||
+      (array.kind == 'b' && array.itemBytes != 1))
+    return fail("unsupported dtype '" + descr + "'");
+
+  if (getHeaderValue(header, "fortran_order") != "False")
+    return fail("arrays in Fortran order are not supported");
+
+  SmallVector<StringRef, 4> dims;
+  getHeaderValue(header, "shape").split(dims, ',', -1, false);
+  for (auto d : dims) {
+    int64_t size;
+    if (d.trim().getAsInteger(10, size) || size < 0)
+      return fail("malformed shape");
+    array.shape.push_back(size);
+  }
+
+  uint64_t bytes = array.getNumElements() * array.itemBytes;
+  if (buffer.size() - dataOffset < bytes)
+    return fail("expected " + Twine(bytes) + " bytes of data, found " +
+                Twine(buffer.size() - dataOffset));
+  array.data.assign(buffer.data() + dataOffset,
+                    buffer.data() + dataOffset + bytes);
+  return array;
+}
+
+void NpyArray::write(raw_ostream &os) const {
+  std::string header = "{'descr': '" + getDescr() +
+                       "', 'fortran_order': False, 'shape': (";
+  for (unsigned i = 0; i < shape.size(); i++)
+    header += (i ? ", " : "") + std::to_string(shape[i]);
+  // a tuple of one element keeps its trailing comma
+  if (shape.size() == 1)
+    header += ",";
+  header += "), }";
+  // pad with spaces so that the data is 64 byte aligned, the header ends
+  // with a newline
+  size_t total = magicLength + 4 + header.size() + 1;
+  header.append((64 - total % 64) % 64, ' ');
+  header += '\n';
+
+  os.write(magic, magicLength);
+  os << (char)1 << (char)0;
+  char length[2];
+  support::endian::write16le(length, header.size());
+  os.write(length, sizeof(length));
+  os << header;
+  os.write(data.data(), data.size());
+}
+
+} // namespace air
+} // namespace xilinx
@@ -8,28 +8,42 @@
 
 #include "air/Util/Runner.h"
 #include "air/Dialect/AIR/AIRDialect.h"
+#include "air/Util/ArchModel.h"
 #include "air/Util/CostModel.h"
+#include "air/Util/TraceSink.h"
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/JSON.h"
 
 #include "mlir/Dialect/Affine/IR/AffineOps.h"
+#include "mlir/Dialect/Arith/IR/Arith.h"
 #include "mlir/Dialect/Func/IR/FuncOps.h"
 #include "mlir/Dialect/Linalg/IR/Linalg.h"
 #include "mlir/Dialect/MemRef/IR/MemRef.h"
 #include "mlir/Dialect/SCF/IR/SCF.h"
 #include "mlir/IR/MLIRContext.h"
+#include "mlir/IR/Threading.h"
 #include "mlir/Support/LogicalResult.h"
 #include "mlir/Support/MathExtras.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <deque>
 #include <float.h>
 #include <list>
 #include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
 #include <sstream>
+#include <tuple>
 #include <vector>
 
 #define DEBUG_TYPE "air-runner"
@@ -41,187 +55,1205 @@ using namespace mlir;
 namespace xilinx {
 namespace air {
 
+namespace {
+
+// An append-only array whose elements never move. Elements published to
+// another thread can be read while the owning thread appends, which lets the
+// logical processes of a parallel simulation share the value and buffer
+// stores. Appends must be serialized by the caller.
+template <typename T, unsigned ChunkBits = 12> class StableVector {
+public:
+  StableVector() { chunks.reserve(MaxChunks); }
+
+  T &operator[](size_t i) { return chunks[i >> ChunkBits][i & ChunkMask]; }
+
+  size_t size() const { return count.load(std::memory_order_acquire); }
+
+  // Append a default constructed element and return its index.
+  size_t emplace_back() {
+    size_t i = count.load(std::memory_order_relaxed);
+    if ((i >> ChunkBits) == chunks.size()) {
+      if (chunks.size() == MaxChunks)
+        llvm::report_fatal_error("air-runner: store exhausted");
+      chunks.emplace_back(new T[ChunkSize]);
+    }
+    count.store(i + 1, std::memory_order_release);
+    return i;
+  }
+
+private:
+  static constexpr size_t ChunkSize = size_t(1) << ChunkBits;
+  static constexpr size_t ChunkMask = ChunkSize - 1;
+  static constexpr size_t MaxChunks = size_t(1) << 16;
+  std::vector<std::unique_ptr<T[]>> chunks;
+  std::atomic<size_t> count{0};
+};
+
+} // namespace
+
 class AIRRunner::AIRRunner_impl {
 
   const int TRACE_PID_QUEUE = 0;
   const int TRACE_PID_ALLOC = 1;
   const int TRACE_PID_STATS = 2;
 
-  void executeOp(arith::ConstantIndexOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    auto attr = op->getAttrOfType<IntegerAttr>("value");
-    out[0] = attr.getValue().sextOrTrunc(INDEX_WIDTH);
+  // A runtime value of the interpreter. Integers and indices are kept sign
+  // extended in `i`, async tokens keep their outstanding count in `i` and
+  // memrefs keep the handle of their buffer in the store in `i`. Values are
+  // plain data, so the value store is a dense array without per-value heap
+  // allocations.
+  struct RuntimeValue {
+    enum Kind : uint8_t { Empty, Int, Float, Token, MemRef };
+    Kind kind;
+    union {
+      int64_t i;
+      double f;
+    };
+
+    RuntimeValue() : kind(Empty), i(0) {}
+
+    static RuntimeValue getInt(int64_t v) {
+      RuntimeValue r;
+      r.kind = Int;
+      r.i = v;
+      return r;
+    }
+    static RuntimeValue getFloat(double v) {
+      RuntimeValue r;
+      r.kind = Float;
+      r.f = v;
+      return r;
+    }
+    static RuntimeValue getToken(int64_t count) {
+      RuntimeValue r;
+      r.kind = Token;
+      r.i = count;
+      return r;
+    }
+    static RuntimeValue getMemRef(unsigned ptr) {
+      RuntimeValue r;
+      r.kind = MemRef;
+      r.i = ptr;
+      return r;
+    }
+  };
+
+  // Truncate `v` to the width of the integer type `ty` and sign extend it
+  // back to 64 bits. Index values are INDEX_WIDTH wide.
+  static int64_t truncToType(int64_t v, Type ty) {
+    unsigned width = INDEX_WIDTH;
+    if (auto ity = ty.dyn_cast<IntegerType>())
+      width = ity.getWidth();
+    if (width >= 64)
+      return v;
+    return llvm::SignExtend64(v, width);
+  }
+
+  // Round `v` to the precision of the float type `ty`.
+  static double roundToType(double v, Type ty) {
+    if (ty.isF64())
+      return v;
+    bool losesInfo;
+    llvm::APFloat f(v);
+    f.convert(ty.cast<FloatType>().getFloatSemantics(),
+              llvm::APFloat::rmNearestTiesToEven, &losesInfo);
+    f.convert(llvm::APFloat::IEEEdouble(), llvm::APFloat::rmNearestTiesToEven,
+              &losesInfo);
+    return f.convertToDouble();
+  }
+
+  // The allocations of one memory: the L1 of a core tile, the L2 of a
+  // partition, or a whole memory space for the other spaces. Buffers are
+  // placed first fit, so that the high-water mark includes the holes left
+  // between buffers.
+  struct MemoryPool {
+    std::string name;
+    // capacity from the arch model, 0 if unknown
+    uint64_t capacity = 0;
+    uint64_t liveBytes = 0;
+    uint64_t peakBytes = 0;
+    uint64_t highWater = 0;
+    // set once the high-water mark has exceeded the capacity
+    bool overflowed = false;
+    // placed buffers, size keyed by offset
+    std::map<uint64_t, uint64_t> blocks;
+
+    // Place a buffer of `bytes` bytes and return its offset.
+    uint64_t allocate(uint64_t bytes) {
+      uint64_t offset = 0;
+      for (auto &b : blocks) {
+        if (b.first - offset >= bytes)
+          break;
+        offset = b.first + b.second;
+      }
+      blocks[offset] = bytes;
+      liveBytes += bytes;
+      peakBytes = std::max(peakBytes, liveBytes);
+      highWater = std::max(highWater, offset + bytes);
+      return offset;
+    }
+
+    void release(uint64_t offset) {
+      auto it = blocks.find(offset);
+      assert(it != blocks.end() && "buffer not in pool");
+      liveBytes -= it->second;
+      blocks.erase(it);
+    }
+  };
+
+  // The backing store of a memref: a flat, row-major buffer of elements of
+  // one of the supported element types. The data is allocated on first
+  // access so that timing-only simulations do not pay for it.
+  struct MemRefBuffer {
+    enum ElementKind : uint8_t { I8, I16, I32, I64, BF16, F16, F32, F64 };
+    ElementKind kind;
+    unsigned elementBytes;
+    uint64_t volume;
+    unsigned memorySpace;
+    bool live;
+    std::vector<char> data;
+    // placement of the buffer, nullptr for empty buffers
+    MemoryPool *pool = nullptr;
+    uint64_t offset = 0;
+
+    MemRefBuffer()
+        : kind(I8), elementBytes(1), volume(0), memorySpace(0), live(false) {}
+
+    MemRefBuffer(Type elementType, uint64_t volume, unsigned memorySpace)
+        : volume(volume), memorySpace(memorySpace), live(true) {
+      if (elementType.isBF16())
+        kind = BF16;
+      else if (elementType.isF16())
+        kind = F16;
+      else if (elementType.isF32())
+        kind = F32;
+      else if (elementType.isF64())
+        kind = F64;
+      else if (elementType.isIntOrIndex() &&
+               elementType.getIntOrFloatBitWidth() <= 8)
+        kind = I8;
+      else if (elementType.isIntOrIndex() &&
+               elementType.getIntOrFloatBitWidth() <= 16)
+        kind = I16;
+      else if (elementType.isInteger(64))
+        kind = I64;
+      else
+        kind = I32;
+      static const unsigned bytes[] = {1, 2, 4, 8, 2, 2, 4, 8};
+      elementBytes = bytes[kind];
+    }
+
+    uint64_t getSizeInBytes() const { return volume * elementBytes; }
+
+    bool isFloat() const { return kind >= BF16; }
+
+    char *getElementPtr(uint64_t idx) {
+      assert(live && idx < volume);
+      if (data.empty())
+        data.resize(getSizeInBytes());
+      return data.data() + idx * elementBytes;
+    }
+
+    RuntimeValue load(uint64_t idx) {
+      const char *p = getElementPtr(idx);
+      switch (kind) {
+      case I8: {
+        int8_t v;
+        memcpy(&v, p, sizeof(v));
+        return RuntimeValue::getInt(v);
+      }
+      case I16: {
+        int16_t v;
+        memcpy(&v, p, sizeof(v));
+        return RuntimeValue::getInt(v);
+      }
+      case I32: {
+        int32_t v;
+        memcpy(&v, p, sizeof(v));
+        return RuntimeValue::getInt(v);
+      }
+      case I64: {
+        int64_t v;
+        memcpy(&v, p, sizeof(v));
+        return RuntimeValue::getInt(v);
+      }
+      case BF16: {
+        // bf16 is the upper half of an f32
+        uint16_t h;
+        memcpy(&h, p, sizeof(h));
+        uint32_t w = uint32_t(h) << 16;
+        float v;
+        memcpy(&v, &w, sizeof(v));
+        return RuntimeValue::getFloat(v);
+      }
+      case F16: {
+        uint16_t h;
+        memcpy(&h, p, sizeof(h));
+        llvm::APFloat v(llvm::APFloat::IEEEhalf(), llvm::APInt(16, h));
+        return RuntimeValue::getFloat(v.convertToFloat());
+      }
+      case F32: {
+        float v;
+        memcpy(&v, p, sizeof(v));
+        return RuntimeValue::getFloat(v);
+      }
+      case F64: {
+        double v;
+        memcpy(&v, p, sizeof(v));
+        return RuntimeValue::getFloat(v);
+      }
+      }
+      llvm_unreachable("unknown element kind");
+    }
+
+    void store(uint64_t idx, const RuntimeValue &value) {
+      char *p = getElementPtr(idx);
+      switch (kind) {
+      case I8: {
+        int8_t v = value.i;
+        memcpy(p, &v, sizeof(v));
+        return;
+      }
+      case I16: {
+        int16_t v = value.i;
+        memcpy(p, &v, sizeof(v));
+        return;
+      }
+      case I32: {
+        int32_t v = value.i;
+        memcpy(p, &v, sizeof(v));
+        return;
+      }
+      case I64: {
+        memcpy(p, &value.i, sizeof(value.i));
+        return;
+      }
+      case BF16: {
+        // round to nearest even on the upper half of the f32
+        float f = value.f;
+        uint32_t w;
+        memcpy(&w, &f, sizeof(w));
+        w += 0x7fff + ((w >> 16) & 1);
+        uint16_t h = w >> 16;
+        memcpy(p, &h, sizeof(h));
+        return;
+      }
+      case F16: {
+        bool losesInfo;
+        llvm::APFloat v(value.f);
+        v.convert(llvm::APFloat::IEEEhalf(),
+                  llvm::APFloat::rmNearestTiesToEven, &losesInfo);
+        uint16_t h = v.bitcastToAPInt().getZExtValue();
+        memcpy(p, &h, sizeof(h));
+        return;
+      }
+      case F32: {
+        float v = value.f;
+        memcpy(p, &v, sizeof(v));
+        return;
+      }
+      case F64: {
+        memcpy(p, &value.f, sizeof(value.f));
+        return;
+      }
+      }
+    }
+
+    void release() {
+      live = false;
+      std::vector<char>().swap(data);
+    }
+  };
+
+  // The dense numbering of the Values defined in a block, including the
+  // Values of nested regions that are interpreted inline. It is computed once
+  // per block and shared by every Environment of that block.
+  struct ValueLayout {
+    llvm::DenseMap<Value, unsigned> index;
+  };
+
+  ValueLayout *getLayout(Block *block) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto &layout = layouts[block];
+    if (layout)
+      return layout.get();
+    layout = std::make_unique<ValueLayout>();
+    auto number = [&](Value v) {
+      layout->index.insert({v, (unsigned)layout->index.size()});
+    };
+    for (auto a : block->getArguments())
+      number(a);
+    for (auto &o : *block) {
+      o.walk([&](Operation *op) {
+        for (auto &r : op->getRegions())
+          for (auto &b : r)
+            for (auto a : b.getArguments())
+              number(a);
+        for (auto r : op->getResults())
+          number(r);
+      });
+    }
+    return layout.get();
+  }
+
+  // An Environment binds the SSA values of one dynamic instance of a region
+  // (one scf.for iteration, one herd tile, ...) to slots in the runner's value
+  // store. Region bodies are interpreted in place: instead of cloning the IR
+  // for every iteration, each iteration gets its own Environment chained to
+  // the enclosing one. Slots are reference counted so that iter_args and
+  // hierarchy operands can alias slots owned by another Environment, and are
+  // recycled once the last Environment referring to them goes away.
+  struct Environment {
+    Environment(AIRRunner_impl &runner, ValueLayout *layout = nullptr,
+                std::shared_ptr<Environment> parent = nullptr)
+        : runner(runner), layout(layout), parent(parent) {
+      if (layout)
+        slotIds.resize(layout->index.size(), -1);
+    }
+    ~Environment() {
+      for (auto slot : slotIds)
+        if (slot >= 0)
+          runner.releaseSlot(slot);
+      for (auto &b : bindings)
+        runner.releaseSlot(b.second);
+      for (auto slot : retained)
+        runner.releaseSlot(slot);
+    }
+    // Return the binding of `v` in this environment, or -1.
+    int64_t find(Value v) {
+      if (layout) {
+        auto it = layout->index.find(v);
+        if (it != layout->index.end())
+          return slotIds[it->second];
+      }
+      auto it = bindings.find(v);
+      if (it != bindings.end())
+        return it->second;
+      return -1;
+    }
+    // Bind `v` to `slot` and return the previous binding, or -1.
+    int64_t bind(Value v, unsigned slot) {
+      int64_t old = -1;
+      if (layout) {
+        auto it = layout->index.find(v);
+        if (it != layout->index.end()) {
+          std::swap(old, slotIds[it->second]);
+          slotIds[it->second] = slot;
+          return old;
+        }
+      }
+      auto it = bindings.find(v);
+      if (it != bindings.end()) {
+        old = it->second;
+        it->second = slot;
+      } else {
+        bindings.insert({v, slot});
+      }
+      return old;
+    }
+    // keep `slot` alive for the lifetime of this environment
+    void retain(unsigned slot) {
+      runner.retainSlot(slot);
+      retained.push_back(slot);
+    }
+    AIRRunner_impl &runner;
+    ValueLayout *layout;
+    std::shared_ptr<Environment> parent;
+    // slots of the Values in `layout`, indexed by their number
+    SmallVector<int64_t, 16> slotIds;
+    // slots of Values outside of `layout`
+    llvm::DenseMap<Value, unsigned> bindings;
+    SmallVector<unsigned, 4> retained;
+  };
+  using EnvPtr = std::shared_ptr<Environment>;
+
+  EnvPtr makeEnvironment(Block &block, EnvPtr parent) {
+    return std::make_shared<Environment>(*this, getLayout(&block), parent);
+  }
+
+  struct LogicalProcess;
+  struct QueueContext;
+  struct ForSchedule;
+
+  // A completed entry of a queue, linked to the entry which determined its
+  // start: the producer of the token it waited on last, the previous entry of
+  // its queue or the entry which enqueued it. Following the links back from
+  // the last entry to finish gives the critical path.
+  struct PathNode {
+    Operation *op;
+    bool is_wait;
+    QueueContext *queue;
+    uint64_t start_time;
+    uint64_t end_time;
+    const PathNode *pred;
+    // error bound of the cycles of an extrapolated loop, see
+    // LoopExtrapolation
+    uint64_t error_bound;
+  };
+
+  // A slot of the value store. The slot is owned by the logical process which
+  // allocated it: only the owner changes the count of an async token in it.
+  struct Slot {
+    RuntimeValue value;
+    std::atomic<unsigned> refs{0};
+    LogicalProcess *owner = nullptr;
+    // Set between the windows of a parallel simulation once the async token
+    // in the slot has completed, see isTokenDone.
+    bool visibleDone = false;
+    // entry which completed the async token in the slot
+    const PathNode *producer = nullptr;
+  };
+
+  unsigned allocateSlot() {
+    std::lock_guard<std::mutex> lock(slotMutex);
+    unsigned slot;
+    if (freeSlots.size()) {
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+    } else {
+      slot = slots.emplace_back();
+    }
+    slots[slot].refs = 0;
+    slots[slot].owner = &lp();
+    slots[slot].visibleDone = false;
+    slots[slot].producer = nullptr;
+    return slot;
+  }
+
+  void retainSlot(unsigned slot) { slots[slot].refs++; }
+
+  void releaseSlot(unsigned slot) {
+    assert(slots[slot].refs);
+    if (--slots[slot].refs)
+      return;
+    slots[slot].value = RuntimeValue();
+    std::lock_guard<std::mutex> lock(slotMutex);
+    freeSlots.push_back(slot);
+  }
+
+  // Find the slot bound to `v` in `env` or one of its ancestors.
+  Optional<unsigned> lookupSlot(Environment *env, Value v) {
+    for (; env; env = env->parent.get()) {
+      auto slot = env->find(v);
+      if (slot >= 0)
+        return slot;
+    }
+    return llvm::None;
+  }
+
+  // Bind `v` in `env` to `slot`.
+  void bindSlot(Environment *env, Value v, unsigned slot) {
+    retainSlot(slot);
+    auto old = env->bind(v, slot);
+    if (old >= 0)
+      releaseSlot(old);
+  }
+
+  // Bind `v` in `env` to a new slot holding `value`.
+  unsigned defineValue(Environment *env, Value v, RuntimeValue value) {
+    unsigned slot = allocateSlot();
+    slots[slot].value = value;
+    bindSlot(env, v, slot);
+    return slot;
+  }
+
+  // Return the slot of `v`, creating an empty one in `env` if `v` has no
+  // binding yet (e.g. function arguments).
+  unsigned getOrCreateSlot(Environment *env, Value v) {
+    if (auto slot = lookupSlot(env, v))
+      return *slot;
+    return defineValue(env, v, RuntimeValue());
+  }
+
+  using ValueVector = SmallVector<RuntimeValue, 4>;
+
+  void executeOp(arith::ConstantIndexOp op, ValueVector &in,
+                 ValueVector &out) {
+    out[0] = RuntimeValue::getInt(truncToType(op.value(), op.getType()));
+  }
+
+  void executeOp(arith::ConstantIntOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getInt(op.value());
+  }
+
+  void executeOp(arith::ConstantFloatOp op, ValueVector &in,
+                 ValueVector &out) {
+    out[0] = RuntimeValue::getFloat(op.value().convertToDouble());
   }
 
-  void executeOp(arith::ConstantIntOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    auto attr = op->getAttrOfType<IntegerAttr>("value");
-    out[0] = attr.getValue();
+  void executeOp(arith::AddIOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getInt(truncToType(in[0].i + in[1].i, op.getType()));
   }
 
-  void executeOp(arith::AddIOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
+  void executeOp(arith::AddFOp op, ValueVector &in, ValueVector &out) {
     out[0] =
-        llvm::any_cast<llvm::APInt>(in[0]) + llvm::any_cast<llvm::APInt>(in[1]);
+        RuntimeValue::getFloat(roundToType(in[0].f + in[1].f, op.getType()));
   }
 
-  void executeOp(arith::AddFOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    out[0] = llvm::any_cast<llvm::APFloat>(in[0]) +
-             llvm::any_cast<llvm::APFloat>(in[1]);
+  void executeOp(arith::SubIOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getInt(truncToType(in[0].i - in[1].i, op.getType()));
   }
 
-  void executeOp(arith::SubIOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
+  void executeOp(arith::SubFOp op, ValueVector &in, ValueVector &out) {
     out[0] =
-        llvm::any_cast<llvm::APInt>(in[0]) - llvm::any_cast<llvm::APInt>(in[1]);
+        RuntimeValue::getFloat(roundToType(in[0].f - in[1].f, op.getType()));
   }
 
-  void executeOp(arith::SubFOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    out[0] = llvm::any_cast<llvm::APFloat>(in[0]) +
-             llvm::any_cast<llvm::APFloat>(in[1]);
+  void executeOp(arith::CmpIOp op, ValueVector &in, ValueVector &out) {
+    unsigned width = INDEX_WIDTH;
+    if (auto ity = op.getLhs().getType().dyn_cast<IntegerType>())
+      width = ity.getWidth();
+    llvm::APInt in0(width, in[0].i, /*isSigned=*/true);
+    llvm::APInt in1(width, in[1].i, /*isSigned=*/true);
+    out[0] = RuntimeValue::getInt(
+        arith::applyCmpPredicate(op.getPredicate(), in0, in1));
   }
 
-  void executeOp(arith::CmpIOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    assert(0 && "unsupported op");
-    llvm::APInt in0 = llvm::any_cast<llvm::APInt>(in[0]);
-    llvm::APInt in1 = llvm::any_cast<llvm::APInt>(in[1]);
-    llvm::APInt out0(1, applyCmpPredicate(op.getPredicate(), in0, in1));
-    out[0] = out0;
+  void executeOp(arith::CmpFOp op, ValueVector &in, ValueVector &out) {
+    llvm::APFloat in0(in[0].f);
+    llvm::APFloat in1(in[1].f);
+    out[0] = RuntimeValue::getInt(
+        arith::applyCmpPredicate(op.getPredicate(), in0, in1));
   }
 
-  void executeOp(arith::CmpFOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    assert(0 && "unsupported op");
-    llvm::APFloat in0 = llvm::any_cast<llvm::APFloat>(in[0]);
-    llvm::APFloat in1 = llvm::any_cast<llvm::APFloat>(in[1]);
-    llvm::APInt out0(1, applyCmpPredicate(op.getPredicate(), in0, in1));
-    out[0] = out0;
+  void executeOp(arith::MulIOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getInt(truncToType(in[0].i * in[1].i, op.getType()));
   }
 
-  void executeOp(arith::MulIOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
+  void executeOp(arith::MulFOp op, ValueVector &in, ValueVector &out) {
     out[0] =
-        llvm::any_cast<llvm::APInt>(in[0]) * llvm::any_cast<llvm::APInt>(in[1]);
+        RuntimeValue::getFloat(roundToType(in[0].f * in[1].f, op.getType()));
   }
 
-  void executeOp(arith::MulFOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    out[0] = llvm::any_cast<llvm::APFloat>(in[0]) *
-             llvm::any_cast<llvm::APFloat>(in[1]);
+  void executeOp(arith::DivFOp op, ValueVector &in, ValueVector &out) {
+    out[0] =
+        RuntimeValue::getFloat(roundToType(in[0].f / in[1].f, op.getType()));
   }
 
-  void executeOp(arith::DivFOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    out[0] = llvm::any_cast<llvm::APFloat>(in[0]) /
-             llvm::any_cast<llvm::APFloat>(in[1]);
+  void executeOp(arith::IndexCastOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getInt(truncToType(in[0].i, op.getType()));
   }
 
-  void executeOp(arith::IndexCastOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
+  void executeOp(arith::ExtSIOp op, ValueVector &in, ValueVector &out) {
     out[0] = in[0];
   }
 
-  void executeOp(memref::LoadOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    llvm::ArrayRef<int64_t> shape = op.getMemRefType().getShape();
-    unsigned address = 0;
-    for (unsigned i = 0; i < shape.size(); i++) {
-      address = address * shape[i] +
-                llvm::any_cast<llvm::APInt>(in[i + 1]).getZExtValue();
-    }
-    unsigned ptr = llvm::any_cast<unsigned>(in[0]);
+  void executeOp(arith::ExtUIOp op, ValueVector &in, ValueVector &out) {
+    unsigned width = op.getIn().getType().getIntOrFloatBitWidth();
+    out[0] = RuntimeValue::getInt(
+        truncToType(width < 64 ? in[0].i & ((1ULL << width) - 1) : in[0].i,
+                    op.getType()));
+  }
+
+  void executeOp(arith::TruncIOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getInt(truncToType(in[0].i, op.getType()));
+  }
+
+  void executeOp(arith::SIToFPOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getFloat(roundToType(in[0].i, op.getType()));
+  }
+
+  void executeOp(arith::FPToSIOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getInt(truncToType(in[0].f, op.getType()));
+  }
+
+  void executeOp(arith::ExtFOp op, ValueVector &in, ValueVector &out) {
+    out[0] = in[0];
+  }
+
+  void executeOp(arith::TruncFOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getFloat(roundToType(in[0].f, op.getType()));
+  }
+
+  void executeOp(arith::MaxFOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getFloat(std::max(in[0].f, in[1].f));
+  }
+
+  // Return the linearized element offset of `indices` in a memref of type
+  // `type` with an identity layout.
+  uint64_t getElementOffset(MemRefType type, ArrayRef<RuntimeValue> indices) {
+    llvm::ArrayRef<int64_t> shape = type.getShape();
+    uint64_t address = 0;
+    for (unsigned i = 0; i < shape.size(); i++)
+      address = address * shape[i] + indices[i].i;
+    return address;
+  }
+
+  void executeOp(memref::LoadOp op, ValueVector &in, ValueVector &out) {
+    unsigned ptr = in[0].i;
     assert(ptr < store.size());
-    auto &ref = store[ptr];
-    assert(address < ref.size());
-    //  LLVM_DEBUG(llvm::dbgs() << "Load " << ref[address] << " from " << ptr <<
-    //  "[" << address << "]\n");
-    llvm::Any result = ref[address];
-    out[0] = result;
-  }
-
-  void executeOp(memref::StoreOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    llvm::ArrayRef<int64_t> shape = op.getMemRefType().getShape();
-    unsigned address = 0;
-    for (unsigned i = 0; i < shape.size(); i++) {
-      address = address * shape[i] +
-                llvm::any_cast<llvm::APInt>(in[i + 2]).getZExtValue();
-    }
-    unsigned ptr = llvm::any_cast<unsigned>(in[1]);
+    auto address = getElementOffset(op.getMemRefType(),
+                                    llvm::makeArrayRef(in).drop_front(1));
+    out[0] = store[ptr].load(address);
+  }
+
+  void executeOp(memref::StoreOp op, ValueVector &in, ValueVector &out) {
+    unsigned ptr = in[1].i;
     assert(ptr < store.size());
-    auto &ref = store[ptr];
-    //  LLVM_DEBUG(llvm::dbgs() << "Store " << in[0] << " to " << ptr << "[" <<
-    //  address << "]\n");
-    assert(address < ref.size());
-    ref[address] = in[0];
+    auto address = getElementOffset(op.getMemRefType(),
+                                    llvm::makeArrayRef(in).drop_front(2));
+    store[ptr].store(address, in[0]);
   }
 
-  void executeOp(memref::AllocOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    out[0] = allocateMemRef(op.getType(), in);
+  void executeOp(memref::AllocOp op, ValueVector &in, ValueVector &out) {
+    out[0] = RuntimeValue::getMemRef(allocateMemRef(op.getType()));
   }
 
-  void executeOp(memref::DeallocOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    unsigned ptr = llvm::any_cast<unsigned>(in[0]);
+  void executeOp(memref::DeallocOp op, ValueVector &in, ValueVector &out) {
+    unsigned ptr = in[0].i;
     deallocateMemRef(ptr);
   }
 
-  void decrementAsyncTokens(Operation *op) {
+  // Return the value of index `v` in `env`, 0 if it is not defined.
+  int64_t getIndexValue(Environment *env, Value v) {
+    if (auto slot = lookupSlot(env, v))
+      return slots[*slot].value.i;
+    return 0;
+  }
+
+  // Report `message` about the ops named like `op` once.
+  void warnFunctional(Operation *op, const Twine &message) {
+    std::string text =
+        (op->getName().getStringRef() + ": " + message).str();
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (functionalWarnings.insert(text).second)
+      llvm::errs() << "WARNING: functional simulation: " << text << "\n";
+  }
+
+  // Return the buffer bound to `memref` in `env`, nullptr with a warning if
+  // it has none, e.g. for the result of a view op.
+  MemRefBuffer *getBuffer(Operation *op, Environment *env, Value memref) {
+    auto slot = lookupSlot(env, memref);
+    if (!slot || slots[*slot].value.kind != RuntimeValue::MemRef) {
+      warnFunctional(op, "operand is not bound to a buffer, skipped");
+      return nullptr;
+    }
+    return &store[slots[*slot].value.i];
+  }
+
+  // Convert `v` to the representation of the elements of `buffer`.
+  static RuntimeValue convertElement(RuntimeValue v,
+                                     const MemRefBuffer &buffer) {
+    if (buffer.isFloat() && v.kind == RuntimeValue::Int)
+      return RuntimeValue::getFloat(v.i);
+    if (!buffer.isFloat() && v.kind == RuntimeValue::Float)
+      return RuntimeValue::getInt(v.f);
+    return v;
+  }
+
+  // The elements of a memref accessed by a DMA or a channel op: offset,
+  // sizes and strides in elements, innermost dimension last.
+  struct AccessPattern {
+    int64_t offset = 0;
+    SmallVector<int64_t, 4> sizes;
+    SmallVector<int64_t, 4> strides;
+
+    // Return the element offsets of the pattern in order.
+    std::vector<uint64_t> getAddresses() const {
+      int64_t count = 1;
+      for (auto s : sizes)
+        count *= s;
+      std::vector<uint64_t> addresses;
+      addresses.reserve(std::max<int64_t>(count, 0));
+      SmallVector<int64_t, 4> idx(sizes.size(), 0);
+      for (int64_t n = 0; n < count; n++) {
+        int64_t address = offset;
+        for (unsigned d = 0; d < sizes.size(); d++)
+          address += idx[d] * strides[d];
+        addresses.push_back(address);
+        for (int d = sizes.size() - 1; d >= 0; d--) {
+          if (++idx[d] < sizes[d])
+            break;
+          idx[d] = 0;
+        }
+      }
+      return addresses;
+    }
+  };
+
+  // Return the access pattern of `memref` given by the operands `offsets`,
+  // `sizes` and `strides` of an op. Without sizes the op accesses the whole
+  // memref, without strides the ones of the row-major layout of the memref.
+  AccessPattern getAccessPattern(Environment *env, Value memref,
+                                 OperandRange offsets, OperandRange sizes,
+                                 OperandRange strides) {
+    AccessPattern pattern;
+    auto type = memref.getType().cast<MemRefType>();
+    if (sizes.empty()) {
+      pattern.sizes.push_back(getTensorVolume(type));
+      pattern.strides.push_back(1);
+      return pattern;
+    }
+    SmallVector<int64_t, 4> rowMajor(sizes.size(), 1);
+    auto shape = type.getShape();
+    for (int d = sizes.size() - 2; d >= 0; d--) {
+      unsigned dim = shape.size() - sizes.size() + d + 1;
+      rowMajor[d] = rowMajor[d + 1] * (dim < shape.size() ? shape[dim] : 1);
+    }
+    for (unsigned d = 0; d < sizes.size(); d++) {
+      int64_t stride =
+          d < strides.size() ? getIndexValue(env, strides[d]) : rowMajor[d];
+      pattern.sizes.push_back(getIndexValue(env, sizes[d]));
+      pattern.strides.push_back(stride);
+      if (d < offsets.size())
+        pattern.offset += getIndexValue(env, offsets[d]) * stride;
+    }
+    return pattern;
+  }
+
+  // Copy the elements of `src` accessed by `srcPattern` to the elements of
+  // `dst` accessed by `dstPattern`, in order.
+  void copyElements(Operation *op, MemRefBuffer &dst,
+                    const AccessPattern &dstPattern, MemRefBuffer &src,
+                    const AccessPattern &srcPattern) {
+    auto dstAddresses = dstPattern.getAddresses();
+    auto srcAddresses = srcPattern.getAddresses();
+    if (dstAddresses.size() != srcAddresses.size())
+      warnFunctional(op, "source and destination sizes differ");
+    size_t count = std::min(dstAddresses.size(), srcAddresses.size());
+    for (size_t i = 0; i < count; i++) {
+      if (dstAddresses[i] >= dst.volume || srcAddresses[i] >= src.volume) {
+        warnFunctional(op, "access out of bounds, copy truncated");
+        return;
+      }
+    }
+    if (dst.kind == src.kind) {
+      for (size_t i = 0; i < count; i++)
+        memcpy(dst.getElementPtr(dstAddresses[i]),
+               src.getElementPtr(srcAddresses[i]), dst.elementBytes);
+      return;
+    }
+    for (size_t i = 0; i < count; i++)
+      dst.store(dstAddresses[i],
+                convertElement(src.load(srcAddresses[i]), dst));
+  }
+
+  // Move the data of DMA `op` in functional mode.
+  void copyDma(xilinx::air::DmaMemcpyInterface op, Environment *env) {
+    auto *src = getBuffer(op, env, op.getSrcMemref());
+    auto *dst = getBuffer(op, env, op.getDstMemref());
+    if (!src || !dst)
+      return;
+    OperandRange none = op->getOperands().take_front(0);
+    AccessPattern srcPattern, dstPattern;
+    if (auto nd = dyn_cast<xilinx::air::DmaMemcpyNdOp>(op.getOperation())) {
+      srcPattern = getAccessPattern(env, nd.getSrcMemref(), nd.getSrcOffsets(),
+                                    nd.getSrcSizes(), nd.getSrcStrides());
+      dstPattern = getAccessPattern(env, nd.getDstMemref(), nd.getDstOffsets(),
+                                    nd.getDstSizes(), nd.getDstStrides());
+    } else {
+      srcPattern =
+          getAccessPattern(env, op.getSrcMemref(), none, none, none);
+      dstPattern =
+          getAccessPattern(env, op.getDstMemref(), none, none, none);
+    }
+    copyElements(op, *dst, dstPattern, *src, srcPattern);
+  }
+
+  // Return a copy of the data sent by channel put `op`, as a contiguous
+  // buffer.
+  std::shared_ptr<MemRefBuffer> readChannelPut(xilinx::air::ChannelPutOp op,
+                                               Environment *env) {
+    auto *src = getBuffer(op, env, op.getSrc());
+    if (!src)
+      return std::make_shared<MemRefBuffer>();
+    auto pattern = getAccessPattern(env, op.getSrc(), op.getSrcOffsets(),
+                                    op.getSrcSizes(), op.getSrcStrides());
+    int64_t volume = 1;
+    for (auto s : pattern.sizes)
+      volume *= s;
+    auto item = std::make_shared<MemRefBuffer>(
+        op.getSrc().getType().cast<MemRefType>().getElementType(), volume, 0);
+    AccessPattern contiguous;
+    contiguous.sizes.push_back(volume);
+    contiguous.strides.push_back(1);
+    copyElements(op, *item, contiguous, *src, pattern);
+    return item;
+  }
+
+  // Write the data `item` received by channel get `op` to its destination.
+  void writeChannelGet(xilinx::air::ChannelGetOp op, Environment *env,
+                       MemRefBuffer &item) {
+    auto *dst = getBuffer(op, env, op.getDst());
+    if (!dst || !item.live)
+      return;
+    AccessPattern contiguous;
+    contiguous.sizes.push_back(item.volume);
+    contiguous.strides.push_back(1);
+    auto pattern = getAccessPattern(env, op.getDst(), op.getDstOffsets(),
+                                    op.getDstSizes(), op.getDstStrides());
+    copyElements(op, *dst, pattern, item, contiguous);
+  }
+
+  // C += A * B on row-major buffers of the same element type, with the
+  // products accumulated in `Acc` and rounded to `T` after every step as
+  // linalg.matmul does.
+  template <typename T, typename Acc>
+  static void runMatmulKernel(MemRefBuffer &A, MemRefBuffer &B,
+                              MemRefBuffer &C, int64_t M, int64_t N,
+                              int64_t K) {
+    auto *a = reinterpret_cast<const T *>(A.getElementPtr(0));
+    auto *b = reinterpret_cast<const T *>(B.getElementPtr(0));
+    auto *c = reinterpret_cast<T *>(C.getElementPtr(0));
+    for (int64_t i = 0; i < M; i++)
+      for (int64_t k = 0; k < K; k++) {
+        Acc aik = a[i * K + k];
+        const T *brow = b + k * N;
+        T *crow = c + i * N;
+        for (int64_t j = 0; j < N; j++)
+          crow[j] = (T)((Acc)crow[j] + aik * (Acc)brow[j]);
+      }
+  }
+
+  void runMatmul(linalg::MatmulOp op, MemRefBuffer &A, MemRefBuffer &B,
+                 MemRefBuffer &C) {
+    auto aTy = op.getDpsInputOperand(0)->get().getType().cast<MemRefType>();
+    auto bTy = op.getDpsInputOperand(1)->get().getType().cast<MemRefType>();
+    int64_t M = aTy.getDimSize(0), K = aTy.getDimSize(1),
+            N = bTy.getDimSize(1);
+    if (!M || !N || !K)
+      return;
+    if (A.kind == C.kind && B.kind == C.kind) {
+      switch (C.kind) {
+      case MemRefBuffer::I8:
+        return runMatmulKernel<int8_t, int64_t>(A, B, C, M, N, K);
+      case MemRefBuffer::I16:
+        return runMatmulKernel<int16_t, int64_t>(A, B, C, M, N, K);
+      case MemRefBuffer::I32:
+        return runMatmulKernel<int32_t, int64_t>(A, B, C, M, N, K);
+      case MemRefBuffer::I64:
+        return runMatmulKernel<int64_t, int64_t>(A, B, C, M, N, K);
+      case MemRefBuffer::F32:
+        return runMatmulKernel<float, float>(A, B, C, M, N, K);
+      case MemRefBuffer::F64:
+        return runMatmulKernel<double, double>(A, B, C, M, N, K);
+      default:
+        break;
+      }
+    }
+    // mixed and 16-bit float element types: the inputs are converted to
+    // the element type of C and the sum is rounded by the store
+    for (int64_t i = 0; i < M; i++)
+      for (int64_t k = 0; k < K; k++) {
+        auto aik = convertElement(A.load(i * K + k), C);
+        for (int64_t j = 0; j < N; j++) {
+          auto bkj = convertElement(B.load(k * N + j), C);
+          auto cij = C.load(i * N + j);
+          if (C.isFloat())
+            cij.f += aik.f * bkj.f;
+          else
+            cij.i += aik.i * bkj.i;
+          C.store(i * N + j, cij);
+        }
+      }
+  }
+
+  // Evaluate `expr` with the values `dims` of its dimensions and `symbols` of
+  // its symbols.
+  static int64_t evaluateAffineExpr(AffineExpr expr, ArrayRef<int64_t> dims,
+                                    ArrayRef<int64_t> symbols) {
+    if (auto d = expr.dyn_cast<AffineDimExpr>())
+      return dims[d.getPosition()];
+    if (auto s = expr.dyn_cast<AffineSymbolExpr>())
+      return symbols[s.getPosition()];
+    if (auto c = expr.dyn_cast<AffineConstantExpr>())
+      return c.getValue();
+    auto bin = expr.cast<AffineBinaryOpExpr>();
+    int64_t lhs = evaluateAffineExpr(bin.getLHS(), dims, symbols);
+    int64_t rhs = evaluateAffineExpr(bin.getRHS(), dims, symbols);
+    switch (expr.getKind()) {
+    case AffineExprKind::Add:
+      return lhs + rhs;
+    case AffineExprKind::Mul:
+      return lhs * rhs;
+    case AffineExprKind::Mod:
+      return mlir::mod(lhs, rhs);
+    case AffineExprKind::FloorDiv:
+      return mlir::floorDiv(lhs, rhs);
+    case AffineExprKind::CeilDiv:
+      return mlir::ceilDiv(lhs, rhs);
+    default:
+      llvm_unreachable("unexpected affine expression");
+    }
+  }
+
+  // Run linalg `op` element by element: the payload is interpreted at every
+  // point of the iteration space, with the operands addressed through their
+  // indexing maps.
+  void runLinalgGeneric(linalg::LinalgOp op, ValueVector &in,
+                        ArrayRef<MemRefBuffer *> buffers) {
+    auto ranges = op.getStaticLoopRanges();
+    if (llvm::any_of(ranges, [](int64_t r) { return r < 0; })) {
+      warnFunctional(op, "dynamic loop ranges are not supported, skipped");
+      return;
+    }
+    unsigned numLoops = ranges.size();
+    unsigned numOperands = op->getNumOperands();
+    auto maps = op.getIndexingMapsArray();
+
+    // the element offset of a shaped operand is affine in the loop indices:
+    // base + sum of coefficient * index
+    SmallVector<int64_t, 4> base(numOperands, 0);
+    SmallVector<SmallVector<int64_t, 4>, 4> coefficients(numOperands);
+    SmallVector<int64_t, 4> point(numLoops, 0);
+    for (unsigned o = 0; o < numOperands; o++) {
+      if (!buffers[o])
+        continue;
+      auto type = op->getOperand(o).getType().cast<MemRefType>();
+      auto map = maps[o];
+      if (llvm::any_of(map.getResults(),
+                       [](AffineExpr e) { return !e.isPureAffine(); })) {
+        warnFunctional(op, "indexing maps with mod or div are not "
+                           "supported, skipped");
+        return;
+      }
+      auto offset = [&]() {
+        int64_t address = 0;
+        for (unsigned r = 0; r < map.getNumResults(); r++)
+          address = address * type.getDimSize(r) +
+                    evaluateAffineExpr(map.getResult(r), point, {});
+        return address;
+      };
+      base[o] = offset();
+      for (unsigned l = 0; l < numLoops; l++) {
+        point[l] = 1;
+        coefficients[o].push_back(offset() - base[o]);
+        point[l] = 0;
+      }
+    }
+
+    Block &body = op->getRegion(0).front();
+    unsigned numInputs = op.getNumDpsInputs();
+    int64_t count = 1;
+    for (auto r : ranges)
+      count *= r;
+    llvm::DenseMap<Value, RuntimeValue> values;
+    SmallVector<uint64_t, 4> addresses(numOperands);
+    for (int64_t n = 0; n < count; n++) {
+      for (unsigned o = 0; o < numOperands; o++) {
+        if (!buffers[o]) {
+          values[body.getArgument(o)] = in[o];
+          continue;
+        }
+        int64_t address = base[o];
+        for (unsigned l = 0; l < numLoops; l++)
+          address += coefficients[o][l] * point[l];
+        addresses[o] = address;
+        values[body.getArgument(o)] = buffers[o]->load(address);
+      }
+      for (auto &payload : body) {
+        if (auto yield = dyn_cast<linalg::YieldOp>(payload)) {
+          for (unsigned r = 0; r < yield->getNumOperands(); r++) {
+            auto *out = buffers[numInputs + r];
+            out->store(addresses[numInputs + r],
+                       convertElement(values[yield->getOperand(r)], *out));
+          }
+          break;
+        }
+        if (auto index = dyn_cast<linalg::IndexOp>(payload)) {
+          values[index.getResult()] =
+              RuntimeValue::getInt(point[index.getDim()]);
+          continue;
+        }
+        ValueVector pin, pout(payload.getNumResults());
+        for (auto v : payload.getOperands())
+          pin.push_back(values.lookup(v));
+        if (!executeOpImpls(payload, pin, pout, nullptr)) {
+          warnFunctional(op, "payload op " +
+                                 payload.getName().getStringRef() +
+                                 " is not supported, skipped");
+          return;
+        }
+        for (unsigned r = 0; r < payload.getNumResults(); r++)
+          values[payload.getResult(r)] = pout[r];
+      }
+      for (int l = numLoops - 1; l >= 0; l--) {
+        if (++point[l] < ranges[l])
+          break;
+        point[l] = 0;
+      }
+    }
+  }
+
+  // Compute linalg `op` on the buffers of its operands in functional mode.
+  // Fill, copy and matmul run on native kernels, the other ops through
+  // their payload.
+  void executeOp(linalg::LinalgOp op, ValueVector &in, ValueVector &out) {
+    SmallVector<MemRefBuffer *, 4> buffers(op->getNumOperands(), nullptr);
+    for (unsigned o = 0; o < op->getNumOperands(); o++) {
+      auto type = op->getOperand(o).getType().dyn_cast<MemRefType>();
+      if (!type)
+        continue;
+      if (in[o].kind != RuntimeValue::MemRef) {
+        warnFunctional(op, "operand is not bound to a buffer, skipped");
+        return;
+      }
+      if (!type.getLayout().isIdentity() || !type.hasStaticShape()) {
+        warnFunctional(op, "operands with a strided layout or dynamic shape "
+                           "are not supported, skipped");
+        return;
+      }
+      buffers[o] = &store[in[o].i];
+    }
+
+    if (isa<linalg::FillOp>(op.getOperation()) && buffers[1]) {
+      auto &dst = *buffers[1];
+      if (!dst.volume)
+        return;
+      dst.store(0, convertElement(in[0], dst));
+      for (uint64_t i = 1; i < dst.volume; i++)
+        memcpy(dst.getElementPtr(i), dst.getElementPtr(0), dst.elementBytes);
+      return;
+    }
+    if (isa<linalg::CopyOp>(op.getOperation()) && buffers[0] && buffers[1]) {
+      AccessPattern all;
+      all.sizes.push_back(buffers[1]->volume);
+      all.strides.push_back(1);
+      copyElements(op, *buffers[1], all, *buffers[0], all);
+      return;
+    }
+    if (auto matmul = dyn_cast<linalg::MatmulOp>(op.getOperation())) {
+      runMatmul(matmul, *buffers[0], *buffers[1], *buffers[2]);
+      return;
+    }
+    runLinalgGeneric(op, in, buffers);
+  }
+
+  void executeOp(AffineApplyOp op, ValueVector &in, ValueVector &out) {
+    auto map = op.getAffineMap();
+    SmallVector<int64_t, 4> operands;
+    for (auto &v : in)
+      operands.push_back(v.i);
+    ArrayRef<int64_t> all(operands);
+    out[0] = RuntimeValue::getInt(
+        evaluateAffineExpr(map.getResult(0), all.take_front(map.getNumDims()),
+                           all.drop_front(map.getNumDims())));
+  }
+
+  // Decrement the count of the async token in `slot`. When the count reaches
+  // zero, every queue waiting on the token is woken up at the current time.
+  // Tokens owned by another logical process are decremented by their owner.
+  void decrementToken(unsigned slot) {
+    auto *owner = slots[slot].owner;
+    if (owner != &lp()) {
+      retainSlot(slot);
+      post(owner, now(), [=]() {
+        decrementToken(slot);
+        releaseSlot(slot);
+      });
+      return;
+    }
+    auto &count = slots[slot].value;
+    assert(count.kind == RuntimeValue::Token && count.i > 0);
+    if (--count.i != 0)
+      return;
+    slots[slot].producer = lp().currentNode;
+    if (parallel)
+      lp().completed.push_back(slot);
+    auto &callbacks = lp().tokenCallbacks;
+    auto cb = callbacks.find(slot);
+    if (cb != callbacks.end()) {
+      auto fns = std::move(cb->second);
+      callbacks.erase(cb);
+      for (auto &fn : fns)
+        fn();
+      releaseSlot(slot);
+    }
+    auto &forwards = lp().tokenForwards;
+    auto fwd = forwards.find(slot);
+    if (fwd != forwards.end()) {
+      auto targets = std::move(fwd->second);
+      forwards.erase(fwd);
+      for (auto to : targets) {
+        decrementToken(to);
+        releaseSlot(to);
+      }
+      releaseSlot(slot);
+    }
+    auto &waiters = lp().waiters;
+    auto it = waiters.find(slot);
+    if (it == waiters.end())
+      return;
+    for (auto *q : it->second) {
+      if (q->lp == &lp())
+        wakeQueue(q, now());
+      else
+        post(q->lp, now(), [=]() { wakeQueue(q, now()); });
+    }
+    waiters.erase(it);
+  }
+
+  void decrementAsyncTokens(Operation *op, Environment *env) {
 
     for (unsigned i = 0, e = op->getNumResults(); i < e; i++) {
       auto r = op->getResult(i);
-      if (r.getType().isa<xilinx::air::AsyncTokenType>()) {
-        valueMap[r] =
-            llvm::any_cast<llvm::APInt>(valueMap[r]) - llvm::APInt(64, 1);
-        assert(llvm::any_cast<llvm::APInt>(valueMap[r]).getSExtValue() >= 0);
-      }
+      if (r.getType().isa<xilinx::air::AsyncTokenType>())
+        decrementToken(getOrCreateSlot(env, r));
     }
   }
 
-  void executeOp(scf::ParallelOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {}
+  // Define the async token results of `op` in `env` with the given count.
+  void defineAsyncTokens(Operation *op, Environment *env, int64_t count = 1) {
+    for (auto r : op->getResults())
+      if (r.getType().isa<xilinx::air::AsyncTokenType>())
+        defineValue(env, r, RuntimeValue::getToken(count));
+  }
 
-  void executeOp(xilinx::air::LaunchOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {}
+  void executeOp(scf::ParallelOp op, ValueVector &in, ValueVector &out) {}
 
-  void executeOp(xilinx::air::HerdOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    decrementAsyncTokens(op);
+  void executeOp(xilinx::air::LaunchOp op, ValueVector &in, ValueVector &out,
+                 Environment *env) {
+    decrementAsyncTokens(op, env);
   }
 
-  void executeOp(xilinx::air::DmaMemcpyInterface op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    decrementAsyncTokens(op);
+  void executeOp(xilinx::air::PartitionOp op, ValueVector &in,
+                 ValueVector &out, Environment *env) {
+    decrementAsyncTokens(op, env);
   }
 
-  void executeOp(xilinx::air::ExecuteTerminatorOp op,
-                 std::vector<llvm::Any> &in, std::vector<llvm::Any> &out) {
+  void executeOp(xilinx::air::HerdOp op, ValueVector &in, ValueVector &out,
+                 Environment *env) {
+    decrementAsyncTokens(op, env);
+  }
+
+  void executeOp(xilinx::air::DmaMemcpyInterface op, ValueVector &in,
+                 ValueVector &out, Environment *env) {
+    if (functional)
+      copyDma(op, env);
+    decrementAsyncTokens(op, env);
+  }
+
+  void executeOp(xilinx::air::ChannelInterface op, ValueVector &in,
+                 ValueVector &out, Environment *env) {
+    decrementAsyncTokens(op, env);
+  }
+
+  void executeOp(xilinx::air::ExecuteTerminatorOp op, ValueVector &in,
+                 ValueVector &out, Environment *env) {
     auto ExecuteOp = op->getParentOfType<xilinx::air::ExecuteOp>();
-    decrementAsyncTokens(ExecuteOp);
+    decrementAsyncTokens(ExecuteOp, env);
 
     for (unsigned i = 1, e = ExecuteOp->getNumResults(); i < e; i++) {
       auto r = ExecuteOp->getResult(i);
       if (!r.getType().isa<xilinx::air::AsyncTokenType>()) {
-        valueMap[r] = in[i - 1];
+        defineValue(env, r, in[i - 1]);
       }
     }
   }
 
-  void executeOp(xilinx::air::WaitAllOp op, std::vector<llvm::Any> &in,
-                 std::vector<llvm::Any> &out) {
-    decrementAsyncTokens(op);
+  void executeOp(xilinx::air::WaitAllOp op, ValueVector &in, ValueVector &out,
+                 Environment *env) {
+    decrementAsyncTokens(op, env);
   }
 
-  bool executeOpImpls(mlir::Operation &op, std::vector<llvm::Any> &inValues,
-                      std::vector<llvm::Any> &outValues) {
+  bool executeOpImpls(mlir::Operation &op, ValueVector &inValues,
+                      ValueVector &outValues, Environment *env) {
     if (auto Op = dyn_cast<arith::ConstantIndexOp>(op))
       executeOp(Op, inValues, outValues);
     else if (auto Op = dyn_cast<arith::ConstantIntOp>(op))
       executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<arith::ConstantFloatOp>(op))
+      executeOp(Op, inValues, outValues);
     else if (auto Op = dyn_cast<arith::AddIOp>(op))
       executeOp(Op, inValues, outValues);
     else if (auto Op = dyn_cast<arith::AddFOp>(op))
@@ -242,44 +1274,74 @@ class AIRRunner::AIRRunner_impl {
       executeOp(Op, inValues, outValues);
     else if (auto Op = dyn_cast<arith::IndexCastOp>(op))
       executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<arith::ExtSIOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<arith::ExtUIOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<arith::TruncIOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<arith::SIToFPOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<arith::FPToSIOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<arith::ExtFOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<arith::TruncFOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<arith::MaxFOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<AffineApplyOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<memref::LoadOp>(op))
+      executeOp(Op, inValues, outValues);
+    else if (auto Op = dyn_cast<memref::StoreOp>(op))
+      executeOp(Op, inValues, outValues);
     else if (auto Op = dyn_cast<memref::AllocOp>(op))
       executeOp(Op, inValues, outValues);
     else if (auto Op = dyn_cast<memref::DeallocOp>(op))
       executeOp(Op, inValues, outValues);
+    else if (functional && isa<linalg::LinalgOp>(op))
+      executeOp(cast<linalg::LinalgOp>(op), inValues, outValues);
     else if (auto Op = dyn_cast<scf::ParallelOp>(op))
       executeOp(Op, inValues, outValues);
     else if (auto Op = dyn_cast<xilinx::air::LaunchOp>(op))
-      executeOp(Op, inValues, outValues);
+      executeOp(Op, inValues, outValues, env);
+    else if (auto Op = dyn_cast<xilinx::air::PartitionOp>(op))
+      executeOp(Op, inValues, outValues, env);
     else if (auto Op = dyn_cast<xilinx::air::ExecuteTerminatorOp>(op))
-      executeOp(Op, inValues, outValues);
+      executeOp(Op, inValues, outValues, env);
     else if (auto Op = dyn_cast<xilinx::air::HerdOp>(op))
-      executeOp(Op, inValues, outValues);
+      executeOp(Op, inValues, outValues, env);
     else if (auto Op = dyn_cast<xilinx::air::WaitAllOp>(op))
-      executeOp(Op, inValues, outValues);
+      executeOp(Op, inValues, outValues, env);
     else if (auto Op = dyn_cast<xilinx::air::DmaMemcpyInterface>(op))
-      executeOp(Op, inValues, outValues);
+      executeOp(Op, inValues, outValues, env);
+    else if (auto Op = dyn_cast<xilinx::air::ChannelInterface>(op))
+      executeOp(Op, inValues, outValues, env);
     else
       return false;
     return true;
   }
 
-  bool executeOp(Operation &op) {
-    std::vector<llvm::Any> inValues(op.getNumOperands());
-    std::vector<llvm::Any> outValues(op.getNumResults());
+  bool executeOp(Operation &op, Environment *env) {
+    ValueVector inValues(op.getNumOperands());
+    ValueVector outValues(op.getNumResults());
     // LLVM_DEBUG(llvm::dbgs() << "OP:  " << op.getName() << "\n");
     int i = 0;
     for (Value in : op.getOperands()) {
-      inValues[i++] = valueMap[in];
+      if (auto slot = lookupSlot(env, in))
+        inValues[i] = slots[*slot].value;
+      i++;
     }
 
-    if (!executeOpImpls(op, inValues, outValues))
+    if (!executeOpImpls(op, inValues, outValues, env))
       return false;
 
-    // record result in valuemap
+    // record result in the environment
     i = 0;
     for (Value out : op.getResults()) {
       if (!out.getType().isa<xilinx::air::AsyncTokenType>()) {
-        valueMap[out] = outValues[i];
+        defineValue(env, out, outValues[i]);
       }
       i++;
     }
@@ -287,116 +1349,150 @@ class AIRRunner::AIRRunner_impl {
   }
 
   void debugArg(const std::string &head, mlir::Value op,
-                const llvm::APInt &value, uint64_t time) {
-    LLVM_DEBUG(llvm::dbgs() << "  " << head << ":  " << op << " = " << value
-                            << " (llvm::APInt<" << value.getBitWidth() << ">) @"
-                            << time << "\n");
-  }
-
-  void debugArg(const std::string &head, mlir::Value op,
-                const llvm::APFloat &value, uint64_t time) {
-    LLVM_DEBUG(llvm::dbgs() << "  " << head << ":  " << op << " = ";
-               value.print(llvm::dbgs());
-               llvm::dbgs() << " ("
-                            << "float"
-                            << ") @" << time << "\n");
-  }
-
-  void debugArg(const std::string &head, mlir::Value op, const llvm::Any &value,
-                uint64_t time) {
-    if (llvm::any_isa<llvm::APInt>(value)) {
-      debugArg(head, op, llvm::any_cast<llvm::APInt>(value), time);
-    } else if (llvm::any_isa<llvm::APFloat>(value)) {
-      debugArg(head, op, llvm::any_cast<llvm::APFloat>(value), time);
-    } else if (llvm::any_isa<unsigned>(value)) {
+                const RuntimeValue &value, uint64_t time) {
+    switch (value.kind) {
+    case RuntimeValue::Int:
+      LLVM_DEBUG(llvm::dbgs() << "  " << head << ":  " << op << " = "
+                              << value.i << " (int) @" << time << "\n");
+      break;
+    case RuntimeValue::Float:
+      LLVM_DEBUG(llvm::dbgs() << "  " << head << ":  " << op << " = "
+                              << value.f << " (float) @" << time << "\n");
+      break;
+    case RuntimeValue::Token:
+      LLVM_DEBUG(llvm::dbgs() << "  " << head << ":  " << op << " = Token "
+                              << value.i << " @" << time << "\n");
+      break;
+    case RuntimeValue::MemRef:
       // Represents an allocated buffer.
       LLVM_DEBUG(llvm::dbgs() << "  " << head << ":  " << op << " = Buffer "
-                              << llvm::any_cast<unsigned>(value) << "\n");
-    } else {
-      // llvm_unreachable("unknown type");
+                              << value.i << "\n");
+      break;
+    case RuntimeValue::Empty:
+      break;
     }
   }
 
 public:
-  AIRRunner_impl(llvm::raw_ostream &trace_stream, llvm::json::Value &json_model,
-                 bool verbose = false)
-      : traceStream(trace_stream), jsonModel(json_model), time(1) {
-
-    auto model = jsonModel.getAsObject();
-
-    dispatch_slots = 1;
-    if (auto ds = model->getNumber("num_dispatch_queues"))
-      dispatch_slots = (unsigned)(*ds);
-
-    dispatch_dma_slots = 1;
-    if (auto dd = model->getNumber("num_dispatch_dma_queues"))
-      dispatch_dma_slots = (unsigned)(*dd);
-
-    core_dma_slots = 1;
-    if (auto cd = model->getNumber("num_core_dma_queues"))
-      core_dma_slots = (unsigned)(*cd);
-
-    herd_slots = 1;
-    if (auto hs = model->getNumber("num_herd_slots"))
-      herd_slots = (unsigned)(*hs);
-
-    LLVM_DEBUG(llvm::dbgs() << "dispatch slots: " << dispatch_slots << "\n");
+  AIRRunner_impl(llvm::raw_ostream &trace_stream, const ArchModel &arch,
+                 const AIRRunnerOptions &options)
+      : traceSink(TraceSink::create(options.traceFormat, trace_stream)),
+        arch(arch), parallel(options.parallel && !options.functional),
+        lookahead(arch.getMinTransferCycles()),
+        failOnMemoryOverflow(options.failOnMemoryOverflow),
+        recordOps(options.recordOps),
+        extrapolateLoops(options.extrapolateLoops && !options.functional),
+        steadyStateWindow(options.steadyStateWindow),
+        maxSteadyStateWindows(std::max(options.maxSteadyStateWindows, 2u)),
+        maxLiveIterations(std::max(options.maxLiveIterations, 1u)),
+        functional(options.functional), randomSeed(options.randomSeed) {
+
+    if (options.functional && (options.parallel || options.extrapolateLoops))
+      llvm::errs() << "WARNING: functional simulation runs sequentially and "
+                      "simulates every loop iteration\n";
+
+    auto &topo = arch.topology;
+    LLVM_DEBUG(llvm::dbgs() << "partitions: " << topo.partitions << " of "
+                            << topo.columns << "x" << topo.rows << "\n");
+    LLVM_DEBUG(llvm::dbgs() << "controllers: " << topo.controllers << "\n");
     LLVM_DEBUG(llvm::dbgs()
-               << "dispatch dma slots: " << dispatch_dma_slots << "\n");
-    LLVM_DEBUG(llvm::dbgs() << "core dma slots: " << core_dma_slots << "\n");
-    LLVM_DEBUG(llvm::dbgs() << "herd slots: " << herd_slots << "\n");
+               << "shim dma channels: " << topo.shim_dma_channels << "\n");
+    LLVM_DEBUG(llvm::dbgs()
+               << "tile dma channels: " << topo.tile_dma_channels << "\n");
+    if (parallel)
+      LLVM_DEBUG(llvm::dbgs() << "parallel lookahead: " << lookahead << "\n");
   }
 
-  // Allocate a new matrix with dimensions given by the type, in the
-  // given store.  Return the pseudo-pointer to the new matrix in the
-  // store (i.e. the first dimension index)
-  unsigned allocateMemRef(mlir::MemRefType type, std::vector<llvm::Any> &in) {
+  // Allocate a new buffer with dimensions given by the type in the store.
+  // Return the handle of the new buffer in the store.
+  unsigned allocateMemRef(mlir::MemRefType type) {
     auto memorySpace = type.getMemorySpaceAsInt();
     auto volume = getTensorVolume(type);
-    auto datawidth = type.getElementTypeBitWidth() / 4;
-    uint64_t bytes = volume * datawidth;
-    unsigned ptr = store.size();
-    store.resize(ptr + 1);
-    store[ptr].resize(1 /*bytes*/);
+    std::unique_lock<std::mutex> lock(storeMutex);
+    unsigned ptr = store.emplace_back();
+    lock.unlock();
+    store[ptr] = MemRefBuffer(type.getElementType(), volume, memorySpace);
+    if (uint64_t bytes = store[ptr].getSizeInBytes()) {
+      lock.lock();
+      auto &pool = getMemoryPool(memorySpace, lp().queue);
+      store[ptr].pool = &pool;
+      store[ptr].offset = pool.allocate(bytes);
+      checkCapacity(pool);
+      emitTraceCounter(pool.name, now(), TRACE_PID_ALLOC, pool.liveBytes);
+      lock.unlock();
+    }
     LLVM_DEBUG(llvm::dbgs() << "alloc " << ptr << " space " << memorySpace
-                            << " size " << bytes << "\n");
-    // mlir::Type elementType = type.getElementType();
-    // int width = elementType.getIntOrFloatBitWidth();
-    //  for (int i = 0; i < bytes; i++) {
-    //    if (elementType.isa<mlir::IntegerType>()) {
-    //      store[ptr][i] = llvm::APInt(width, 0);
-    //    }
-    //    else if (elementType.isa<mlir::FloatType>()) {
-    //      store[ptr][i] = llvm::APFloat(0.0);
-    //    }
-    //    else {
-    //      llvm_unreachable("Unknown result type!\n");
-    //    }
-    //  }
+                            << " size " << store[ptr].getSizeInBytes()
+                            << "\n");
     //  emitTraceEvent(traceStream,
     //                 "tensor "+std::to_string(ptr)+" space " \
     //                 +std::to_string(memorySpace)+" size " \
-    //                 +std::to_string(bytes), "layer", "B", time, ptr,
+    //                 +std::to_string(bytes), "layer", 'B', time, ptr,
     //                 TRACE_PID_ALLOC);
     return ptr;
   }
 
   void deallocateMemRef(unsigned ptr) {
-    // assert(store[ptr].size());
-    // auto allocationSize = store[ptr].size();
     LLVM_DEBUG(llvm::dbgs() << "dealloc " << ptr << "\n");
-    store[ptr].resize(0);
-    // emitTraceEvent(traceStream, "dealloc", "layer", "E", time, ptr,
+    if (store[ptr].live && store[ptr].pool) {
+      std::lock_guard<std::mutex> lock(storeMutex);
+      auto &pool = *store[ptr].pool;
+      pool.release(store[ptr].offset);
+      emitTraceCounter(pool.name, now(), TRACE_PID_ALLOC, pool.liveBytes);
+    }
+    store[ptr].release();
+    // emitTraceEvent("dealloc", "layer", 'E', time, ptr,
     //   TRACE_PID_ALLOC);
   }
 
-  std::string printAnyValueWithType(mlir::Type type, llvm::Any &value) {
+  // Return the pool of memory space `space` allocated from by queue `q`: the
+  // L1 of its core tile or the L2 of its partition.
+  MemoryPool &getMemoryPool(unsigned space, QueueContext *q) {
+    int64_t unit = -1;
+    if (q && space == (unsigned)xilinx::air::MemorySpace::L1)
+      unit = q->tile;
+    else if (q && space == (unsigned)xilinx::air::MemorySpace::L2)
+      unit = q->partition;
+    auto &pool = memoryPools[{space, unit}];
+    if (pool.name.size())
+      return pool;
+
+    auto *mem = arch.getMemory(space);
+    pool.name = mem && mem->name.size()
+                    ? mem->name
+                    : "memory space " + std::to_string(space);
+    if (mem)
+      pool.capacity = mem->bytes;
+    auto &topo = arch.topology;
+    if (unit >= 0 && space == (unsigned)xilinx::air::MemorySpace::L1)
+      pool.name += " of tile (" +
+                   std::to_string(unit / topo.rows + topo.column_offset) +
+                   ", " + std::to_string(unit % topo.rows + topo.row_offset) +
+                   ")";
+    else if (unit >= 0)
+      pool.name += " of partition " + std::to_string(unit);
+    return pool;
+  }
+
+  // Report the first time the buffers of `pool` do not fit its capacity.
+  void checkCapacity(MemoryPool &pool) {
+    if (!pool.capacity || pool.highWater <= pool.capacity || pool.overflowed)
+      return;
+    pool.overflowed = true;
+    results.memoryOverflow = true;
+    llvm::errs() << (failOnMemoryOverflow ? "ERROR: " : "WARNING: ")
+                 << pool.name << " needs " << pool.highWater
+                 << " bytes at time " << now() << ", its capacity is "
+                 << pool.capacity << " bytes\n";
+  }
+
+  std::string printValueWithType(mlir::Type type, const RuntimeValue &value) {
     std::stringstream out;
     if (type.isa<mlir::IntegerType>() || type.isa<mlir::IndexType>()) {
-      out << llvm::any_cast<llvm::APInt>(value).getSExtValue();
+      out << value.i;
       return out.str();
     } else if (type.isa<mlir::FloatType>()) {
-      out << llvm::any_cast<llvm::APFloat>(value).convertToDouble();
+      out << value.f;
       return out.str();
     } else if (type.isa<mlir::NoneType>()) {
       return "none";
@@ -405,30 +1501,28 @@ public:
     }
   }
 
-  void emitTraceStart(llvm::raw_ostream &s) { s << "[\n"; }
+  void emitTraceStart(llvm::raw_ostream &s) { traceSink->start(s); }
 
-  void emitTraceEnd(llvm::raw_ostream &s) { s << "{}]\n"; }
+  void emitTraceEnd(llvm::raw_ostream &s) { traceSink->finish(s); }
 
-  void emitTraceEvent(llvm::raw_ostream &s, std::string name, std::string cat,
-                      std::string ph, uint64_t ts, int64_t tid, int64_t pid) {
-    s << "{\n";
-    s << "  \"name\": \"" << name << "\","
-      << "\n";
-    s << "  \"cat\": \"" << cat << "\","
-      << "\n";
-    s << "  \"ph\": \"" << ph << "\","
-      << "\n";
-    s << "  \"ts\": " << ts << ","
-      << "\n";
-    s << "  \"pid\": " << pid << ","
-      << "\n";
-    s << "  \"tid\": " << tid << ","
-      << "\n";
-    s << "  \"args\": "
-      << "{}"
-      << ""
-      << "\n";
-    s << "},\n";
+  // Parallel simulations buffer the events of each logical process until the
+  // end of the window, see flushTrace.
+  void emitTraceEvent(std::string name, llvm::StringRef cat, char ph,
+                      uint64_t ts, int64_t tid, int64_t pid) {
+    if (parallel) {
+      lp().traceEvents.push_back({std::move(name), cat, ph, ts, tid, pid});
+      return;
+    }
+    traceSink->event(name, cat, ph, ts, tid, pid);
+  }
+
+  void emitTraceCounter(std::string name, uint64_t ts, int64_t pid,
+                        int64_t value) {
+    if (parallel) {
+      lp().traceEvents.push_back({std::move(name), "", 'C', ts, 0, pid, value});
+      return;
+    }
+    traceSink->counter(name, ts, pid, value);
   }
 
   uint64_t getTensorVolume(const mlir::ShapedType ty) {
@@ -457,52 +1551,15 @@ public:
 
   uint64_t getTransferCost(unsigned srcSpace, unsigned dstSpace,
                            int64_t volume) {
-    std::map<std::pair<unsigned, unsigned>, double> interface_bw;
-
-    // defaults
-    interface_bw.insert({{0, 1}, 100});
-    interface_bw.insert({{1, 0}, 100});
-    interface_bw.insert({{1, 2}, DBL_MAX});
-    interface_bw.insert({{2, 1}, DBL_MAX});
-    double cps = 0.0f;
-
-    // override of defaults
-    auto model = jsonModel.getAsObject();
-    unsigned datawidth = 0;
-    // if interfaces exists, assume everthing else exists
-    if (model && model->getArray("interfaces")) {
-      auto interfaces = model->getArray("interfaces");
-      assert(interfaces);
-
-      for (auto it = interfaces->begin(), ie = interfaces->end(); it != ie;
-           ++it) {
-        llvm::json::Value jv = *it;
-        llvm::json::Object *interface = jv.getAsObject();
-        assert(interface);
-        auto srcSpace = interface->getNumber("src");
-        auto dstSpace = interface->getNumber("dst");
-        auto bps = interface->getNumber("bytes_per_second");
-        assert(srcSpace && dstSpace && bps);
-        unsigned s = *srcSpace;
-        unsigned d = *dstSpace;
-        double b = *bps;
-        if (interface_bw.count({s, d}))
-          interface_bw[{s, d}] = b;
-        else
-          interface_bw.insert({{s, d}, b});
-      }
-      if (auto d = model->getNumber("clock"))
-        cps = *d;
-      if (auto dt = model->getObject("datatype"))
-        if (auto bytes = dt->getNumber("bytes"))
-          datawidth = *bytes;
+    if (!arch.hasInterface(srcSpace, dstSpace)) {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      if (missingInterfaces.insert({srcSpace, dstSpace}).second)
+        llvm::errs() << "WARNING: no interface from memory space " << srcSpace
+                     << " to memory space " << dstSpace
+                     << " in the arch model, transfers are not modeled\n";
     }
-    assert(cps != 0.0f && datawidth);
-
-    double bytes = volume * datawidth;
-    double bps = interface_bw[{srcSpace, dstSpace}];
-    double seconds = bytes / bps;
-    return (uint64_t)ceil(seconds * cps);
+    double bytes = volume * arch.datatype_bytes;
+    return arch.getTransferCycles(srcSpace, dstSpace, bytes);
   }
 
   // model the memory tranfer time for a layer
@@ -511,13 +1568,7 @@ public:
     const int num_mem = 2;
     std::vector<uint64_t> ld_xfer_time(num_mem, 0);
     std::vector<uint64_t> st_xfer_time(num_mem, 0);
-
-    auto model = jsonModel.getAsObject();
-    if (!model)
-      assert(model);
-    auto memories = model->getObject("memories");
-    if (!memories)
-      assert(memories);
+    uint64_t time = 0;
 
     // unsigned idx = 0;
     // for (Value o : op->getOperands()) {
@@ -581,24 +1632,21 @@ public:
     //   idx++;
     // }
 
-    time = 0;
     for (int i = 0; i < num_mem; i++) {
       // llvm::dbgs() << "memory[" << i << "] ld time: " << ld_xfer_time[i] << "
       // st time: " << st_xfer_time[i] << "\n";
-      auto mem = memories->getObject(std::to_string(i));
-      if (!mem)
-        assert(mem);
-      auto type = mem->getString("type");
-      if (!type)
-        assert(type);
+      auto mem = arch.getMemory(i);
+      if (!mem) {
+        llvm::errs() << "WARNING: memory space " << i
+                     << " not found in the arch model\n";
+        continue;
+      }
 
       uint64_t t;
-      if (*type == "duplex")
+      if (mem->duplex)
         t = std::max(st_xfer_time[i], ld_xfer_time[i]);
-      else if (*type == "simplex")
-        t = st_xfer_time[i] + ld_xfer_time[i];
       else
-        llvm_unreachable("bad memory type in device model");
+        t = st_xfer_time[i] + ld_xfer_time[i];
 
       time = std::max(t, time);
     }
@@ -606,8 +1654,29 @@ public:
     return std::tie(time, ld_xfer_time, st_xfer_time);
   }
 
+  struct SharedInterface;
+
+  struct ChannelFifo;
+
+  // The steady state of an scf.for of which only the first iterations are
+  // simulated, see scheduleScfFor. The remaining iterations are extrapolated
+  // from the spacing of the completion times of the last simulated ones.
+  struct LoopExtrapolation {
+    int64_t trip_count;
+    // completion time of the tokens yielded by each simulated iteration
+    std::vector<uint64_t> iter_done;
+    // sorted completion times of the completed iterations
+    std::vector<uint64_t> completions;
+    uint64_t period = 0;
+    // largest deviation of an iteration from the period, times the number of
+    // extrapolated iterations
+    uint64_t error_bound = 0;
+    bool steady = false;
+  };
+
   struct CommandQueueEntry {
     mlir::Operation *op;
+    EnvPtr env;
     uint64_t start_time;
     uint64_t end_time;
     uint64_t compute_op_cost;
@@ -620,13 +1689,43 @@ public:
     std::vector<uint64_t> ld_xfer_time;
     std::vector<uint64_t> st_xfer_time;
 
+    // A wait entry is created by the runner rather than for an op of the
+    // program. It waits for the token slots in `deps`, then runs its
+    // callback. `op` is the operation on whose behalf it waits.
+    bool is_wait;
+    SmallVector<unsigned, 4> deps;
+
+    // A transfer over a shared interface. Its end time is recomputed as
+    // other transfers start and finish on the same interface.
+    SharedInterface *xfer_interface;
+    double xfer_bytes;
+    // fixed cycles of the transfer on top of moving its bytes
+    uint64_t xfer_latency;
+
+    // The channel buffers of an air.channel.put or air.channel.get, resolved
+    // when the entry first tries to start.
+    SmallVector<ChannelFifo *, 1> fifos;
+    bool channel_blocked;
+
+    // A wait entry which stands for the extrapolated iterations of a loop.
+    std::shared_ptr<LoopExtrapolation> extrapolation;
+
+    // The entry which enqueued this one and the entry which determined its
+    // start, see PathNode.
+    const PathNode *creator;
+    const PathNode *pred;
+
     bool is_started() { return (start_time != 0) && (end_time != 0); }
     bool is_done(uint64_t t) { return t >= end_time; }
 
-    CommandQueueEntry(mlir::Operation *o, LaunchFn launch_fn = nullptr)
-        : op(o), start_time(0), end_time(0), compute_op_cost(0),
+    CommandQueueEntry(mlir::Operation *o, EnvPtr env,
+                      LaunchFn launch_fn = nullptr)
+        : op(o), env(env), start_time(0), end_time(0), compute_op_cost(0),
           compute_xfer_cost(0), queue_ready_time(0),
-          launch_callback_fn(launch_fn) {}
+          launch_callback_fn(launch_fn), is_wait(false),
+          xfer_interface(nullptr), xfer_bytes(0), xfer_latency(0),
+          channel_blocked(false),
+          creator(nullptr), pred(nullptr) {}
 
     CommandQueueEntry &operator=(const CommandQueueEntry &) = delete;
   };
@@ -634,6 +1733,21 @@ public:
   struct QueueContext {
     std::string name;
     std::deque<CommandQueueEntry> queue;
+    // time of the earliest pending wake-up of this queue, or UINT64_MAX
+    uint64_t wakeup_time = UINT64_MAX;
+    // shim column through which the transfers of this queue are routed
+    unsigned column = 0;
+    // logical process simulating this queue
+    LogicalProcess *lp = nullptr;
+    // index of the core tile in coreGrid of this queue or of the tile owning
+    // it, or -1, and the partition of the queue
+    int64_t tile = -1;
+    unsigned partition = 0;
+    // cycles spent running entries and waiting for the entry at the front to
+    // become ready, and the last entry to finish
+    uint64_t busy_cycles = 0;
+    uint64_t stall_cycles = 0;
+    const PathNode *last = nullptr;
     std::vector< std::pair< std::vector<std::string>, std::vector<QueueContext*> > > contexts;
     std::map<std::vector<QueueContext*>*, size_t> rrmap;
 
@@ -662,8 +1776,498 @@ public:
 
   std::vector<QueueContext*> queues;
 
+  // Pending queue wake-ups ordered by time. The sequence number breaks ties
+  // so that queues woken at the same time are processed in wake-up order.
+  using Wakeup = std::tuple<uint64_t, uint64_t, QueueContext *>;
+
+  // Work posted to a logical process by another one, ordered like wake-ups.
+  struct Task {
+    uint64_t time;
+    uint64_t seq;
+    std::function<void()> fn;
+    bool operator>(const Task &t) const {
+      return std::tie(time, seq) > std::tie(t.time, t.seq);
+    }
+  };
+
+  // Schedule `q` to be processed at time `t`. An earlier pending wake-up
+  // makes this one redundant: the queue re-arms itself when it is processed.
+  void wakeQueue(QueueContext *q, uint64_t t) {
+    if (q->wakeup_time <= t)
+      return;
+    q->wakeup_time = t;
+    q->lp->wakeups.push({t, q->lp->wakeupSeq++, q});
+  }
+
+  // A memory interface whose bandwidth is shared by the transfers in flight
+  // on it. The interface bandwidth is divided max-min fairly between the
+  // active transfers, subject to the per shim column limit if the arch model
+  // gives one. Shares are recomputed whenever a transfer starts or finishes.
+  struct SharedInterface {
+    struct Transfer {
+      CommandQueueEntry *entry;
+      QueueContext *queue;
+      unsigned column;
+      double remaining; // bytes
+      double rate;      // bytes per cycle
+      // fixed cycles on top of moving the bytes
+      uint64_t latency;
+    };
+    double bytes_per_cycle;
+    double column_bytes_per_cycle;
+    unsigned num_columns;
+    uint64_t last_update = 0;
+    std::list<Transfer> active;
+    // guards the transfers, which may belong to several logical processes
+    std::mutex mutex;
+  };
+
+  // The buffer between an air.channel instance and one of its consumers.
+  // A put reserves space when it starts and makes its item available when it
+  // finishes, a get takes an item when it starts and frees its space when it
+  // finishes. Puts block while the buffer is full, gets while it is empty.
+  struct ChannelFifo {
+    unsigned depth = 1;
+    unsigned reserved = 0;
+    unsigned available = 0;
+    // queues blocked on this buffer
+    SmallVector<QueueContext *, 4> waiters;
+    // contents of the available items in functional mode, shared by the
+    // buffers a put is broadcast to
+    std::deque<std::shared_ptr<MemRefBuffer>> items;
+  };
+
+  // An air.channel with `size` instances. Every instance is broadcast to
+  // the consumers of `broadcastShape` it covers, each with its own buffer.
+  struct ChannelState {
+    SmallVector<int64_t, 4> size;
+    SmallVector<int64_t, 4> broadcastShape;
+    unsigned depth = 1;
+    // bandwidth of a put, 0 to use the memory interface to `dstSpace`
+    double bytes_per_cycle = 0;
+    // memory space the gets of the channel write to
+    unsigned dstSpace = 0;
+    // buffers keyed by the linear index of the consumer in `broadcastShape`
+    std::map<int64_t, ChannelFifo> fifos;
+  };
+
+  // A trace event buffered by a logical process. Categories are literals.
+  struct TraceEvent {
+    std::string name;
+    llvm::StringRef cat;
+    char ph;
+    uint64_t ts;
+    int64_t tid;
+    int64_t pid;
+    // value of a counter event, ph 'C'
+    int64_t value = 0;
+  };
+
+  // A logical process of the simulation: a set of queues with their own
+  // event list and clock. A sequential simulation has a single logical
+  // process. A parallel simulation has one for the host queues and one per
+  // partition of the topology, see runParallel.
+  struct LogicalProcess {
+    uint64_t time = 1;
+
+    std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>>
+        wakeups;
+    uint64_t wakeupSeq = 0;
+    uint64_t taskSeq = 0;
+
+    // Work posted by other logical processes, and work for other logical
+    // processes posted during the current window.
+    std::priority_queue<Task, std::vector<Task>, std::greater<Task>> tasks;
+    std::vector<std::pair<LogicalProcess *, Task>> outbox;
+
+    // Queues blocked on an async token owned by this process, keyed by the
+    // slot they wait on.
+    llvm::DenseMap<unsigned, SmallVector<QueueContext *, 4>> waiters;
+
+    // Token slots to decrement when a token slot completes, see forwardToken.
+    llvm::DenseMap<unsigned, SmallVector<unsigned, 1>> tokenForwards;
+
+    // Functions to run when a token slot completes, see whenTokenDone.
+    llvm::DenseMap<unsigned, SmallVector<std::function<void()>, 1>>
+        tokenCallbacks;
+
+    // Queues of this process blocked on a token owned by another process,
+    // and tokens of this process completed during the current window.
+    std::vector<std::pair<unsigned, QueueContext *>> remoteWaits;
+    std::vector<unsigned> completed;
+
+    // Work has been posted to another process at the current time, which
+    // may post work back at that time, see runWindow.
+    bool posted = false;
+
+    // trace events of the current window of a parallel simulation
+    std::vector<TraceEvent> traceEvents;
+
+    // queue being processed, whose tile and partition own the allocations
+    QueueContext *queue = nullptr;
+
+    // Completed entries, and the entry whose completion is being processed.
+    // Work posted to other processes carries the current entry along.
+    std::deque<PathNode> pathNodes;
+    const PathNode *currentNode = nullptr;
+
+    // extrapolated instances of each scf.for
+    std::map<Operation *, AIRRunnerResults::Loop> loops;
+
+    // scf.for loops of this process waiting for an iteration to complete
+    // before scheduling the next one, see releaseStalledLoop
+    std::vector<std::shared_ptr<ForSchedule>> stalledLoops;
+
+    // stall cycles and number of stalls, keyed by the waiting op and the cause
+    std::map<std::pair<std::string, std::string>, std::pair<uint64_t, uint64_t>>
+        stalls;
+
+    uint64_t getNextTime() const {
+      uint64_t t = UINT64_MAX;
+      if (wakeups.size())
+        t = std::get<0>(wakeups.top());
+      if (tasks.size())
+        t = std::min(t, tasks.top().time);
+      return t;
+    }
+  };
+
+  std::vector<std::unique_ptr<LogicalProcess>> lps;
+
+  // The logical process being simulated by the calling thread.
+  static thread_local LogicalProcess *currentLP;
+
+  LogicalProcess &lp() { return *currentLP; }
+  uint64_t now() { return currentLP->time; }
+
+  // Run `fn` on logical process `target` at time `t`. The work is delivered
+  // at the end of the current window, at time `t` unless `target` has
+  // simulated past it in the window, see endWindow.
+  void post(LogicalProcess *target, uint64_t t, std::function<void()> fn) {
+    assert(target != &lp() && t >= now());
+    lp().posted = true;
+    auto *node = lp().currentNode;
+    lp().outbox.push_back({target, Task{t, 0, [=, fn = std::move(fn)]() {
+                             auto *saved = lp().currentNode;
+                             lp().currentNode = node;
+                             fn();
+                             lp().currentNode = saved;
+                           }}});
+  }
+
+  // Run `fn` on the logical process simulating `q` at the current time.
+  void runOn(QueueContext *q, std::function<void()> fn) {
+    if (q->lp == &lp())
+      fn();
+    else
+      post(q->lp, now(), std::move(fn));
+  }
+
+  // Return the shared interface from `srcSpace` to `dstSpace`, or nullptr if
+  // transfers between the spaces are not limited by bandwidth. The
+  // interfaces are shared by the logical processes.
+  SharedInterface *getSharedInterface(unsigned srcSpace, unsigned dstSpace) {
+    std::lock_guard<std::mutex> lock(interfaceMutex);
+    auto &iface = sharedInterfaces[{srcSpace, dstSpace}];
+    if (iface)
+      return iface.get();
+    double bps = arch.getBandwidth(srcSpace, dstSpace);
+    if (bps <= 0 || bps == DBL_MAX)
+      return nullptr;
+    iface = std::make_unique<SharedInterface>();
+    iface->bytes_per_cycle = bps / arch.clock;
+    iface->num_columns = arch.getNumColumns(srcSpace, dstSpace);
+    iface->column_bytes_per_cycle =
+        arch.getColumnBandwidth(srcSpace, dstSpace) / arch.clock;
+    return iface.get();
+  }
+
+  // Account for the bytes moved by the transfers of `iface` up to time `t`.
+  void advanceTransfers(SharedInterface &iface, uint64_t t) {
+    for (auto &x : iface.active)
+      x.remaining = std::max(0.0, x.remaining - x.rate * (t - iface.last_update));
+    iface.last_update = t;
+  }
+
+  // Recompute the bandwidth share of the transfers of `iface` at time `t`,
+  // moving their end times and waking their queues as needed.
+  void updateTransferRates(SharedInterface &iface, uint64_t t) {
+    if (iface.active.empty())
+      return;
+
+    // Transfers which have moved all of their bytes only wait out the fixed
+    // DMA latency, they take no bandwidth and their end time is final.
+    auto isDrained = [](const SharedInterface::Transfer &x) {
+      return x.remaining <= 1e-6;
+    };
+
+    // Water-fill the interface bandwidth: columns with the most transfers
+    // have the smallest per-transfer column share, so they are limited first
+    // and whatever they cannot use is left for the other columns.
+    std::map<unsigned, unsigned> perColumn;
+    unsigned remaining = 0;
+    for (auto &x : iface.active) {
+      if (isDrained(x))
+        continue;
+      perColumn[iface.num_columns ? x.column % iface.num_columns : 0]++;
+      remaining++;
+    }
+    std::vector<std::pair<unsigned, unsigned>> columns(perColumn.begin(),
+                                                       perColumn.end());
+    std::sort(columns.begin(), columns.end(), [](auto &a, auto &b) {
+      return a.second > b.second;
+    });
+    std::map<unsigned, double> columnRate;
+    double available = iface.bytes_per_cycle;
+    for (auto &col : columns) {
+      double rate = available / remaining;
+      if (iface.num_columns)
+        rate = std::min(rate, iface.column_bytes_per_cycle / col.second);
+      columnRate[col.first] = rate;
+      available -= rate * col.second;
+      remaining -= col.second;
+    }
+
+    for (auto &x : iface.active) {
+      if (isDrained(x)) {
+        x.rate = 0;
+        continue;
+      }
+      x.rate = columnRate[iface.num_columns ? x.column % iface.num_columns : 0];
+      // the entries of other processes are updated by their process, from
+      // the state of the interface once every transfer at `t` has started
+      if (x.queue->lp != &lp()) {
+        auto *entry = x.entry;
+        auto *shared = &iface;
+        post(x.queue->lp, t, [=]() {
+          std::lock_guard<std::mutex> lock(shared->mutex);
+          for (auto &x : shared->active)
+            if (x.entry == entry && !isDrained(x))
+              updateTransferEnd(x, shared->last_update);
+        });
+        continue;
+      }
+      updateTransferEnd(x, t);
+    }
+  }
+
+  // Move the end time of transfer `x` to the time it moves its remaining
+  // bytes at its rate from time `t`, and wake its queue as needed.
+  void updateTransferEnd(SharedInterface::Transfer &x, uint64_t t) {
+    // tolerate rounding error in the bytes already moved
+    double cycles = std::max(0.0, x.remaining / x.rate - 1e-6);
+    uint64_t end = t + (uint64_t)ceil(cycles) + x.latency;
+    if (end == x.entry->end_time)
+      return;
+    x.entry->end_time = end;
+    wakeQueue(x.queue, end);
+  }
+
+  // Start the transfer of entry `c` of queue `q` at time `t` and return its
+  // end time at the current bandwidth share.
+  uint64_t startTransfer(CommandQueueEntry &c, QueueContext *q, uint64_t t) {
+    auto &iface = *c.xfer_interface;
+    std::lock_guard<std::mutex> lock(iface.mutex);
+    advanceTransfers(iface, t);
+    iface.active.push_back({&c, q, q->column, c.xfer_bytes, 0, c.xfer_latency});
+    c.end_time = t + c.xfer_latency;
+    updateTransferRates(iface, t);
+    return c.end_time;
+  }
+
+  // Remove the transfer of entry `c` from its interface at time `t`, giving
+  // its bandwidth to the remaining transfers.
+  void finishTransfer(CommandQueueEntry &c, uint64_t t) {
+    auto &iface = *c.xfer_interface;
+    std::lock_guard<std::mutex> lock(iface.mutex);
+    advanceTransfers(iface, t);
+    iface.active.remove_if(
+        [&](const SharedInterface::Transfer &x) { return x.entry == &c; });
+    c.xfer_interface = nullptr;
+    updateTransferRates(iface, t);
+  }
+
+  // Build the state of the channels declared in `module` from their
+  // declarations and the arch model.
+  void modelChannels(ModuleOp module) {
+    channels.clear();
+    module.walk([&](xilinx::air::ChannelOp op) {
+      auto &state = channels[op.getSymName()];
+      for (auto a : op.getSize())
+        state.size.push_back(a.cast<IntegerAttr>().getInt());
+      if (state.size.empty())
+        state.size.push_back(1);
+      state.broadcastShape = state.size;
+      if (auto bcast = op->getAttrOfType<ArrayAttr>("broadcast_shape")) {
+        SmallVector<int64_t, 4> shape;
+        for (auto a : bcast)
+          shape.push_back(a.cast<IntegerAttr>().getInt());
+        bool valid = shape.size() == state.size.size();
+        for (unsigned d = 0; valid && d < shape.size(); d++)
+          valid = shape[d] % state.size[d] == 0;
+        if (valid)
+          state.broadcastShape = shape;
+        else
+          llvm::errs() << "WARNING: broadcast_shape of channel '"
+                       << op.getSymName()
+                       << "' is not a multiple of its size, ignored\n";
+      }
+      auto &params = arch.getChannel(op.getSymName());
+      state.depth = params.depth;
+      state.bytes_per_cycle = params.bytes_per_second / arch.clock;
+    });
+    module.walk([&](xilinx::air::ChannelGetOp op) {
+      auto it = channels.find(op.getChanName());
+      if (it != channels.end())
+        it->second.dstSpace =
+            op.getDst().getType().cast<MemRefType>().getMemorySpaceAsInt();
+    });
+  }
+
+  ChannelState &getChannelState(StringRef name) {
+    auto it = channels.find(name);
+    if (it == channels.end())
+      llvm::report_fatal_error("air-runner: unknown channel '" + name + "'");
+    return it->second;
+  }
+
+  // Return the buffers written by the put or read by the get of entry `c`. A
+  // put writes the buffer of every consumer covered by its channel instance.
+  SmallVector<ChannelFifo *, 1> getChannelFifos(CommandQueueEntry &c) {
+    auto chan = cast<xilinx::air::ChannelInterface>(c.op);
+    auto &state = getChannelState(chan.getChanName());
+    OperandRange indices =
+        isa<xilinx::air::ChannelPutOp>(c.op)
+            ? cast<xilinx::air::ChannelPutOp>(c.op).getIndices()
+            : cast<xilinx::air::ChannelGetOp>(c.op).getIndices();
+    unsigned rank = state.size.size();
+    SmallVector<int64_t, 4> idx(rank, 0);
+    for (unsigned d = 0; d < rank && d < indices.size(); d++)
+      idx[d] = slots[getOrCreateSlot(c.env.get(), indices[d])].value.i;
+
+    auto getFifo = [&](ArrayRef<int64_t> consumer) {
+      int64_t key = 0;
+      for (unsigned d = 0; d < rank; d++)
+        key = key * state.broadcastShape[d] + consumer[d];
+      auto &fifo = state.fifos[key];
+      fifo.depth = state.depth;
+      return &fifo;
+    };
+
+    SmallVector<ChannelFifo *, 1> fifos;
+    if (isa<xilinx::air::ChannelGetOp>(c.op)) {
+      fifos.push_back(getFifo(idx));
+      return fifos;
+    }
+    // enumerate the consumers of instance `idx`, the box of broadcastShape
+    // / size consumers per dimension starting at idx * broadcastShape / size
+    SmallVector<int64_t, 4> ratio(rank), consumer(rank);
+    int64_t count = 1;
+    for (unsigned d = 0; d < rank; d++) {
+      ratio[d] = state.broadcastShape[d] / state.size[d];
+      count *= ratio[d];
+    }
+    for (int64_t i = 0; i < count; i++) {
+      auto offset = delinearize(i, ratio);
+      for (unsigned d = 0; d < rank; d++)
+        consumer[d] = idx[d] * ratio[d] + offset[d];
+      fifos.push_back(getFifo(consumer));
+    }
+    return fifos;
+  }
+
+  // Start the channel put or get of entry `c` of queue `q` if none of its
+  // buffers blocks it. Otherwise park `q` on the blocking buffer and return
+  // false.
+  bool tryStartChannelOp(CommandQueueEntry &c, QueueContext *q) {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    if (c.fifos.empty())
+      c.fifos = getChannelFifos(c);
+    bool put = isa<xilinx::air::ChannelPutOp>(c.op);
+    for (auto *f : c.fifos) {
+      if (put ? f->reserved < f->depth : f->available > 0)
+        continue;
+      if (f->waiters.empty() || f->waiters.back() != q)
+        f->waiters.push_back(q);
+      return false;
+    }
+    for (auto *f : c.fifos) {
+      if (put)
+        f->reserved++;
+      else
+        f->available--;
+    }
+    return true;
+  }
+
+  // Complete the channel put or get of entry `c` and wake the queues blocked
+  // on its buffers.
+  void finishChannelOp(CommandQueueEntry &c) {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    bool put = isa<xilinx::air::ChannelPutOp>(c.op);
+    std::shared_ptr<MemRefBuffer> item;
+    if (functional && put)
+      item = readChannelPut(cast<xilinx::air::ChannelPutOp>(c.op),
+                            c.env.get());
+    for (auto *f : c.fifos) {
+      if (functional && put) {
+        f->items.push_back(item);
+      } else if (functional) {
+        assert(f->items.size() && "channel get without data");
+        writeChannelGet(cast<xilinx::air::ChannelGetOp>(c.op), c.env.get(),
+                        *f->items.front());
+        f->items.pop_front();
+      }
+      if (put)
+        f->available++;
+      else
+        f->reserved--;
+      for (auto *q : f->waiters) {
+        if (q->lp == &lp())
+          wakeQueue(q, now());
+        else
+          post(q->lp, now(), [=]() { wakeQueue(q, now()); });
+      }
+      f->waiters.clear();
+    }
+    c.fifos.clear();
+  }
+
+  // Return the cycles taken by channel put `op` of entry `c` to move its data
+  // into the channel.
+  uint64_t getChannelPutCycles(xilinx::air::ChannelPutOp op,
+                               CommandQueueEntry &c) {
+    auto srcTy = op.getSrc().getType().cast<MemRefType>();
+    int64_t volume = getTensorVolume(srcTy);
+    if (op.getSrcSizes().size()) {
+      volume = 1;
+      for (auto v : op.getSrcSizes())
+        volume *= slots[getOrCreateSlot(c.env.get(), v)].value.i;
+    }
+    double bytes = volume * arch.datatype_bytes;
+    dmaBytes += volume * arch.datatype_bytes;
+    auto &state = getChannelState(op.getChanName());
+    if (state.bytes_per_cycle > 0)
+      return ceil(bytes / state.bytes_per_cycle) + arch.dma_latency;
+    return arch.getTransferCycles(srcTy.getMemorySpaceAsInt(), state.dstSpace,
+                                  bytes) +
+           arch.dma_latency;
+  }
+
+  void enqueue(QueueContext *q, CommandQueueEntry c) {
+    if (!c.creator)
+      c.creator = lp().currentNode;
+    if (q->lp != &lp()) {
+      post(q->lp, now(), [=]() { enqueue(q, c); });
+      return;
+    }
+    q->queue.push_back(c);
+    wakeQueue(q, now());
+  }
+
   QueueContext *newQueueContext(std::string name) {
     QueueContext *q =  new QueueContext(name);
+    q->lp = lps.front().get();
     queues.push_back(q);
     return q;
   }
@@ -674,60 +2278,271 @@ public:
     delete q;
   }
 
-  QueueContext *makeCoreContext() {
+  // Delete the queues of the last simulation, which refer to its logical
+  // processes.
+  void clearQueueContexts() {
+    for (auto *q : queues)
+      delete q;
+    queues.clear();
+    coreGrid.clear();
+  }
+
+  ~AIRRunner_impl() { clearQueueContexts(); }
+
+  QueueContext *makeCoreContext(unsigned column, int64_t tile) {
     QueueContext *ctx = newQueueContext("core");
-    std::vector<std::string> ops{"air.dma_memcpy_nd"};
+    ctx->column = column;
+    ctx->tile = tile;
+    std::vector<std::string> ops{"air.dma_memcpy_nd", "air.channel.put"};
     std::vector<QueueContext*> ctxs;
-    for (unsigned i = 0; i < core_dma_slots; i++)
-      ctxs.push_back(makeDmaContext());
+    for (unsigned i = 0; i < arch.topology.tile_dma_channels; i++)
+      ctxs.push_back(makeDmaContext(column));
     ctx->contexts.push_back({ops, ctxs});
+    std::vector<QueueContext *> s2mm;
+    for (unsigned i = 0; i < arch.topology.tile_dma_channels; i++)
+      s2mm.push_back(makeDmaContext(column));
+    ctx->contexts.push_back({{"air.channel.get"}, s2mm});
+    for (auto *dma : ctxs)
+      dma->tile = tile;
+    for (auto *dma : s2mm)
+      dma->tile = tile;
     return ctx;
   }
 
-  QueueContext *makeDmaContext() {
+  QueueContext *makeDmaContext(unsigned column) {
     QueueContext *ctx = newQueueContext("dma");
+    ctx->column = column;
     return ctx;
   }
 
-  QueueContext *makeDispatchContext() {
+  // A controller of the partition starting at `first_column`. Transfers it
+  // issues are spread over the shim DMA channels `shim_dmas` of the
+  // partition, channel gets over the channels `shim_s2mm`.
+  QueueContext *makeDispatchContext(unsigned first_column,
+                                    const std::vector<QueueContext *> &shim_dmas,
+                                    const std::vector<QueueContext *> &shim_s2mm) {
     QueueContext *ctx = newQueueContext("dispatch");
+    ctx->column = first_column;
+    std::vector<std::string> ops{"air.dma_memcpy_nd", "air.channel.put"};
+    ctx->contexts.push_back({ops, shim_dmas});
+    ctx->contexts.push_back({{"air.channel.get"}, shim_s2mm});
+    return ctx;
+  }
+
+  QueueContext *makeTopContext() {
+    auto &topo = arch.topology;
+    QueueContext *ctx = newQueueContext("top");
+
+    // queues for top level parallel dispatch, spread over the controllers of
+    // every partition
+    std::vector<std::string> ops{"scf.parallel"};
+    std::vector<QueueContext*> ctxs;
+    for (unsigned p = 0; p < topo.partitions; p++) {
+      unsigned first_column = p * topo.columns;
+      size_t first_queue = queues.size();
+      for (unsigned col = 0; col < topo.columns; col++)
+        for (unsigned row = 0; row < topo.rows; row++)
+          coreGrid.push_back(
+              makeCoreContext(first_column + col, coreGrid.size()));
+      std::vector<QueueContext *> shim_dmas, shim_s2mm;
+      for (unsigned col = 0; col < topo.columns; col++)
+        for (unsigned i = 0; i < topo.shim_dma_channels; i++) {
+          shim_dmas.push_back(makeDmaContext(first_column + col));
+          shim_s2mm.push_back(makeDmaContext(first_column + col));
+        }
+      for (unsigned i = 0; i < topo.controllers; i++)
+        ctxs.push_back(
+            makeDispatchContext(first_column, shim_dmas, shim_s2mm));
+
+      for (size_t i = first_queue; i < queues.size(); i++)
+        queues[i]->partition = p;
+
+      // a parallel simulation gives every partition its own logical process
+      if (parallel) {
+        lps.push_back(std::make_unique<LogicalProcess>());
+        for (size_t i = first_queue; i < queues.size(); i++)
+          queues[i]->lp = lps.back().get();
+      }
+    }
+    ctx->contexts.push_back({ops, ctxs});
+
+    return ctx;
+  }
+
+  // Return the queue of the core tile running tile (`col`, `row`) of `herd`,
+  // which is dispatched from `qctx`. Herds placed by air-place-herds use
+  // their x_loc/y_loc device coordinates, other herds are placed at the
+  // first column of the partition of `qctx`.
+  QueueContext *getTileContext(QueueContext *qctx, xilinx::air::HerdOp herd,
+                               int64_t col, int64_t row) {
+    auto &topo = arch.topology;
+    int64_t x = qctx->column + col;
+    int64_t y = row;
+    auto x_loc = herd.getColOffset();
+    auto y_loc = herd.getRowOffset();
+    if (x_loc && y_loc) {
+      x = (int64_t)*x_loc - topo.column_offset + col;
+      y = (int64_t)*y_loc - topo.row_offset + row;
+    }
+    int64_t columns = topo.getNumColumns();
+    int64_t rows = topo.rows;
+    if (x < 0 || x >= columns || y < 0 || y >= rows) {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      if (misplacedHerds.insert(herd.getOperation()).second)
+        llvm::errs() << "WARNING: herd tile (" << x << ", " << y
+                     << ") is outside of the " << columns << "x" << rows
+                     << " device, wrapping it onto the device\n";
+      x = ((x % columns) + columns) % columns;
+      y = ((y % rows) + rows) % rows;
+    }
+    return coreGrid[x * rows + y];
+  }
+
+  // Return the mean spacing of the last `steadyStateWindow` of the sorted
+  // completion times `done`, and the smallest and largest spacing in `lo` and
+  // `hi`. `done` holds more than `steadyStateWindow` times.
+  uint64_t getWindowPeriod(ArrayRef<uint64_t> done, uint64_t &lo,
+                           uint64_t &hi) {
+    uint64_t sum = 0;
+    lo = UINT64_MAX;
+    hi = 0;
+    for (size_t i = done.size() - steadyStateWindow; i < done.size(); i++) {
+      uint64_t d = done[i] - done[i - 1];
+      lo = std::min(lo, d);
+      hi = std::max(hi, d);
+      sum += d;
+    }
+    return (sum + steadyStateWindow / 2) / steadyStateWindow;
+  }
+
+  // The iterations of a loop are steady once the spacing of the completions
+  // in each of the last two windows, and the periods of the two windows,
+  // agree within 1%.
+  bool isSteady(ArrayRef<uint64_t> done) {
+    if (done.size() <= 2 * steadyStateWindow)
+      return false;
+    uint64_t lo0, hi0, lo1, hi1;
+    uint64_t p0 = getWindowPeriod(done.drop_back(steadyStateWindow), lo0, hi0);
+    uint64_t p1 = getWindowPeriod(done, lo1, hi1);
+    return hi0 - lo0 <= p0 / 100 && hi1 - lo1 <= p1 / 100 &&
+           std::max(p0, p1) - std::min(p0, p1) <= p0 / 100;
+  }
+
+  // Estimate the cycles of the iterations of a loop which were not simulated:
+  // the mean spacing of the completion times of the last `steadyStateWindow`
+  // simulated iterations, per remaining iteration.
+  uint64_t extrapolate(LoopExtrapolation &ext) {
+    auto done = ext.iter_done;
+    std::sort(done.begin(), done.end());
+    uint64_t lo, hi;
+    ext.period = getWindowPeriod(done, lo, hi);
+    // iterations scheduled before the loop was found steady, or the last
+    // windows of a loop which ran into maxSteadyStateWindows
+    ext.steady = ext.steady || isSteady(done);
+    uint64_t remaining = ext.trip_count - done.size();
+    ext.error_bound = remaining * std::max(hi - ext.period, ext.period - lo);
+    return std::max<uint64_t>(remaining * ext.period, 1);
+  }
+
+  // Return the rows of the external memory side of DMA `op`, its source if
+  // `srcIsExternal`: the number of 1D buffer descriptors the controller
+  // pushes and the elements of each.
+  // Without static sizes and strides, the tile moved has the shape of the
+  // smaller memref and the strides of the larger one.
+  std::pair<uint64_t, uint64_t>
+  getShimRows(xilinx::air::DmaMemcpyInterface op, bool srcIsExternal) {
+    auto memTy = (srcIsExternal ? op.getSrcMemref() : op.getDstMemref())
+                     .getType()
+                     .cast<MemRefType>();
+    auto otherTy = (srcIsExternal ? op.getDstMemref() : op.getSrcMemref())
+                       .getType()
+                       .cast<MemRefType>();
+
+    SmallVector<int64_t, 4> sizes, strides;
+    auto getConstants = [](OperandRange values, SmallVector<int64_t, 4> &out) {
+      for (auto v : values) {
+        auto c = v.getDefiningOp<arith::ConstantIndexOp>();
+        if (!c) {
+          out.clear();
+          return;
+        }
+        out.push_back(c.value());
+      }
+    };
+    if (auto nd = dyn_cast<xilinx::air::DmaMemcpyNdOp>(op.getOperation())) {
+      getConstants(srcIsExternal ? nd.getSrcSizes() : nd.getDstSizes(), sizes);
+      getConstants(srcIsExternal ? nd.getSrcStrides() : nd.getDstStrides(),
+                   strides);
+      if (sizes.empty() || sizes.size() != strides.size()) {
+        sizes.clear();
+        strides.clear();
+      }
+    }
+    if (sizes.empty()) {
+      auto tileTy =
+          getTensorVolume(otherTy) < getTensorVolume(memTy) ? otherTy : memTy;
+      if (!memTy.hasStaticShape() || !tileTy.hasStaticShape() ||
+          tileTy.getRank() != memTy.getRank() || !memTy.getRank())
+        return {1, getTensorVolume(tileTy)};
+      sizes.append(tileTy.getShape().begin(), tileTy.getShape().end());
+      strides.resize(sizes.size());
+      int64_t stride = 1;
+      for (int d = sizes.size() - 1; d >= 0; d--) {
+        strides[d] = stride;
+        stride *= memTy.getDimSize(d);
+      }
+    }
 
-    // herd core queues
-    {
-      std::vector<std::string> ops{"air.launch_herd"};
-      std::vector<QueueContext*> ctxs;
-      for (int i=0; i<16; i++)
-        ctxs.push_back(makeCoreContext());
-      ctx->contexts.push_back({ops, ctxs});
-    }
-    {
-      std::vector<std::string> ops{"air.dma_memcpy_nd"};
-      std::vector<QueueContext*> ctxs;
-      for (unsigned i = 0; i < dispatch_dma_slots; i++)
-        ctxs.push_back(makeDmaContext());
-      ctx->contexts.push_back({ops, ctxs});
+    // merge the inner dimensions which are contiguous into one row
+    int d = sizes.size() - 1;
+    uint64_t row = 1;
+    if (strides[d] == 1) {
+      row = sizes[d--];
+      while (d >= 0 && strides[d] == (int64_t)row)
+        row *= sizes[d--];
     }
-    return ctx;
+    uint64_t rows = 1;
+    for (; d >= 0; d--)
+      rows *= sizes[d];
+    return {rows, row};
   }
 
-  QueueContext *makeTopContext() {
-    QueueContext *ctx = newQueueContext("top");
-
-    // queues for top level parallel dispatch
-    std::vector<std::string> ops{"scf.parallel"};
-    std::vector<QueueContext*> ctxs;
-    for (unsigned i=0; i < dispatch_slots; i++)
-      ctxs.push_back(makeDispatchContext());
-    ctx->contexts.push_back({ops, ctxs});
-  
-    return ctx;
+  // Return the cycles the buffer descriptors of DMA `op` add to the time
+  // taken to move its bytes, if the arch model times shim transfers by
+  // buffer descriptor. See ArchModel::ShimBD.
+  uint64_t getShimBDOverhead(xilinx::air::DmaMemcpyInterface op,
+                             unsigned srcSpace, unsigned dstSpace) {
+    unsigned external = (unsigned)xilinx::air::MemorySpace::L3;
+    if (!arch.shim_bd.enabled || (srcSpace != external && dstSpace != external))
+      return 0;
+    auto rows = getShimRows(op, srcSpace == external);
+    double bytes_per_second = arch.getColumnBandwidth(srcSpace, dstSpace);
+    if (!bytes_per_second)
+      bytes_per_second = arch.getBandwidth(srcSpace, dstSpace);
+    double bytes_per_cycle = 0;
+    if (bytes_per_second > 0 && bytes_per_second != DBL_MAX)
+      bytes_per_cycle = bytes_per_second / arch.clock;
+    double row_bytes = (double)rows.second * arch.datatype_bytes;
+    uint64_t cycles =
+        arch.getShimBDCycles(rows.first, row_bytes, bytes_per_cycle);
+    uint64_t data = 0;
+    if (bytes_per_cycle > 0)
+      data = ceil(rows.first * row_bytes / bytes_per_cycle);
+    return cycles > data ? cycles - data : 0;
   }
 
   uint64_t modelOp(CommandQueueEntry &c) {
     mlir::Operation *op = c.op;
     uint64_t execution_time = 1;
 
-    if (auto Op = mlir::dyn_cast<xilinx::air::WaitAllOp>(op)) {
+    if (c.is_wait) {
+      // the end of an scf.for iteration without async tokens only marks the
+      // point where its queue has run the iteration, see scheduleIteration
+      if (c.extrapolation)
+        execution_time = extrapolate(*c.extrapolation);
+      else if (isa<scf::YieldOp>(op))
+        execution_time = 0;
+    } else if (auto Op = mlir::dyn_cast<xilinx::air::WaitAllOp>(op)) {
       execution_time = 1;
     } else if (auto Op = mlir::dyn_cast<xilinx::air::DmaMemcpyInterface>(op)) {
 
@@ -737,82 +2552,29 @@ public:
       auto dstSpace = dstTy.getMemorySpaceAsInt();
       // if there is a size mismatch, it's because we're moving a tile of the
       // larger tensor
-      if (getTensorVolume(srcTy) <= getTensorVolume(dstTy))
-        execution_time = getTransferCost(srcSpace, dstSpace, srcTy);
-      else
-        execution_time = getTransferCost(srcSpace, dstSpace, dstTy);
-    } else if (auto Op = mlir::dyn_cast<linalg::LinalgOp>(op)) {
-      auto opCounts = xilinx::air::CostModel().getOpCounts(op);
-      std::string skip = "footprint";
-      std::string memops = "reads;writes;";
-      std::string cpuops = "math.rsqrt;";
-      cpuops += "arith.mulf;arith.divf;arith.addf;arith.subf;arith.truncf;"
-                "arith.cmpf;arith.maxf;";
-      cpuops += "arith.muli;arith.divi;arith.addi;arith.subi;arith.trunci;"
-                "arith.cmpi;arith.maxi";
-      cpuops += "std.select";
-      uint64_t memory_op_count = 0;
-      uint64_t compute_op_count = 0;
-      for (auto &p : opCounts.map) {
-        auto name = std::get<0>(p);
-        auto count = std::get<1>(p);
-        if (memops.find(name) != std::string::npos)
-          memory_op_count += count;
-        else if (cpuops.find(name) != std::string::npos)
-          compute_op_count += count;
-        else if (skip.find(name) == std::string::npos)
-          LLVM_DEBUG(llvm::dbgs() << name << " not counted\n");
-      }
-      c.compute_xfer_cost = 0; // memory_op_count;
-
-      if (compute_op_count) {
-        // defaults
-        double num_cores = 1;
-        double ops_per_core_per_cycle = 8; // vector width for this type
-        double cycles_per_second = 1e9;
-        double efficiency = 1.0f;
-
-        auto model = jsonModel.getAsObject();
-        assert(model);
-
-        // if kernels exists, assume everthing else exists
-        if (model && model->getObject("kernels")) {
-          // device level override of defaults
-          if (auto d = model->getNumber("cores"))
-            num_cores = *d;
-          if (auto d = model->getNumber("ops_per_core_per_cycle"))
-            ops_per_core_per_cycle = *d;
-          if (auto d = model->getNumber("clock"))
-            cycles_per_second = *d;
-          if (auto d = model->getNumber("efficiency"))
-            efficiency = *d;
-
-          // kernel level override of defaults
-          auto kernels = model->getObject("kernels");
-          assert(kernels && "kernels not found in JSON model");
-
-          if (kernels) {
-            auto kernel = kernels->getObject(op->getName().getStringRef());
-            if (kernel) {
-              if (auto d = kernel->getNumber("cores"))
-                num_cores = *d;
-              if (auto d = kernel->getNumber("ops_per_core_per_cycle"))
-                ops_per_core_per_cycle = *d;
-              if (auto d = kernel->getNumber("clock"))
-                cycles_per_second = *d;
-              if (auto d = kernel->getNumber("efficiency"))
-                efficiency = *d;
-            }
-          }
-        }
-
-        double ops_per_cycle = num_cores * ops_per_core_per_cycle * efficiency;
-        assert(ops_per_cycle > 0 &&
-               "ops per cycle in model must be greater than zero");
-
-        double cycles = ceil(compute_op_count / ops_per_cycle);
-        c.compute_op_cost = cycles;
+      MemRefType ty =
+          getTensorVolume(srcTy) <= getTensorVolume(dstTy) ? srcTy : dstTy;
+      dmaBytes += getTensorVolume(ty) * arch.datatype_bytes;
+      uint64_t bdOverhead = getShimBDOverhead(Op, srcSpace, dstSpace);
+      if (auto *iface = getSharedInterface(srcSpace, dstSpace)) {
+        // the duration depends on the other transfers sharing the interface,
+        // it is computed by startTransfer.
+        c.xfer_interface = iface;
+        c.xfer_bytes = (double)getTensorVolume(ty) * arch.datatype_bytes;
+        c.xfer_latency = arch.dma_latency + bdOverhead;
+        execution_time = 0;
+      } else {
+        execution_time = getTransferCost(srcSpace, dstSpace, ty) +
+                         arch.dma_latency + bdOverhead;
       }
+    } else if (auto Op = mlir::dyn_cast<xilinx::air::ChannelPutOp>(op)) {
+      execution_time = getChannelPutCycles(Op, c);
+    } else if (auto Op = mlir::dyn_cast<xilinx::air::ChannelGetOp>(op)) {
+      // the data was moved by the matching put
+      execution_time = 1;
+    } else if (auto Op = mlir::dyn_cast<linalg::LinalgOp>(op)) {
+      c.compute_xfer_cost = 0;
+      c.compute_op_cost = linalgCycles.lookup(op);
       execution_time = std::max(c.compute_op_cost, c.compute_xfer_cost);
     } else {
       LLVM_DEBUG(llvm::dbgs()
@@ -823,166 +2585,454 @@ public:
     return execution_time;
   }
 
-  std::string to_string(Operation *op) {
-    return op->getName().getStringRef().str();
+  // Compute the cycles taken by the linalg ops of `func` up front. The cost
+  // model memoizes its counts and is not thread safe, logical processes only
+  // read the cycles.
+  void modelLinalgOps(func::FuncOp func) {
+    SmallVector<Operation *, 16> ops;
+    func.walk([&](linalg::LinalgOp op) { ops.push_back(op); });
+    for (auto *op : ops)
+      linalgCycles[op] = getLinalgCycles(op);
   }
 
-  std::string to_string(CommandQueueEntry &c) { return to_string(c.op); }
+  uint64_t getLinalgCycles(Operation *op) {
+    auto &counts = costModel.getLinalgOpCounts(cast<linalg::LinalgOp>(op));
+    uint64_t compute_op_count = counts.getComputeOps();
+    LLVM_DEBUG(llvm::dbgs()
+               << counts.getCount(CostModel::OpKind::Other)
+               << " payload ops not counted\n");
+    if (!compute_op_count)
+      return 0;
+    return ceil(getKernel(op).getComputeCycles(
+        to_string(counts.elementType), compute_op_count, counts.macs));
+  }
 
-  void processQueue(std::deque<CommandQueueEntry> &q, uint64_t time) {
-    if (q.size() == 0)
-      return;
+  // Return the compute parameters of the arch model for `op`, caching the
+  // lookup by operation name.
+  const ArchModel::Kernel &getKernel(Operation *op) {
+    auto &kernel = kernelCache[op->getName()];
+    if (!kernel)
+      kernel = &arch.getKernel(op->getName().getStringRef());
+    return *kernel;
+  }
 
-    CommandQueueEntry &c = q.front();
+  std::string to_string(Operation *op) {
+    return op->getName().getStringRef().str();
+  }
 
-    if (c.is_started()) {
-      if (c.is_done(time)) {
-        LLVM_DEBUG(llvm::dbgs() << "finish: '");
-        LLVM_DEBUG(c.op->print(llvm::dbgs()));
-        LLVM_DEBUG(llvm::dbgs() << "' @ " << time << "\n");
+  std::string to_string(Type type) {
+    if (!type)
+      return "";
+    std::string s;
+    llvm::raw_string_ostream os(s);
+    type.print(os);
+    return os.str();
+  }
 
-        // execute
-        executeOp(*c.op);
-        if (c.launch_callback_fn)
-          c.launch_callback_fn(c.op);
+  std::string to_string(CommandQueueEntry &c) {
+    if (c.extrapolation)
+      return "scf.for (extrapolated)";
+    if (c.is_wait)
+      return "air.wait_all";
+    return to_string(c.op);
+  }
 
-        // emit trace event end
-        emitTraceEvent(traceStream, to_string(c), "layer", "E", time,
-                       (size_t)(void *)&q, TRACE_PID_QUEUE);
+  std::string to_string(const PathNode &n) {
+    // the wait entries of scf.for ops stand for extrapolated iterations
+    if (n.is_wait && isa<scf::ForOp>(n.op))
+      return "scf.for (extrapolated)";
+    if (n.is_wait)
+      return "air.wait_all";
+    return to_string(n.op);
+  }
 
-        if (c.compute_xfer_cost && c.compute_op_cost) {
-          if (c.compute_op_cost >= c.compute_xfer_cost) {
-            emitTraceEvent(traceStream, "compute_bound", "stats", "B",
-                           c.start_time, 0, TRACE_PID_STATS);
-            emitTraceEvent(traceStream, "compute_bound", "stats", "E",
-                           c.end_time, 0, TRACE_PID_STATS);
-          } else {
-            emitTraceEvent(traceStream, "memory_bound", "stats", "B",
-                           c.start_time, 0, TRACE_PID_STATS);
-            emitTraceEvent(traceStream, "memory_bound", "stats", "E",
-                           c.end_time, 0, TRACE_PID_STATS);
-          }
-          if (c.compute_op_cost) {
-            std::stringstream cat;
-            cat << "compute time";
-            emitTraceEvent(traceStream, cat.str(), "stats", "B", c.start_time,
-                           100, TRACE_PID_STATS);
-            emitTraceEvent(traceStream, cat.str(), "stats", "E",
-                           c.start_time + c.compute_op_cost, 100,
-                           TRACE_PID_STATS);
-          }
-          if (c.compute_xfer_cost) {
-            std::stringstream cat;
-            cat << "transfer time";
-            emitTraceEvent(traceStream, cat.str(), "stats", "B", c.start_time,
-                           101, TRACE_PID_STATS);
-            emitTraceEvent(traceStream, cat.str(), "stats", "E",
-                           c.start_time + c.compute_xfer_cost, 101,
-                           TRACE_PID_STATS);
-          }
-        }
-        for (int i = 0, e = c.ld_xfer_time.size(); i < e; i++) {
-          if (!c.ld_xfer_time[i])
-            continue;
-          std::stringstream cat;
-          cat << "mem " << i << " load";
-          emitTraceEvent(traceStream, cat.str(), "stats", "B", c.start_time,
-                         (i + 1) * 200, TRACE_PID_STATS);
-          emitTraceEvent(traceStream, cat.str(), "stats", "E",
-                         c.start_time + c.ld_xfer_time[i], (i + 1) * 200,
-                         TRACE_PID_STATS);
-        }
-        for (int i = 0, e = c.st_xfer_time.size(); i < e; i++) {
-          if (!c.st_xfer_time[i])
-            continue;
-          std::stringstream cat;
-          cat << "mem " << i << " store";
-          emitTraceEvent(traceStream, cat.str(), "stats", "B", c.start_time,
-                         (i + 1) * 200 + 1, TRACE_PID_STATS);
-          emitTraceEvent(traceStream, cat.str(), "stats", "E",
-                         c.start_time + c.st_xfer_time[i], (i + 1) * 200 + 1,
-                         TRACE_PID_STATS);
-        }
+  void finishEntry(CommandQueueEntry &c, std::deque<CommandQueueEntry> &q,
+                   uint64_t time) {
+    LLVM_DEBUG(llvm::dbgs() << "finish: '");
+    LLVM_DEBUG(c.op->print(llvm::dbgs()));
+    LLVM_DEBUG(llvm::dbgs() << "' @ " << time << "\n");
+
+    auto *qctx = lp().queue;
+    auto &node = lp().pathNodes.emplace_back(
+        PathNode{c.op, c.is_wait, qctx, c.start_time, time, c.pred,
+                 c.extrapolation ? c.extrapolation->error_bound : 0});
+    qctx->busy_cycles += time - c.start_time;
+    qctx->last = &node;
+    lp().currentNode = &node;
+
+    // execute
+    if (!c.is_wait)
+      executeOp(*c.op, c.env.get());
+    if (c.launch_callback_fn)
+      c.launch_callback_fn(c.op);
+    lp().currentNode = nullptr;
+
+    // emit trace event end
+    emitTraceEvent(to_string(c), "layer", 'E', time,
+                   (size_t)(void *)&q, TRACE_PID_QUEUE);
 
-        // done, return.
-        q.pop_front();
-        // return;
+    if (c.compute_xfer_cost && c.compute_op_cost) {
+      if (c.compute_op_cost >= c.compute_xfer_cost) {
+        emitTraceEvent("compute_bound", "stats", 'B',
+                       c.start_time, 0, TRACE_PID_STATS);
+        emitTraceEvent("compute_bound", "stats", 'E',
+                       c.end_time, 0, TRACE_PID_STATS);
       } else {
-        // running...
-        LLVM_DEBUG(llvm::dbgs() << "running: '");
-        LLVM_DEBUG(c.op->print(llvm::dbgs()));
-        LLVM_DEBUG(llvm::dbgs()
-                   << "' @ " << time << " - " << c.end_time << "\n");
-        // in-order, return.
-        return;
+        emitTraceEvent("memory_bound", "stats", 'B',
+                       c.start_time, 0, TRACE_PID_STATS);
+        emitTraceEvent("memory_bound", "stats", 'E',
+                       c.end_time, 0, TRACE_PID_STATS);
+      }
+      if (c.compute_op_cost) {
+        std::stringstream cat;
+        cat << "compute time";
+        emitTraceEvent(cat.str(), "stats", 'B', c.start_time,
+                       100, TRACE_PID_STATS);
+        emitTraceEvent(cat.str(), "stats", 'E',
+                       c.start_time + c.compute_op_cost, 100,
+                       TRACE_PID_STATS);
       }
+      if (c.compute_xfer_cost) {
+        std::stringstream cat;
+        cat << "transfer time";
+        emitTraceEvent(cat.str(), "stats", 'B', c.start_time,
+                       101, TRACE_PID_STATS);
+        emitTraceEvent(cat.str(), "stats", 'E',
+                       c.start_time + c.compute_xfer_cost, 101,
+                       TRACE_PID_STATS);
+      }
+    }
+    for (int i = 0, e = c.ld_xfer_time.size(); i < e; i++) {
+      if (!c.ld_xfer_time[i])
+        continue;
+      std::stringstream cat;
+      cat << "mem " << i << " load";
+      emitTraceEvent(cat.str(), "stats", 'B', c.start_time,
+                     (i + 1) * 200, TRACE_PID_STATS);
+      emitTraceEvent(cat.str(), "stats", 'E',
+                     c.start_time + c.ld_xfer_time[i], (i + 1) * 200,
+                     TRACE_PID_STATS);
     }
+    for (int i = 0, e = c.st_xfer_time.size(); i < e; i++) {
+      if (!c.st_xfer_time[i])
+        continue;
+      std::stringstream cat;
+      cat << "mem " << i << " store";
+      emitTraceEvent(cat.str(), "stats", 'B', c.start_time,
+                     (i + 1) * 200 + 1, TRACE_PID_STATS);
+      emitTraceEvent(cat.str(), "stats", 'E',
+                     c.start_time + c.st_xfer_time[i], (i + 1) * 200 + 1,
+                     TRACE_PID_STATS);
+    }
+  }
 
-    if (!q.size()) {
-      LLVM_DEBUG(llvm::dbgs() << "queue empty @ " << time << "\n");
-      return;
+  // Tokens owned by another logical process are only known to be done once
+  // a window in which they completed has ended.
+  bool isTokenDone(unsigned slot) {
+    if (slots[slot].owner != &lp())
+      return slots[slot].visibleDone;
+    auto &count = slots[slot].value;
+    if (count.kind != RuntimeValue::Token)
+      return false;
+    if (count.i != 0) {
+      LLVM_DEBUG(llvm::dbgs() << "count @ " << count.i << "\n");
+      return false;
     }
+    return true;
+  }
+
+  // Return the slots of the async tokens entry `c` waits for.
+  SmallVector<unsigned, 4> getTokenDeps(CommandQueueEntry &c) {
+    if (c.is_wait)
+      return c.deps;
+    SmallVector<unsigned, 4> deps;
+    for (Value in : c.op->getOperands())
+      if (in.getType().isa<xilinx::air::AsyncTokenType>())
+        deps.push_back(getOrCreateSlot(c.env.get(), in));
+    return deps;
+  }
+
+  // Return the slot of an async token the entry depends on which has not yet
+  // completed, or None if the entry is ready to start.
+  Optional<unsigned> getBlockingToken(CommandQueueEntry &c) {
+    for (auto slot : getTokenDeps(c))
+      if (!isTokenDone(slot))
+        return slot;
+    return llvm::None;
+  }
 
-    CommandQueueEntry &c_next = q.front();
+  // Find the entry which determined the start of `c` at `time` on `qctx`,
+  // and account the time `c` stalled at the front of the queue to the cause:
+  // the channel it was blocked on or the last of its tokens to complete.
+  void recordStart(CommandQueueEntry &c, QueueContext *qctx, uint64_t time) {
+    const PathNode *token = nullptr;
+    for (auto slot : getTokenDeps(c)) {
+      auto *p = slots[slot].producer;
+      if (p && (!token || p->end_time > token->end_time))
+        token = p;
+    }
+    c.pred = token;
+    for (auto *p : {qctx->last, c.creator})
+      if (p && (!c.pred || p->end_time > c.pred->end_time))
+        c.pred = p;
 
-    if (!c_next.queue_ready_time)
-      c_next.queue_ready_time = time;
+    if (time <= c.queue_ready_time)
+      return;
+    uint64_t stall = time - c.queue_ready_time;
+    qctx->stall_cycles += stall;
+    std::string cause = "unknown";
+    if (c.channel_blocked)
+      cause = "channel @" +
+              cast<xilinx::air::ChannelInterface>(c.op).getChanName().str();
+    else if (token)
+      cause = to_string(*token);
+    auto &stats = lp().stalls[{to_string(c), cause}];
+    stats.first += stall;
+    stats.second++;
+  }
 
-    bool ready = true;
-    for (Value in : c_next.op->getOperands()) {
-      if (in.getType().isa<xilinx::air::AsyncTokenType>()) {
-        if (!valueMap.count(in))
-          ready = false;
-        else if (llvm::any_cast<llvm::APInt>(valueMap[in]) != 0) {
+  // Advance the queue as far as possible at `time`: retire the running entry
+  // if it has completed and start the following entries until one is still
+  // running or blocked. A running entry re-arms the queue for its end time, a
+  // blocked entry parks the queue on the token it is waiting for.
+  void processQueue(QueueContext *qctx, uint64_t time) {
+    lp().queue = qctx;
+    auto &q = qctx->queue;
+    while (q.size()) {
+      CommandQueueEntry &c = q.front();
+
+      if (c.is_started()) {
+        if (!c.is_done(time)) {
+          // running...
+          LLVM_DEBUG(llvm::dbgs() << "running: '");
+          LLVM_DEBUG(c.op->print(llvm::dbgs()));
           LLVM_DEBUG(llvm::dbgs()
-                     << "count @ " << llvm::any_cast<llvm::APInt>(valueMap[in])
-                     << "\n");
-          ready = false;
+                     << "' @ " << time << " - " << c.end_time << "\n");
+          // in-order, wait for completion.
+          wakeQueue(qctx, c.end_time);
+          return;
         }
+        if (c.xfer_interface)
+          finishTransfer(c, time);
+        if (c.fifos.size())
+          finishChannelOp(c);
+        finishEntry(c, q, time);
+        q.pop_front();
+        continue;
+      }
+
+      if (!c.queue_ready_time)
+        c.queue_ready_time = time;
+
+      if (auto token = getBlockingToken(c)) {
+        LLVM_DEBUG(llvm::dbgs() << "not ready: '");
+        LLVM_DEBUG(c.op->print(llvm::dbgs()));
+        LLVM_DEBUG(llvm::dbgs() << "' @ " << time << "\n");
+        if (slots[*token].owner != &lp()) {
+          // resolved between windows, see endWindow
+          lp().remoteWaits.push_back({*token, qctx});
+          return;
+        }
+        auto &w = lp().waiters[*token];
+        if (w.empty() || w.back() != qctx)
+          w.push_back(qctx);
+        return;
+      }
+
+      if (isa<xilinx::air::ChannelInterface>(c.op) &&
+          !tryStartChannelOp(c, qctx)) {
+        c.channel_blocked = true;
+        LLVM_DEBUG(llvm::dbgs() << "channel blocked: '");
+        LLVM_DEBUG(c.op->print(llvm::dbgs()));
+        LLVM_DEBUG(llvm::dbgs() << "' @ " << time << "\n");
+        return;
+      }
+
+      recordStart(c, qctx, time);
+      c.start_time = time;
+      c.end_time = time + modelOp(c);
+      if (c.xfer_interface)
+        c.end_time = startTransfer(c, qctx, time);
+      LLVM_DEBUG(llvm::dbgs() << "start: '");
+      LLVM_DEBUG(c.op->print(llvm::dbgs()));
+      LLVM_DEBUG(llvm::dbgs()
+                 << "' @ " << time << " - " << c.end_time << "\n");
+
+      // emit trace event begin
+      if (time > c.queue_ready_time) {
+        emitTraceEvent("stall", "layer", 'B', c.queue_ready_time,
+                       (size_t)(void *)&q, TRACE_PID_QUEUE);
+        emitTraceEvent("stall", "layer", 'E', time,
+                       (size_t)(void *)&q, TRACE_PID_QUEUE);
       }
+      emitTraceEvent(to_string(c), "layer", 'B', time,
+                     (size_t)(void *)&q, TRACE_PID_QUEUE);
     }
+    LLVM_DEBUG(llvm::dbgs() << "queue empty @ " << time << "\n");
+  }
+
+  // Create a wait entry for `op` which completes once all of the token slots
+  // in `deps` have completed.
+  CommandQueueEntry makeWaitEntry(Operation *op, EnvPtr env,
+                                  ArrayRef<unsigned> deps,
+                                  CommandQueueEntry::LaunchFn fn = nullptr) {
+    auto waitEnv = std::make_shared<Environment>(*this, nullptr, env);
+    for (auto slot : deps)
+      waitEnv->retain(slot);
+    CommandQueueEntry c(op, waitEnv, fn);
+    c.is_wait = true;
+    c.deps.append(deps.begin(), deps.end());
+    return c;
+  }
 
-    if (!ready) {
-      LLVM_DEBUG(llvm::dbgs() << "not ready: '");
-      LLVM_DEBUG(c_next.op->print(llvm::dbgs()));
-      LLVM_DEBUG(llvm::dbgs() << "' @ " << time << "\n");
+  // Decrement token slot `to` once token slot `from` completes.
+  void forwardToken(unsigned from, unsigned to) {
+    auto *owner = slots[from].owner;
+    if (owner != &lp()) {
+      retainSlot(from);
+      retainSlot(to);
+      post(owner, now(), [=]() {
+        forwardToken(from, to);
+        releaseSlot(from);
+        releaseSlot(to);
+      });
+      return;
+    }
+    if (isTokenDone(from)) {
+      auto *node = lp().currentNode;
+      lp().currentNode = slots[from].producer;
+      decrementToken(to);
+      lp().currentNode = node;
       return;
     }
+    retainSlot(from);
+    retainSlot(to);
+    lp().tokenForwards[from].push_back(to);
+  }
 
-    c_next.start_time = time;
-    c_next.end_time = time + modelOp(c_next);
-    LLVM_DEBUG(llvm::dbgs() << "start: '");
-    LLVM_DEBUG(c_next.op->print(llvm::dbgs()));
-    LLVM_DEBUG(llvm::dbgs()
-               << "' @ " << time << " - " << c_next.end_time << "\n");
-
-    // emit trace event begin
-    if (time > c_next.queue_ready_time) {
-      emitTraceEvent(traceStream, "stall", "layer", "B",
-                     c_next.queue_ready_time, (size_t)(void *)&q,
-                     TRACE_PID_QUEUE);
-      emitTraceEvent(traceStream, "stall", "layer", "E", time,
-                     (size_t)(void *)&q, TRACE_PID_QUEUE);
+  void recordExtrapolation(Operation *op, const LoopExtrapolation &ext) {
+    auto &loop = lp().loops[op];
+    loop.instances++;
+    loop.simulatedIterations += ext.iter_done.size();
+    loop.extrapolatedIterations += ext.trip_count - ext.iter_done.size();
+    loop.period = std::max(loop.period, ext.period);
+    loop.maxErrorBound = std::max(loop.maxErrorBound, ext.error_bound);
+    if (!ext.steady)
+      loop.unsteady++;
+  }
+
+  // Run `fn` on the owner of token slot `slot` once the token completes.
+  void whenTokenDone(unsigned slot, std::function<void()> fn) {
+    auto *owner = slots[slot].owner;
+    if (owner != &lp()) {
+      retainSlot(slot);
+      post(owner, now(), [=]() {
+        whenTokenDone(slot, fn);
+        releaseSlot(slot);
+      });
+      return;
     }
-    emitTraceEvent(traceStream, to_string(c_next), "layer", "B", time,
-                   (size_t)(void *)&q, TRACE_PID_QUEUE);
+    if (isTokenDone(slot)) {
+      fn();
+      return;
+    }
+    auto &fns = lp().tokenCallbacks[slot];
+    if (fns.empty())
+      retainSlot(slot);
+    fns.push_back(std::move(fn));
+  }
 
-    return;
+  // Return the slots of the async tokens produced by the ops of `block`.
+  SmallVector<unsigned, 8> getBlockTokens(Block &block, Environment *env) {
+    SmallVector<unsigned, 8> tokens;
+    for (auto &o : block)
+      for (auto r : o.getResults())
+        if (r.getType().isa<xilinx::air::AsyncTokenType>())
+          if (auto slot = lookupSlot(env, r))
+            tokens.push_back(*slot);
+    return tokens;
   }
 
-  void scheduleAIRRegion(xilinx::air::ExecuteOp &ro, QueueContext *qctx) {
+  // Return the slots of the size operands followed by the kernel operands of
+  // hierarchy op `op` in the parent environment `parentEnv`.
+  template <typename T>
+  SmallVector<unsigned, 8> getHierarchyOperandSlots(T op,
+                                                    Environment *parentEnv) {
+    SmallVector<unsigned, 8> operandSlots;
+    for (auto v : op.getSizeOperands())
+      operandSlots.push_back(getOrCreateSlot(parentEnv, v));
+    for (unsigned i = 0, e = op.getNumKernelOperands(); i < e; i++)
+      operandSlots.push_back(getOrCreateSlot(parentEnv, op.getKernelOperand(i)));
+    return operandSlots;
+  }
 
-    for (auto r : ro->getResults()) {
-      if (r.getType().isa<xilinx::air::AsyncTokenType>()) {
-        valueMap[r] = llvm::APInt(64, 1);
-      }
+  // Bind the block arguments of the body of hierarchy op `op` for the
+  // instance with the given ids. The sizes and kernel arguments alias the
+  // `operandSlots` of the corresponding operands, see
+  // getHierarchyOperandSlots. The slots are resolved by the caller so that
+  // the instance can be bound on another logical process.
+  template <typename T>
+  void bindHierarchyArguments(T op, Environment *env,
+                              ArrayRef<unsigned> operandSlots,
+                              ArrayRef<int64_t> ids) {
+    for (auto t : llvm::enumerate(op.getIds()))
+      defineValue(env, t.value(), RuntimeValue::getInt(ids[t.index()]));
+    unsigned numSizes = op.getSizeOperands().size();
+    for (auto t : llvm::enumerate(op.getSize()))
+      bindSlot(env, t.value(), operandSlots[t.index()]);
+    for (unsigned i = 0, e = op.getNumKernelOperands(); i < e; i++)
+      bindSlot(env, op.getKernelArgument(i), operandSlots[numSizes + i]);
+  }
+
+  // Convert the linear iteration number `iter` of an iteration space with
+  // `counts` iterations per dimension into per-dimension indices.
+  SmallVector<int64_t, 4> delinearize(int64_t iter, ArrayRef<int64_t> counts) {
+    SmallVector<int64_t, 4> ids(counts.size());
+    for (int d = counts.size() - 1; d >= 0; d--) {
+      ids[d] = iter % counts[d];
+      iter = iter / counts[d];
     }
-    qctx->queue.push_back(
-        CommandQueueEntry(ro.getOperation()));
-    scheduleBlock(ro->getRegion(0).front(), qctx);
+    return ids;
   }
 
-  void scheduleScfFor(mlir::scf::ForOp &fo, QueueContext *qctx) {
+  void scheduleAIRRegion(xilinx::air::ExecuteOp &ro, QueueContext *qctx,
+                         EnvPtr env) {
+
+    defineAsyncTokens(ro, env.get());
+    enqueue(qctx, CommandQueueEntry(ro.getOperation(), env));
+    scheduleBlock(ro->getRegion(0).front(), qctx, env);
+  }
+
+  // The iterations of an scf.for being scheduled. Iterations are scheduled
+  // as earlier ones complete, so that at most `maxLiveIterations` of them are
+  // scheduled and not complete at a time rather than the whole trip count.
+  struct ForSchedule {
+    scf::ForOp op;
+    QueueContext *qctx;
+    EnvPtr env;
+    int64_t lb, step;
+    // number of iterations to simulate, and the next one to schedule
+    int64_t simulated;
+    int64_t next = 0;
+    // iterations scheduled and not complete
+    unsigned live = 0;
+    // the body of an iteration is being scheduled, see scheduleIteration
+    bool scheduling = false;
+    // scheduleIterations is running further up the stack
+    bool looping = false;
+    // listed in the stalledLoops of the logical process of `qctx`
+    bool stalled = false;
+    // the iter_args of the next iteration, and the environment of the
+    // previous iteration which keeps them alive
+    SmallVector<unsigned, 4> iterSlots;
+    EnvPtr lastEnv;
+    std::shared_ptr<LoopExtrapolation> ext;
+    // schedules the ops after the scf.for
+    std::function<void()> then;
+  };
+
+  void scheduleScfFor(mlir::scf::ForOp fo, QueueContext *qctx, EnvPtr env,
+                      std::function<void()> then) {
     auto ub = fo.getUpperBound().getDefiningOp<arith::ConstantIndexOp>();
     auto lb = fo.getLowerBound().getDefiningOp<arith::ConstantIndexOp>();
     auto step = fo.getStep().getDefiningOp<arith::ConstantIndexOp>();
@@ -991,47 +3041,201 @@ public:
     auto r = ub.value() - lb.value();
     auto trip_count = mlir::ceilDiv(r, step.value());
 
-    // programQueue->push_back(CommandQueueEntry(fo.getOperation()));
-
-    for (auto r : fo->getResults()) {
-      if (r.getType().isa<xilinx::air::AsyncTokenType>()) {
-        valueMap[r] = llvm::APInt(64, 1);
-      }
-    }
-
-    BlockAndValueMapping map;
-    // for the first iteration of the loop, map the iter_args to the
-    // operands of the scf.for
-    for (auto t : llvm::zip(fo.getRegionIterArgs(), fo.getIterOperands()))
-      map.map(std::get<0>(t), std::get<1>(t));
-    for (auto i = 0; i < trip_count; i++) {
-      auto bb = new mlir::Block();
-      fo.getRegion().push_back(bb);
-      auto bldr = OpBuilder::atBlockEnd(bb);
-      for (auto &o : fo.getRegion().front()) {
-        auto c = bldr.clone(o, map);
-        // for the next iteration of the loop, map the iter_args to the
-        // operands of the scf.yield
-        if (isa<scf::YieldOp>(c)) {
-          map.clear();
-          for (auto t : llvm::zip(fo.getRegionIterArgs(), c->getOperands()))
-            map.map(std::get<0>(t), std::get<1>(t));
-        }
+    auto s = std::make_shared<ForSchedule>();
+    s->op = fo;
+    s->qctx = qctx;
+    s->env = env;
+    s->lb = lb.value();
+    s->step = step.value();
+    s->then = std::move(then);
+
+    // for the first iteration of the loop, the iter_args are the operands of
+    // the scf.for
+    for (auto o : fo.getIterOperands())
+      s->iterSlots.push_back(getOrCreateSlot(env.get(), o));
+
+    // Past the first iterations the schedule of a loop carrying only async
+    // tokens is usually periodic: simulate iterations until the period of
+    // the last two windows agrees, see checkSteadyState, at most
+    // maxSteadyStateWindows windows after the first iteration, and
+    // extrapolate the rest.
+    s->simulated = std::max<int64_t>(trip_count, 0);
+    if (extrapolateLoops && steadyStateWindow &&
+        trip_count > 2 * (int64_t)steadyStateWindow &&
+        fo.getNumIterOperands() &&
+        llvm::all_of(fo.getIterOperands().getTypes(), [](Type t) {
+          return t.isa<xilinx::air::AsyncTokenType>();
+        })) {
+      s->simulated = std::min<int64_t>(
+          trip_count, (int64_t)maxSteadyStateWindows * steadyStateWindow + 1);
+      s->ext = std::make_shared<LoopExtrapolation>();
+      s->ext->trip_count = trip_count;
+    }
+    scheduleIterations(s);
+  }
+
+  // Schedule the next iterations of `s` while fewer than maxLiveIterations
+  // are live, and at least one if `force`. Once the last one has been
+  // scheduled, bind the results and schedule the ops after the loop.
+  void scheduleIterations(std::shared_ptr<ForSchedule> s,
+                          bool force = false) {
+    if (s->scheduling || s->looping)
+      return;
+    s->looping = true;
+    while (!s->scheduling && s->next < s->simulated &&
+           (force || s->live < maxLiveIterations)) {
+      force = false;
+      scheduleIteration(s);
+    }
+    s->looping = false;
+    if (s->scheduling)
+      return;
+    if (s->next < s->simulated) {
+      if (!s->stalled) {
+        s->stalled = true;
+        s->qctx->lp->stalledLoops.push_back(s);
+      }
+      return;
+    }
+    if (s->then)
+      finishScfFor(s);
+  }
+
+  // Stop scheduling the iterations of `s` once they are steady. The
+  // iterations already scheduled are simulated as well.
+  void checkSteadyState(std::shared_ptr<ForSchedule> s) {
+    auto &ext = *s->ext;
+    if (ext.steady || !s->then || !isSteady(ext.completions))
+      return;
+    ext.steady = true;
+    s->simulated = s->next;
+    scheduleIterations(s);
+  }
+
+  void scheduleIteration(std::shared_ptr<ForSchedule> s) {
+    int64_t i = s->next++;
+    s->live++;
+    if (s->ext)
+      s->ext->iter_done.push_back(0);
+    s->scheduling = true;
+    auto fo = s->op;
+    auto iterEnv = makeEnvironment(*fo.getBody(), s->env);
+    defineValue(iterEnv.get(), fo.getInductionVar(),
+                RuntimeValue::getInt(s->lb + i * s->step));
+    for (auto t : llvm::zip(fo.getRegionIterArgs(), s->iterSlots))
+      bindSlot(iterEnv.get(), std::get<0>(t), std::get<1>(t));
+    scheduleBlock(*fo.getBody(), s->qctx, iterEnv, [=]() {
+      auto &body = *s->op.getBody();
+      // for the next iteration of the loop, the iter_args are the operands
+      // of the scf.yield
+      auto yield = cast<scf::YieldOp>(body.getTerminator());
+      s->iterSlots.clear();
+      for (auto o : yield.getOperands())
+        s->iterSlots.push_back(getOrCreateSlot(iterEnv.get(), o));
+      s->lastEnv = iterEnv;
+      if (auto ext = s->ext) {
+        // the iteration completes with the last of the tokens it yields
+        auto pending = std::make_shared<unsigned>(s->iterSlots.size());
+        for (auto slot : s->iterSlots)
+          whenTokenDone(slot, [=]() {
+            uint64_t t = now();
+            runOn(s->qctx, [=]() {
+              ext->iter_done[i] = std::max(ext->iter_done[i], t);
+              if (--*pending)
+                return;
+              auto &c = ext->completions;
+              c.insert(std::upper_bound(c.begin(), c.end(), ext->iter_done[i]),
+                       ext->iter_done[i]);
+              if (s->ext)
+                checkSteadyState(s);
+            });
+          });
       }
-      scheduleBlock(*bb, qctx);
+
+      // The iteration is complete once the async tokens produced in its body
+      // are. Without tokens it completes when the queue reaches its end.
+      auto done = [=]() {
+        s->live--;
+        scheduleIterations(s);
+      };
+      auto tokens = getBlockTokens(body, iterEnv.get());
+      if (tokens.empty()) {
+        enqueue(s->qctx, makeWaitEntry(yield, iterEnv, {},
+                                       [=](Operation *) { done(); }));
+      } else {
+        auto pending = std::make_shared<unsigned>(tokens.size());
+        for (auto slot : tokens)
+          whenTokenDone(slot, [=]() {
+            runOn(s->qctx, [=]() {
+              if (!--*pending)
+                done();
+            });
+          });
+      }
+      s->scheduling = false;
+      scheduleIterations(s);
+    });
+  }
+
+  void finishScfFor(std::shared_ptr<ForSchedule> s) {
+    auto then = std::move(s->then);
+    s->then = nullptr;
+    auto fo = s->op;
+    auto &env = s->env;
+    // a loop which did not reach a steady state before its last iteration is
+    // simulated in full
+    if (s->ext && s->simulated == s->ext->trip_count)
+      s->ext.reset();
+    if (s->ext) {
+      // the results complete once the extrapolated iterations have run,
+      // after the tokens yielded by the last simulated iteration
+      SmallVector<unsigned, 4> resultSlots;
+      for (auto r : fo.getResults())
+        resultSlots.push_back(
+            defineValue(env.get(), r, RuntimeValue::getToken(1)));
+      auto ext = s->ext;
+      auto c = makeWaitEntry(fo, env, s->iterSlots, [=](Operation *op) {
+        for (auto slot : resultSlots)
+          decrementToken(slot);
+        recordExtrapolation(op, *ext);
+      });
+      c.extrapolation = ext;
+      enqueue(s->qctx, c);
+    } else {
+      // the results of the scf.for are the operands of the final scf.yield
+      for (auto t : llvm::zip(fo.getResults(), s->iterSlots))
+        bindSlot(env.get(), std::get<0>(t), std::get<1>(t));
     }
-    // replace the results of the scf.for with the operands of the
-    // final scf.yield operation
-    for (auto &a : fo.getIterOpOperands()) {
-      auto v = map.lookupOrNull(fo.getRegionIterArgForOpOperand(a));
-      fo.getResultForOpOperand(a).replaceAllUsesWith(v);
+    s->lastEnv.reset();
+    then();
+  }
+
+  // Schedule an iteration of a loop waiting for one of its iterations to
+  // complete, when the simulation has run out of events. The iteration it
+  // waits on then depends on ops only scheduled after it, such as the get
+  // of a channel put in the loop. Returns false if no loop is stalled.
+  bool releaseStalledLoop() {
+    for (auto &p : lps) {
+      while (p->stalledLoops.size()) {
+        auto s = p->stalledLoops.front();
+        p->stalledLoops.erase(p->stalledLoops.begin());
+        s->stalled = false;
+        if (s->scheduling || s->next >= s->simulated ||
+            s->live < maxLiveIterations)
+          continue;
+        currentLP = p.get();
+        scheduleIterations(s, /*force=*/true);
+        return true;
+      }
     }
-    return;
+    return false;
   }
 
-  void scheduleScfParallel(mlir::scf::ParallelOp &po, QueueContext *qctx) {
+  void scheduleScfParallel(mlir::scf::ParallelOp &po, QueueContext *qctx,
+                           EnvPtr env) {
 
     int64_t trip_count = 1;
+    SmallVector<int64_t, 4> lbs, steps, counts;
     for (auto t :
          llvm::zip(po.getLowerBound(), po.getUpperBound(), po.getStep())) {
       auto lb = std::get<0>(t).getDefiningOp<arith::ConstantIndexOp>();
@@ -1039,268 +3243,813 @@ public:
       auto step = std::get<2>(t).getDefiningOp<arith::ConstantIndexOp>();
       assert(ub && lb && step);
       auto r = ub.value() - lb.value();
-      trip_count *= mlir::ceilDiv(r, step.value());
-    }
-
-    qctx->queue.push_back(
-        CommandQueueEntry(po.getOperation(), [=](Operation *op) {
-          auto spo = cast<scf::ParallelOp>(op);
-
-          auto initOperands = spo.getInitVals();
-          Value lastResult = initOperands[0];
-          for (auto i = 0; i < trip_count; i++) {
-            BlockAndValueMapping map;
-            auto bb = new mlir::Block();
-            spo.getRegion().push_back(bb);
-            auto bldr = OpBuilder::atBlockEnd(bb);
-            for (auto &o : spo.getRegion().front().getOperations()) {
-              if (auto rop = dyn_cast<scf::ReduceOp>(o)) {
-                auto &rbb = rop.getRegion().front();
-                map.map(rbb.getArgument(0), lastResult);
-                map.map(rbb.getArgument(1),
-                        map.lookupOrDefault(rop.getOperand()));
-                for (auto &ro : rbb) {
-                  if (auto rrop = dyn_cast<scf::ReduceReturnOp>(ro))
-                    lastResult = map.lookupOrDefault(rrop.getOperand());
-                  else
-                    bldr.clone(ro, map);
+      lbs.push_back(lb.value());
+      steps.push_back(step.value());
+      counts.push_back(mlir::ceilDiv(r, step.value()));
+      trip_count *= counts.back();
+    }
+
+    // The token result of the scf.parallel completes when the result of the
+    // last reduction completes.
+    Optional<unsigned> resultSlot;
+    if (po->getNumResults())
+      resultSlot = defineValue(env.get(), po.getResult(0),
+                               RuntimeValue::getToken(1));
+
+    enqueue(qctx, CommandQueueEntry(po.getOperation(), env, [=](Operation *op) {
+              auto makeIterEnv = [=](int64_t i) {
+                auto spo = cast<scf::ParallelOp>(op);
+                auto ids = delinearize(i, counts);
+                auto iterEnv = makeEnvironment(spo.getRegion().front(), env);
+                for (auto t : llvm::enumerate(spo.getInductionVars()))
+                  defineValue(iterEnv.get(), t.value(),
+                              RuntimeValue::getInt(lbs[t.index()] +
+                                                   ids[t.index()] *
+                                                       steps[t.index()]));
+                return iterEnv;
+              };
+              auto getContext = [=](int64_t i) {
+                QueueContext *ctx = qctx;
+                auto qs = qctx->match("scf.parallel");
+                if (qs) {
+                  ctx = (*qs)->at(i % (*qs)->size());
                 }
-              } else {
-                bldr.clone(o, map);
+                return ctx;
+              };
+
+              auto initOperands = cast<scf::ParallelOp>(op).getInitVals();
+              if (!initOperands.size()) {
+                for (auto i = 0; i < trip_count; i++) {
+                  QueueContext *ctx = getContext(i);
+                  runOn(ctx, [=]() {
+                    auto &body = cast<scf::ParallelOp>(op).getRegion().front();
+                    scheduleBlock(body, ctx, makeIterEnv(i));
+                  });
+                }
+                return;
               }
-            }
-            QueueContext *ctx = qctx;
-            auto qs = qctx->match("scf.parallel");
-            if (qs) {
-              ctx = (*qs)->at(i % (*qs)->size());
-            }
-            scheduleBlock(*bb, ctx);
-          }
-          spo.getResult(0).replaceAllUsesWith({lastResult});
-        }));
+
+              // reductions chain the iterations, they are kept on the logical
+              // process of the scf.parallel
+              auto lastResult = std::make_shared<unsigned>(
+                  getOrCreateSlot(env.get(), initOperands[0]));
+              scheduleInOrder(
+                  trip_count,
+                  [=](int64_t i, std::function<void()> next) {
+                    QueueContext *ctx = getContext(i);
+                    if (ctx->lp != &lp())
+                      ctx = qctx;
+                    auto iterEnv = makeIterEnv(i);
+                    auto &body = cast<scf::ParallelOp>(op).getRegion().front();
+                    scheduleBlock(body, ctx, iterEnv, [=]() {
+                      auto &body =
+                          cast<scf::ParallelOp>(op).getRegion().front();
+                      for (auto rop : body.getOps<scf::ReduceOp>()) {
+                        auto &rbb = rop.getRegion().front();
+                        bindSlot(iterEnv.get(), rbb.getArgument(0),
+                                 *lastResult);
+                        bindSlot(iterEnv.get(), rbb.getArgument(1),
+                                 getOrCreateSlot(iterEnv.get(),
+                                                 rop.getOperand()));
+                        scheduleBlock(rbb, ctx, iterEnv);
+                        auto rrop =
+                            cast<scf::ReduceReturnOp>(rbb.getTerminator());
+                        *lastResult =
+                            getOrCreateSlot(iterEnv.get(), rrop.getOperand());
+                      }
+                      next();
+                    });
+                  },
+                  [=]() {
+                    if (resultSlot)
+                      forwardToken(*lastResult, *resultSlot);
+                  });
+            }));
     return;
   }
 
-  void scheduleAirLaunch(xilinx::air::LaunchOp &lo, QueueContext *qctx) {
+  // Call `step(i, next)` for each i in [0, n) in order, where the step calls
+  // `next` once it has been scheduled, then call `then`. Steps are only
+  // scheduled later on when their blocks contain an scf.for, the others run
+  // in a loop rather than recursively.
+  void scheduleInOrder(int64_t n,
+                       std::function<void(int64_t, std::function<void()>)> step,
+                       std::function<void()> then) {
+    struct State {
+      int64_t next = 0;
+      bool running = false;
+      bool waiting = false;
+    };
+    auto state = std::make_shared<State>();
+    auto resume = std::make_shared<std::function<void()>>();
+    std::weak_ptr<std::function<void()>> weakResume = resume;
+    *resume = [=]() {
+      // the pending steps keep `resume` alive
+      auto self = weakResume.lock();
+      state->running = true;
+      while (state->next < n) {
+        state->waiting = true;
+        step(state->next++, [=]() {
+          state->waiting = false;
+          if (!state->running)
+            (*self)();
+        });
+        if (state->waiting) {
+          state->running = false;
+          return;
+        }
+      }
+      state->running = false;
+      then();
+    };
+    (*resume)();
+  }
+
+  // Schedule the iterations of an air.launch or air.partition. Launch
+  // iterations are spread over the controllers, the iterations of a
+  // partition run on the controller which dispatches it.
+  template <typename T>
+  void scheduleAirHierarchy(T &lo, QueueContext *qctx, EnvPtr env) {
 
     int64_t trip_count = 1;
+    SmallVector<int64_t, 4> counts;
     for (auto s : lo.getSizeOperands()) {
       auto ub = s.getDefiningOp<arith::ConstantIndexOp>();
       auto r = ub.value();
+      counts.push_back(r);
       trip_count *= r;
     }
 
-    qctx->queue.push_back(
-        CommandQueueEntry(lo.getOperation(), [=](Operation *op) {
-          auto spo = cast<xilinx::air::LaunchOp>(op);
-
-          for (auto i = 0; i < trip_count; i++) {
-            BlockAndValueMapping map;
-            auto bb = new mlir::Block();
-            lo->getRegion(0).push_back(bb);
-            auto bldr = OpBuilder::atBlockEnd(bb);
-            for (auto &o : lo->getRegion(0).front().getOperations()) {
-              bldr.clone(o, map);
-            }
-            QueueContext *ctx = qctx;
-            auto qs = qctx->match("scf.parallel");
-            if (qs) {
-              ctx = (*qs)->at(i % (*qs)->size());
-            }
-            scheduleBlock(*bb, ctx);
-          }
-        }));
+    // The token completes when the op has executed and every iteration of
+    // its body has completed.
+    Optional<unsigned> launchToken;
+    if (lo->getNumResults())
+      launchToken = defineValue(env.get(), lo->getResult(0),
+                                RuntimeValue::getToken(trip_count + 1));
+
+    enqueue(qctx, CommandQueueEntry(lo.getOperation(), env, [=](Operation *op) {
+              auto operandSlots = getHierarchyOperandSlots(cast<T>(op),
+                                                           env.get());
+              for (auto i = 0; i < trip_count; i++) {
+                QueueContext *ctx = qctx;
+                auto qs = qctx->match("scf.parallel");
+                if (qs && isa<xilinx::air::LaunchOp>(op)) {
+                  ctx = (*qs)->at(i % (*qs)->size());
+                }
+                auto ids = delinearize(i, counts);
+                runOn(ctx, [=]() {
+                  auto spo = cast<T>(op);
+                  auto &body = spo.getBody().front();
+                  auto iterEnv = makeEnvironment(body, env);
+                  bindHierarchyArguments(spo, iterEnv.get(), operandSlots,
+                                         ids);
+                  scheduleBlock(body, ctx, iterEnv, [=]() {
+                    if (!launchToken)
+                      return;
+                    auto &body = cast<T>(op).getBody().front();
+                    auto exit_deps = getBlockTokens(body, iterEnv.get());
+                    enqueue(ctx, makeWaitEntry(op, iterEnv, exit_deps,
+                                               [=](Operation *) {
+                                                 decrementToken(*launchToken);
+                                               }));
+                  });
+                });
+              }
+            }));
     return;
   }
 
-  void scheduleHerd(xilinx::air::HerdOp &hlo, QueueContext *qctx) {
+  void scheduleHerd(xilinx::air::HerdOp &hlo, QueueContext *qctx,
+                    EnvPtr env) {
 
     int64_t cols = hlo.getNumCols();
     int64_t rows = hlo.getNumRows();
 
+    Optional<unsigned> herdToken;
     if (hlo->getNumResults())
-      valueMap[hlo->getResult(0)] = APInt(64, rows * cols + 1);
-
-    qctx->queue.push_back(
-        CommandQueueEntry(hlo.getOperation(), [=](Operation *op) {
-          auto ho = cast<xilinx::air::HerdOp>(op);
-          auto tokenTy = xilinx::air::AsyncTokenType::get(op->getContext());
-          // SmallVector<Value, 16> exit_tokens;
-          for (auto row = 0; row < rows; row++) {
-            for (auto col = 0; col < cols; col++) {
-              BlockAndValueMapping map;
-              auto bb = new mlir::Block();
-              ho.getRegion().push_back(bb);
-              auto bldr = OpBuilder::atBlockEnd(bb);
-              // insert a blocking wait on all input dependencies of the launch
-              // op
-              bldr.create<xilinx::air::WaitAllOp>(op->getLoc(),
-                                                  SmallVector<Type, 1>{},
-                                                  ho.getAsyncDependencies());
-              SmallVector<Value, 8> exit_deps;
-              for (auto &o : ho.getRegion().front()) {
-                auto c = bldr.clone(o, map);
-                // collect each token created in the block
-                for (auto r : c->getResults())
-                  if (r.getType().isa<xilinx::air::AsyncTokenType>())
-                    exit_deps.push_back(r);
-              }
-              Operation *t = nullptr;
-              if (ho->getNumResults()) {
-                // Create an async wait_all on all tokens created in the block.
-                // When the wait_all runs it decrements the herd result event.
-                t = bldr.create<xilinx::air::WaitAllOp>(
-                    op->getLoc(), SmallVector<Type, 1>{tokenTy}, exit_deps);
-                // exit_tokens.push_back(t.getResult(0));
-              }
-              QueueContext *ctx = qctx;
-              auto qs = qctx->match("air.launch_herd");
-              if (qs)
-                ctx = (*qs)->at(col * 4 + row);
-              scheduleBlock(*bb, ctx);
-              if (t) {
-                valueMap[t->getResult(0)] = APInt(64, 2);
-                ctx->queue.push_back(
-                    CommandQueueEntry(t, [=](Operation *tOp) {
-                      valueMap[op->getResult(0)] =
-                          llvm::any_cast<llvm::APInt>(
-                              valueMap[op->getResult(0)]) -
-                          llvm::APInt(64, 1);
-                    }));
+      herdToken = defineValue(env.get(), hlo->getResult(0),
+                              RuntimeValue::getToken(rows * cols + 1));
+
+    enqueue(qctx, CommandQueueEntry(hlo.getOperation(), env, [=](Operation *op) {
+              auto ho = cast<xilinx::air::HerdOp>(op);
+              SmallVector<unsigned, 4> entry_deps;
+              for (auto d : ho.getAsyncDependencies())
+                entry_deps.push_back(getOrCreateSlot(env.get(), d));
+              auto operandSlots = getHierarchyOperandSlots(ho, env.get());
+              for (int64_t row = 0; row < rows; row++) {
+                for (int64_t col = 0; col < cols; col++) {
+                  QueueContext *ctx = getTileContext(qctx, ho, col, row);
+                  runOn(ctx, [=]() {
+                    auto ho = cast<xilinx::air::HerdOp>(op);
+                    auto &body = ho.getRegion().front();
+                    auto tileEnv = makeEnvironment(body, env);
+                    bindHierarchyArguments(ho, tileEnv.get(), operandSlots,
+                                           {col, row});
+                    // a blocking wait on all input dependencies of the herd
+                    enqueue(ctx, makeWaitEntry(op, tileEnv, entry_deps));
+                    scheduleBlock(body, ctx, tileEnv, [=]() {
+                      if (!herdToken)
+                        return;
+                      auto &body =
+                          cast<xilinx::air::HerdOp>(op).getRegion().front();
+                      // wait on all tokens created in the block. When the
+                      // wait completes it decrements the herd result token.
+                      auto exit_deps = getBlockTokens(body, tileEnv.get());
+                      enqueue(ctx, makeWaitEntry(op, tileEnv, exit_deps,
+                                                 [=](Operation *) {
+                                                   decrementToken(*herdToken);
+                                                 }));
+                    });
+                  });
+                }
               }
-            }
-          }
-        }));
+            }));
   }
 
-  void scheduleAIRAsyncOp(Operation *op, std::deque<CommandQueueEntry> *q) {
-    q->push_back(CommandQueueEntry(op));
-    for (auto r : op->getResults()) {
-      if (r.getType().isa<xilinx::air::AsyncTokenType>()) {
-        valueMap[r] = APInt(64, 1);
-      }
-    }
+  void scheduleAIRAsyncOp(Operation *op, QueueContext *q, EnvPtr env) {
+    defineAsyncTokens(op, env.get());
+    enqueue(q, CommandQueueEntry(op, env));
   }
 
-  void scheduleBlock(mlir::Block &block, QueueContext *qctx) {
-    if (!block.getOperations().size())
-      return;
-    Operation &o = block.getOperations().front();
-    Operation *op = &o;
+  // True if `op` computes integers or indices, which timing simulation
+  // evaluates as they may select a channel or a DMA tile. Float arithmetic
+  // only matters for the contents of buffers.
+  static bool isIndexComputation(Operation *op) {
+    return llvm::all_of(op->getResultTypes(), [](Type t) {
+      return t.isa<IndexType>() || t.isa<IntegerType>();
+    });
+  }
+
+  // Schedule the ops of `block`, then run `then`. The ops after an scf.for
+  // are scheduled once its last iteration has been, which may be after the
+  // call returns, see scheduleScfFor.
+  void scheduleBlock(mlir::Block &block, QueueContext *qctx, EnvPtr env,
+                     std::function<void()> then = nullptr) {
+    scheduleOps(block.empty() ? nullptr : &block.front(), qctx, env,
+                std::move(then));
+  }
+
+  // Schedule `op` and the ops following it in its block, then run `then`.
+  void scheduleOps(Operation *op, QueueContext *qctx, EnvPtr env,
+                   std::function<void()> then) {
     while (op) {
 
       if (isa<arith::ConstantOp>(op) || isa<arith::ConstantIndexOp>(op)) {
-        executeOp(*op);
+        executeOp(*op, env.get());
       } else if (isa<memref::AllocOp>(op) || isa<memref::DeallocOp>(op)) {
-        qctx->queue.push_back(CommandQueueEntry(op));
+        enqueue(qctx, CommandQueueEntry(op, env));
       } else if (isa<xilinx::air::DmaMemcpyInterface>(op)) {
         QueueContext *ctx = qctx;
         auto qs = qctx->match("air.dma_memcpy_nd");
         if (qs)
           ctx = qctx->getRR(*qs);
-        scheduleAIRAsyncOp(op, &ctx->queue);
+        scheduleAIRAsyncOp(op, ctx, env);
+      } else if (isa<xilinx::air::ChannelInterface>(op)) {
+        // puts and gets use separate DMA channels, so that a blocked get
+        // cannot hold up the put it is waiting for
+        QueueContext *ctx = qctx;
+        auto qs = qctx->match(op->getName().getStringRef().str());
+        if (qs)
+          ctx = qctx->getRR(*qs);
+        scheduleAIRAsyncOp(op, ctx, env);
       } else if (isa<xilinx::air::WaitAllOp>(op) ||
                  isa<xilinx::air::ExecuteTerminatorOp>(op)) {
-        scheduleAIRAsyncOp(op, &qctx->queue);
+        scheduleAIRAsyncOp(op, qctx, env);
       } else if (auto r = dyn_cast<xilinx::air::ExecuteOp>(op)) {
-        scheduleAIRRegion(r, qctx);
+        scheduleAIRRegion(r, qctx, env);
       } else if (auto hlo = dyn_cast<xilinx::air::HerdOp>(op)) {
-        scheduleHerd(hlo, qctx);
+        scheduleHerd(hlo, qctx, env);
       } else if (auto linalgOp = mlir::dyn_cast<linalg::LinalgOp>(op)) {
-        qctx->queue.push_back(CommandQueueEntry(op));
+        enqueue(qctx, CommandQueueEntry(op, env));
       } else if (auto sfo = dyn_cast<mlir::scf::ForOp>(op)) {
-        scheduleScfFor(sfo, qctx);
+        Operation *next = op->getNextNode();
+        scheduleScfFor(sfo, qctx, env, [=]() {
+          scheduleOps(next, qctx, env, then);
+        });
+        return;
       } else if (auto spo = dyn_cast<mlir::scf::ParallelOp>(op)) {
-        scheduleScfParallel(spo, qctx);
+        scheduleScfParallel(spo, qctx, env);
       } else if (auto alo = dyn_cast<xilinx::air::LaunchOp>(op)) {
-        scheduleAirLaunch(alo, qctx);
+        scheduleAirHierarchy(alo, qctx, env);
+      } else if (auto apo = dyn_cast<xilinx::air::PartitionOp>(op)) {
+        scheduleAirHierarchy(apo, qctx, env);
+      } else if (isa<AffineApplyOp>(op) ||
+                 (isa_and_nonnull<arith::ArithDialect>(op->getDialect()) &&
+                  (functional || isIndexComputation(op)))) {
+        // index computations of DMA offsets, channel indices and the like
+        // take no time, their operands are known when the block is scheduled
+        executeOp(*op, env.get());
       } else {
         ; // op->dump();
         ; // llvm_unreachable("unexpected operation");
       }
       op = op->getNextNode();
     }
+    if (then)
+      then();
   }
 
-  void scheduleRegion(mlir::Region &region, QueueContext *qctx) {
+  void scheduleRegion(mlir::Region &region, QueueContext *qctx, EnvPtr env) {
     for (auto &b : region.getBlocks())
-      scheduleBlock(b, qctx);
+      scheduleBlock(b, qctx, env);
   }
 
-  void scheduleFunction(func::FuncOp &toplevel) {
-    QueueContext *ctx = makeTopContext();
-    scheduleRegion(toplevel.getRegion(), ctx);
+  // Process the events of logical process `p` which happen before `end`.
+  // Discrete-event loop: only queues with a pending wake-up are visited, so
+  // the cost scales with the number of events rather than with elapsed time
+  // multiplied by the number of queues.
+  void runWindow(LogicalProcess &p, uint64_t end) {
+    currentLP = &p;
+    p.posted = false;
+    while (true) {
+      uint64_t t = p.getNextTime();
+      if (t >= end)
+        break;
+      // the work posted to other processes may post work back at the current
+      // time, which must be run before any later event
+      if (p.posted && t != p.time)
+        break;
+      assert(t >= p.time && "event in the past of the logical process");
+      if (t != p.time)
+        LLVM_DEBUG(llvm::dbgs() << "time: " << t << "\n");
+      p.time = t;
+
+      // posted work first, it may wake queues at this time
+      if (p.tasks.size() && p.tasks.top().time == t) {
+        auto fn = p.tasks.top().fn;
+        p.tasks.pop();
+        fn();
+        continue;
+      }
 
-    uint64_t time = 1;
+      QueueContext *qctx;
+      std::tie(std::ignore, std::ignore, qctx) = p.wakeups.top();
+      p.wakeups.pop();
+      // stale wake-up, superseded by an earlier one that has been processed
+      if (qctx->wakeup_time != t)
+        continue;
+      qctx->wakeup_time = UINT64_MAX;
+      processQueue(qctx, t);
+    }
+  }
 
-    bool running = true;
-    while (running) {
-      LLVM_DEBUG(llvm::dbgs() << "time: " << time << "\n");
+  // Parallel simulation in lookahead windows. Logical processes only
+  // interact through posted work and through the memory interfaces they
+  // share, and the partitions mostly interact through transfers, which take
+  // at least `lookahead` cycles. Every process with an event in the window
+  // [first, first + lookahead), where `first` is the earliest pending event,
+  // simulates the window in parallel. A process which posts work stops at
+  // its current time, the work may post work back. The posted work and the
+  // completed tokens are exchanged between windows.
+  void runParallel(MLIRContext *ctx) {
+    // deliver the work posted while the function was scheduled
+    endWindow();
+    SmallVector<LogicalProcess *, 8> runnable;
+    while (true) {
+      uint64_t first = UINT64_MAX;
+      for (auto &p : lps)
+        first = std::min(first, p->getNextTime());
+      if (first == UINT64_MAX)
+        break;
+      uint64_t end = first + lookahead;
+      runnable.clear();
+      for (auto &p : lps) {
+        if (p->getNextTime() < end)
+          runnable.push_back(p.get());
+      }
+      results.parallelWindows++;
+      if (runnable.size() == 1) {
+        runWindow(*runnable[0], end);
+      } else {
+        results.concurrentWindows++;
+        mlir::parallelForEach(ctx, runnable.begin(), runnable.end(),
+                              [&](LogicalProcess *p) { runWindow(*p, end); });
+      }
+      endWindow();
+    }
+  }
 
-      running = false;
-      std::vector<uint64_t> next_times;
+  // Write the trace events buffered by the logical processes to the sink.
+  void flushTrace() {
+    for (auto &p : lps) {
+      for (auto &e : p->traceEvents) {
+        if (e.ph == 'C')
+          traceSink->counter(e.name, e.ts, e.pid, e.value);
+        else
+          traceSink->event(e.name, e.cat, e.ph, e.ts, e.tid, e.pid);
+      }
+      p->traceEvents.clear();
+    }
+  }
 
-      for (auto *qctx : queues) {
-        auto &q = qctx->queue;
-        processQueue(q, time);
-        if (q.size()) {
-          running = true;
-          if (q.front().is_started() && q.front().end_time)
-            next_times.push_back(q.front().end_time);
+  // Exchange the effects of the last window between the logical processes.
+  // Runs while no process is simulating.
+  void endWindow() {
+    for (auto &p : lps) {
+      for (auto slot : p->completed)
+        slots[slot].visibleDone = true;
+      p->completed.clear();
+    }
+    flushTrace();
+    for (auto &p : lps) {
+      for (auto &m : p->outbox) {
+        auto *target = m.first;
+        // work for a time the target has simulated past in the window takes
+        // effect at the start of the next window
+        if (m.second.time < target->time) {
+          m.second.time = target->time;
+          results.delayedInteractions++;
         }
+        m.second.seq = target->taskSeq++;
+        target->tasks.push(std::move(m.second));
       }
+      p->outbox.clear();
+    }
+    for (auto &p : lps) {
+      for (auto &w : p->remoteWaits) {
+        unsigned slot = w.first;
+        QueueContext *q = w.second;
+        if (slots[slot].visibleDone) {
+          wakeQueue(q, q->lp->time);
+          continue;
+        }
+        auto &list = slots[slot].owner->waiters[slot];
+        if (llvm::find(list, q) == list.end())
+          list.push_back(q);
+      }
+      p->remoteWaits.clear();
+    }
+    currentLP = lps.front().get();
+  }
+
+  LogicalResult scheduleFunction(func::FuncOp &toplevel) {
+    clearQueueContexts();
+    lps.clear();
+    lps.push_back(std::make_unique<LogicalProcess>());
+    currentLP = lps.front().get();
+    results = AIRRunnerResults();
+    memoryPools.clear();
+    sharedInterfaces.clear();
+    dmaBytes = 0;
 
-      uint64_t next_time = 0;
-      if (next_times.size())
-        next_time = *std::min_element(next_times.begin(), next_times.end());
-      time = std::max(time + 1, next_time);
-      // if (time > 5000000)
-      //   running = false;
+    modelLinalgOps(toplevel);
+    modelChannels(toplevel->getParentOfType<ModuleOp>());
+
+    QueueContext *ctx = makeTopContext();
+    auto env = makeEnvironment(toplevel.getBody().front(), nullptr);
+    // Bind the arguments up front, other logical processes must not create
+    // slots in the environment of the function.
+    argumentOutputs.clear();
+    if (functional && failed(allocateArguments(toplevel, env.get())))
+      return failure();
+    for (auto arg : toplevel.getArguments())
+      getOrCreateSlot(env.get(), arg);
+    scheduleRegion(toplevel.getRegion(), ctx, env);
+
+    for (auto *qctx : queues)
+      if (qctx->queue.size())
+        wakeQueue(qctx, qctx->lp->time);
+
+    do {
+      if (parallel)
+        runParallel(toplevel.getContext());
+      else
+        runWindow(lp(), UINT64_MAX);
+    } while (releaseStalledLoop());
+    currentLP = lps.front().get();
+
+    uint64_t time = 0;
+    for (auto &p : lps)
+      time = std::max(time, p->time);
+
+    for (auto *qctx : queues) {
+      if (qctx->queue.size()) {
+        llvm::errs() << "WARNING: queue '" << qctx->name << "' blocked with "
+                     << qctx->queue.size() << " pending entries at time "
+                     << time << "\n";
+      }
     }
 
+    if (functional)
+      readArguments(toplevel, env.get());
     for (unsigned ptr = 0, end = store.size(); ptr != end; ++ptr) {
-      if (store[ptr].size()) {
-        emitTraceEvent(traceStream, "dealloc", "layer", "E", time, ptr,
+      if (store[ptr].live) {
+        emitTraceEvent("dealloc", "layer", 'E', time, ptr,
                        TRACE_PID_ALLOC);
-        store[ptr].resize(0);
+        store[ptr].release();
+      }
+    }
+    flushTrace();
+    results.makespan = time;
+    results.dmaBytes = dmaBytes;
+    for (auto &p : memoryPools) {
+      unsigned space = p.first.first;
+      auto &pool = p.second;
+      results.memories.push_back(
+          {pool.name, space, pool.capacity, pool.peakBytes, pool.highWater});
+      if (space >= results.peakBytes.size())
+        results.peakBytes.resize(space + 1, 0);
+      results.peakBytes[space] =
+          std::max(results.peakBytes[space], pool.peakBytes);
+    }
+    reportBottlenecks(queues);
+    if (failOnMemoryOverflow && results.memoryOverflow)
+      return failure();
+    return success();
+  }
+
+  // Allocate the buffers of the memref arguments of `func` in `env` and fill
+  // them with their inputs or random values.
+  LogicalResult allocateArguments(func::FuncOp func, Environment *env) {
+    std::mt19937_64 rng(randomSeed);
+    std::uniform_real_distribution<double> randomFloat(-1.0, 1.0);
+    std::uniform_int_distribution<int64_t> randomInt(-16, 15);
+    for (auto arg : func.getArguments()) {
+      auto type = arg.getType().dyn_cast<MemRefType>();
+      if (!type)
+        continue;
+      if (!type.hasStaticShape()) {
+        llvm::errs() << "error: functional simulation needs a static shape "
+                        "for argument "
+                     << arg.getArgNumber() << "\n";
+        return failure();
       }
+      unsigned ptr = allocateMemRef(type);
+      defineValue(env, arg, RuntimeValue::getMemRef(ptr));
+      auto &buffer = store[ptr];
+
+      auto input = argumentInputs.find(arg.getArgNumber());
+      if (input == argumentInputs.end()) {
+        for (uint64_t i = 0; i < buffer.volume; i++)
+          buffer.store(i, buffer.isFloat()
+                              ? RuntimeValue::getFloat(randomFloat(rng))
+                              : RuntimeValue::getInt(randomInt(rng)));
+        continue;
+      }
+      auto &array = input->second;
+      if (array.getNumElements() != buffer.volume) {
+        llvm::errs() << "error: input of argument " << arg.getArgNumber()
+                     << " has " << array.getNumElements()
+                     << " elements, expected " << buffer.volume << "\n";
+        return failure();
+      }
+      for (uint64_t i = 0; i < buffer.volume; i++)
+        buffer.store(i, buffer.isFloat()
+                            ? RuntimeValue::getFloat(array.getFloat(i))
+                            : RuntimeValue::getInt(array.getInt(i)));
+    }
+    return success();
+  }
+
+  // Copy the final contents of the memref arguments of `func` to the
+  // argument outputs. There is no numpy dtype for bf16, bf16 buffers are
+  // written as f32.
+  void readArguments(func::FuncOp func, Environment *env) {
+    for (auto arg : func.getArguments()) {
+      auto type = arg.getType().dyn_cast<MemRefType>();
+      auto slot = lookupSlot(env, arg);
+      if (!type || !slot || slots[*slot].value.kind != RuntimeValue::MemRef)
+        continue;
+      auto &buffer = store[slots[*slot].value.i];
+      if (!buffer.live)
+        continue;
+      unsigned itemBytes =
+          buffer.kind == MemRefBuffer::BF16 ? 4 : buffer.elementBytes;
+      NpyArray array(buffer.isFloat() ? 'f' : 'i', itemBytes,
+                     type.getShape());
+      for (uint64_t i = 0; i < buffer.volume; i++) {
+        auto v = buffer.load(i);
+        if (buffer.isFloat())
+          array.setFloat(i, v.f);
+        else
+          array.setInt(i, v.i);
+      }
+      argumentOutputs[arg.getArgNumber()] = std::move(array);
+    }
+  }
+
+  void setArgument(unsigned index, const NpyArray &array) {
+    argumentInputs[index] = array;
+  }
+
+  const NpyArray *getArgument(unsigned index) const {
+    auto it = argumentOutputs.find(index);
+    return it == argumentOutputs.end() ? nullptr : &it->second;
+  }
+
+  // Fill the queue activity, critical path and stall attribution of the
+  // results for the queues of the last simulation.
+  void reportBottlenecks(ArrayRef<QueueContext *> simQueues) {
+    auto &topo = arch.topology;
+    llvm::DenseMap<QueueContext *, std::string> labels;
+    for (unsigned i = 0, e = simQueues.size(); i < e; i++) {
+      auto *q = simQueues[i];
+      std::string label = q->name + "#" + std::to_string(i);
+      if (q->tile >= 0)
+        label += " tile (" +
+                 std::to_string(q->tile / topo.rows + topo.column_offset) +
+                 ", " + std::to_string(q->tile % topo.rows + topo.row_offset) +
+                 ")";
+      else
+        label += " partition " + std::to_string(q->partition);
+      labels[q] = label;
+      if (q->busy_cycles || q->stall_cycles)
+        results.queues.push_back({label, q->busy_cycles, q->stall_cycles});
+    }
+
+    const PathNode *last = nullptr;
+    std::map<std::pair<std::string, std::string>, std::pair<uint64_t, uint64_t>>
+        stalls;
+    for (auto &p : lps) {
+      for (auto &n : p->pathNodes)
+        if (!last || n.end_time > last->end_time)
+          last = &n;
+      for (auto &s : p->stalls) {
+        auto &stats = stalls[s.first];
+        stats.first += s.second.first;
+        stats.second += s.second.second;
+      }
+    }
+    for (auto *n = last; n; n = n->pred) {
+      results.extrapolationErrorBound += n->error_bound;
+      results.criticalPath.push_back(
+          {to_string(*n), labels.lookup(n->queue), n->start_time, n->end_time});
+    }
+    std::reverse(results.criticalPath.begin(), results.criticalPath.end());
+
+    std::map<Operation *, AIRRunnerResults::Loop> loops;
+    for (auto &p : lps) {
+      for (auto &l : p->loops) {
+        auto &loop = loops[l.first];
+        loop.instances += l.second.instances;
+        loop.simulatedIterations += l.second.simulatedIterations;
+        loop.extrapolatedIterations += l.second.extrapolatedIterations;
+        loop.period = std::max(loop.period, l.second.period);
+        loop.maxErrorBound =
+            std::max(loop.maxErrorBound, l.second.maxErrorBound);
+        loop.unsteady += l.second.unsteady;
+      }
+    }
+    for (auto &l : loops) {
+      llvm::raw_string_ostream loc(l.second.loc);
+      l.first->getLoc().print(loc);
+      loc.flush();
+      results.loops.push_back(l.second);
+    }
+
+    if (recordOps) {
+      for (auto &p : lps)
+        for (auto &n : p->pathNodes)
+          results.ops.push_back(
+              {to_string(n), labels.lookup(n.queue), n.start_time, n.end_time});
+      llvm::stable_sort(results.ops, [](auto &a, auto &b) {
+        return a.start < b.start;
+      });
     }
-    llvm::dbgs() << "Finished at time " << time << "\n";
+
+    for (auto &s : stalls)
+      results.stalls.push_back(
+          {s.first.first, s.first.second, s.second.first, s.second.second});
+    llvm::sort(results.stalls, [](auto &a, auto &b) {
+      return a.cycles > b.cycles;
+    });
   }
 
+  const AIRRunnerResults &getResults() const { return results; }
+
 private:
-  llvm::raw_ostream &traceStream;
-  llvm::json::Value &jsonModel;
-  uint64_t time;
+  std::unique_ptr<TraceSink> traceSink;
+  ArchModel arch;
+
+  // arch model lookups cached by operation name
+  llvm::DenseMap<OperationName, const ArchModel::Kernel *> kernelCache;
+
+  CostModel costModel;
+
+  // interfaces missing from the arch model which have been reported
+  std::set<std::pair<unsigned, unsigned>> missingInterfaces;
+
+  // simulate the partitions of the topology on parallel threads
+  bool parallel;
+
+  // Length of the windows of a parallel simulation: the shortest time a
+  // transfer between memories takes.
+  uint64_t lookahead;
+
+  // compute cycles of the linalg ops of the function, see modelLinalgOps
+  llvm::DenseMap<Operation *, uint64_t> linalgCycles;
 
-  std::vector<llvm::Any> results;
-  std::vector<uint64_t> resultTimes;
+  // channels of the module keyed by symbol name, see modelChannels. The
+  // buffers may be shared by logical processes.
+  llvm::StringMap<ChannelState> channels;
+  std::mutex channelMutex;
 
-  // The valueMap associates each SSA statement in the program
-  // (represented by a Value*) with it's corresponding value.
-  llvm::DenseMap<Value, llvm::Any> valueMap;
+  // memory interfaces keyed by source and destination memory space, see
+  // getSharedInterface
+  std::map<std::pair<unsigned, unsigned>, std::unique_ptr<SharedInterface>>
+      sharedInterfaces;
+  std::mutex interfaceMutex;
+
+  // The value store holds the runtime value of every live SSA value
+  // instance. Environments map Values to slots in the store.
+  StableVector<Slot> slots;
+  std::vector<unsigned> freeSlots;
+  std::mutex slotMutex;
+
+  // Per-block value numbering shared by the Environments of the block.
+  llvm::DenseMap<Block *, std::unique_ptr<ValueLayout>> layouts;
+
+  // guards the caches and warning sets shared by the logical processes
+  std::mutex cacheMutex;
 
   // The store associates each allocation in the program
-  // (represented by a int) with a vector of values which can be
-  // accessed by it.
-  std::vector<std::vector<llvm::Any>> store;
+  // (represented by a int) with a flat buffer of its elements.
+  StableVector<MemRefBuffer> store;
+  std::mutex storeMutex;
+
+  // memory pools keyed by memory space and tile or partition, see
+  // getMemoryPool. Guarded by storeMutex.
+  std::map<std::pair<unsigned, int64_t>, MemoryPool> memoryPools;
+
+  // exceeding the capacity of a memory fails the simulation
+  bool failOnMemoryOverflow;
+
+  // copy every completed entry to the results
+  bool recordOps;
+
+  // extrapolate the steady state of scf.for loops once the periods of two
+  // windows of `steadyStateWindow` iterations agree, see scheduleScfFor
+  bool extrapolateLoops;
+  unsigned steadyStateWindow;
+  unsigned maxSteadyStateWindows;
+
+  // iterations of an scf.for scheduled and not complete at a time, see
+  // scheduleScfFor
+  unsigned maxLiveIterations;
 
-  unsigned dispatch_slots;
-  unsigned dispatch_dma_slots;
-  unsigned core_dma_slots;
-  unsigned herd_slots;
+  // compute the contents of the buffers, see AIRRunnerOptions::functional
+  bool functional;
+  uint64_t randomSeed;
+
+  // contents of the memref arguments of the function keyed by position:
+  // inputs set before a functional simulation and outputs after
+  std::map<unsigned, NpyArray> argumentInputs;
+  std::map<unsigned, NpyArray> argumentOutputs;
+
+  // unsupported ops and operands which have been reported
+  std::set<std::string> functionalWarnings;
+
+  // bytes moved by transfers, across all logical processes
+  std::atomic<uint64_t> dmaBytes{0};
+
+  AIRRunnerResults results;
+
+  // core tile queues of the device, indexed by column * rows + row
+  std::vector<QueueContext *> coreGrid;
+
+  // herds which have been reported to be placed outside of the device
+  llvm::SmallPtrSet<Operation *, 4> misplacedHerds;
 
 }; // AIRRunner_impl
 
+thread_local AIRRunner::AIRRunner_impl::LogicalProcess
+    *AIRRunner::AIRRunner_impl::currentLP = nullptr;
+
 AIRRunner::AIRRunner(llvm::raw_ostream &trace_stream,
                      llvm::json::Value &json_model, bool verbose) {
-  impl = std::make_unique<AIRRunner_impl>(trace_stream, json_model, verbose);
+  std::string errorMessage;
+  auto arch = ArchModel::parse(json_model, &errorMessage);
+  if (!arch)
+    llvm::report_fatal_error(llvm::Twine(errorMessage));
+  AIRRunnerOptions options;
+  options.verbose = verbose;
+  impl = std::make_unique<AIRRunner_impl>(trace_stream, *arch, options);
+  if (verbose) {
+    llvm::DebugFlag = true;
+    llvm::setCurrentDebugType(DEBUG_TYPE);
+  }
+}
+
+AIRRunner::AIRRunner(llvm::raw_ostream &trace_stream, const ArchModel &arch,
+                     bool verbose) {
+  AIRRunnerOptions options;
+  options.verbose = verbose;
+  impl = std::make_unique<AIRRunner_impl>(trace_stream, arch, options);
   if (verbose) {
     llvm::DebugFlag = true;
     llvm::setCurrentDebugType(DEBUG_TYPE);
   }
 }
 
+AIRRunner::AIRRunner(llvm::raw_ostream &trace_stream, const ArchModel &arch,
+                     const AIRRunnerOptions &options) {
+  impl = std::make_unique<AIRRunner_impl>(trace_stream, arch, options);
+  if (options.verbose) {
+    llvm::DebugFlag = true;
+    llvm::setCurrentDebugType(DEBUG_TYPE);
+  }
+}
+
 AIRRunner::~AIRRunner() {}
 
 void AIRRunner::emitTraceStart(llvm::raw_ostream &s) {
@@ -1309,8 +4058,20 @@ void AIRRunner::emitTraceStart(llvm::raw_ostream &s) {
 
 void AIRRunner::emitTraceEnd(llvm::raw_ostream &s) { impl->emitTraceEnd(s); }
 
-void AIRRunner::scheduleFunction(func::FuncOp &toplevel) {
-  impl->scheduleFunction(toplevel);
+LogicalResult AIRRunner::scheduleFunction(func::FuncOp &toplevel) {
+  return impl->scheduleFunction(toplevel);
+}
+
+const AIRRunnerResults &AIRRunner::getResults() const {
+  return impl->getResults();
+}
+
+void AIRRunner::setArgument(unsigned index, const NpyArray &array) {
+  impl->setArgument(index, array);
+}
+
+const NpyArray *AIRRunner::getArgument(unsigned index) const {
+  return impl->getArgument(index);
 }
 
 } // namespace air
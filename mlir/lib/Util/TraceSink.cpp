@@ -0,0 +1,464 @@
+//===- TraceSink.cpp --------------------------------------------*- C++ -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+#include "air/Util/TraceSink.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace xilinx {
+namespace air {
+
+namespace {
+
+void writeVarint(raw_ostream &os, uint64_t v) {
+  while (v >= 0x80) {
+    os << (char)((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  os << (char)v;
+}
+
+uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+
+// Assigns dense ids to strings in order of first use.
+class StringInterner {
+public:
+  // Return the id of `s`, and whether this is its first use.
+  std::pair<unsigned, bool> intern(StringRef s) {
+    auto r = ids.insert({s, (unsigned)ids.size()});
+    return {r.first->second, r.second};
+  }
+
+private:
+  StringMap<unsigned> ids;
+};
+
+// Chrome trace event JSON, as loaded by chrome://tracing and Perfetto UI.
+class JSONTraceSink : public TraceSink {
+public:
+  JSONTraceSink(raw_ostream &os) : os(os) {}
+
+  void start(raw_ostream &s) override { s << "[\n"; }
+
+  void event(StringRef name, StringRef cat, char ph, uint64_t ts,
+             uint64_t tid, int64_t pid) override {
+    os << "{\n";
+    os << "  \"name\": \"" << name << "\","
+       << "\n";
+    os << "  \"cat\": \"" << cat << "\","
+       << "\n";
+    os << "  \"ph\": \"" << ph << "\","
+       << "\n";
+    os << "  \"ts\": " << ts << ","
+       << "\n";
+    os << "  \"pid\": " << pid << ","
+       << "\n";
+    os << "  \"tid\": " << tid << ","
+       << "\n";
+    os << "  \"args\": "
+       << "{}"
+       << ""
+       << "\n";
+    os << "},\n";
+  }
+
+  void counter(StringRef name, uint64_t ts, int64_t pid,
+               int64_t value) override {
+    os << "{\n";
+    os << "  \"name\": \"" << name << "\",\n";
+    os << "  \"ph\": \"C\",\n";
+    os << "  \"ts\": " << ts << ",\n";
+    os << "  \"pid\": " << pid << ",\n";
+    os << "  \"args\": {\"bytes\": " << value << "}\n";
+    os << "},\n";
+  }
+
+  void finish(raw_ostream &s) override { s << "{}]\n"; }
+
+private:
+  raw_ostream &os;
+};
+
+// Protobuf encoding of the Perfetto Trace message. Every event is a
+// TracePacket holding a TrackEvent on a track of its (pid, tid). Event names
+// and categories are interned on a single packet sequence, and each track is
+// described by a TrackDescriptor packet before its first event.
+class PerfettoTraceSink : public TraceSink {
+public:
+  PerfettoTraceSink(raw_ostream &os) : os(os) {}
+
+  void event(StringRef name, StringRef cat, char ph, uint64_t ts,
+             uint64_t tid, int64_t pid) override {
+    uint64_t track = getTrack(pid, tid);
+
+    std::string packet;
+    raw_string_ostream p(packet);
+    writeVarintField(p, TracePacket_timestamp, ts);
+    writeVarintField(p, TracePacket_trusted_packet_sequence_id, SequenceId);
+    writeVarintField(p, TracePacket_sequence_flags, firstPacket
+                                                        ? SeqIncrementalCleared
+                                                        : SeqNeedsIncremental);
+    firstPacket = false;
+
+    std::string interned;
+    raw_string_ostream i(interned);
+    auto catId = categories.intern(cat);
+    if (catId.second)
+      writeInternedString(i, InternedData_event_categories, catId.first + 1,
+                          cat);
+    auto nameId = names.intern(name);
+    if (nameId.second)
+      writeInternedString(i, InternedData_event_names, nameId.first + 1,
+                          name);
+    if (i.str().size())
+      writeBytesField(p, TracePacket_interned_data, i.str());
+
+    std::string trackEvent;
+    raw_string_ostream e(trackEvent);
+    writeVarintField(e, TrackEvent_type,
+                     ph == 'B' ? TrackEvent_SliceBegin : TrackEvent_SliceEnd);
+    writeVarintField(e, TrackEvent_track_uuid, track);
+    writeVarintField(e, TrackEvent_category_iids, catId.first + 1);
+    if (ph == 'B')
+      writeVarintField(e, TrackEvent_name_iid, nameId.first + 1);
+    writeBytesField(p, TracePacket_track_event, e.str());
+
+    writeBytesField(os, Trace_packet, p.str());
+  }
+
+  void counter(StringRef name, uint64_t ts, int64_t pid,
+               int64_t value) override {
+    uint64_t track = getCounterTrack(name, pid);
+    std::string packet;
+    raw_string_ostream p(packet);
+    writeVarintField(p, TracePacket_timestamp, ts);
+    writeVarintField(p, TracePacket_trusted_packet_sequence_id, SequenceId);
+    std::string trackEvent;
+    raw_string_ostream e(trackEvent);
+    writeVarintField(e, TrackEvent_type, TrackEvent_Counter);
+    writeVarintField(e, TrackEvent_track_uuid, track);
+    writeVarintField(e, TrackEvent_counter_value, value);
+    writeBytesField(p, TracePacket_track_event, e.str());
+    writeBytesField(os, Trace_packet, p.str());
+  }
+
+private:
+  // field numbers of perfetto/trace/trace.proto and the messages it uses
+  enum {
+    Trace_packet = 1,
+    TracePacket_timestamp = 8,
+    TracePacket_trusted_packet_sequence_id = 10,
+    TracePacket_track_event = 11,
+    TracePacket_interned_data = 12,
+    TracePacket_sequence_flags = 13,
+    TracePacket_track_descriptor = 60,
+    TrackDescriptor_uuid = 1,
+    TrackDescriptor_name = 2,
+    TrackDescriptor_process = 3,
+    TrackDescriptor_parent_uuid = 5,
+    TrackDescriptor_counter = 8,
+    ProcessDescriptor_pid = 1,
+    TrackEvent_category_iids = 3,
+    TrackEvent_type = 9,
+    TrackEvent_name_iid = 10,
+    TrackEvent_track_uuid = 11,
+    TrackEvent_counter_value = 30,
+    InternedData_event_categories = 1,
+    InternedData_event_names = 2,
+    InternedString_iid = 1,
+    InternedString_name = 2,
+  };
+  enum {
+    TrackEvent_SliceBegin = 1,
+    TrackEvent_SliceEnd = 2,
+    TrackEvent_Counter = 4
+  };
+  enum { SeqIncrementalCleared = 1, SeqNeedsIncremental = 2 };
+  static constexpr uint64_t SequenceId = 1;
+
+  static void writeVarintField(raw_ostream &s, unsigned field, uint64_t v) {
+    writeVarint(s, (field << 3) | 0);
+    writeVarint(s, v);
+  }
+
+  static void writeBytesField(raw_ostream &s, unsigned field, StringRef v) {
+    writeVarint(s, (field << 3) | 2);
+    writeVarint(s, v.size());
+    s << v;
+  }
+
+  static void writeInternedString(raw_ostream &s, unsigned field,
+                                  uint64_t iid, StringRef name) {
+    std::string msg;
+    raw_string_ostream m(msg);
+    writeVarintField(m, InternedString_iid, iid);
+    writeBytesField(m, InternedString_name, name);
+    writeBytesField(s, field, m.str());
+  }
+
+  void writeTrackDescriptor(uint64_t uuid, Optional<uint64_t> parent,
+                            Optional<int64_t> pid, StringRef name,
+                            bool isCounter = false) {
+    std::string desc;
+    raw_string_ostream d(desc);
+    writeVarintField(d, TrackDescriptor_uuid, uuid);
+    writeBytesField(d, TrackDescriptor_name, name);
+    if (parent)
+      writeVarintField(d, TrackDescriptor_parent_uuid, *parent);
+    // an empty CounterDescriptor makes this a counter track
+    if (isCounter)
+      writeBytesField(d, TrackDescriptor_counter, "");
+    if (pid) {
+      std::string process;
+      raw_string_ostream pd(process);
+      writeVarintField(pd, ProcessDescriptor_pid, *pid);
+      writeBytesField(d, TrackDescriptor_process, pd.str());
+    }
+    std::string packet;
+    raw_string_ostream p(packet);
+    writeBytesField(p, TracePacket_track_descriptor, d.str());
+    writeBytesField(os, Trace_packet, p.str());
+  }
+
+  uint64_t getProcessTrack(int64_t pid) {
+    auto &process = tracks[{pid, UINT64_MAX}];
+    if (!process) {
+      process = ++lastTrack;
+      writeTrackDescriptor(process, None, pid, "pid " + std::to_string(pid));
+    }
+    return process;
+  }
+
+  // Return the uuid of the track of (pid, tid), describing it on first use.
+  uint64_t getTrack(int64_t pid, uint64_t tid) {
+    uint64_t process = getProcessTrack(pid);
+    auto &thread = tracks[{pid, tid}];
+    if (!thread) {
+      thread = ++lastTrack;
+      writeTrackDescriptor(thread, process, None, std::to_string(tid));
+    }
+    return thread;
+  }
+
+  // Return the uuid of counter track `name` of process `pid`.
+  uint64_t getCounterTrack(StringRef name, int64_t pid) {
+    uint64_t process = getProcessTrack(pid);
+    auto &counter = counterTracks[{pid, name.str()}];
+    if (!counter) {
+      counter = ++lastTrack;
+      writeTrackDescriptor(counter, process, None, name, /*isCounter=*/true);
+    }
+    return counter;
+  }
+
+  raw_ostream &os;
+  bool firstPacket = true;
+  StringInterner names;
+  StringInterner categories;
+  std::map<std::pair<int64_t, uint64_t>, uint64_t> tracks;
+  std::map<std::pair<int64_t, std::string>, uint64_t> counterTracks;
+  uint64_t lastTrack = 0;
+};
+
+// A compact binary trace:
+//
+//   header: "AIRTRACE" varint(version)
+//   string: 0x01 varint(id) varint(size) bytes
+//   begin:  0x02 varint(name) varint(cat) zigzag(pid) varint(tid) zigzag(dt)
+//   end:    0x03 varint(name) varint(cat) zigzag(pid) varint(tid) zigzag(dt)
+//   count:  0x04 varint(name) zigzag(pid) zigzag(dt) zigzag(value)
+//   footer: 0x00
+//
+// Names and categories are interned: a string record gives the next id to a
+// string before its first use. `dt` is the difference to the time of the
+// previous event.
+class BinaryTraceSink : public TraceSink {
+public:
+  BinaryTraceSink(raw_ostream &os) : os(os) {}
+
+  void start(raw_ostream &s) override {
+    s << "AIRTRACE";
+    writeVarint(s, Version);
+  }
+
+  void event(StringRef name, StringRef cat, char ph, uint64_t ts,
+             uint64_t tid, int64_t pid) override {
+    unsigned nameId = intern(name);
+    unsigned catId = intern(cat);
+    os << (char)(ph == 'B' ? Begin : End);
+    writeVarint(os, nameId);
+    writeVarint(os, catId);
+    writeVarint(os, zigzag(pid));
+    writeVarint(os, tid);
+    writeVarint(os, zigzag((int64_t)(ts - lastTime)));
+    lastTime = ts;
+  }
+
+  void counter(StringRef name, uint64_t ts, int64_t pid,
+               int64_t value) override {
+    unsigned nameId = intern(name);
+    os << (char)Counter;
+    writeVarint(os, nameId);
+    writeVarint(os, zigzag(pid));
+    writeVarint(os, zigzag((int64_t)(ts - lastTime)));
+    writeVarint(os, zigzag(value));
+    lastTime = ts;
+  }
+
+  void finish(raw_ostream &s) override { s << (char)Footer; }
+
+private:
+  enum { Footer = 0, String = 1, Begin = 2, End = 3, Counter = 4 };
+  static constexpr uint64_t Version = 1;
+
+  unsigned intern(StringRef s) {
+    auto id = strings.intern(s);
+    if (id.second) {
+      os << (char)String;
+      writeVarint(os, id.first);
+      writeVarint(os, s.size());
+      os << s;
+    }
+    return id.first;
+  }
+
+  raw_ostream &os;
+  StringInterner strings;
+  uint64_t lastTime = 0;
+};
+
+// Pairs the begin and end events of every track and accumulates a histogram
+// of the slice durations per event name. Nothing is written until finish,
+// which emits a JSON summary ordered by total duration.
+class AggregateTraceSink : public TraceSink {
+public:
+  AggregateTraceSink(raw_ostream &os) {}
+
+  void event(StringRef name, StringRef cat, char ph, uint64_t ts,
+             uint64_t tid, int64_t pid) override {
+    unsigned id = names.intern(name).first;
+    if (id == stats.size())
+      stats.push_back({name.str(), cat.str()});
+    auto &stack = open[{pid, tid}];
+    if (ph == 'B') {
+      stack.push_back({id, ts});
+      return;
+    }
+    // an end event without a matching begin, such as a deallocation
+    if (stack.empty() || stack.back().first != id)
+      return;
+    uint64_t start = stack.pop_back_val().second;
+    stats[id].add(ts > start ? ts - start : 0);
+  }
+
+  void finish(raw_ostream &s) override {
+    std::vector<const Stats *> sorted;
+    for (auto &st : stats)
+      if (st.count)
+        sorted.push_back(&st);
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const Stats *a, const Stats *b) {
+                       return a->total > b->total;
+                     });
+    json::OStream j(s, 2);
+    j.array([&] {
+      for (auto *st : sorted) {
+        j.object([&] {
+          j.attribute("name", st->name);
+          j.attribute("cat", st->cat);
+          j.attribute("count", (int64_t)st->count);
+          j.attribute("total", (int64_t)st->total);
+          j.attribute("min", (int64_t)st->min);
+          j.attribute("max", (int64_t)st->max);
+          // [lower bound, count] of the non-empty power of two buckets
+          j.attributeArray("histogram", [&] {
+            for (unsigned b = 0; b < NumBuckets; b++) {
+              if (!st->buckets[b])
+                continue;
+              j.array([&] {
+                j.value(b ? (int64_t)1 << (b - 1) : 0);
+                j.value((int64_t)st->buckets[b]);
+              });
+            }
+          });
+        });
+      }
+    });
+    s << "\n";
+  }
+
+private:
+  static constexpr unsigned NumBuckets = 65;
+
+  struct Stats {
+    std::string name;
+    std::string cat;
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t min = UINT64_MAX;
+    uint64_t max = 0;
+    uint64_t buckets[NumBuckets] = {};
+
+    void add(uint64_t d) {
+      count++;
+      total += d;
+      min = std::min(min, d);
+      max = std::max(max, d);
+      buckets[d ? Log2_64(d) + 1 : 0]++;
+    }
+  };
+
+  StringInterner names;
+  std::vector<Stats> stats;
+  std::map<std::pair<int64_t, uint64_t>,
+           SmallVector<std::pair<unsigned, uint64_t>, 4>>
+      open;
+};
+
+} // namespace
+
+TraceSink::~TraceSink() {}
+
+Optional<TraceFormat> parseTraceFormat(StringRef name) {
+  return StringSwitch<Optional<TraceFormat>>(name)
+      .Case("json", TraceFormat::JSON)
+      .Case("perfetto", TraceFormat::Perfetto)
+      .Case("binary", TraceFormat::Binary)
+      .Case("aggregate", TraceFormat::Aggregate)
+      .Default(None);
+}
+
+std::unique_ptr<TraceSink> TraceSink::create(TraceFormat format,
+                                             raw_ostream &os) {
+  switch (format) {
+  case TraceFormat::JSON:
+    return std::make_unique<JSONTraceSink>(os);
+  case TraceFormat::Perfetto:
+    return std::make_unique<PerfettoTraceSink>(os);
+  case TraceFormat::Binary:
+    return std::make_unique<BinaryTraceSink>(os);
+  case TraceFormat::Aggregate:
+    return std::make_unique<AggregateTraceSink>(os);
+  }
+  llvm_unreachable("unknown trace format");
+}
+
+} // namespace air
+} // namespace xilinx
@@ -13,18 +13,142 @@
 #include "mlir-c/Bindings/Python/Interop.h"
 #include "mlir/Bindings/Python/PybindAdaptors.h"
 
+#include <pybind11/numpy.h>
+
+#include <stdexcept>
 #include <string>
+#include <utility>
+
+namespace py = pybind11;
 
 namespace xilinx {
 namespace air {
 
+namespace {
+
+// Owner of the results of a simulation.
+class PyRunnerResults {
+public:
+  PyRunnerResults(AirRunnerResults results) : results(results) {}
+  PyRunnerResults(PyRunnerResults &&other) : results(other.results) {
+    other.results.ptr = nullptr;
+  }
+  PyRunnerResults(const PyRunnerResults &) = delete;
+  ~PyRunnerResults() {
+    if (!airRunnerResultsIsNull(results))
+      airRunnerResultsDestroy(results);
+  }
+
+  AirRunnerResults get() const { return results; }
+
+  py::array_t<uint64_t> getStarts() const {
+    py::array_t<uint64_t> starts(airRunnerResultsGetNumOps(results));
+    airRunnerResultsGetOpTimes(results, starts.mutable_data(), nullptr);
+    return starts;
+  }
+  py::array_t<uint64_t> getEnds() const {
+    py::array_t<uint64_t> ends(airRunnerResultsGetNumOps(results));
+    airRunnerResultsGetOpTimes(results, nullptr, ends.mutable_data());
+    return ends;
+  }
+
+private:
+  AirRunnerResults results;
+};
+
+} // namespace
+
 void defineAIRRunnerModule(pybind11::module &m) {
   m.def("run", [](MlirModule module, std::string json, std::string outfile,
                   std::string function, bool verbose) {
     airRunnerRun(module, json.c_str(), outfile.c_str(), function.c_str(),
                  verbose);
   });
+
+  py::class_<PyRunnerResults>(m, "Results", "results of an air-runner simulation")
+      .def_property_readonly(
+          "makespan",
+          [](PyRunnerResults &r) { return airRunnerResultsGetMakespan(r.get()); },
+          "cycles until the last queue finished")
+      .def_property_readonly(
+          "dma_bytes",
+          [](PyRunnerResults &r) { return airRunnerResultsGetDmaBytes(r.get()); },
+          "bytes moved by DMA transfers and channel puts")
+      .def_property_readonly(
+          "peak_bytes",
+          [](PyRunnerResults &r) {
+            py::list peaks;
+            for (intptr_t i = 0, e = airRunnerResultsGetNumMemorySpaces(r.get());
+                 i < e; i++)
+              peaks.append(airRunnerResultsGetPeakBytes(r.get(), i));
+            return peaks;
+          },
+          "peak bytes of the fullest memory of each memory space")
+      .def_property_readonly(
+          "op_names",
+          [](PyRunnerResults &r) {
+            py::list names;
+            for (intptr_t i = 0, e = airRunnerResultsGetNumOps(r.get()); i < e;
+                 i++) {
+              auto name = airRunnerResultsGetOpName(r.get(), i);
+              names.append(py::str(name.data, name.length));
+            }
+            return names;
+          },
+          "name of each recorded op")
+      .def_property_readonly(
+          "op_queues",
+          [](PyRunnerResults &r) {
+            py::list queues;
+            for (intptr_t i = 0, e = airRunnerResultsGetNumOps(r.get()); i < e;
+                 i++) {
+              auto queue = airRunnerResultsGetOpQueue(r.get(), i);
+              queues.append(py::str(queue.data, queue.length));
+            }
+            return queues;
+          },
+          "queue on which each recorded op ran")
+      .def_property_readonly(
+          "starts",
+          [](PyRunnerResults &r) { return r.getStarts(); },
+          "numpy array of the start cycle of each recorded op")
+      .def_property_readonly(
+          "ends", [](PyRunnerResults &r) { return r.getEnds(); },
+          "numpy array of the end cycle of each recorded op");
+
+  m.def(
+      "simulate",
+      [](MlirModule module, py::object arch, std::string function,
+         bool record_ops) {
+        // the arch model is a dict or its JSON text
+        std::string json = py::isinstance<py::str>(arch)
+                               ? arch.cast<std::string>()
+                               : py::module::import("json")
+                                     .attr("dumps")(arch)
+                                     .cast<std::string>();
+        std::string error;
+        AirRunnerResults results;
+        {
+          py::gil_scoped_release release;
+          results = airRunnerSimulate(
+              module, mlirStringRefCreate(json.data(), json.size()),
+              mlirStringRefCreate(function.data(), function.size()),
+              record_ops,
+              [](MlirStringRef str, void *userData) {
+                static_cast<std::string *>(userData)->append(str.data,
+                                                             str.length);
+              },
+              &error);
+        }
+        if (airRunnerResultsIsNull(results))
+          throw std::runtime_error(error);
+        return PyRunnerResults(results);
+      },
+      py::arg("module"), py::arg("arch"), py::arg("function"),
+      py::arg("record_ops") = true,
+      "Simulate `function` of `module` on the arch model `arch` and return "
+      "the results. The GIL is released while simulating.");
 }
 
 } // namespace air
-} // namespace xilinx
\ No newline at end of file
+} // namespace xilinx
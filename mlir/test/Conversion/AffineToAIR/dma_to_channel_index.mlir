@@ -0,0 +1,51 @@
+//===- dma_to_channel_index.mlir -------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-opt %s -air-dma-to-channel | FileCheck %s
+
+// The channel index of the pass starts with @channel_0. The channel created
+// for the first DMA skips it and the function @channel_1. The channel of the
+// second DMA skips the one added for the first DMA mid-pass. The external
+// channel ops created in the herd are erased once hoisted.
+
+// CHECK: air.channel @channel_3 [1, 1]
+// CHECK: air.channel @channel_2 [1, 1]
+// CHECK: air.channel @channel_0 [1, 1]
+// CHECK: func.func private @channel_1()
+// CHECK-LABEL: func.func @copy
+// CHECK: air.channel.put{{.*}}@channel_0[]
+// CHECK: scf.parallel
+// CHECK: air.channel.put{{.*}}@channel_2[]
+// CHECK: scf.parallel
+// CHECK: air.channel.get{{.*}}@channel_3[]
+// CHECK: air.herd
+// CHECK-NOT: air.channel.put{{.*}}@channel_2[]
+// CHECK: air.channel.get{{.*}}@channel_0[]
+// CHECK-NEXT: air.channel.get{{.*}}@channel_2[]
+// CHECK-NEXT: air.channel.put{{.*}}@channel_3[]
+// CHECK-NOT: air.channel.get{{.*}}@channel_3[]
+// CHECK: air.herd_terminator
+
+module {
+  air.channel @channel_0 [1, 1]
+  func.func private @channel_1()
+  func.func @copy(%arg0: memref<32xi32>, %arg1: memref<32xi32>) {
+    %c1 = arith.constant 1 : index
+    air.channel.put @channel_0[] (%arg1[] [] []) : (memref<32xi32>)
+    air.herd @herd_0  tile (%arg2, %arg3) in (%arg4=%c1, %arg5=%c1) args(%arg6=%arg0, %arg7=%arg1) : memref<32xi32>, memref<32xi32> {
+      %alloc = memref.alloc() : memref<32xi32, 2>
+      %alloc_0 = memref.alloc() : memref<32xi32, 2>
+      air.channel.get @channel_0[] (%alloc_0[] [] []) : (memref<32xi32, 2>)
+      air.dma_memcpy_nd (%alloc[] [] [], %arg6[] [] []) {id = 1 : i32} : (memref<32xi32, 2>, memref<32xi32>)
+      air.dma_memcpy_nd (%arg7[] [] [], %alloc[] [] []) {id = 2 : i32} : (memref<32xi32>, memref<32xi32, 2>)
+      memref.dealloc %alloc : memref<32xi32, 2>
+      memref.dealloc %alloc_0 : memref<32xi32, 2>
+      air.herd_terminator
+    }
+    return
+  }
+}
@@ -0,0 +1,43 @@
+//===- calibrate.mlir ------------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f calib -m %S/arch.json -o %t.json -calibrate=%S/Inputs/calibrate.json | FileCheck %s --check-prefix=REPORT
+// RUN: FileCheck %s --check-prefix=MODEL < %t.json
+// RUN: not air-runner %s -f calib -m %S/arch.json -o %t.json -calibrate=%S/Inputs/calibrate_missing.json 2>&1 | FileCheck %s --check-prefix=MISSING
+
+// The 4x4x4 matmul is modeled as 128 ops at 16 ops per cycle, and measured
+// to take twice as long. The transfer of 128 bytes is modeled at 4 GB/s and
+// measured to take 64 ns. Each measurement fits one parameter, exactly but
+// for the small ridge term of the fit.
+
+// REPORT: calibrated from 2 measurements, rms error {{[0-9.]+}} -> 0.0 cycles:
+// REPORT-NEXT: kernel linalg.matmul: 1 -> 0.5000{{[0-9]*}} (1 samples)
+// REPORT-NEXT: interface 0->2: 4e+09 -> 2e+09 (1 samples)
+
+// MODEL: "interfaces": [
+// MODEL: "bytes_per_second": 2000000{{[0-9.]*}},
+// MODEL-NEXT: "dst": 2,
+// MODEL-NEXT: "src": 0
+// MODEL: "kernels": {
+// MODEL-NEXT: "linalg.matmul": {
+// MODEL-NEXT: "efficiency": 0.5000{{[0-9]*}},
+
+// MISSING: measurement 0 herd 'herd_9' not found in the function
+
+module {
+  func.func @calib(%arg0: memref<32xi32>, %arg1: memref<4x4xi32>, %arg2: memref<4x4xi32>, %arg3: memref<4x4xi32>) {
+    %c1 = arith.constant 1 : index
+    air.herd @herd_0  tile (%arg4, %arg5) in (%arg6=%c1, %arg7=%c1) args(%arg8=%arg0, %arg9=%arg1, %arg10=%arg2, %arg11=%arg3) : memref<32xi32>, memref<4x4xi32>, memref<4x4xi32>, memref<4x4xi32> {
+      %0 = memref.alloc() : memref<32xi32, 2>
+      air.dma_memcpy_nd (%0[] [] [], %arg8[] [] []) : (memref<32xi32, 2>, memref<32xi32>)
+      linalg.matmul ins(%arg9, %arg10 : memref<4x4xi32>, memref<4x4xi32>) outs(%arg11 : memref<4x4xi32>)
+      memref.dealloc %0 : memref<32xi32, 2>
+      air.herd_terminator
+    }
+    return
+  }
+}
@@ -0,0 +1,40 @@
+//===- channel_index.mlir --------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f graph -m %S/arch.json 2>&1 | FileCheck %s
+
+// Channel indices computed by affine.apply and by arith ops, also inside an
+// air.execute, select the channel of each put and get in timing simulation.
+// Reading them as 0 pairs the gets with the wrong puts and blocks the queues.
+
+// CHECK-NOT: WARNING
+// CHECK: Finished at time
+
+#map = affine_map<()[s0] -> (s0 + 1)>
+module {
+  air.channel @channel_0 [3]
+  func.func @graph(%arg0: memref<32xi32>, %arg1: memref<32xi32>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c2 = arith.constant 2 : index
+    %0 = affine.apply #map()[%c0]
+    %1 = air.channel.put async @channel_0[%0] (%arg0[] [] []) : (memref<32xi32>)
+    %2 = air.channel.put async @channel_0[%c2] (%arg1[] [] []) : (memref<32xi32>)
+    %async_token, %results = air.execute -> (memref<32xi32, 2>) {
+      %5 = memref.alloc() : memref<32xi32, 2>
+      air.execute_terminator %5 : memref<32xi32, 2>
+    }
+    %async_token_0, %results_1 = air.execute -> (index) {
+      %5 = arith.addi %c1, %c1 : index
+      air.execute_terminator %5 : index
+    }
+    %3 = air.channel.get async [%async_token] @channel_0[%c1] (%results[] [] []) : (memref<32xi32, 2>)
+    %4 = air.channel.get async [%async_token, %async_token_0] @channel_0[%results_1] (%results[] [] []) : (memref<32xi32, 2>)
+    air.wait_all [%1, %2, %3, %4]
+    return
+  }
+}
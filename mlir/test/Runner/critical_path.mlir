@@ -0,0 +1,54 @@
+//===- critical_path.mlir --------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f chain -m %S/arch.json -o %t.json 2>&1 | FileCheck %s
+
+// The second herd waits on the first one, the critical path runs through
+// the transfers of both herds, on their own tiles, in order.
+
+// CHECK: Finished at time
+// CHECK: queues (busy, stalled, idle):
+// CHECK-DAG: core#{{[0-9]+}} tile (0, 0)
+// CHECK-DAG: core#{{[0-9]+}} tile (1, 0)
+// CHECK: critical path ({{[0-9]+}} entries):
+// CHECK: [{{[0-9]+}}, {{[0-9]+}}] air.dma_memcpy_nd on core#{{[0-9]+}} tile (0, 0)
+// CHECK-NOT: tile (0, 0)
+// CHECK: [{{[0-9]+}}, {{[0-9]+}}] air.dma_memcpy_nd on core#{{[0-9]+}} tile (1, 0)
+// CHECK-NOT: tile (0, 0)
+// CHECK: stalls:
+
+module {
+  func.func @chain(%arg0: memref<256xi32>) {
+    %c1 = arith.constant 1 : index
+    %0 = air.herd async tile (%arg1, %arg2) in (%arg3=%c1, %arg4=%c1) args(%arg5=%arg0) : memref<256xi32> attributes {x_loc = 0 : i64, y_loc = 0 : i64} {
+      %async_token, %results = air.execute -> (memref<256xi32, 2>) {
+        %3 = memref.alloc() : memref<256xi32, 2>
+        air.execute_terminator %3 : memref<256xi32, 2>
+      }
+      %2 = air.dma_memcpy_nd async [%async_token] (%results[] [] [], %arg5[] [] []) : (memref<256xi32, 2>, memref<256xi32>)
+      %async_token_0 = air.execute [%2] {
+        memref.dealloc %results : memref<256xi32, 2>
+        air.execute_terminator
+      }
+      air.herd_terminator
+    }
+    %1 = air.herd async [%0] tile (%arg1, %arg2) in (%arg3=%c1, %arg4=%c1) args(%arg5=%arg0) : memref<256xi32> attributes {x_loc = 1 : i64, y_loc = 0 : i64} {
+      %async_token, %results = air.execute -> (memref<256xi32, 2>) {
+        %3 = memref.alloc() : memref<256xi32, 2>
+        air.execute_terminator %3 : memref<256xi32, 2>
+      }
+      %2 = air.dma_memcpy_nd async [%async_token] (%arg5[] [] [], %results[] [] []) : (memref<256xi32>, memref<256xi32, 2>)
+      %async_token_0 = air.execute [%2] {
+        memref.dealloc %results : memref<256xi32, 2>
+        air.execute_terminator
+      }
+      air.herd_terminator
+    }
+    air.wait_all [%1]
+    return
+  }
+}
@@ -0,0 +1,72 @@
+//===- extrapolate_loops.mlir ----------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f steady -m %S/arch.json -o %t.json 2> %t.full
+// RUN: air-runner %s -f steady -m %S/arch.json -o %t.json -extrapolate-loops 2> %t.ext
+// RUN: cat %t.full %t.ext | FileCheck %s --check-prefix=STEADY
+// RUN: air-runner %s -f contended -m %S/arch.json -o %t.json -extrapolate-loops -max-steady-state-windows=2 2>&1 | FileCheck %s --check-prefix=UNSTEADY
+
+// The iterations of a chain of transfers are periodic from the start. The
+// loop is extrapolated once two windows of iterations agree, and the
+// extrapolated makespan is that of the full simulation.
+
+// STEADY: Finished at time [[TIME:[0-9]+]]
+// STEADY-NOT: extrapolated loops
+// STEADY: Finished at time [[TIME]]
+// STEADY: extrapolated loops (makespan error bound 0 cycles):
+// STEADY-NEXT: 1 instances, {{[0-9]+}} of 64 iterations extrapolated, period {{[0-9]+}} cycles, error bound 0 cycles{{$}}
+
+// The transfers of the loop share the interface from L3 to L1 with a transfer
+// of the herd for the first iterations, which are slower than the later
+// ones. The two windows simulated do not agree, the loop is reported.
+
+// UNSTEADY: Finished at time
+// UNSTEADY: extrapolated loops
+// UNSTEADY-NEXT: 1 instances, 55 of 64 iterations extrapolated, period {{[0-9]+}} cycles, error bound {{[0-9]+}} cycles, 1 instances not steady
+
+module {
+  func.func @steady(%arg0: memref<32xi32>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c64 = arith.constant 64 : index
+    %async_token, %results = air.execute -> (memref<32xi32, 2>) {
+      %1 = memref.alloc() : memref<32xi32, 2>
+      air.execute_terminator %1 : memref<32xi32, 2>
+    }
+    %0 = scf.for %arg1 = %c0 to %c64 step %c1 iter_args(%arg2 = %async_token) -> (!air.async.token) {
+      %1 = air.dma_memcpy_nd async [%arg2] (%results[] [] [], %arg0[] [] []) : (memref<32xi32, 2>, memref<32xi32>)
+      %2 = air.dma_memcpy_nd async [%1] (%arg0[] [] [], %results[] [] []) : (memref<32xi32>, memref<32xi32, 2>)
+      scf.yield %2 : !air.async.token
+    }
+    air.wait_all [%0]
+    return
+  }
+  func.func @contended(%arg0: memref<32xi32>, %arg1: memref<320xi32>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c64 = arith.constant 64 : index
+    %0 = air.herd async tile (%arg2, %arg3) in (%arg4=%c1, %arg5=%c1) args(%arg6=%arg1) : memref<320xi32> {
+      %async_token_0, %results_1 = air.execute -> (memref<320xi32, 2>) {
+        %3 = memref.alloc() : memref<320xi32, 2>
+        air.execute_terminator %3 : memref<320xi32, 2>
+      }
+      %2 = air.dma_memcpy_nd async [%async_token_0] (%results_1[] [] [], %arg6[] [] []) : (memref<320xi32, 2>, memref<320xi32>)
+      air.herd_terminator
+    }
+    %async_token, %results = air.execute -> (memref<32xi32, 2>) {
+      %2 = memref.alloc() : memref<32xi32, 2>
+      air.execute_terminator %2 : memref<32xi32, 2>
+    }
+    %1 = scf.for %arg2 = %c0 to %c64 step %c1 iter_args(%arg3 = %async_token) -> (!air.async.token) {
+      %2 = air.dma_memcpy_nd async [%arg3] (%results[] [] [], %arg0[] [] []) : (memref<32xi32, 2>, memref<32xi32>)
+      %3 = air.dma_memcpy_nd async [%2] (%arg0[] [] [], %results[] [] []) : (memref<32xi32>, memref<32xi32, 2>)
+      scf.yield %3 : !air.async.token
+    }
+    air.wait_all [%0, %1]
+    return
+  }
+}
@@ -0,0 +1,78 @@
+//===- functional_matmul.mlir ----------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f matmul -m %S/arch.json -o %t.json -functional -input=0:%S/Inputs/matmul_a.npy -input=1:%S/Inputs/matmul_b.npy -output=2:%t.npy -reference=2:%S/Inputs/matmul_c.npy 2>&1 | FileCheck %s
+// RUN: cmp %t.npy %S/Inputs/matmul_c.npy
+
+// Each of the two tiles of the herd computes four rows of an 8x8x8 i32
+// matmul from the .npy inputs. The output written back to L3 matches the
+// reference.
+
+// CHECK-NOT: WARNING
+// CHECK: Finished at time
+// CHECK: argument 2: 0 of 64 elements mismatch
+
+#map = affine_map<()[s0] -> (s0 * 4)>
+module {
+  func.func @matmul(%arg0: memref<8x8xi32>, %arg1: memref<8x8xi32>, %arg2: memref<8x8xi32>) {
+    %c1 = arith.constant 1 : index
+    %0 = air.launch async (%arg3, %arg4) in (%arg5=%c1, %arg6=%c1) args(%arg7=%arg0, %arg8=%arg1, %arg9=%arg2) : memref<8x8xi32>, memref<8x8xi32>, memref<8x8xi32> {
+      %1 = air.partition async args(%arg10=%arg7, %arg11=%arg8, %arg12=%arg9) : memref<8x8xi32>, memref<8x8xi32>, memref<8x8xi32> {
+        %c1_0 = arith.constant 1 : index
+        %c2_0 = arith.constant 2 : index
+        %2 = air.herd async tile (%arg13, %arg14) in (%arg15=%c2_0, %arg16=%c1_0) args(%arg17=%arg10, %arg18=%arg11, %arg19=%arg12) : memref<8x8xi32>, memref<8x8xi32>, memref<8x8xi32> {
+          %c0 = arith.constant 0 : index
+          %c1_1 = arith.constant 1 : index
+          %c4 = arith.constant 4 : index
+          %c8 = arith.constant 8 : index
+          %c0_i32 = arith.constant 0 : i32
+          %3 = affine.apply #map()[%arg13]
+          %async_token, %results = air.execute -> (memref<4x8xi32, 2>) {
+            %7 = memref.alloc() : memref<4x8xi32, 2>
+            air.execute_terminator %7 : memref<4x8xi32, 2>
+          }
+          %async_token_2, %results_3 = air.execute -> (memref<8x8xi32, 2>) {
+            %7 = memref.alloc() : memref<8x8xi32, 2>
+            air.execute_terminator %7 : memref<8x8xi32, 2>
+          }
+          %async_token_4, %results_5 = air.execute -> (memref<4x8xi32, 2>) {
+            %7 = memref.alloc() : memref<4x8xi32, 2>
+            air.execute_terminator %7 : memref<4x8xi32, 2>
+          }
+          %4 = air.dma_memcpy_nd async [%async_token] (%results[] [] [], %arg17[%3, %c0] [%c4, %c8] [%c8, %c1_1]) : (memref<4x8xi32, 2>, memref<8x8xi32>)
+          %5 = air.dma_memcpy_nd async [%async_token_2] (%results_3[] [] [], %arg18[] [] []) : (memref<8x8xi32, 2>, memref<8x8xi32>)
+          %async_token_6 = air.execute [%async_token_4] {
+            linalg.fill ins(%c0_i32 : i32) outs(%results_5 : memref<4x8xi32, 2>)
+            air.execute_terminator
+          }
+          %async_token_7 = air.execute [%4, %5, %async_token_6] {
+            linalg.matmul ins(%results, %results_3 : memref<4x8xi32, 2>, memref<8x8xi32, 2>) outs(%results_5 : memref<4x8xi32, 2>)
+            air.execute_terminator
+          }
+          %6 = air.dma_memcpy_nd async [%async_token_7] (%arg19[%3, %c0] [%c4, %c8] [%c8, %c1_1], %results_5[] [] []) : (memref<8x8xi32>, memref<4x8xi32, 2>)
+          %async_token_8 = air.execute [%async_token_7] {
+            memref.dealloc %results : memref<4x8xi32, 2>
+            air.execute_terminator
+          }
+          %async_token_9 = air.execute [%async_token_7] {
+            memref.dealloc %results_3 : memref<8x8xi32, 2>
+            air.execute_terminator
+          }
+          %async_token_10 = air.execute [%6] {
+            memref.dealloc %results_5 : memref<4x8xi32, 2>
+            air.execute_terminator
+          }
+          air.herd_terminator
+        }
+        air.partition_terminator
+      }
+      air.launch_terminator
+    }
+    air.wait_all [%0]
+    return
+  }
+}
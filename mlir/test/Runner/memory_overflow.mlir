@@ -0,0 +1,48 @@
+//===- memory_overflow.mlir ------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f herd -m %S/Inputs/arch_small_l1.json -o %t.json 2>&1 | FileCheck %s
+// RUN: not air-runner %s -f herd -m %S/Inputs/arch_small_l1.json -o %t.json -fail-on-memory-overflow 2>&1 | FileCheck %s --check-prefix=FAIL
+
+// The L1 of a tile holds 1024 bytes. The first buffer of the herd fits, the
+// second one is placed after it and overflows the memory, which is reported
+// once.
+
+// CHECK: WARNING: tile of tile ({{[0-9]+}}, {{[0-9]+}}) needs 1536 bytes at time {{[0-9]+}}, its capacity is 1024 bytes
+// CHECK-NOT: WARNING
+// CHECK: Finished at time
+// CHECK: memory space 2: peak 1536 bytes in tile of tile ({{[0-9]+}}, {{[0-9]+}}) (capacity 1024), 1 memories, worst fragmentation {{[0-9.]+}}%, 1 over capacity
+
+// FAIL: ERROR: tile of tile ({{[0-9]+}}, {{[0-9]+}}) needs 1536 bytes at time {{[0-9]+}}, its capacity is 1024 bytes
+// FAIL-NOT: Finished at time
+
+module {
+  func.func @herd() {
+    %c1 = arith.constant 1 : index
+    %0 = air.herd async tile (%arg0, %arg1) in (%arg2=%c1, %arg3=%c1) {
+      %async_token, %results = air.execute -> (memref<192xi32, 2>) {
+        %2 = memref.alloc() : memref<192xi32, 2>
+        air.execute_terminator %2 : memref<192xi32, 2>
+      }
+      %async_token_0, %results_1 = air.execute [%async_token] -> (memref<192xi32, 2>) {
+        %2 = memref.alloc() : memref<192xi32, 2>
+        air.execute_terminator %2 : memref<192xi32, 2>
+      }
+      %async_token_2 = air.execute [%async_token_0] {
+        memref.dealloc %results : memref<192xi32, 2>
+        air.execute_terminator
+      }
+      %async_token_3 = air.execute [%async_token_0] {
+        memref.dealloc %results_1 : memref<192xi32, 2>
+        air.execute_terminator
+      }
+      air.herd_terminator
+    }
+    air.wait_all [%0]
+    return
+  }
+}
@@ -0,0 +1,62 @@
+//===- parallel_partitions.mlir --------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f graph -m %S/arch_2p.json -o %t.json 2> %t.seq
+// RUN: air-runner %s -f graph -m %S/arch_2p.json -o %t.json -parallel 2> %t.par
+// RUN: cat %t.seq %t.par | FileCheck %s
+
+// The iterations of the launch run on the two partitions of the topology,
+// their transfers share the interface between memory spaces 0 and 2. The
+// parallel simulation runs both partitions in the same lookahead windows.
+// Interactions between the partitions may be delayed to the next window, so
+// the makespans are not compared.
+
+// CHECK-NOT: WARNING
+// CHECK: Finished at time {{[0-9]+}}
+// CHECK-NOT: Parallel simulation
+// CHECK-NOT: WARNING
+// CHECK: Finished at time {{[0-9]+}}
+// CHECK-NEXT: Parallel simulation: {{[0-9]+}} windows, {{[1-9][0-9]*}} with concurrent partitions
+
+module {
+  func.func @graph(%arg0: memref<2048xi32>) {
+    %c1 = arith.constant 1 : index
+    %c2 = arith.constant 2 : index
+    %0 = air.launch async (%arg1, %arg2) in (%arg3=%c2, %arg4=%c1) args(%arg5=%arg0) : memref<2048xi32> {
+      %1 = air.partition async args(%arg6=%arg1, %arg7=%arg5) : index, memref<2048xi32> {
+        %c1_0 = arith.constant 1 : index
+        %c2_0 = arith.constant 2 : index
+        %2 = air.herd async tile (%arg8, %arg9) in (%arg10=%c2_0, %arg11=%c1_0) args(%arg12=%arg6, %arg13=%arg7) : index, memref<2048xi32> {
+          %c512 = arith.constant 512 : index
+          %c1024 = arith.constant 1024 : index
+          %c1_1 = arith.constant 1 : index
+          %c0_i32 = arith.constant 0 : i32
+          %3 = affine.apply affine_map<()[s0, s1] -> (s0 * 1024 + s1 * 512)>()[%arg12, %arg8]
+          %async_token, %results = air.execute -> (memref<512xi32, 2>) {
+            %7 = memref.alloc() : memref<512xi32, 2>
+            air.execute_terminator %7 : memref<512xi32, 2>
+          }
+          %4 = air.dma_memcpy_nd async [%async_token] (%results[] [] [], %arg13[%3] [%c512] [%c1_1]) : (memref<512xi32, 2>, memref<2048xi32>)
+          %async_token_2 = air.execute [%4] {
+            linalg.fill ins(%c0_i32 : i32) outs(%results : memref<512xi32, 2>)
+            air.execute_terminator
+          }
+          %5 = air.dma_memcpy_nd async [%async_token_2] (%arg13[%3] [%c512] [%c1_1], %results[] [] []) : (memref<2048xi32>, memref<512xi32, 2>)
+          %async_token_3 = air.execute [%5] {
+            memref.dealloc %results : memref<512xi32, 2>
+            air.execute_terminator
+          }
+          air.herd_terminator
+        }
+        air.partition_terminator
+      }
+      air.launch_terminator
+    }
+    air.wait_all [%0]
+    return
+  }
+}
@@ -0,0 +1,63 @@
+//===- scf_for_window.mlir -------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f chain -m %S/arch.json -o %t.json -max-live-iterations=1 2> %t.1
+// RUN: air-runner %s -f chain -m %S/arch.json -o %t.json 2> %t.2
+// RUN: cat %t.1 %t.2 | FileCheck %s --check-prefix=CHAIN
+// RUN: air-runner %s -f put_get -m %S/arch.json -o %t.json -max-live-iterations=1 2>&1 | FileCheck %s --check-prefix=PUTGET
+
+// The iterations of an scf.for are scheduled as earlier ones complete. An
+// iteration waiting on the previous one starts at the same time as when every
+// iteration is scheduled ahead.
+
+// CHAIN: Finished at time [[TIME:[0-9]+]]
+// CHAIN: Finished at time [[TIME]]
+
+// The puts of the first loop only complete once the second loop gets them,
+// the iterations of the first loop are released when the simulation stalls.
+
+// PUTGET-NOT: WARNING
+// PUTGET: Finished at time
+
+module {
+  air.channel @channel_0 [1]
+  func.func @chain(%arg0: memref<32xi32>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c16 = arith.constant 16 : index
+    %async_token, %results = air.execute -> (memref<32xi32, 2>) {
+      %1 = memref.alloc() : memref<32xi32, 2>
+      air.execute_terminator %1 : memref<32xi32, 2>
+    }
+    %0 = scf.for %arg1 = %c0 to %c16 step %c1 iter_args(%arg2 = %async_token) -> (!air.async.token) {
+      %1 = air.dma_memcpy_nd async [%arg2] (%results[] [] [], %arg0[] [] []) : (memref<32xi32, 2>, memref<32xi32>)
+      %2 = air.dma_memcpy_nd async [%1] (%arg0[] [] [], %results[] [] []) : (memref<32xi32>, memref<32xi32, 2>)
+      scf.yield %2 : !air.async.token
+    }
+    air.wait_all [%0]
+    return
+  }
+  func.func @put_get(%arg0: memref<32xi32>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c8 = arith.constant 8 : index
+    %async_token, %results = air.execute -> (memref<32xi32, 2>) {
+      %2 = memref.alloc() : memref<32xi32, 2>
+      air.execute_terminator %2 : memref<32xi32, 2>
+    }
+    %0 = scf.for %arg1 = %c0 to %c8 step %c1 iter_args(%arg2 = %async_token) -> (!air.async.token) {
+      %2 = air.channel.put async [%arg2] @channel_0[] (%arg0[] [] []) : (memref<32xi32>)
+      scf.yield %2 : !air.async.token
+    }
+    %1 = scf.for %arg1 = %c0 to %c8 step %c1 iter_args(%arg2 = %async_token) -> (!air.async.token) {
+      %2 = air.channel.get async [%arg2] @channel_0[] (%results[] [] []) : (memref<32xi32, 2>)
+      scf.yield %2 : !air.async.token
+    }
+    air.wait_all [%0, %1]
+    return
+  }
+}
@@ -0,0 +1,53 @@
+//===- shim_bd.mlir --------------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f contiguous -m %S/Inputs/arch_shim_bd.json -o %t.agg -trace-format=aggregate
+// RUN: FileCheck %s --check-prefix=CONTIGUOUS < %t.agg
+// RUN: air-runner %s -f strided -m %S/Inputs/arch_shim_bd.json -o %t.agg -trace-format=aggregate
+// RUN: FileCheck %s --check-prefix=STRIDED < %t.agg
+
+// Both functions move 4096 bytes from L3 at 4 bytes per cycle, 1024 cycles
+// of data. The contiguous transfer is a single buffer descriptor: 10 setup
+// cycles, then 4 + 1024 cycles of DMA.
+
+// CONTIGUOUS: "name": "air.dma_memcpy_nd",
+// CONTIGUOUS: "min": 1038,
+// CONTIGUOUS-NEXT: "max": 1038,
+
+// The strided transfer is 64 descriptors of 64 bytes, 4 + 16 cycles of DMA
+// each. The controller pushes one every 10 cycles until 4 are queued, then
+// polls every 100 cycles while the DMA drains the queue and idles. Without
+// the limit on outstanding descriptors it would take 10 + 64 * 20 cycles.
+
+// STRIDED: "name": "air.dma_memcpy_nd",
+// STRIDED: "min": 1690,
+// STRIDED-NEXT: "max": 1690,
+
+module {
+  func.func @contiguous(%arg0: memref<64x16xi32>) {
+    %async_token, %results = air.execute -> (memref<64x16xi32, 2>) {
+      %1 = memref.alloc() : memref<64x16xi32, 2>
+      air.execute_terminator %1 : memref<64x16xi32, 2>
+    }
+    %0 = air.dma_memcpy_nd async [%async_token] (%results[] [] [], %arg0[] [] []) : (memref<64x16xi32, 2>, memref<64x16xi32>)
+    air.wait_all [%0]
+    return
+  }
+  func.func @strided(%arg0: memref<64x64xi32>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c16 = arith.constant 16 : index
+    %c64 = arith.constant 64 : index
+    %async_token, %results = air.execute -> (memref<64x16xi32, 2>) {
+      %1 = memref.alloc() : memref<64x16xi32, 2>
+      air.execute_terminator %1 : memref<64x16xi32, 2>
+    }
+    %0 = air.dma_memcpy_nd async [%async_token] (%results[] [] [], %arg0[%c0, %c0] [%c64, %c16] [%c64, %c1]) : (memref<64x16xi32, 2>, memref<64x64xi32>)
+    air.wait_all [%0]
+    return
+  }
+}
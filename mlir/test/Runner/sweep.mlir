@@ -0,0 +1,50 @@
+//===- sweep.mlir ----------------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f matmul -m %S/arch.json -o %t.json -sweep-l1-tile-size=16x16x16,32x32x32 | FileCheck %s --check-prefix=TABLE
+// RUN: FileCheck %s --check-prefix=JSON < %t.json
+// RUN: FileCheck %s --check-prefix=PARETO < %t.json
+// RUN: air-runner %s -f matmul -m %S/arch.json -o %t.json -sweep-l1-tile-size=32x32x32 -sweep-pipeline=air-no-such-pass | FileCheck %s --check-prefix=ERROR-TABLE
+// RUN: FileCheck %s --check-prefix=ERROR-JSON < %t.json
+
+// Both points of the grid are lowered and simulated, in grid order. A point
+// no other point dominates is on the Pareto front, and the front of a grid
+// is never empty.
+
+// TABLE: herd {{ *}}l1-tile {{ *}}l2-tile {{ *}}latency {{ *}}peak L1 {{ *}}peak L2 {{ *}}DMA bytes  pareto
+// TABLE-NEXT: - {{ *}}16x16x16 {{ *}}- {{ *}}{{[1-9][0-9]*}} {{ *}}{{[1-9][0-9]*}} {{ *}}{{[0-9]+}} {{ *}}{{[1-9][0-9]*}}
+// TABLE-NEXT: - {{ *}}32x32x32 {{ *}}- {{ *}}{{[1-9][0-9]*}} {{ *}}{{[1-9][0-9]*}} {{ *}}{{[0-9]+}} {{ *}}{{[1-9][0-9]*}}
+
+// JSON: "l1_tile_size": [
+// JSON-NEXT: 16,
+// JSON-NEXT: 16,
+// JSON-NEXT: 16
+// JSON-NEXT: ],
+// JSON-NEXT: "l2_tile_size": [],
+// JSON-NEXT: "latency": {{[1-9][0-9]*}},
+// JSON-NEXT: "peak_l1_bytes": {{[1-9][0-9]*}},
+// JSON-NEXT: "peak_l2_bytes": {{[0-9]+}},
+// JSON-NEXT: "dma_bytes": {{[1-9][0-9]*}},
+// JSON-NEXT: "pareto": {{true|false}}
+// JSON: "l1_tile_size": [
+// JSON-NEXT: 32,
+// JSON: "pareto": {{true|false}}
+// PARETO: "pareto": true
+
+// A point whose pipeline fails reports the error instead of its results, and
+// is not on the front.
+
+// ERROR-TABLE: - {{ *}}32x32x32 {{ *}}- {{ *}}error: pass pipeline '{{.*}}air-no-such-pass' failed
+// ERROR-JSON: "error": "pass pipeline '{{.*}}air-no-such-pass' failed
+// ERROR-JSON-NOT: "pareto"
+
+module {
+  func.func @matmul(%arg0: memref<64x64xi32>, %arg1: memref<64x64xi32>, %arg2: memref<64x64xi32>) {
+    linalg.matmul ins(%arg0, %arg1 : memref<64x64xi32>, memref<64x64xi32>) outs(%arg2 : memref<64x64xi32>)
+    return
+  }
+}
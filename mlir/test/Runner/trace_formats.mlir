@@ -0,0 +1,75 @@
+//===- trace_formats.mlir --------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-runner %s -f copy -m %S/arch.json -o %t.json -trace-format=json
+// RUN: FileCheck %s --check-prefix=JSON < %t.json
+// RUN: air-runner %s -f copy -m %S/arch.json -o %t.agg -trace-format=aggregate
+// RUN: FileCheck %s --check-prefix=AGG < %t.agg
+// RUN: air-runner %s -f copy -m %S/arch.json -o %t.bin -trace-format=binary
+// RUN: head -c 9 %t.bin | od -A n -t x1 | FileCheck %s --check-prefix=BIN-HEADER
+// RUN: tail -c 1 %t.bin | od -A n -t x1 | FileCheck %s --check-prefix=BIN-FOOTER
+// RUN: grep -a -o air.dma_memcpy_nd %t.bin | wc -l | FileCheck %s --check-prefix=ONCE
+// RUN: air-runner %s -f copy -m %S/arch.json -o %t.pb -trace-format=perfetto
+// RUN: head -c 1 %t.pb | od -A n -t x1 | FileCheck %s --check-prefix=PERFETTO
+// RUN: grep -a -o air.dma_memcpy_nd %t.pb | wc -l | FileCheck %s --check-prefix=ONCE
+
+// Each of the four transfers of the loop is a slice on the queue of the
+// function.
+
+// JSON: [
+// JSON: "name": "air.dma_memcpy_nd",
+// JSON-NEXT: "cat": "layer",
+// JSON-NEXT: "ph": "B",
+// JSON: "name": "air.dma_memcpy_nd",
+// JSON-NEXT: "cat": "layer",
+// JSON-NEXT: "ph": "E",
+// JSON: {}]
+
+// The transfers all move 128 bytes at the same bandwidth.
+
+// AGG: [
+// AGG: "name": "air.dma_memcpy_nd",
+// AGG-NEXT: "cat": "layer",
+// AGG-NEXT: "count": 4,
+// AGG-NEXT: "total": {{[0-9]+}},
+// AGG-NEXT: "min": [[DURATION:[0-9]+]],
+// AGG-NEXT: "max": [[DURATION]],
+// AGG-NEXT: "histogram": [
+// AGG-NEXT: [
+// AGG-NEXT: {{[0-9]+}},
+// AGG-NEXT: 4
+// AGG-NEXT: ]
+// AGG-NEXT: ]
+
+// The binary trace starts with the magic and version 1 and ends with the
+// footer record. Event names are interned: each is written once however many
+// events use it, and so are the names of the Perfetto trace, which is a
+// stream of Trace.packet fields.
+
+// BIN-HEADER: 41 49 52 54 52 41 43 45 01{{$}}
+// BIN-FOOTER: 00{{$}}
+// PERFETTO: 0a{{$}}
+// ONCE: {{^ *}}1{{$}}
+
+module {
+  func.func @copy(%arg0: memref<32xi32>) {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c2 = arith.constant 2 : index
+    %async_token, %results = air.execute -> (memref<32xi32, 2>) {
+      %1 = memref.alloc() : memref<32xi32, 2>
+      air.execute_terminator %1 : memref<32xi32, 2>
+    }
+    %0 = scf.for %arg1 = %c0 to %c2 step %c1 iter_args(%arg2 = %async_token) -> (!air.async.token) {
+      %1 = air.dma_memcpy_nd async [%arg2] (%results[] [] [], %arg0[] [] []) : (memref<32xi32, 2>, memref<32xi32>)
+      %2 = air.dma_memcpy_nd async [%1] (%arg0[] [] [], %results[] [] []) : (memref<32xi32>, memref<32xi32, 2>)
+      scf.yield %2 : !air.async.token
+    }
+    air.wait_all [%0]
+    return
+  }
+}
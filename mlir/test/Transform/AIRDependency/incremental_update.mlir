@@ -0,0 +1,132 @@
+//===- incremental_update.mlir ---------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-opt %s -air-dependency -air-test-dependency-update -air-dependency-canonicalize | FileCheck %s
+
+// Each function is traced by air-dependency, then an op is moved, cloned or
+// erased and the deps are updated incrementally. Each reference function is
+// the transformed function traced from scratch: both get the same deps after
+// air-dependency-canonicalize.
+
+// Moving the fill before the dma which writes the same memref
+
+// CHECK-LABEL: func.func @move
+// CHECK: %[[EVENT0:.*]], %[[VALUE0:.*]] = air.execute
+// CHECK-NEXT: memref.alloc
+// CHECK: %[[EVENT1:.*]] = air.execute [%[[EVENT0]]]
+// CHECK-NEXT: linalg.fill
+// CHECK: %[[EVENT2:.*]] = air.dma_memcpy_nd async [%[[EVENT1]]]
+// CHECK: %[[EVENT3:.*]] = air.dma_memcpy_nd async [%[[EVENT2]]]
+// CHECK: air.execute [%[[EVENT3]]]
+// CHECK-NEXT: memref.dealloc
+
+// CHECK-LABEL: func.func @move_ref
+// CHECK: %[[EVENT4:.*]], %[[VALUE1:.*]] = air.execute
+// CHECK-NEXT: memref.alloc
+// CHECK: %[[EVENT5:.*]] = air.execute [%[[EVENT4]]]
+// CHECK-NEXT: linalg.fill
+// CHECK: %[[EVENT6:.*]] = air.dma_memcpy_nd async [%[[EVENT5]]]
+// CHECK: %[[EVENT7:.*]] = air.dma_memcpy_nd async [%[[EVENT6]]]
+// CHECK: air.execute [%[[EVENT7]]]
+// CHECK-NEXT: memref.dealloc
+
+module {
+  func.func @move(%arg0: memref<32xi32>, %arg1: memref<32xi32>) {
+    %c0_i32 = arith.constant 0 : i32
+    %0 = memref.alloc() : memref<32xi32, 2>
+    air.dma_memcpy_nd (%0[] [] [], %arg0[] [] []) {id = 1 : i32} : (memref<32xi32, 2>, memref<32xi32>)
+    linalg.fill {test_move_before} ins(%c0_i32 : i32) outs(%0 : memref<32xi32, 2>)
+    air.dma_memcpy_nd (%arg1[] [] [], %0[] [] []) {id = 2 : i32} : (memref<32xi32>, memref<32xi32, 2>)
+    memref.dealloc %0 : memref<32xi32, 2>
+    return
+  }
+  func.func @move_ref(%arg0: memref<32xi32>, %arg1: memref<32xi32>) {
+    %c0_i32 = arith.constant 0 : i32
+    %0 = memref.alloc() : memref<32xi32, 2>
+    linalg.fill ins(%c0_i32 : i32) outs(%0 : memref<32xi32, 2>)
+    air.dma_memcpy_nd (%0[] [] [], %arg0[] [] []) {id = 3 : i32} : (memref<32xi32, 2>, memref<32xi32>)
+    air.dma_memcpy_nd (%arg1[] [] [], %0[] [] []) {id = 4 : i32} : (memref<32xi32>, memref<32xi32, 2>)
+    memref.dealloc %0 : memref<32xi32, 2>
+    return
+  }
+
+// Cloning a copy which reads and writes the memrefs of its neighbours
+
+// CHECK-LABEL: func.func @create
+// CHECK: %[[EVENT8:.*]], %[[VALUE2:.*]] = air.execute
+// CHECK-NEXT: memref.alloc
+// CHECK: %[[EVENT9:.*]] = air.dma_memcpy_nd async [%[[EVENT8]]]
+// CHECK: %[[EVENT10:.*]] = air.execute [%[[EVENT9]]]
+// CHECK-NEXT: memref.copy
+// CHECK: %[[EVENT11:.*]] = air.execute [%[[EVENT10]]]
+// CHECK-NEXT: memref.copy
+// CHECK: air.execute [%[[EVENT11]]]
+// CHECK-NEXT: memref.dealloc
+
+// CHECK-LABEL: func.func @create_ref
+// CHECK: %[[EVENT12:.*]], %[[VALUE3:.*]] = air.execute
+// CHECK-NEXT: memref.alloc
+// CHECK: %[[EVENT13:.*]] = air.dma_memcpy_nd async [%[[EVENT12]]]
+// CHECK: %[[EVENT14:.*]] = air.execute [%[[EVENT13]]]
+// CHECK-NEXT: memref.copy
+// CHECK: %[[EVENT15:.*]] = air.execute [%[[EVENT14]]]
+// CHECK-NEXT: memref.copy
+// CHECK: air.execute [%[[EVENT15]]]
+// CHECK-NEXT: memref.dealloc
+
+  func.func @create(%arg0: memref<32xi32>, %arg1: memref<32xi32, 2>) {
+    %0 = memref.alloc() : memref<32xi32, 2>
+    air.dma_memcpy_nd (%0[] [] [], %arg0[] [] []) {id = 5 : i32} : (memref<32xi32, 2>, memref<32xi32>)
+    memref.copy %0, %arg1 {test_clone} : memref<32xi32, 2> to memref<32xi32, 2>
+    memref.dealloc %0 : memref<32xi32, 2>
+    return
+  }
+  func.func @create_ref(%arg0: memref<32xi32>, %arg1: memref<32xi32, 2>) {
+    %0 = memref.alloc() : memref<32xi32, 2>
+    air.dma_memcpy_nd (%0[] [] [], %arg0[] [] []) {id = 6 : i32} : (memref<32xi32, 2>, memref<32xi32>)
+    memref.copy %0, %arg1 : memref<32xi32, 2> to memref<32xi32, 2>
+    memref.copy %0, %arg1 : memref<32xi32, 2> to memref<32xi32, 2>
+    memref.dealloc %0 : memref<32xi32, 2>
+    return
+  }
+
+// Erasing the fill between two dmas on the same memref
+
+// CHECK-LABEL: func.func @erase
+// CHECK: %[[EVENT16:.*]], %[[VALUE4:.*]] = air.execute
+// CHECK-NEXT: memref.alloc
+// CHECK: %[[EVENT17:.*]] = air.dma_memcpy_nd async [%[[EVENT16]]]
+// CHECK-NOT: linalg.fill
+// CHECK: %[[EVENT18:.*]] = air.dma_memcpy_nd async [%[[EVENT17]]]
+// CHECK: air.execute [%[[EVENT18]]]
+// CHECK-NEXT: memref.dealloc
+
+// CHECK-LABEL: func.func @erase_ref
+// CHECK: %[[EVENT19:.*]], %[[VALUE5:.*]] = air.execute
+// CHECK-NEXT: memref.alloc
+// CHECK: %[[EVENT20:.*]] = air.dma_memcpy_nd async [%[[EVENT19]]]
+// CHECK: %[[EVENT21:.*]] = air.dma_memcpy_nd async [%[[EVENT20]]]
+// CHECK: air.execute [%[[EVENT21]]]
+// CHECK-NEXT: memref.dealloc
+
+  func.func @erase(%arg0: memref<32xi32>, %arg1: memref<32xi32>) {
+    %c0_i32 = arith.constant 0 : i32
+    %0 = memref.alloc() : memref<32xi32, 2>
+    air.dma_memcpy_nd (%0[] [] [], %arg0[] [] []) {id = 7 : i32} : (memref<32xi32, 2>, memref<32xi32>)
+    linalg.fill {test_erase} ins(%c0_i32 : i32) outs(%0 : memref<32xi32, 2>)
+    air.dma_memcpy_nd (%arg1[] [] [], %0[] [] []) {id = 8 : i32} : (memref<32xi32>, memref<32xi32, 2>)
+    memref.dealloc %0 : memref<32xi32, 2>
+    return
+  }
+  func.func @erase_ref(%arg0: memref<32xi32>, %arg1: memref<32xi32>) {
+    %0 = memref.alloc() : memref<32xi32, 2>
+    air.dma_memcpy_nd (%0[] [] [], %arg0[] [] []) {id = 9 : i32} : (memref<32xi32, 2>, memref<32xi32>)
+    air.dma_memcpy_nd (%arg1[] [] [], %0[] [] []) {id = 10 : i32} : (memref<32xi32>, memref<32xi32, 2>)
+    memref.dealloc %0 : memref<32xi32, 2>
+    return
+  }
+}
@@ -0,0 +1,107 @@
+//===- multiple_funcs.mlir -------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-opt %s -air-dependency | FileCheck %s
+
+// Functions are traced independently: the ids of async ops are numbered across
+// the module, while deps only connect ops within one function. Execute,
+// hierarchy and wait_all ops are numbered separately, in function order.
+
+// CHECK-LABEL: func.func @first
+// CHECK: %[[EVENT0:.*]], %[[VALUE0:.*]] = air.execute{{ *}}-> (memref<32xf32>)
+// CHECK: } {id = 1 : i32}
+// CHECK: %[[EVENT1:.*]] = air.execute [%[[EVENT0]]] {
+// CHECK: } {id = 2 : i32}
+// CHECK: %[[EVENT2:.*]] = air.execute [%[[EVENT1]]] {
+// CHECK: } {id = 3 : i32}
+
+// CHECK-LABEL: func.func @second
+// CHECK: %[[EVENT3:.*]], %[[VALUE1:.*]] = air.execute{{ *}}-> (memref<32xf32>)
+// CHECK: } {id = 4 : i32}
+// CHECK: %[[EVENT4:.*]] = air.execute [%[[EVENT3]]] {
+// CHECK: } {id = 5 : i32}
+// CHECK: %[[EVENT5:.*]] = air.execute [%[[EVENT4]]] {
+// CHECK: } {id = 6 : i32}
+
+// CHECK-LABEL: func.func @third
+// CHECK: air.launch async {{.*}} attributes {id = 2 : i32}
+// CHECK: air.herd async {{.*}} attributes {id = 1 : i32}
+// CHECK: %[[EVENT6:.*]], %[[VALUE2:.*]] = air.execute{{ *}}-> (memref<64xi32, 2>)
+// CHECK: } {id = 7 : i32}
+// CHECK: %[[EVENT7:.*]] = air.wait_all async [%[[EVENT6]]]{{ *}}{id = 2 : i32}
+// CHECK: %[[EVENT8:.*]] = scf.for{{.*}}iter_args(%[[EVENT9:.*]] = %[[EVENT7]])
+// CHECK: %[[EVENT10:.*]] = air.dma_memcpy_nd async [%[[EVENT9]]]
+// CHECK: air.wait_all async [%[[EVENT10]]]{{ *}}{id = 1 : i32}
+// CHECK: air.execute [%[[EVENT8]]] {
+// CHECK: } {id = 8 : i32}
+
+// CHECK-LABEL: func.func @fourth
+// CHECK: air.launch async {{.*}} attributes {id = 4 : i32}
+// CHECK: air.herd async {{.*}} attributes {id = 3 : i32}
+// CHECK: %[[EVENT11:.*]], %[[VALUE3:.*]] = air.execute{{ *}}-> (memref<64xi32, 2>)
+// CHECK: } {id = 9 : i32}
+// CHECK: %[[EVENT12:.*]] = air.wait_all async [%[[EVENT11]]]{{ *}}{id = 4 : i32}
+// CHECK: %[[EVENT13:.*]] = scf.for{{.*}}iter_args(%[[EVENT14:.*]] = %[[EVENT12]])
+// CHECK: %[[EVENT15:.*]] = air.dma_memcpy_nd async [%[[EVENT14]]]
+// CHECK: air.wait_all async [%[[EVENT15]]]{{ *}}{id = 3 : i32}
+// CHECK: air.execute [%[[EVENT13]]] {
+// CHECK: } {id = 10 : i32}
+
+module {
+  func.func @first() {
+    %cst = arith.constant 0.000000e+00 : f32
+    %0 = memref.alloc() : memref<32xf32>
+    linalg.fill ins(%cst : f32) outs(%0 : memref<32xf32>)
+    memref.dealloc %0 : memref<32xf32>
+    return
+  }
+  func.func @second() {
+    %cst = arith.constant 1.000000e+00 : f32
+    %0 = memref.alloc() : memref<32xf32>
+    linalg.fill ins(%cst : f32) outs(%0 : memref<32xf32>)
+    memref.dealloc %0 : memref<32xf32>
+    return
+  }
+  func.func @third(%arg0: memref<64xi32>) {
+    %c1 = arith.constant 1 : index
+    air.launch (%arg1, %arg2) in (%arg3=%c1, %arg4=%c1) args(%arg5=%arg0) : memref<64xi32> {
+      %c1_0 = arith.constant 1 : index
+      air.herd tile (%arg6, %arg7) in (%arg8=%c1_0, %arg9=%c1_0) args(%arg10=%arg5) : memref<64xi32> {
+        %c0 = arith.constant 0 : index
+        %c1_1 = arith.constant 1 : index
+        %c2 = arith.constant 2 : index
+        %0 = memref.alloc() : memref<64xi32, 2>
+        scf.for %arg11 = %c0 to %c2 step %c1_1 {
+          air.dma_memcpy_nd (%0[] [] [], %arg10[] [] []) : (memref<64xi32, 2>, memref<64xi32>)
+        }
+        memref.dealloc %0 : memref<64xi32, 2>
+        air.herd_terminator
+      }
+      air.launch_terminator
+    }
+    return
+  }
+  func.func @fourth(%arg0: memref<64xi32>) {
+    %c1 = arith.constant 1 : index
+    air.launch (%arg1, %arg2) in (%arg3=%c1, %arg4=%c1) args(%arg5=%arg0) : memref<64xi32> {
+      %c1_0 = arith.constant 1 : index
+      air.herd tile (%arg6, %arg7) in (%arg8=%c1_0, %arg9=%c1_0) args(%arg10=%arg5) : memref<64xi32> {
+        %c0 = arith.constant 0 : index
+        %c1_1 = arith.constant 1 : index
+        %c2 = arith.constant 2 : index
+        %0 = memref.alloc() : memref<64xi32, 2>
+        scf.for %arg11 = %c0 to %c2 step %c1_1 {
+          air.dma_memcpy_nd (%0[] [] [], %arg10[] [] []) : (memref<64xi32, 2>, memref<64xi32>)
+        }
+        memref.dealloc %0 : memref<64xi32, 2>
+        air.herd_terminator
+      }
+      air.launch_terminator
+    }
+    return
+  }
+}
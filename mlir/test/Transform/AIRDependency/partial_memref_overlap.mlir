@@ -0,0 +1,96 @@
+//===- partial_memref_overlap.mlir -----------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-opt %s -air-dependency | FileCheck %s
+
+// Dependency tracing compares the element ranges of partial memrefs: disjoint
+// tiles are independent, while equal offsets computed by different ops are
+// detected as overlapping.
+
+// CHECK-LABEL: func.func @partial_memref_overlap
+// CHECK: %[[EVENT0:.*]] = air.dma_memcpy_nd async [
+// CHECK-NOT: %[[EVENT1:.*]] = air.dma_memcpy_nd async [{{.*}}%[[EVENT0]]
+// CHECK: %[[EVENT2:.*]] = air.dma_memcpy_nd async [{{.*}}%[[EVENT0]]
+// CHECK: air.herd_terminator
+
+// A memref.subview is a tile of its source with the sizes of the subview: the
+// fill of [32 * i + 16, 32 * i + 48) depends on the dma of [32 * i, 32 * i + 32).
+
+// CHECK-LABEL: func.func @subview_overlap
+// CHECK: %[[EVENT3:.*]] = air.dma_memcpy_nd async [
+// CHECK: memref.subview
+// CHECK: air.execute [{{.*}}%[[EVENT3]]
+// CHECK-NEXT: linalg.fill
+// CHECK: air.herd_terminator
+
+// Tiles with more dims than the memref are compared element by element
+// through their strides; a tile without known extents overlaps any other.
+
+// CHECK-LABEL: func.func @nd_dma_more_dims
+// CHECK: %[[EVENT4:.*]] = air.dma_memcpy_nd async [
+// CHECK-NOT: %[[EVENT5:.*]] = air.dma_memcpy_nd async [{{.*}}%[[EVENT4]]
+// CHECK: %[[EVENT6:.*]] = air.dma_memcpy_nd async [{{.*}}%[[EVENT4]]
+// CHECK: air.execute [{{.*}}%[[EVENT6]]
+// CHECK-NEXT: memref.dealloc
+
+#map0 = affine_map<()[s0] -> (s0 * 32)>
+#map1 = affine_map<()[s0] -> (s0 * 32 + 16)>
+module {
+  func.func @partial_memref_overlap() {
+    %c4 = arith.constant 4 : index
+    %c1 = arith.constant 1 : index
+    %0 = memref.alloc() : memref<128xf32, 2>
+    air.herd @herd_0  tile (%arg0, %arg1) in (%arg2=%c4, %arg3=%c1) args(%arg4=%0) : memref<128xf32, 2> {
+      %c1_0 = arith.constant 1 : index
+      %c16 = arith.constant 16 : index
+      %1 = affine.apply #map0()[%arg0]
+      %2 = affine.apply #map1()[%arg0]
+      %3 = affine.apply #map0()[%arg0]
+      %4 = memref.alloc() : memref<128xf32, 2>
+      air.dma_memcpy_nd (%4[%1] [%c16] [%c1_0], %arg4[%1] [%c16] [%c1_0]) {id = 1 : i32} : (memref<128xf32, 2>, memref<128xf32, 2>)
+      air.dma_memcpy_nd (%4[%2] [%c16] [%c1_0], %arg4[%2] [%c16] [%c1_0]) {id = 2 : i32} : (memref<128xf32, 2>, memref<128xf32, 2>)
+      air.dma_memcpy_nd (%4[%3] [%c16] [%c1_0], %arg4[%3] [%c16] [%c1_0]) {id = 3 : i32} : (memref<128xf32, 2>, memref<128xf32, 2>)
+      air.herd_terminator
+    }
+    return
+  }
+
+  func.func @subview_overlap() {
+    %c4 = arith.constant 4 : index
+    %c1 = arith.constant 1 : index
+    %0 = memref.alloc() : memref<128xf32>
+    air.herd @herd_0  tile (%arg0, %arg1) in (%arg2=%c4, %arg3=%c1) args(%arg4=%0) : memref<128xf32> {
+      %c1_0 = arith.constant 1 : index
+      %c32 = arith.constant 32 : index
+      %cst = arith.constant 0.000000e+00 : f32
+      %1 = affine.apply #map0()[%arg0]
+      %2 = affine.apply #map1()[%arg0]
+      %3 = memref.alloc() : memref<160xf32, 2>
+      air.dma_memcpy_nd (%3[%1] [%c32] [%c1_0], %arg4[%1] [%c32] [%c1_0]) {id = 4 : i32} : (memref<160xf32, 2>, memref<128xf32>)
+      %4 = memref.subview %3[%2] [32] [1] : memref<160xf32, 2> to memref<32xf32, strided<[1], offset: ?>, 2>
+      linalg.fill ins(%cst : f32) outs(%4 : memref<32xf32, strided<[1], offset: ?>, 2>)
+      air.herd_terminator
+    }
+    return
+  }
+
+  func.func @nd_dma_more_dims() {
+    %c0 = arith.constant 0 : index
+    %c1 = arith.constant 1 : index
+    %c2 = arith.constant 2 : index
+    %c32 = arith.constant 32 : index
+    %c64 = arith.constant 64 : index
+    %0 = memref.alloc() : memref<128xf32>
+    %1 = memref.alloc() : memref<128xf32, 2>
+    %2 = memref.alloc() : memref<128xf32>
+    air.dma_memcpy_nd (%1[%c0, %c0] [%c2, %c32] [%c32, %c1], %0[%c0] [%c64] [%c1]) {id = 5 : i32} : (memref<128xf32, 2>, memref<128xf32>)
+    air.dma_memcpy_nd (%2[%c0] [%c32] [%c1], %1[%c64] [%c32] [%c1]) {id = 6 : i32} : (memref<128xf32>, memref<128xf32, 2>)
+    air.dma_memcpy_nd (%2[%c64] [%c32] [%c1], %1[%c32] [%c32] [%c1]) {id = 7 : i32} : (memref<128xf32>, memref<128xf32, 2>)
+    memref.dealloc %1 : memref<128xf32, 2>
+    return
+  }
+}
@@ -0,0 +1,35 @@
+//===- transitive_reduction.mlir -------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-opt %s -air-dependency | FileCheck %s
+
+// Every op after the alloc touches the buffer, so the traced graph has an
+// edge from the alloc to each of them and from the fill to both transfers
+// and the dealloc. The transitive reduction keeps only the diamond: the
+// transfers depend on the fill alone, and the dealloc on the two transfers,
+// in the order of the transfers.
+
+// CHECK-LABEL: func.func @diamond
+// CHECK: %[[ALLOC:[^ ,]+]], %{{[^ ]+}} = air.execute -> (memref<32xi32, 1>)
+// CHECK: %[[FILL:[^ ]+]] = air.execute [%[[ALLOC]]] {
+// CHECK-NEXT: linalg.fill
+// CHECK: %[[DMA0:[^ ]+]] = air.dma_memcpy_nd async [%[[FILL]]] (%arg0
+// CHECK: %[[DMA1:[^ ]+]] = air.dma_memcpy_nd async [%[[FILL]]] (%arg1
+// CHECK: air.execute [%[[DMA0]], %[[DMA1]]] {
+// CHECK-NEXT: memref.dealloc
+
+module {
+  func.func @diamond(%arg0: memref<32xi32>, %arg1: memref<32xi32>) {
+    %c0_i32 = arith.constant 0 : i32
+    %0 = memref.alloc() : memref<32xi32, 1>
+    linalg.fill ins(%c0_i32 : i32) outs(%0 : memref<32xi32, 1>)
+    air.dma_memcpy_nd (%arg0[] [] [], %0[] [] []) {id = 1 : i32} : (memref<32xi32>, memref<32xi32, 1>)
+    air.dma_memcpy_nd (%arg1[] [] [], %0[] [] []) {id = 2 : i32} : (memref<32xi32>, memref<32xi32, 1>)
+    memref.dealloc %0 : memref<32xi32, 1>
+    return
+  }
+}
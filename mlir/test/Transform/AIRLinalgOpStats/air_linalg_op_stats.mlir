@@ -0,0 +1,57 @@
+//===- air_linalg_op_stats.mlir --------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-opt %s -air-linalg-op-stats | FileCheck %s
+
+// The two matmuls of @same have the same counts, the second one from the
+// memoized counts of the first. The matmul of @smaller differs only in its
+// operand types and is counted on its own. Counting the ops does not modify
+// the IR.
+
+// CHECK: "same": {
+// CHECK: "linalg.matmul{{[0-9]+}}": {
+// CHECK-NEXT: "arith.addi": 32768,
+// CHECK-NEXT: "arith.muli": 32768,
+// CHECK-NEXT: "footprint": 12288,
+// CHECK-NEXT: "reads": 98304,
+// CHECK-NEXT: "writes": 32768
+// CHECK-NEXT: },
+// CHECK-NEXT: "linalg.matmul{{[0-9]+}}": {
+// CHECK-NEXT: "arith.addi": 32768,
+// CHECK-NEXT: "arith.muli": 32768,
+// CHECK-NEXT: "footprint": 12288,
+// CHECK-NEXT: "reads": 98304,
+// CHECK-NEXT: "writes": 32768
+// CHECK-NEXT: },
+// CHECK: "smaller": {
+// CHECK: "linalg.matmul{{[0-9]+}}": {
+// CHECK-NEXT: "arith.addi": 4096,
+// CHECK-NEXT: "arith.muli": 4096,
+// CHECK-NEXT: "footprint": 3072,
+// CHECK-NEXT: "reads": 12288,
+// CHECK-NEXT: "writes": 4096
+// CHECK-NEXT: },
+
+// CHECK-LABEL: func.func @same
+// CHECK-NEXT: linalg.matmul
+// CHECK-NEXT: linalg.matmul
+// CHECK-NEXT: return
+// CHECK-LABEL: func.func @smaller
+// CHECK-NEXT: linalg.matmul
+// CHECK-NEXT: return
+
+module {
+  func.func @same(%arg0: memref<32x32xi32>, %arg1: memref<32x32xi32>, %arg2: memref<32x32xi32>) {
+    linalg.matmul ins(%arg0, %arg1 : memref<32x32xi32>, memref<32x32xi32>) outs(%arg2 : memref<32x32xi32>)
+    linalg.matmul ins(%arg0, %arg1 : memref<32x32xi32>, memref<32x32xi32>) outs(%arg2 : memref<32x32xi32>)
+    return
+  }
+  func.func @smaller(%arg0: memref<16x16xi32>, %arg1: memref<16x16xi32>, %arg2: memref<16x16xi32>) {
+    linalg.matmul ins(%arg0, %arg1 : memref<16x16xi32>, memref<16x16xi32>) outs(%arg2 : memref<16x16xi32>)
+    return
+  }
+}
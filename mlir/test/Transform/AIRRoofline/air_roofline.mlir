@@ -0,0 +1,70 @@
+//===- air_roofline.mlir ---------------------------------------*- MLIR -*-===//
+//
+// Copyright (C) 2022, Xilinx Inc. All rights reserved.
+// Copyright (C) 2022, Advanced Micro Devices, Inc. All rights reserved.
+// SPDX-License-Identifier: MIT
+//
+//===----------------------------------------------------------------------===//
+
+// RUN: air-opt %s -air-roofline="arch=%S/arch.json format=csv" | FileCheck %s
+// RUN: air-opt %s -air-roofline="arch=%S/arch.json" | FileCheck %s --check-prefix=JSON
+// RUN: air-opt %s -air-roofline="format=csv" | FileCheck %s --check-prefix=NOARCH
+
+// The herd does 2 iterations of a 32x32x32 matmul on each of its 4 tiles. The
+// i32 matmul is limited by the 4 i32 MACs per cycle of a tile, 8192 cycles,
+// so each tile computes for 2 x 8192 cycles. Moving the inputs from L3 to L2
+// takes longer.
+// CHECK: kind,name,parent,count,static,ops,operand_bytes,peak_ops_per_cycle,compute_cycles,src,dst,bytes,intensity,bytes_per_cycle,ridge,transfer_cycles,bound,cycles
+// CHECK: func,forward,,1,1,524288,,32,16384,L3,L2,32768,16,1,32,32768,L3->L2,32768
+// CHECK: func,forward,,1,1,524288,,32,16384,L2,L1,98304,5.333,16,2,6144,L3->L2,32768
+// CHECK: func,forward,,1,1,524288,,32,16384,L1,L2,32768,16,16,2,2048,L3->L2,32768
+// CHECK: herd,herd_0,forward,1,1,524288,,32,16384,L2,L1,98304,5.333,16,2,6144,compute,16384
+// CHECK: herd,herd_0,forward,1,1,524288,,32,16384,L1,L2,32768,16,16,2,2048,compute,16384
+// CHECK: linalg,linalg.matmul_0,herd_0,8,1,65536,12288,8,8192,,,,5.333,,,,compute,8192
+
+// JSON: "arch": "testdevice"
+// JSON: "bound": "L3->L2"
+// JSON: "kind": "func"
+// JSON: "bound": "compute"
+// JSON: "kind": "herd"
+// JSON: "name": "herd_0"
+
+// NOARCH: func,forward,,1,1,524288,,,,L3,L2,32768,16,,,,,
+// NOARCH: linalg,linalg.matmul_0,herd_0,8,1,65536,12288,,,,,,5.333,,,,,
+
+module {
+  func.func @forward(%arg0: memref<64x64xi32>, %arg1: memref<64x64xi32>, %arg2: memref<64x64xi32>) {
+    %c2 = arith.constant 2 : index
+    %c0 = arith.constant 0 : index
+    %c64 = arith.constant 64 : index
+    %c1 = arith.constant 1 : index
+    %0 = memref.alloc() : memref<64x64xi32, 1>
+    %1 = memref.alloc() : memref<64x64xi32, 1>
+    %2 = memref.alloc() : memref<64x64xi32, 1>
+    air.dma_memcpy_nd (%0[] [] [], %arg0[%c0, %c0] [%c64, %c64] [%c64, %c1]) {id = 1 : i32} : (memref<64x64xi32, 1>, memref<64x64xi32>)
+    air.dma_memcpy_nd (%1[] [] [], %arg1[%c0, %c0] [%c64, %c64] [%c64, %c1]) {id = 2 : i32} : (memref<64x64xi32, 1>, memref<64x64xi32>)
+    air.herd tile (%arg3, %arg4) in (%arg5=%c2, %arg6=%c2) args(%arg7=%0, %arg8=%1, %arg9=%2) : memref<64x64xi32, 1>,memref<64x64xi32, 1>,memref<64x64xi32, 1> attributes {sym_name = "herd_0"} {
+      %c32 = arith.constant 32 : index
+      %c0_0 = arith.constant 0 : index
+      %c64_1 = arith.constant 64 : index
+      %c1_2 = arith.constant 1 : index
+      %3 = arith.muli %arg3, %c32 : index
+      %4 = arith.muli %arg4, %c32 : index
+      scf.for %arg10 = %c0_0 to %c64_1 step %c32 {
+        %5 = memref.alloc() : memref<32x32xi32, 2>
+        %6 = memref.alloc() : memref<32x32xi32, 2>
+        %7 = memref.alloc() : memref<32x32xi32, 2>
+        air.dma_memcpy_nd (%5[] [] [], %arg7[%3, %arg10] [%c32, %c32] [%c64_1, %c1_2]) {id = 3 : i32} : (memref<32x32xi32, 2>, memref<64x64xi32, 1>)
+        air.dma_memcpy_nd (%6[] [] [], %arg8[%arg10, %4] [%c32, %c32] [%c64_1, %c1_2]) {id = 4 : i32} : (memref<32x32xi32, 2>, memref<64x64xi32, 1>)
+        air.dma_memcpy_nd (%7[] [] [], %arg9[%3, %4] [%c32, %c32] [%c64_1, %c1_2]) {id = 5 : i32} : (memref<32x32xi32, 2>, memref<64x64xi32, 1>)
+        linalg.matmul ins(%5, %6 : memref<32x32xi32, 2>, memref<32x32xi32, 2>) outs(%7 : memref<32x32xi32, 2>)
+        air.dma_memcpy_nd (%arg9[%3, %4] [%c32, %c32] [%c64_1, %c1_2], %7[] [] []) {id = 6 : i32} : (memref<64x64xi32, 1>, memref<32x32xi32, 2>)
+        memref.dealloc %5 : memref<32x32xi32, 2>
+        memref.dealloc %6 : memref<32x32xi32, 2>
+        memref.dealloc %7 : memref<32x32xi32, 2>
+      }
+      air.herd_terminator
+    }
+    return
+  }
+}
@@ -56,7 +56,7 @@ llvm_config.with_environment('PATH', config.llvm_tools_dir, append_path=True)
 
 tool_dirs = [config.air_tools_dir, config.llvm_tools_dir]
 tools = [
-    'air-opt', 'air-translate'
+    'air-opt', 'air-runner', 'air-translate'
 ]
 
 llvm_config.add_tool_substitutions(tools, tool_dirs)
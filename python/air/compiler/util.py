@@ -60,15 +60,7 @@ class Runner:
         self.trace_filename = trace_filename
         self.verbose = verbose
 
-    def run(self, module, function):
-        air_module = _convert_module(module)
-
-        trace_tmpfile = None
-        trace_filename = self.trace_filename
-        if trace_filename is None:
-            trace_tmpfile = tempfile.NamedTemporaryFile(delete=False)
-            trace_filename = trace_tmpfile.name
-        
+    def _load_json_model(self):
         # the json model can be:
         #  1. json in string form
         #  2. json in python object form
@@ -80,6 +72,28 @@ class Runner:
                     json_model = json.loads(f.read())
             else:
                 json_model = json.loads(json_model)
+        return json_model
+
+    def simulate(self, module, function, record_ops=True):
+        """Simulate function and return a runner.Results object with the
+        makespan, memory peaks and, if record_ops is set, the op names and
+        numpy arrays of their start and end times. No trace is written and
+        the GIL is released while simulating, so independent simulations can
+        run from a thread pool."""
+        air_module = _convert_module(module)
+        return runner.simulate(air_module, self._load_json_model(), function,
+                               record_ops)
+
+    def run(self, module, function):
+        air_module = _convert_module(module)
+
+        trace_tmpfile = None
+        trace_filename = self.trace_filename
+        if trace_filename is None:
+            trace_tmpfile = tempfile.NamedTemporaryFile(delete=False)
+            trace_filename = trace_tmpfile.name
+        
+        json_model = self._load_json_model()
 
         json_tmpfile = tempfile.NamedTemporaryFile(delete=False)
         json_tmpfile.write(str.encode(json.dumps(json_model)))
@@ -7,21 +7,34 @@
 //===----------------------------------------------------------------------===//
 
 #include "air/Dialect/AIR/AIRDialect.h"
+#include "air/Util/Calibration.h"
+#include "air/Util/Npy.h"
 #include "air/Util/Runner.h"
 #include "air/InitAll.h"
 
 #include "mlir/InitAllDialects.h"
 #include "mlir/Parser/Parser.h"
+#include "mlir/Pass/PassManager.h"
+#include "mlir/Pass/PassRegistry.h"
 #include "mlir/Support/FileUtilities.h"
 #include "mlir/Support/LogicalResult.h"
+#include "mlir/Transforms/Passes.h"
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/ToolOutputFile.h"
 
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
 #include <vector>
 
 #define DEBUG_TYPE "air-runner"
@@ -32,6 +45,412 @@ using namespace mlir;
 
 namespace {
 
+// A point of a design-space sweep: the air-linalg-codegen tiling options and
+// the simulation results of the module lowered with them. Empty options are
+// left at their pass defaults.
+struct SweepPoint {
+  SmallVector<unsigned, 3> herdSize;
+  SmallVector<unsigned, 3> l1TileSize;
+  SmallVector<unsigned, 3> l2TileSize;
+  xilinx::air::AIRRunnerResults results;
+  std::string error;
+  bool pareto = false;
+
+  uint64_t getLatency() const { return results.makespan; }
+  uint64_t getPeakL1() const {
+    return results.getPeakBytes((unsigned)xilinx::air::MemorySpace::L1);
+  }
+  uint64_t getPeakL2() const {
+    return results.getPeakBytes((unsigned)xilinx::air::MemorySpace::L2);
+  }
+  uint64_t getDmaBytes() const { return results.dmaBytes; }
+
+  // true if this point is no worse than `p` in every metric and better in
+  // at least one
+  bool dominates(const SweepPoint &p) const {
+    uint64_t a[] = {getLatency(), getPeakL1(), getPeakL2(), getDmaBytes()};
+    uint64_t b[] = {p.getLatency(), p.getPeakL1(), p.getPeakL2(),
+                    p.getDmaBytes()};
+    bool better = false;
+    for (unsigned i = 0; i < 4; i++) {
+      if (a[i] > b[i])
+        return false;
+      better |= a[i] < b[i];
+    }
+    return better;
+  }
+};
+
+// Parse the sizes of a sweep grid, e.g. "2x2,4x4" gives {2, 2} and {4, 4}.
+// An empty list gives a single empty size which keeps the pass default.
+bool parseSweepSizes(ArrayRef<std::string> list,
+                     std::vector<SmallVector<unsigned, 3>> &sizes) {
+  sizes.clear();
+  for (auto &str : list) {
+    SmallVector<StringRef, 3> dims;
+    StringRef(str).split(dims, 'x');
+    SmallVector<unsigned, 3> size;
+    for (auto d : dims) {
+      unsigned v;
+      if (d.getAsInteger(10, v)) {
+        llvm::errs() << "invalid sweep size '" << str << "'\n";
+        return false;
+      }
+      size.push_back(v);
+    }
+    sizes.push_back(size);
+  }
+  if (sizes.empty())
+    sizes.emplace_back();
+  return true;
+}
+
+// Parse arguments of the form "<argument>:<file>", e.g. "0:a.npy", into
+// files keyed by argument position.
+bool parseArgumentFiles(ArrayRef<std::string> list,
+                        std::map<unsigned, std::string> &files) {
+  for (auto &str : list) {
+    StringRef index, file;
+    std::tie(index, file) = StringRef(str).split(':');
+    unsigned i;
+    if (index.getAsInteger(10, i) || file.empty()) {
+      llvm::errs() << "invalid argument file '" << str
+                   << "', expected <argument>:<file>\n";
+      return false;
+    }
+    files[i] = file.str();
+  }
+  return true;
+}
+
+// Compare the output `actual` of argument `index` to `reference` element by
+// element: an element matches if |actual - reference| <= atol + rtol *
+// |reference|. Print a line per argument and return the number of elements
+// which do not match.
+uint64_t compareWithReference(unsigned index,
+                              const xilinx::air::NpyArray &actual,
+                              const xilinx::air::NpyArray &reference,
+                              double rtol, double atol, raw_ostream &os) {
+  uint64_t n = actual.getNumElements();
+  if (n != reference.getNumElements()) {
+    os << "argument " << index << ": " << n
+       << " elements, reference has " << reference.getNumElements() << "\n";
+    return std::max(n, reference.getNumElements());
+  }
+  uint64_t mismatches = 0, first = 0;
+  double maxError = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    double a = actual.getFloat(i), r = reference.getFloat(i);
+    double error = std::abs(a - r);
+    if (!(error <= atol + rtol * std::abs(r))) {
+      if (!mismatches)
+        first = i;
+      mismatches++;
+    }
+    if (!(error <= maxError))
+      maxError = error;
+  }
+  os << llvm::format("argument %u: %llu of %llu elements mismatch, max abs "
+                     "error %g",
+                     index, (unsigned long long)mismatches,
+                     (unsigned long long)n, maxError);
+  if (mismatches)
+    os << llvm::format(", first at %llu: %g, expected %g",
+                       (unsigned long long)first, actual.getFloat(first),
+                       reference.getFloat(first));
+  os << "\n";
+  return mismatches;
+}
+
+std::string formatSizes(ArrayRef<unsigned> size, char sep) {
+  if (size.empty())
+    return "-";
+  std::string str;
+  for (auto s : llvm::enumerate(size)) {
+    if (s.index())
+      str += sep;
+    str += std::to_string(s.value());
+  }
+  return str;
+}
+
+// Lower the module in `source` with air-linalg-codegen configured by `point`
+// followed by `pipeline`, then simulate function `function` of the result.
+void runSweepPoint(SweepPoint &point, StringRef source,
+                   const DialectRegistry &registry, StringRef pipeline,
+                   StringRef function, const xilinx::air::ArchModel &arch) {
+  MLIRContext context(registry, MLIRContext::Threading::DISABLED);
+  llvm::SourceMgr sourceMgr;
+  sourceMgr.AddNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(source, "sweep"), llvm::SMLoc());
+  auto module = parseSourceFile<ModuleOp>(sourceMgr, &context);
+  if (!module) {
+    point.error = "failed to parse the input";
+    return;
+  }
+
+  std::string codegen = "air-linalg-codegen{";
+  if (point.herdSize.size())
+    codegen += " herd-size=" + formatSizes(point.herdSize, ',');
+  if (point.l1TileSize.size())
+    codegen += " l1-tile-size=" + formatSizes(point.l1TileSize, ',');
+  if (point.l2TileSize.size())
+    codegen += " l2-tile-size=" + formatSizes(point.l2TileSize, ',');
+  codegen += "}";
+  if (pipeline.size())
+    codegen += "," + pipeline.str();
+
+  std::string errors;
+  llvm::raw_string_ostream errorStream(errors);
+  PassManager pm(&context);
+  if (failed(parsePassPipeline(codegen, pm, errorStream)) ||
+      failed(pm.run(*module))) {
+    point.error = "pass pipeline '" + codegen + "' failed";
+    if (errorStream.str().size())
+      point.error += ": " + errorStream.str();
+    return;
+  }
+
+  auto toplevel = module->lookupSymbol<func::FuncOp>(function);
+  if (!toplevel) {
+    point.error = "function '" + function.str() + "' not found";
+    return;
+  }
+  // only the results are wanted, the aggregate sink produces no events
+  xilinx::air::AIRRunnerOptions options;
+  options.traceFormat = xilinx::air::TraceFormat::Aggregate;
+  xilinx::air::AIRRunner runner(llvm::nulls(), arch, options);
+  if (failed(runner.scheduleFunction(toplevel))) {
+    point.error = "simulation of '" + function.str() + "' failed";
+    return;
+  }
+  point.results = runner.getResults();
+}
+
+// Print the fullest memory of each memory space, the worst fragmentation and
+// the memories which did not fit their capacity.
+void printMemoryReport(const xilinx::air::AIRRunnerResults &results,
+                       raw_ostream &os) {
+  std::map<unsigned, std::vector<const xilinx::air::AIRRunnerResults::Memory *>>
+      spaces;
+  for (auto &m : results.memories)
+    spaces[m.space].push_back(&m);
+  for (auto &s : spaces) {
+    auto &mems = s.second;
+    auto *fullest = *std::max_element(
+        mems.begin(), mems.end(),
+        [](auto *a, auto *b) { return a->peakBytes < b->peakBytes; });
+    double fragmentation = 0;
+    unsigned overflows = 0;
+    for (auto *m : mems) {
+      fragmentation = std::max(fragmentation, m->getFragmentation());
+      if (m->capacity && m->highWater > m->capacity)
+        overflows++;
+    }
+    os << "memory space " << s.first << ": peak " << fullest->peakBytes
+       << " bytes in " << fullest->name;
+    if (fullest->capacity)
+      os << " (capacity " << fullest->capacity << ")";
+    os << ", " << mems.size() << " memories, worst fragmentation "
+       << llvm::format("%.1f%%", 100 * fragmentation);
+    if (overflows)
+      os << ", " << overflows << " over capacity";
+    os << "\n";
+  }
+}
+
+// Print the busy, stall and idle time of every active queue, the critical
+// path with consecutive steps of the same op on the same queue merged, and
+// the `numStalls` largest stall causes.
+void printBottleneckReport(const xilinx::air::AIRRunnerResults &results,
+                           unsigned numStalls, raw_ostream &os) {
+  auto percent = [&](uint64_t cycles) {
+    return llvm::format("%5.1f%%", results.makespan
+                                       ? 100.0 * cycles / results.makespan
+                                       : 0.0);
+  };
+
+  auto queues = results.queues;
+  llvm::stable_sort(queues, [](auto &a, auto &b) {
+    return a.busyCycles > b.busyCycles;
+  });
+  os << "queues (busy, stalled, idle):\n";
+  for (auto &q : queues) {
+    uint64_t active = q.busyCycles + q.stallCycles;
+    os << "  " << percent(q.busyCycles) << " " << percent(q.stallCycles) << " "
+       << percent(results.makespan > active ? results.makespan - active : 0)
+       << "  " << q.name << "\n";
+  }
+
+  auto &path = results.criticalPath;
+  os << "critical path (" << path.size() << " entries):\n";
+  for (size_t i = 0; i < path.size();) {
+    size_t j = i + 1;
+    while (j < path.size() && path[j].op == path[i].op &&
+           path[j].queue == path[i].queue)
+      j++;
+    os << "  [" << path[i].start << ", " << path[j - 1].end << "] "
+       << path[i].op;
+    if (j - i > 1)
+      os << " x" << j - i;
+    os << " on " << path[i].queue << "\n";
+    i = j;
+  }
+
+  os << "stalls:\n";
+  for (auto &s : llvm::make_range(
+           results.stalls.begin(),
+           results.stalls.begin() +
+               std::min<size_t>(numStalls, results.stalls.size())))
+    os << "  " << s.cycles << " cycles in " << s.count << " stalls of "
+       << s.op << " waiting on " << s.cause << "\n";
+}
+
+// Print the extrapolated loops and the error bound of the makespan.
+void printExtrapolationReport(const xilinx::air::AIRRunnerResults &results,
+                              raw_ostream &os) {
+  if (results.loops.empty())
+    return;
+  os << "extrapolated loops (makespan error bound "
+     << results.extrapolationErrorBound << " cycles):\n";
+  for (auto &l : results.loops) {
+    os << "  " << l.loc << ": " << l.instances << " instances, "
+       << l.extrapolatedIterations << " of "
+       << l.simulatedIterations + l.extrapolatedIterations
+       << " iterations extrapolated, period " << l.period
+       << " cycles, error bound " << l.maxErrorBound << " cycles";
+    if (l.unsteady)
+      os << ", " << l.unsteady << " instances not steady";
+    os << "\n";
+  }
+}
+
+void printCalibrationReport(const xilinx::air::CalibrationResult &result,
+                            raw_ostream &os) {
+  os << "calibrated from " << result.numSamples
+     << " measurements, rms error "
+     << llvm::format("%.1f", result.rmsBefore) << " -> "
+     << llvm::format("%.1f", result.rmsAfter) << " cycles:\n";
+  for (auto &p : result.parameters) {
+    os << "  " << p.name << ": " << llvm::format("%g", p.before) << " -> "
+       << llvm::format("%g", p.after) << " (" << p.samples << " samples)";
+    if (!p.fitted)
+      os << ", fit not positive, kept";
+    os << "\n";
+  }
+}
+
+// Fit the arch model `archJson` to the measured durations in
+// `measurementsFile` of function `function` of the module in `source`.
+// Writes the updated model to `os`.
+LogicalResult runCalibration(StringRef source, StringRef measurementsFile,
+                             StringRef function,
+                             const llvm::json::Value &archJson,
+                             raw_ostream &os, raw_ostream &reportOs) {
+  std::string errorMessage;
+  auto file = openInputFile(measurementsFile, &errorMessage);
+  if (!file) {
+    llvm::errs() << errorMessage << "\n";
+    return failure();
+  }
+  auto measurements = llvm::json::parse(file->getBuffer());
+  if (!measurements) {
+    llvm::errs() << "failed to parse measurements json: "
+                 << llvm::toString(measurements.takeError()) << "\n";
+    return failure();
+  }
+
+  DialectRegistry registry;
+  registerAllDialects(registry);
+  registry.insert<xilinx::air::airDialect>();
+  MLIRContext context(registry);
+  llvm::SourceMgr sourceMgr;
+  sourceMgr.AddNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(source, "calibrate"),
+      llvm::SMLoc());
+  auto module = parseSourceFile<ModuleOp>(sourceMgr, &context);
+  if (!module)
+    return failure();
+  auto func = module->lookupSymbol<func::FuncOp>(function);
+  if (!func) {
+    llvm::errs() << "Toplevel function " << function << " not found!\n";
+    return failure();
+  }
+
+  xilinx::air::CalibrationResult result;
+  auto updated = xilinx::air::calibrateArchModel(func, archJson, *measurements,
+                                                 result, &errorMessage);
+  if (!updated) {
+    llvm::errs() << errorMessage << "\n";
+    return failure();
+  }
+  printCalibrationReport(result, reportOs);
+  os << llvm::formatv("{0:2}", *updated) << "\n";
+  return success();
+}
+
+// Mark the points which no other successful point dominates.
+void markPareto(std::vector<SweepPoint> &points) {
+  for (auto &p : points) {
+    if (p.error.size())
+      continue;
+    p.pareto = llvm::none_of(points, [&](const SweepPoint &q) {
+      return q.error.empty() && q.dominates(p);
+    });
+  }
+}
+
+void printSweepTable(ArrayRef<SweepPoint> points, raw_ostream &os) {
+  os << llvm::format("%-10s %-14s %-14s %12s %12s %12s %14s  %s\n", "herd",
+                     "l1-tile", "l2-tile", "latency", "peak L1", "peak L2",
+                     "DMA bytes", "pareto");
+  for (auto &p : points) {
+    os << llvm::format("%-10s %-14s %-14s ",
+                       formatSizes(p.herdSize, 'x').c_str(),
+                       formatSizes(p.l1TileSize, 'x').c_str(),
+                       formatSizes(p.l2TileSize, 'x').c_str());
+    if (p.error.size()) {
+      os << "error: " << p.error << "\n";
+      continue;
+    }
+    os << llvm::format("%12llu %12llu %12llu %14llu  %s\n",
+                       (unsigned long long)p.getLatency(),
+                       (unsigned long long)p.getPeakL1(),
+                       (unsigned long long)p.getPeakL2(),
+                       (unsigned long long)p.getDmaBytes(),
+                       p.pareto ? "*" : "");
+  }
+}
+
+void writeSweepJSON(ArrayRef<SweepPoint> points, raw_ostream &os) {
+  llvm::json::OStream j(os, 2);
+  auto sizes = [&](StringRef name, ArrayRef<unsigned> size) {
+    j.attributeArray(name, [&] {
+      for (auto s : size)
+        j.value((int64_t)s);
+    });
+  };
+  j.array([&] {
+    for (auto &p : points) {
+      j.object([&] {
+        sizes("herd_size", p.herdSize);
+        sizes("l1_tile_size", p.l1TileSize);
+        sizes("l2_tile_size", p.l2TileSize);
+        if (p.error.size()) {
+          j.attribute("error", p.error);
+          return;
+        }
+        j.attribute("latency", (int64_t)p.getLatency());
+        j.attribute("peak_l1_bytes", (int64_t)p.getPeakL1());
+        j.attribute("peak_l2_bytes", (int64_t)p.getPeakL2());
+        j.attribute("dma_bytes", (int64_t)p.getDmaBytes());
+        j.attribute("pareto", p.pareto);
+      });
+    }
+  });
+  os << "\n";
+}
+
 LogicalResult run(int argc, char **argv, llvm::StringRef toolName) {
 
   static llvm::cl::opt<std::string> inputFilename(
@@ -54,12 +473,137 @@ LogicalResult run(int argc, char **argv, llvm::StringRef toolName) {
                                        llvm::cl::value_desc("bool"),
                                        llvm::cl::init(false));
 
+  static llvm::cl::opt<bool> clParallel(
+      "parallel",
+      llvm::cl::desc("simulate the partitions of the topology in parallel"),
+      llvm::cl::init(false));
+
+  static llvm::cl::opt<bool> clFailOnMemoryOverflow(
+      "fail-on-memory-overflow",
+      llvm::cl::desc("fail when buffers exceed the capacity of a memory in the "
+                     "arch model"),
+      llvm::cl::init(false));
+
+  static llvm::cl::opt<bool> clExtrapolateLoops(
+      "extrapolate-loops",
+      llvm::cl::desc("extrapolate the steady state of scf.for loops instead "
+                     "of simulating every iteration"),
+      llvm::cl::init(false));
+
+  static llvm::cl::opt<unsigned> clSteadyStateWindow(
+      "steady-state-window",
+      llvm::cl::desc("iterations over which the period of an extrapolated "
+                     "loop is measured, after as many warm-up iterations"),
+      llvm::cl::init(4));
+
+  static llvm::cl::opt<unsigned> clMaxSteadyStateWindows(
+      "max-steady-state-windows",
+      llvm::cl::desc("windows of iterations simulated at most before an "
+                     "extrapolated loop which is not steady is extrapolated"),
+      llvm::cl::init(8));
+
+  static llvm::cl::opt<unsigned> clMaxLiveIterations(
+      "max-live-iterations",
+      llvm::cl::desc("iterations of an scf.for scheduled ahead of the "
+                     "earliest incomplete one"),
+      llvm::cl::init(8));
+
+  static llvm::cl::opt<unsigned> clReportStalls(
+      "report-stalls",
+      llvm::cl::desc("number of stall causes in the bottleneck report"),
+      llvm::cl::init(10));
+
+  static llvm::cl::opt<std::string> clCalibrate(
+      "calibrate",
+      llvm::cl::desc("fit the kernel efficiencies and interface bandwidths "
+                     "of the arch model to the measured durations in this "
+                     "JSON file, and write the updated model to the output"),
+      llvm::cl::value_desc("filename"), llvm::cl::init(""));
+
+  static llvm::cl::list<std::string> clSweepHerdSize(
+      "sweep-herd-size",
+      llvm::cl::desc("herd sizes to sweep over, e.g. 2x2,4x4"),
+      llvm::cl::CommaSeparated);
+
+  static llvm::cl::list<std::string> clSweepL1TileSize(
+      "sweep-l1-tile-size",
+      llvm::cl::desc("L1 tile sizes to sweep over, e.g. 32x32x32,64x64x32"),
+      llvm::cl::CommaSeparated);
+
+  static llvm::cl::list<std::string> clSweepL2TileSize(
+      "sweep-l2-tile-size",
+      llvm::cl::desc("L2 tile sizes to sweep over, e.g. 64x64x64"),
+      llvm::cl::CommaSeparated);
+
+  static llvm::cl::opt<std::string> clSweepPipeline(
+      "sweep-pipeline",
+      llvm::cl::desc("passes run after air-linalg-codegen for each point of "
+                     "a sweep"),
+      llvm::cl::init("air-par-to-herd,air-copy-to-dma,canonicalize,cse,"
+                     "air-dependency"));
+
+  static llvm::cl::opt<unsigned> clSweepThreads(
+      "sweep-threads",
+      llvm::cl::desc("threads evaluating sweep points, 0 for all cores"),
+      llvm::cl::init(0));
+
+  static llvm::cl::opt<bool> clFunctional(
+      "functional",
+      llvm::cl::desc("compute the contents of the buffers along with the "
+                     "timing, with the memref arguments of the function as "
+                     "inputs and outputs"),
+      llvm::cl::init(false));
+
+  static llvm::cl::opt<uint64_t> clRandomSeed(
+      "random-seed",
+      llvm::cl::desc("seed of the random contents of the memref arguments "
+                     "without an input"),
+      llvm::cl::init(0));
+
+  static llvm::cl::list<std::string> clInputs(
+      "input",
+      llvm::cl::desc("initial contents of a memref argument, e.g. 0:a.npy, "
+                     "implies -functional"),
+      llvm::cl::value_desc("argument:file.npy"));
+
+  static llvm::cl::list<std::string> clOutputs(
+      "output",
+      llvm::cl::desc("write the final contents of a memref argument, e.g. "
+                     "2:c.npy, implies -functional"),
+      llvm::cl::value_desc("argument:file.npy"));
+
+  static llvm::cl::list<std::string> clReferences(
+      "reference",
+      llvm::cl::desc("compare the final contents of a memref argument to a "
+                     "reference and fail on a mismatch, e.g. 2:c_ref.npy, "
+                     "implies -functional"),
+      llvm::cl::value_desc("argument:file.npy"));
+
+  static llvm::cl::opt<double> clRtol(
+      "rtol", llvm::cl::desc("relative tolerance of the reference comparison"),
+      llvm::cl::init(1e-5));
+
+  static llvm::cl::opt<double> clAtol(
+      "atol", llvm::cl::desc("absolute tolerance of the reference comparison"),
+      llvm::cl::init(1e-8));
+
+  static llvm::cl::opt<xilinx::air::TraceFormat> clTraceFormat(
+      "trace-format", llvm::cl::desc("format of the output trace"),
+      llvm::cl::values(
+          clEnumValN(xilinx::air::TraceFormat::JSON, "json",
+                     "Chrome trace event JSON"),
+          clEnumValN(xilinx::air::TraceFormat::Perfetto, "perfetto",
+                     "Perfetto protobuf trace"),
+          clEnumValN(xilinx::air::TraceFormat::Binary, "binary",
+                     "compact binary trace with interned names"),
+          clEnumValN(xilinx::air::TraceFormat::Aggregate, "aggregate",
+                     "per-event histograms of durations only")),
+      llvm::cl::init(xilinx::air::TraceFormat::JSON));
+
   llvm::InitLLVM y(argc, argv);
   llvm::cl::ParseCommandLineOptions(argc, argv, toolName);
 
   verbose = clVerbose;
-  // herd_slots = clHerdSlots;
-  // dispatch_slots = clDispatchSlots;
 
   std::string errorMessage;
   auto input = openInputFile(inputFilename, &errorMessage);
@@ -74,12 +618,86 @@ LogicalResult run(int argc, char **argv, llvm::StringRef toolName) {
     return failure();
   }
 
+  auto jsonModel = llvm::json::parse(json_file->getBuffer());
+  if (!jsonModel) {
+    llvm::errs() << "failed to parse model json: "
+                 << llvm::toString(jsonModel.takeError()) << "\n";
+    return failure();
+  }
+
+  auto archModel = xilinx::air::ArchModel::parse(*jsonModel, &errorMessage);
+  if (!archModel) {
+    llvm::errs() << errorMessage << "\n";
+    return failure();
+  }
+
   auto output = openOutputFile(outputFilename, &errorMessage);
   if (!output) {
     llvm::errs() << errorMessage << "\n";
     return failure();
   }
 
+  std::map<unsigned, std::string> inputFiles, outputFiles, referenceFiles;
+  if (!parseArgumentFiles(clInputs, inputFiles) ||
+      !parseArgumentFiles(clOutputs, outputFiles) ||
+      !parseArgumentFiles(clReferences, referenceFiles))
+    return failure();
+  bool functional = clFunctional || inputFiles.size() || outputFiles.size() ||
+                    referenceFiles.size();
+
+  // Calibration mode: fit the arch model to measurements instead of
+  // simulating.
+  if (!clCalibrate.empty()) {
+    if (failed(runCalibration(input->getBuffer(), clCalibrate,
+                              topLevelFunction, *jsonModel, output->os(),
+                              outputFilename == "-" ? llvm::errs()
+                                                    : llvm::outs())))
+      return failure();
+    output->keep();
+    return success();
+  }
+  // Sweep mode: lower and simulate the linalg input for every point of the
+  // grid, write the results as JSON to the output and as a table.
+  if (clSweepHerdSize.size() || clSweepL1TileSize.size() ||
+      clSweepL2TileSize.size()) {
+    std::vector<SmallVector<unsigned, 3>> herdSizes, l1TileSizes,
+        l2TileSizes;
+    if (!parseSweepSizes(clSweepHerdSize, herdSizes) ||
+        !parseSweepSizes(clSweepL1TileSize, l1TileSizes) ||
+        !parseSweepSizes(clSweepL2TileSize, l2TileSizes))
+      return failure();
+    std::vector<SweepPoint> points;
+    for (auto &h : herdSizes)
+      for (auto &l1 : l1TileSizes)
+        for (auto &l2 : l2TileSizes) {
+          points.emplace_back();
+          points.back().herdSize = h;
+          points.back().l1TileSize = l1;
+          points.back().l2TileSize = l2;
+        }
+
+    xilinx::air::registerAllPasses();
+    mlir::registerTransformsPasses();
+    DialectRegistry registry;
+    registerAllDialects(registry);
+    registry.insert<xilinx::air::airDialect>();
+
+    llvm::ThreadPool pool(llvm::hardware_concurrency(clSweepThreads));
+    for (auto &p : points)
+      pool.async([&, point = &p]() {
+        runSweepPoint(*point, input->getBuffer(), registry, clSweepPipeline,
+                      topLevelFunction, *archModel);
+      });
+    pool.wait();
+
+    markPareto(points);
+    printSweepTable(points, outputFilename == "-" ? llvm::errs()
+                                                  : llvm::outs());
+    writeSweepJSON(points, output->os());
+    output->keep();
+    return success();
+  }
+
   auto processBuffer = [&](std::unique_ptr<llvm::MemoryBuffer> ownedBuffer,
                            raw_ostream &os) {
     MLIRContext context;
@@ -95,70 +713,103 @@ LogicalResult run(int argc, char **argv, llvm::StringRef toolName) {
     if (!module)
       return failure();
 
-    Operation *topOp = module->lookupSymbol(topLevelFunction);
     // The toplevel function can accept any number of operands, and returns
     // any number of results.
-    if (!topOp) {
+    auto toplevel = module->lookupSymbol<func::FuncOp>(topLevelFunction);
+    if (!toplevel) {
       llvm::errs() << "Toplevel function " << topLevelFunction
                    << " not found!\n";
       return failure();
     }
-
-    // We need three things in a function-type independent way.
-    // The type signature of the function.
-    FunctionType ftype;
-    // The arguments of the entry block.
-    Block::BlockArgListType blockArgs;
-
-    std::string json_str = json_file->getBuffer().str();
-    StringRef sr(json_str);
-    auto jsonModel = llvm::json::parse(sr);
-    if (!jsonModel)
-      llvm_unreachable("failed to parse model json\n");
-
-    xilinx::air::AIRRunner runner(os, *jsonModel, clVerbose);
-
+    FunctionType ftype = toplevel.getFunctionType();
     // The number of inputs to the function in the IR.
-    unsigned numInputs = 0;
-    unsigned numOutputs = 0;
-
-    if (func::FuncOp toplevel =
-            module->lookupSymbol<func::FuncOp>(topLevelFunction)) {
-      ftype = toplevel.getFunctionType();
-      Block &entryBlock = toplevel.getBody().front();
-      blockArgs = entryBlock.getArguments();
-
-      // Get the primary inputs of toplevel off the command line.
-      numInputs = ftype.getNumInputs();
-      numOutputs = ftype.getNumResults();
-    } else {
-      llvm_unreachable("Function not supported.\n");
+    unsigned numInputs = ftype.getNumInputs();
+
+    xilinx::air::AIRRunnerOptions runnerOptions;
+    runnerOptions.verbose = clVerbose;
+    runnerOptions.parallel = clParallel;
+    runnerOptions.traceFormat = clTraceFormat;
+    runnerOptions.failOnMemoryOverflow = clFailOnMemoryOverflow;
+    runnerOptions.extrapolateLoops = clExtrapolateLoops;
+    runnerOptions.steadyStateWindow = clSteadyStateWindow;
+    runnerOptions.maxSteadyStateWindows = clMaxSteadyStateWindows;
+    runnerOptions.maxLiveIterations = clMaxLiveIterations;
+    runnerOptions.functional = functional;
+    runnerOptions.randomSeed = clRandomSeed;
+    xilinx::air::AIRRunner runner(os, *archModel, runnerOptions);
+
+    // Read the contents of the memref arguments, the others are random.
+    auto readArgumentFile = [&](unsigned i, StringRef file)
+        -> llvm::Optional<xilinx::air::NpyArray> {
+      if (i >= numInputs || !ftype.getInput(i).isa<MemRefType>()) {
+        llvm::errs() << "argument " << i << " of " << topLevelFunction
+                     << " is not a memref\n";
+        return llvm::None;
+      }
+      auto buffer = openInputFile(file, &errorMessage);
+      if (!buffer) {
+        llvm::errs() << errorMessage << "\n";
+        return llvm::None;
+      }
+      auto array =
+          xilinx::air::NpyArray::parse(buffer->getBuffer(), &errorMessage);
+      if (!array)
+        llvm::errs() << file << ": " << errorMessage << "\n";
+      return array;
+    };
+    for (auto &f : inputFiles) {
+      auto array = readArgumentFile(f.first, f.second);
+      if (!array)
+        return failure();
+      runner.setArgument(f.first, *array);
     }
 
-    std::vector<std::string> inputArgs;
-
     runner.emitTraceStart(os);
 
-    // for (unsigned i = 0; i < numInputs; i++) {
-    //   Type type = ftype.getInput(i);
-    //   if (auto tensorTy = type.dyn_cast<MemRefType>()) {
-    //     // We require this memref type to be fully specified.
-    //     std::vector<llvm::Any> nothing;
-    //     unsigned buffer = runner.allocateMemRef(tensorTy, nothing);
-    //     runner.valueMap[blockArgs[i]] = buffer;
-    //     // runner.timeMap[blockArgs[i]] = 0;
-    //   } else {
-    //     llvm_unreachable("Only memref arguments are supported.\n");
-    //   }
-    // }
-
-    std::vector<llvm::Any> results(numOutputs);
-    std::vector<uint64_t> resultTimes(numOutputs);
-    if (func::FuncOp toplevel =
-            module->lookupSymbol<func::FuncOp>(topLevelFunction)) {
-      runner.scheduleFunction(toplevel);
-    }
+    if (failed(runner.scheduleFunction(toplevel)))
+      return failure();
+    llvm::errs() << "Finished at time " << runner.getResults().makespan
+                 << "\n";
+    if (clParallel)
+      llvm::errs() << "Parallel simulation: "
+                   << runner.getResults().parallelWindows << " windows, "
+                   << runner.getResults().concurrentWindows
+                   << " with concurrent partitions, "
+                   << runner.getResults().delayedInteractions
+                   << " delayed interactions\n";
+    printMemoryReport(runner.getResults(), llvm::errs());
+    printBottleneckReport(runner.getResults(), clReportStalls, llvm::errs());
+    printExtrapolationReport(runner.getResults(), llvm::errs());
     runner.emitTraceEnd(os);
+
+    for (auto &f : outputFiles) {
+      auto *array = runner.getArgument(f.first);
+      if (!array) {
+        llvm::errs() << "argument " << f.first << " of " << topLevelFunction
+                     << " is not a memref\n";
+        return failure();
+      }
+      auto file = openOutputFile(f.second, &errorMessage);
+      if (!file) {
+        llvm::errs() << errorMessage << "\n";
+        return failure();
+      }
+      array->write(file->os());
+      file->keep();
+    }
+    uint64_t mismatches = 0;
+    for (auto &f : referenceFiles) {
+      auto reference = readArgumentFile(f.first, f.second);
+      auto *array = runner.getArgument(f.first);
+      if (!reference || !array)
+        return failure();
+      mismatches += compareWithReference(f.first, *array, *reference, clRtol,
+                                         clAtol, llvm::errs());
+    }
+    if (mismatches) {
+      llvm::errs() << "error: outputs do not match the reference\n";
+      return failure();
+    }
     return success();
   };
   if (failed(processBuffer(std::move(input), output->os())))